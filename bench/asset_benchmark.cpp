@@ -0,0 +1,793 @@
+// CPU-side micro-benchmarks for the asset and geometry pipeline, no GL required
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ply_model.h"
+#include "mesh_arena.h"
+#include "collision.h"
+#include "meshlet.h"
+#include "frustum.h"
+#include "mesh_lod.h"
+#include "mesh_bvh.h"
+#include "light_clusters.h"
+#include "instance_transforms.h"
+#include "terrain.h"
+#include "occlusion_buffer.h"
+#include "chunked_mesh_builder.h"
+
+#ifdef BENCH_HAS_STB_IMAGE
+#include "stb_image.h"
+#endif
+
+#ifndef BENCH_ASSET_DIR
+#define BENCH_ASSET_DIR "."
+#endif
+
+using namespace std;
+
+// allocation counters fed by the global operator new below
+static atomic<long long> allocCount(0);
+static atomic<long long> allocBytes(0);
+
+void* operator new(size_t size)
+{
+    allocCount.fetch_add(1, memory_order_relaxed);
+    allocBytes.fetch_add((long long)size, memory_order_relaxed);
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == NULL)
+        throw bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+struct BenchResult
+{
+    string name;
+    string input;
+    long long items; // work units per iteration (faces, vertices, pixels, tests)
+    int iterations;
+    double ms_per_iter;
+    double items_per_sec;
+    double allocs_per_iter;
+    double bytes_per_iter;
+};
+
+struct BenchConfig
+{
+    double min_time_ms;
+    int min_iterations;
+    bool quick;
+    string json_file;
+    string filter;
+};
+
+static vector<BenchResult> results;
+
+static double now_ms()
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool is_selected(const BenchConfig& config, const string& name)
+{
+    return config.filter.empty() || name.find(config.filter) != string::npos;
+}
+
+// runs fn until both the minimum time and iteration count are reached, false when filtered out
+static bool run_benchmark(const BenchConfig& config, const string& name, const string& input, long long items, const function<void()>& fn)
+{
+    if (!is_selected(config, name))
+        return false;
+
+    fn(); // warm caches and the page cache
+
+    long long allocStart = allocCount.load();
+    long long bytesStart = allocBytes.load();
+    double start = now_ms();
+    double elapsed = 0;
+    int iterations = 0;
+    while (iterations < config.min_iterations || elapsed < config.min_time_ms)
+    {
+        fn();
+        iterations++;
+        elapsed = now_ms() - start;
+    }
+
+    BenchResult r;
+    r.name = name;
+    r.input = input;
+    r.items = items;
+    r.iterations = iterations;
+    r.ms_per_iter = elapsed / iterations;
+    r.items_per_sec = items / (r.ms_per_iter / 1000.0);
+    r.allocs_per_iter = (double)(allocCount.load() - allocStart) / iterations;
+    r.bytes_per_iter = (double)(allocBytes.load() - bytesStart) / iterations;
+    results.push_back(r);
+
+    printf("%-24s %-28s %10.3f ms %14.0f items/s %10.0f allocs %12.0f bytes\n", r.name.c_str(), r.input.c_str(), r.ms_per_iter, r.items_per_sec, r.allocs_per_iter, r.bytes_per_iter);
+    fflush(stdout);
+    return true;
+}
+
+// n x n vertex grid bent into a shallow dome, two faces per cell
+static string write_synthetic_ply(const string& dir, int n)
+{
+    string filename = dir + "/grid_" + to_string(n) + ".ply";
+    ofstream ply(filename.c_str());
+    int faceNum = 2 * (n - 1) * (n - 1);
+
+    ply << "ply\nformat ascii 1.0\n";
+    ply << "element vertex " << n * n << "\nproperty float x\nproperty float y\nproperty float z\n";
+    ply << "element face " << faceNum << "\nproperty list uchar int vertex_indices\nend_header\n";
+    for (int z = 0; z < n; ++z)
+    {
+        for (int x = 0; x < n; ++x)
+        {
+            float fx = (float)x / (n - 1) - 0.5f;
+            float fz = (float)z / (n - 1) - 0.5f;
+            ply << fx << " " << 0.25f - fx * fx - fz * fz << " " << fz << "\n";
+        }
+    }
+    for (int z = 0; z < n - 1; ++z)
+    {
+        for (int x = 0; x < n - 1; ++x)
+        {
+            int a = z * n + x;
+            ply << "3 " << a << " " << a + n << " " << a + 1 << "\n";
+            ply << "3 " << a + 1 << " " << a + n << " " << a + n + 1 << "\n";
+        }
+    }
+    ply.close();
+    return filename;
+}
+
+static void bench_ply(const BenchConfig& config, const string& filename, const string& label)
+{
+    PlyModel probe;
+    probe.get_ply_model(filename.c_str());
+    long long faces = probe.get_face_num();
+    long long verts = probe.get_vertex_num();
+    if (faces == 0)
+    {
+        cout << "skipping " << filename << " (not found or empty)" << endl;
+        return;
+    }
+    probe.add_normal_vectors();
+
+    run_benchmark(config, "ply_parse", label, faces + verts, [&]() {
+        PlyModel model;
+        model.get_ply_model(filename.c_str());
+    });
+
+    run_benchmark(config, "add_normal_vectors", label, faces, [&]() {
+        probe.add_normal_vectors();
+    });
+
+    run_benchmark(config, "bounding_box", label, verts, [&]() {
+        probe.compute_bounding_box();
+    });
+
+    const float* vertices = probe.get_model_vertices();
+    unsigned int* faceList = probe.get_model_faces();
+    const int stride = PlyModel::VERTEX_STRIDE;
+
+    MeshLod lod;
+    run_benchmark(config, "build_lod", label, verts, [&]() {
+        build_lod(vertices, stride, (int)verts, faceList, (int)faces, 24, lod);
+    });
+
+    vector<Meshlet> meshlets;
+    build_meshlets(vertices, stride, faceList, (int)faces, 96, meshlets); // cull_meshlets needs clusters even when this one is filtered out
+    run_benchmark(config, "build_meshlets", label, faces, [&]() {
+        build_meshlets(vertices, stride, faceList, (int)faces, 96, meshlets);
+    });
+
+    // 45 degree perspective 2 units back from the model, looking down -z
+    float f = 1.0f / tan(22.5f * 3.1415927f / 180.0f);
+    float nearPlane = 0.1f, farPlane = 100.0f;
+    float viewProj[16] = { 0 };
+    viewProj[0] = f * 0.75f;
+    viewProj[5] = f;
+    viewProj[10] = (farPlane + nearPlane) / (nearPlane - farPlane);
+    viewProj[11] = -1.0f;
+    viewProj[14] = -2.0f * viewProj[10] + 2.0f * farPlane * nearPlane / (nearPlane - farPlane);
+    viewProj[15] = 2.0f;
+    Frustum frustum;
+    extract_frustum(viewProj, frustum);
+    float camera[3] = { 0.0f, 0.0f, 2.0f };
+
+    vector<int> counts;
+    vector<const void*> offsets;
+    MeshletCullStats stats = MeshletCullStats();
+    run_benchmark(config, "cull_meshlets", label, (long long)meshlets.size(), [&]() {
+        reset_cull_stats(stats);
+        cull_meshlets(meshlets, frustum, camera, counts, offsets, stats);
+    });
+    if (stats.meshlet_num > 0)
+    {
+        cout << "  meshlets " << stats.meshlet_num << ", rejected " << 100.0 * (stats.frustum_culled + stats.backface_culled) / stats.meshlet_num
+            << "%, indices saved " << 100.0 * stats.indices_culled / stats.index_num << "%" << endl;
+    }
+
+    MeshBvh bvh;
+    bvh.build(vertices, stride, faceList, (int)faces, 4); // bvh_rays needs the hierarchy even when this one is filtered out
+    if (run_benchmark(config, "build_bvh", label, faces, [&]() {
+        bvh.build(vertices, stride, faceList, (int)faces, 4);
+    }))
+    {
+        BvhStats bvhStats;
+        bvh.get_stats(bvhStats);
+        cout << "  bvh " << bvhStats.node_num << " nodes, " << bvhStats.leaf_num << " leaves, depth " << bvhStats.max_depth << endl;
+    }
+
+    // rays from a shell twice the model's size towards random points inside its box, like picks from around it
+    float lo[3], hi[3];
+    bvh.get_bounds(lo, hi);
+    const int rayNum = 4096;
+    vector<float> rays(6 * rayNum);
+    unsigned int seed = 647;
+    for (int i = 0; i < rayNum; ++i)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            float center = 0.5f * (lo[k] + hi[k]), extent = hi[k] - lo[k];
+            seed = seed * 1664525u + 1013904223u;
+            rays[6 * i + k] = center + ((seed >> 8) / 16777216.0f - 0.5f) * 4.0f * extent;
+            seed = seed * 1664525u + 1013904223u;
+            rays[6 * i + 3 + k] = lo[k] + (seed >> 8) / 16777216.0f * extent - rays[6 * i + k];
+        }
+    }
+    int rayHits = 0;
+    if (run_benchmark(config, "bvh_rays", label, rayNum, [&]() {
+        rayHits = 0;
+        RayHit hit;
+        for (int i = 0; i < rayNum; ++i)
+        {
+            rayHits += bvh.intersect(&rays[6 * i], &rays[6 * i + 3], 1e30f, hit) ? 1 : 0;
+        }
+    }))
+    {
+        cout << "  " << 100.0 * rayHits / rayNum << "% of rays hit" << endl;
+    }
+
+    return;
+}
+
+// loads a batch of meshes the way a scene would, once on the heap and once into one arena.
+// False when the arena path makes more than a couple of allocations per mesh, i.e. parsing allocates again
+static bool bench_mesh_batch(const BenchConfig& config, const vector<string>& filenames, const string& label)
+{
+    run_benchmark(config, "mesh_batch_heap", label, (long long)filenames.size(), [&]() {
+        vector<PlyModel> models(filenames.size());
+        for (size_t i = 0; i < filenames.size(); ++i)
+        {
+            models[i].get_ply_model(filenames[i].c_str());
+        }
+    });
+
+    // one block sized to the batch from the file headers
+    size_t blockSize = 0;
+    for (size_t i = 0; i < filenames.size(); ++i)
+    {
+        blockSize += PlyModel::peek_buffer_bytes(filenames[i].c_str()) + 2 * MeshArena::ALIGNMENT;
+    }
+
+    MemoryStats stats = MemoryStats();
+    if (!run_benchmark(config, "mesh_batch_arena", label, (long long)filenames.size(), [&]() {
+        MeshArena arena(blockSize);
+        vector<PlyModel> models;
+        models.reserve(filenames.size());
+        for (size_t i = 0; i < filenames.size(); ++i)
+        {
+            models.push_back(PlyModel(&arena));
+            models.back().get_ply_model(filenames[i].c_str());
+        }
+        arena.get_stats(stats);
+    }))
+    {
+        return true;
+    }
+
+    // per iteration: the read buffer of every mesh, the model vector and the arena block
+    double allowedAllocs = 2.0 * filenames.size() + 4.0;
+    bool passed = results.back().allocs_per_iter <= allowedAllocs;
+    cout << "  arena: " << stats.allocation_count << " buffers in " << stats.block_count << " blocks, peak " << stats.peak_bytes / 1024 << " KB, resident "
+        << stats.reserved_bytes / 1024 << " KB, " << results.back().allocs_per_iter << " allocs for " << filenames.size() << " meshes" << (passed ? "" : " FAILED") << endl;
+    return passed;
+}
+
+#ifdef BENCH_HAS_STB_IMAGE
+static string write_synthetic_ppm(const string& dir, int size)
+{
+    string filename = dir + "/image_" + to_string(size) + ".ppm";
+    ofstream image(filename.c_str(), ios::binary);
+    image << "P6\n" << size << " " << size << "\n255\n";
+    vector<unsigned char> row(3 * size);
+    for (int y = 0; y < size; ++y)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            row[3 * x] = (unsigned char)(x ^ y);
+            row[3 * x + 1] = (unsigned char)(x + y);
+            row[3 * x + 2] = (unsigned char)(x * y);
+        }
+        image.write((const char*)row.data(), row.size());
+    }
+    image.close();
+    return filename;
+}
+
+static void bench_image(const BenchConfig& config, const string& filename, const string& label)
+{
+    int width, height, nrChannels;
+    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrChannels, 0);
+    if (data == NULL)
+    {
+        cout << "skipping " << filename << " (not found)" << endl;
+        return;
+    }
+    stbi_image_free(data);
+
+    run_benchmark(config, "stbi_load", label, (long long)width * height, [&]() {
+        int w, h, c;
+        unsigned char* pixels = stbi_load(filename.c_str(), &w, &h, &c, 0);
+        stbi_image_free(pixels);
+    });
+    return;
+}
+#endif
+
+static void bench_collision(const BenchConfig& config, int boxNum)
+{
+    vector<float> boxes(3 * boxNum);
+    srand(647);
+    for (int i = 0; i < boxNum; ++i)
+    {
+        boxes[3 * i] = (rand() % 4000) / 100.0f - 20.0f;
+        boxes[3 * i + 1] = (rand() % 4000) / 100.0f - 20.0f;
+        boxes[3 * i + 2] = 0.5f + (rand() % 200) / 100.0f;
+    }
+
+    volatile int hits = 0;
+    run_benchmark(config, "check_collision", to_string(boxNum) + " boxes", boxNum, [&]() {
+        int h = 0;
+        for (int i = 0; i < boxNum; ++i)
+        {
+            h += check_collision(-7.8f, -7.8f, 1.6f, boxes[3 * i], boxes[3 * i + 1], boxes[3 * i + 2]);
+        }
+        hits = h;
+    });
+    return;
+}
+
+// lights scattered over the playfield, camera at the character's eye height looking down -z
+static void bench_light_binning(const BenchConfig& config, int lightNum)
+{
+    vector<PointLight> lights(lightNum);
+    srand(647);
+    for (int i = 0; i < lightNum; ++i)
+    {
+        lights[i].position[0] = (rand() % 3600) / 100.0f - 18.0f;
+        lights[i].position[1] = 0.5f + (rand() % 250) / 100.0f;
+        lights[i].position[2] = (rand() % 3600) / 100.0f - 18.0f;
+        lights[i].radius = 3.0f + (rand() % 300) / 100.0f;
+        lights[i].color[0] = lights[i].color[1] = lights[i].color[2] = 0.5f;
+        lights[i].padding = 0.0f;
+    }
+
+    float f = 1.0f / tan(22.5f * 3.1415927f / 180.0f);
+    float nearPlane = 0.1f, farPlane = 100.0f;
+    float projection[16] = { 0 };
+    projection[0] = f * 0.75f;
+    projection[5] = f;
+    projection[10] = (farPlane + nearPlane) / (nearPlane - farPlane);
+    projection[11] = -1.0f;
+    projection[14] = 2.0f * farPlane * nearPlane / (nearPlane - farPlane);
+    float view[16] = { 0 };
+    view[0] = view[5] = view[10] = view[15] = 1.0f;
+    view[13] = -1.6f;
+    view[14] = -20.0f;
+
+    LightClusters clusters;
+    clusters.init(16, 9, 24, nearPlane, farPlane);
+    run_benchmark(config, "bin_lights", to_string(lightNum) + " lights", lightNum, [&]() {
+        clusters.bin(lights, view, projection);
+    });
+
+    LightClusterStats stats;
+    clusters.get_stats(stats);
+    if (stats.visible_num > 0)
+    {
+        cout << "  visible " << stats.visible_num << ", occupied clusters " << stats.occupied_clusters
+            << ", max per cluster " << stats.max_per_cluster << ", indices " << stats.index_num << endl;
+    }
+    return;
+}
+
+static void bench_instance_matrices(const BenchConfig& config, int instanceNum)
+{
+    vector<InstanceTransform> transforms(instanceNum);
+    srand(647);
+    for (int i = 0; i < instanceNum; ++i)
+    {
+        set_instance_transform(transforms[i], (rand() % 4000) / 100.0f - 20.0f, 0.0f, (rand() % 4000) / 100.0f - 20.0f, 10.0f);
+        transforms[i].rotation[1] = (rand() % 628) / 100.0f;
+        transforms[i].scale[1] = 5.0f + (rand() % 1000) / 100.0f;
+    }
+
+    vector<InstanceMatrices> matrices;
+    run_benchmark(config, "instance_matrices", to_string(instanceNum) + " instances", instanceNum, [&]() {
+        compute_instance_matrices(transforms, matrices);
+    });
+    return;
+}
+
+// the SSE normal matrices against the scalar path, and N^T * M = I for the upper 3x3, on rotated and
+// non-uniformly scaled instances; eleven of them so both the four-wide loop and the tail are covered
+static bool check_instance_matrices()
+{
+    const int instanceNum = 11;
+    vector<InstanceTransform> transforms(instanceNum);
+    srand(647);
+    for (int i = 0; i < instanceNum; ++i)
+    {
+        set_instance_transform(transforms[i], (rand() % 4000) / 100.0f - 20.0f, (rand() % 400) / 100.0f, (rand() % 4000) / 100.0f - 20.0f, 1.0f);
+        for (int k = 0; k < 3; ++k)
+        {
+            transforms[i].rotation[k] = (rand() % 628) / 100.0f;
+            transforms[i].scale[k] = 0.1f + (rand() % 2000) / 100.0f;
+        }
+    }
+
+    vector<InstanceMatrices> matrices;
+    compute_instance_matrices(transforms, matrices);
+
+    double maxReferenceError = 0.0, maxIdentityError = 0.0;
+    for (int i = 0; i < instanceNum; ++i)
+    {
+        const float* m = matrices[i].model;
+        const float* n = matrices[i].normal;
+        float reference[12];
+        normal_matrix(m, reference);
+        for (int k = 0; k < 12; ++k)
+        {
+            double scale = max(1.0, fabs((double)reference[k]));
+            maxReferenceError = max(maxReferenceError, fabs((double)n[k] - reference[k]) / scale);
+        }
+
+        // (N^T M)_ij is column i of N dotted with column j of M
+        for (int row = 0; row < 3; ++row)
+        {
+            for (int col = 0; col < 3; ++col)
+            {
+                double dot = 0.0;
+                for (int k = 0; k < 3; ++k)
+                {
+                    dot += (double)n[4 * row + k] * m[4 * col + k];
+                }
+                maxIdentityError = max(maxIdentityError, fabs(dot - (row == col ? 1.0 : 0.0)));
+            }
+        }
+    }
+
+    bool passed = maxReferenceError < 1e-5 && maxIdentityError < 1e-4;
+    cout << "instance normal matrices: " << instanceNum << " checked, max difference from scalar " << maxReferenceError
+        << ", max |N^T M - I| " << maxIdentityError << (passed ? "" : " FAILED") << endl;
+    return passed;
+}
+
+// one chunk out in the hills: batched noise against the scalar reference, then the whole chunk
+static void bench_terrain(const BenchConfig& config)
+{
+    TerrainParams params;
+    set_default_terrain_params(params);
+    int edge = params.chunk_quads + 1;
+    float x0 = 3 * params.chunk_size, z0 = 2 * params.chunk_size, spacing = params.chunk_size / params.chunk_quads;
+    vector<float> heights(edge * edge);
+    string label = to_string(edge) + "^2 samples";
+
+    run_benchmark(config, "terrain_height_scalar", label, edge * edge, [&]() {
+        for (int j = 0; j < edge; ++j)
+        {
+            for (int i = 0; i < edge; ++i)
+            {
+                heights[j * edge + i] = terrain_height(params, x0 + i * spacing, z0 + j * spacing);
+            }
+        }
+    });
+    run_benchmark(config, "terrain_heights_batch", label, edge * edge, [&]() {
+        terrain_heights(params, x0, z0, spacing, edge, edge, heights.data());
+    });
+
+    TerrainChunkData chunk;
+    run_benchmark(config, "build_terrain_chunk", label, edge * edge, [&]() {
+        build_terrain_chunk(params, 3, 2, chunk);
+    });
+    return;
+}
+
+// the farm seen from behind a crop row: ground and cubes as occluders, a grid of boxes behind them
+static void bench_occlusion(const BenchConfig& config, int boxNum)
+{
+    float f = 1.0f / tan(22.5f * 3.1415927f / 180.0f);
+    float nearPlane = 0.1f, farPlane = 100.0f;
+    float projection[16] = { 0 };
+    projection[0] = f * 0.75f;
+    projection[5] = f;
+    projection[10] = (farPlane + nearPlane) / (nearPlane - farPlane);
+    projection[11] = -1.0f;
+    projection[14] = 2.0f * farPlane * nearPlane / (nearPlane - farPlane);
+    // eye at (0, 1, -8.5) looking down +z
+    float view[16] = { 0 };
+    view[0] = -1.0f;
+    view[5] = 1.0f;
+    view[10] = -1.0f;
+    view[13] = -1.0f;
+    view[14] = -8.5f;
+    view[15] = 1.0f;
+    float viewProj[16];
+    for (int c = 0; c < 4; ++c)
+    {
+        for (int r = 0; r < 4; ++r)
+        {
+            viewProj[c * 4 + r] = 0.0f;
+            for (int k = 0; k < 4; ++k)
+                viewProj[c * 4 + r] += projection[k * 4 + r] * view[c * 4 + k];
+        }
+    }
+
+    float cube[72];
+    int faces[6][4] = { { 0, 1, 3, 2 }, { 4, 5, 7, 6 }, { 0, 2, 6, 4 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 3, 7, 6 } };
+    for (int q = 0; q < 6; ++q)
+    {
+        for (int v = 0; v < 4; ++v)
+        {
+            int corner = faces[q][v];
+            cube[q * 12 + v * 3] = corner & 1 ? 1.0f : -1.0f;
+            cube[q * 12 + v * 3 + 1] = corner & 2 ? 1.0f : -1.0f;
+            cube[q * 12 + v * 3 + 2] = corner & 4 ? 1.0f : -1.0f;
+        }
+    }
+    float ground[12] = { -24.0f, 0.0f, -24.0f,   24.0f, 0.0f, -24.0f,   24.0f, 0.0f, 24.0f,   -24.0f, 0.0f, 24.0f };
+    float identity[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+
+    OcclusionBuffer buffer;
+    buffer.init(256, 128, 4, 2);
+    auto rasterizeFarm = [&]() {
+        buffer.begin_frame(viewProj);
+        buffer.add_occluder_quads(ground, 1, identity);
+        float model[16];
+        memcpy(model, identity, sizeof(model));
+        for (int i = 0; i < 9; ++i)
+        {
+            model[12] = 5.0f * (i % 3 - 1);
+            model[13] = 1.0f;
+            model[14] = 5.0f * (i / 3 - 1);
+            buffer.add_occluder_quads(cube, 6, model);
+        }
+        buffer.rasterize_async();
+        buffer.wait();
+    };
+    rasterizeFarm(); // occlusion_test needs the depth even when this one is filtered out
+    run_benchmark(config, "occlusion_raster", "farm 256x128", 55, rasterizeFarm);
+
+    vector<float> boxes(boxNum * 3);
+    srand(647);
+    for (int i = 0; i < boxNum; ++i)
+    {
+        boxes[3 * i] = (rand() % 2000) / 100.0f - 10.0f;
+        boxes[3 * i + 1] = (rand() % 150) / 100.0f - 1.0f;
+        boxes[3 * i + 2] = (rand() % 2000) / 100.0f - 4.0f;
+    }
+    int occluded = 0;
+    if (run_benchmark(config, "occlusion_test", to_string(boxNum) + " boxes", boxNum, [&]() {
+        occluded = 0;
+        for (int i = 0; i < boxNum; ++i)
+        {
+            float lo[3] = { boxes[3 * i] - 0.5f, boxes[3 * i + 1] - 0.5f, boxes[3 * i + 2] - 0.5f };
+            float hi[3] = { boxes[3 * i] + 0.5f, boxes[3 * i + 1] + 0.5f, boxes[3 * i + 2] + 0.5f };
+            occluded += buffer.is_occluded(lo, hi) ? 1 : 0;
+        }
+    }))
+    {
+        cout << "  occluded " << occluded << " of " << boxNum << endl;
+    }
+
+    buffer.destroy();
+    return;
+}
+
+// out-of-core conversion with small chunks and budget, so even the grids spill and go deep
+static void bench_chunked_mesh(const BenchConfig& config, const string& filename, long long faceNum)
+{
+    ChunkedMeshBuildParams params;
+    set_default_chunked_mesh_params(params);
+    params.leaf_faces = 16384;
+    params.memory_budget = 4 << 20;
+    string output = filename + ".ooc";
+    ChunkedMeshBuildReport report;
+    string error;
+    bool ok = false;
+    run_benchmark(config, "chunked_mesh_build", "grid " + to_string(faceNum) + " faces", faceNum, [&]() {
+        ok = build_chunked_mesh(filename.c_str(), output.c_str(), params, report, error);
+    });
+    if (!ok)
+    {
+        if (!error.empty())
+            cout << "  build failed: " << error << endl;
+        return;
+    }
+    cout << "  " << report.leaf_num << " leaves, " << report.node_num << " nodes, " << report.output_bytes / 1024 << " KB" << endl;
+    remove(output.c_str());
+    return;
+}
+
+static bool write_json(const string& filename)
+{
+    ofstream json(filename.c_str());
+    if (json.fail())
+    {
+        cout << "Fail to open file: " << filename << endl;
+        return false;
+    }
+
+    json << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult& r = results[i];
+        json << "    {\"name\": \"" << r.name << "\", \"input\": \"" << r.input << "\", \"items\": " << r.items
+            << ", \"iterations\": " << r.iterations << ", \"ms_per_iter\": " << r.ms_per_iter
+            << ", \"items_per_sec\": " << r.items_per_sec << ", \"allocs_per_iter\": " << r.allocs_per_iter
+            << ", \"bytes_per_iter\": " << r.bytes_per_iter << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+    json.close();
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig config;
+    config.min_time_ms = 200.0;
+    config.min_iterations = 3;
+    config.quick = false;
+    string assetDir = BENCH_ASSET_DIR;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc)
+            config.json_file = argv[++i];
+        else if (arg == "--filter" && i + 1 < argc)
+            config.filter = argv[++i];
+        else if (arg == "--assets" && i + 1 < argc)
+            assetDir = argv[++i];
+        else if (arg == "--quick")
+            config.quick = true;
+        else
+        {
+            cout << "usage: asset_benchmark [--json out.json] [--filter name] [--assets dir] [--quick]" << endl;
+            return 1;
+        }
+    }
+
+    if (config.quick)
+    {
+        config.min_time_ms = 10.0;
+        config.min_iterations = 1;
+    }
+
+    string tempDir = (filesystem::temp_directory_path() / "gl_universe_bench").string();
+    filesystem::create_directories(tempDir);
+
+    // bundled scans first, then synthetic grids of increasing size
+    const char* bundledModels[] = { "models/bun_zipper_res4.ply", "models/dragon_vrip_res4.ply", "models/happy_vrip_res4.ply" };
+    for (int i = 0; i < 3; ++i)
+    {
+        bench_ply(config, assetDir + "/" + bundledModels[i], bundledModels[i]);
+    }
+
+    int gridSizes[] = { 32, 128, 512 };
+    int gridNum = config.quick ? 2 : 3;
+    vector<string> batch;
+    for (int i = 0; i < gridNum; ++i)
+    {
+        string filename = write_synthetic_ply(tempDir, gridSizes[i]);
+        bench_ply(config, filename, "grid " + to_string(2 * (gridSizes[i] - 1) * (gridSizes[i] - 1)) + " faces");
+        batch.push_back(filename);
+    }
+
+    // many small meshes (LODs, tiles) is where per-buffer heap churn shows up
+    string tile = write_synthetic_ply(tempDir, 16);
+    vector<string> tiles(64, tile);
+    bool checksPassed = bench_mesh_batch(config, tiles, "64 tiles");
+    checksPassed = bench_mesh_batch(config, batch, to_string(batch.size()) + " grids") && checksPassed;
+    bench_chunked_mesh(config, batch.back(), 2LL * (gridSizes[gridNum - 1] - 1) * (gridSizes[gridNum - 1] - 1));
+
+#ifdef BENCH_HAS_STB_IMAGE
+    const char* bundledImages[] = { "img/soil.jpg", "img/cornfield.jpg", "img/W.jpg" };
+    for (int i = 0; i < 3; ++i)
+    {
+        bench_image(config, assetDir + "/" + bundledImages[i], bundledImages[i]);
+    }
+
+    int imageSizes[] = { 256, 1024, 4096 };
+    int imageNum = config.quick ? 2 : 3;
+    for (int i = 0; i < imageNum; ++i)
+    {
+        bench_image(config, write_synthetic_ppm(tempDir, imageSizes[i]), "ppm " + to_string(imageSizes[i]) + "^2");
+    }
+#else
+    cout << "stb_image.h not available, image decoding benchmarks skipped" << endl;
+#endif
+
+    int boxCounts[] = { 9, 1024, 65536 };
+    for (int i = 0; i < 3; ++i)
+    {
+        bench_collision(config, boxCounts[i]);
+    }
+
+    int lightCounts[] = { 1, 64, 512 };
+    for (int i = 0; i < 3; ++i)
+    {
+        bench_light_binning(config, lightCounts[i]);
+    }
+
+    checksPassed = check_instance_matrices() && checksPassed;
+    int instanceCounts[] = { 3, 1024, 65536 };
+    for (int i = 0; i < 3; ++i)
+    {
+        bench_instance_matrices(config, instanceCounts[i]);
+    }
+
+    bench_terrain(config);
+
+    int occlusionBoxCounts[] = { 16, 1024 };
+    for (int i = 0; i < 2; ++i)
+    {
+        bench_occlusion(config, occlusionBoxCounts[i]);
+    }
+
+    if (!config.json_file.empty())
+    {
+        write_json(config.json_file);
+    }
+    return checksPassed ? 0 : 1;
+}
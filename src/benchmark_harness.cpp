@@ -0,0 +1,384 @@
+#include "benchmark_harness.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+static const double MAX_MISMATCH_RATIO = 0.001; // fraction of pixels allowed outside tolerance
+
+static unsigned long long now_ns()
+{
+    return (unsigned long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double percentile(vector<double> values, double p)
+{
+    if (values.empty())
+        return 0.0;
+
+    size_t k = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+    nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+BenchmarkHarness::BenchmarkHarness()
+{
+    this->frame_start_ns = 0;
+    this->failed_images = 0;
+    this->compared_images = 0;
+    return;
+}
+
+bool BenchmarkHarness::parse_args(int argc, char** argv, BenchmarkOptions& options)
+{
+    options.headless = false;
+    options.frames = 600;
+    options.width = 800;
+    options.height = 600;
+    options.seed = 647;
+    options.timestep = 1.0f / 60.0f;
+    options.dump_every = 60;
+    options.tolerance = 8;
+    options.meshlet_culling = true;
+    options.occlusion_culling = true;
+    options.lights = -1;
+    options.posed_models = false;
+    options.hot_reload = false;
+    options.views = 1;
+    options.frame_budget = 0.0f;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--headless")
+            options.headless = true;
+        else if (arg == "--frames" && hasValue)
+            options.frames = atoi(argv[++i]);
+        else if (arg == "--width" && hasValue)
+            options.width = atoi(argv[++i]);
+        else if (arg == "--height" && hasValue)
+            options.height = atoi(argv[++i]);
+        else if (arg == "--seed" && hasValue)
+            options.seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (arg == "--timestep" && hasValue)
+            options.timestep = (float)atof(argv[++i]);
+        else if (arg == "--camera-path" && hasValue)
+            options.camera_path = argv[++i];
+        else if (arg == "--report" && hasValue)
+            options.report_file = argv[++i];
+        else if (arg == "--dump-frames" && hasValue)
+            options.dump_dir = argv[++i];
+        else if (arg == "--reference" && hasValue)
+            options.reference_dir = argv[++i];
+        else if (arg == "--dump-every" && hasValue)
+            options.dump_every = max(1, atoi(argv[++i]));
+        else if (arg == "--tolerance" && hasValue)
+            options.tolerance = atoi(argv[++i]);
+        else if (arg == "--no-meshlet-cull")
+            options.meshlet_culling = false;
+        else if (arg == "--no-occlusion-cull")
+            options.occlusion_culling = false;
+        else if (arg == "--lights" && hasValue)
+            options.lights = atoi(argv[++i]);
+        else if (arg == "--posed-models")
+            options.posed_models = true;
+        else if (arg == "--hot-reload")
+            options.hot_reload = true;
+        else if (arg == "--views" && hasValue)
+            options.views = atoi(argv[++i]);
+        else if (arg == "--frame-budget" && hasValue)
+            options.frame_budget = (float)atof(argv[++i]);
+        else if (arg == "--record" && hasValue)
+            options.record_file = argv[++i];
+        else if (arg == "--replay" && hasValue)
+            options.replay_file = argv[++i];
+        else if (arg == "--trace" && hasValue)
+            options.trace_file = argv[++i];
+        else if (arg == "--shader-cache" && hasValue)
+            options.shader_cache = argv[++i];
+        else
+            cout << "Unknown argument: " << arg << endl;
+    }
+
+    return options.headless;
+}
+
+bool BenchmarkHarness::init(const BenchmarkOptions& options)
+{
+    this->options = options;
+    this->frames.clear();
+    this->frames.reserve(options.frames);
+
+    if (options.camera_path.empty())
+    {
+        this->use_default_camera_path();
+        return true;
+    }
+    return this->load_camera_path(options.camera_path.c_str());
+}
+
+bool BenchmarkHarness::load_camera_path(const char* filename)
+{
+    ifstream pathFile(filename);
+    if (pathFile.fail())
+    {
+        cout << "Fail to open file: " << filename << endl;
+        return false;
+    }
+
+    string line;
+    while (getline(pathFile, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        CameraKey key;
+        istringstream is(line);
+        if (is >> key.time >> key.pos[0] >> key.pos[1] >> key.pos[2] >> key.yaw >> key.pitch)
+        {
+            this->camera_keys.push_back(key);
+        }
+    }
+    pathFile.close();
+
+    if (this->camera_keys.empty())
+    {
+        cout << "Camera path has no keys: " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+void BenchmarkHarness::use_default_camera_path()
+{
+    // one orbit around the field, looking at the centre
+    this->camera_keys.clear();
+    for (int i = 0; i <= 8; ++i)
+    {
+        float a = i * 45.0f;
+        CameraKey key;
+        key.time = i * 2.0f;
+        key.pos[0] = 15.0f * cos(a * 3.1415927f / 180.0f);
+        key.pos[1] = 3.0f;
+        key.pos[2] = 15.0f * sin(a * 3.1415927f / 180.0f);
+        key.yaw = a + 180.0f;
+        key.pitch = -8.0f;
+        this->camera_keys.push_back(key);
+    }
+    return;
+}
+
+void BenchmarkHarness::sample_camera(float time, float pos[3], float& yaw, float& pitch)
+{
+    // the path loops once it runs out of keys
+    float duration = this->camera_keys.back().time;
+    if (duration > 0)
+    {
+        time = fmod(time, duration);
+    }
+
+    size_t k = 0;
+    while (k + 1 < this->camera_keys.size() && this->camera_keys[k + 1].time <= time)
+    {
+        ++k;
+    }
+
+    const CameraKey& a = this->camera_keys[k];
+    const CameraKey& b = this->camera_keys[min(k + 1, this->camera_keys.size() - 1)];
+    float t = b.time > a.time ? (time - a.time) / (b.time - a.time) : 0.0f;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        pos[i] = a.pos[i] + (b.pos[i] - a.pos[i]) * t;
+    }
+    yaw = a.yaw + (b.yaw - a.yaw) * t;
+    pitch = a.pitch + (b.pitch - a.pitch) * t;
+    return;
+}
+
+void BenchmarkHarness::begin_frame(int frame)
+{
+    BenchmarkFrame record;
+    record.frame = frame;
+    record.cpu_ms = 0.0;
+    record.gpu_ms = -1.0;
+    record.draw_calls = 0;
+    record.triangles = 0;
+    this->frames.push_back(record);
+
+    this->frame_start_ns = now_ns();
+    return;
+}
+
+void BenchmarkHarness::end_frame(int draw_calls, long long triangles)
+{
+    BenchmarkFrame& record = this->frames.back();
+    record.cpu_ms = (now_ns() - this->frame_start_ns) / 1.0e6;
+    record.draw_calls = draw_calls;
+    record.triangles = triangles;
+    return;
+}
+
+void BenchmarkHarness::set_frame_gpu_ms(int frame, double gpu_ms)
+{
+    if (frame < 0 || frame >= (int)this->frames.size())
+        return;
+
+    this->frames[frame].gpu_ms = gpu_ms;
+    return;
+}
+
+bool BenchmarkHarness::wants_image(int frame)
+{
+    if (this->options.dump_dir.empty() && this->options.reference_dir.empty())
+        return false;
+
+    return frame % this->options.dump_every == 0;
+}
+
+void BenchmarkHarness::process_image(int frame, const vector<unsigned char>& rgb, int width, int height)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "frame_%05d.ppm", frame);
+
+    if (!this->options.dump_dir.empty())
+    {
+        this->write_ppm(this->options.dump_dir + "/" + name, rgb, width, height);
+    }
+
+    if (!this->options.reference_dir.empty())
+    {
+        vector<unsigned char> reference;
+        int refWidth, refHeight;
+        this->compared_images++;
+        if (!this->read_ppm(this->options.reference_dir + "/" + name, reference, refWidth, refHeight) || refWidth != width || refHeight != height)
+        {
+            cout << "Missing or mismatched reference frame: " << name << endl;
+            this->failed_images++;
+            return;
+        }
+
+        int mismatched = 0;
+        int maxDiff = 0;
+        for (int i = 0; i < width * height; ++i)
+        {
+            int pixelDiff = 0;
+            for (int c = 0; c < 3; ++c)
+            {
+                pixelDiff = max(pixelDiff, abs((int)rgb[3 * i + c] - (int)reference[3 * i + c]));
+            }
+            maxDiff = max(maxDiff, pixelDiff);
+            if (pixelDiff > this->options.tolerance)
+            {
+                mismatched++;
+            }
+        }
+
+        double ratio = (double)mismatched / (width * height);
+        if (ratio > MAX_MISMATCH_RATIO)
+        {
+            cout << "Frame " << frame << " differs from reference: " << 100.0 * ratio << "% pixels, max diff " << maxDiff << endl;
+            this->failed_images++;
+        }
+    }
+
+    return;
+}
+
+bool BenchmarkHarness::write_report()
+{
+    if (this->options.report_file.empty())
+        return true;
+
+    ofstream report(this->options.report_file.c_str());
+    if (report.fail())
+    {
+        cout << "Fail to open file: " << this->options.report_file << endl;
+        return false;
+    }
+
+    report << "frame,cpu_ms,gpu_ms,draw_calls,triangles" << endl;
+    for (size_t i = 0; i < this->frames.size(); ++i)
+    {
+        const BenchmarkFrame& f = this->frames[i];
+        report << f.frame << "," << f.cpu_ms << "," << f.gpu_ms << "," << f.draw_calls << "," << f.triangles << endl;
+    }
+    report.close();
+    return true;
+}
+
+void BenchmarkHarness::print_summary()
+{
+    vector<double> cpu, gpu;
+    long long triangles = 0;
+    int drawCalls = 0;
+    for (size_t i = 0; i < this->frames.size(); ++i)
+    {
+        cpu.push_back(this->frames[i].cpu_ms);
+        if (this->frames[i].gpu_ms >= 0)
+        {
+            gpu.push_back(this->frames[i].gpu_ms);
+        }
+        drawCalls += this->frames[i].draw_calls;
+        triangles += this->frames[i].triangles;
+    }
+
+    int frameNum = max(1, (int)this->frames.size());
+    cout << "Benchmark: " << this->frames.size() << " frames, seed " << this->options.seed << endl;
+    cout << "cpu p50 " << percentile(cpu, 50) << " ms, p99 " << percentile(cpu, 99) << " ms" << endl;
+    cout << "gpu p50 " << percentile(gpu, 50) << " ms, p99 " << percentile(gpu, 99) << " ms" << endl;
+    cout << "draw calls/frame " << drawCalls / frameNum << ", triangles/frame " << triangles / frameNum << endl;
+    if (this->compared_images > 0)
+    {
+        cout << "image regression: " << this->compared_images - this->failed_images << "/" << this->compared_images << " frames match" << endl;
+    }
+    return;
+}
+
+int BenchmarkHarness::get_failed_images()
+{
+    return this->failed_images;
+}
+
+bool BenchmarkHarness::write_ppm(const string& filename, const vector<unsigned char>& rgb, int width, int height)
+{
+    ofstream image(filename.c_str(), ios::binary);
+    if (image.fail())
+    {
+        cout << "Fail to open file: " << filename << endl;
+        return false;
+    }
+
+    image << "P6\n" << width << " " << height << "\n255\n";
+    image.write((const char*)rgb.data(), 3 * width * height);
+    image.close();
+    return true;
+}
+
+bool BenchmarkHarness::read_ppm(const string& filename, vector<unsigned char>& rgb, int& width, int& height)
+{
+    ifstream image(filename.c_str(), ios::binary);
+    if (image.fail())
+        return false;
+
+    string magic;
+    int maxValue;
+    image >> magic >> width >> height >> maxValue;
+    image.get(); // single whitespace before the pixel data
+    if (magic != "P6" || maxValue != 255 || width <= 0 || height <= 0)
+        return false;
+
+    rgb.resize(3 * width * height);
+    image.read((char*)rgb.data(), rgb.size());
+    return (bool)image;
+}
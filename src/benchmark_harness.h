@@ -0,0 +1,89 @@
+#ifndef BENCHMARK_HARNESS_H
+#define BENCHMARK_HARNESS_H
+
+#include <string>
+#include <vector>
+
+struct BenchmarkOptions
+{
+    bool headless;
+    int frames;
+    int width;
+    int height;
+    unsigned int seed;
+    float timestep; // fixed simulation step in seconds
+    std::string camera_path; // "t x y z yaw pitch" per line, empty for the built-in orbit
+    std::string report_file; // per-frame CSV
+    std::string dump_dir;
+    std::string reference_dir;
+    int dump_every;
+    int tolerance; // per-channel difference still counted as a match
+    bool meshlet_culling;
+    bool occlusion_culling;
+    int lights; // dynamic point lights, -1 keeps the scene default
+    bool posed_models; // rotate and non-uniformly scale the models
+    bool hot_reload; // watch the scene file and assets between frames
+    int views; // split-screen views, 1-4
+    float frame_budget; // GPU ms held by the resolution governor, 0 keeps it off
+    std::string record_file; // input log written by a windowed session
+    std::string replay_file; // input log that drives the camera, timestep and character walk
+    std::string trace_file; // chrome trace written on exit, empty for none
+    std::string shader_cache; // program binary cache, empty for the default next to the executable, "none" for no cache
+};
+
+struct CameraKey
+{
+    float time;
+    float pos[3];
+    float yaw;
+    float pitch;
+};
+
+struct BenchmarkFrame
+{
+    int frame;
+    double cpu_ms;
+    double gpu_ms;
+    int draw_calls;
+    long long triangles;
+};
+
+// scripted camera replay, per-frame timing report and frame image regression checks
+class BenchmarkHarness
+{
+public:
+    BenchmarkHarness();
+
+    static bool parse_args(int argc, char** argv, BenchmarkOptions& options);
+
+    bool init(const BenchmarkOptions& options);
+
+    void sample_camera(float time, float pos[3], float& yaw, float& pitch);
+
+    void begin_frame(int frame);
+    void end_frame(int draw_calls, long long triangles);
+    void set_frame_gpu_ms(int frame, double gpu_ms); // timer results resolve a few frames late
+
+    bool wants_image(int frame);
+    void process_image(int frame, const std::vector<unsigned char>& rgb, int width, int height);
+
+    bool write_report();
+    void print_summary();
+    int get_failed_images();
+
+private:
+    BenchmarkOptions options;
+    std::vector<CameraKey> camera_keys;
+    std::vector<BenchmarkFrame> frames;
+    unsigned long long frame_start_ns;
+    int failed_images;
+    int compared_images;
+
+    bool load_camera_path(const char* filename);
+    void use_default_camera_path();
+
+    bool write_ppm(const std::string& filename, const std::vector<unsigned char>& rgb, int width, int height);
+    bool read_ppm(const std::string& filename, std::vector<unsigned char>& rgb, int& width, int& height);
+};
+
+#endif
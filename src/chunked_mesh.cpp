@@ -0,0 +1,126 @@
+#include "chunked_mesh.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+    this->data = NULL;
+    this->size = 0;
+#if defined(_WIN32)
+    this->file = NULL;
+    this->mapping = NULL;
+#endif
+    return;
+}
+
+MappedFile::~MappedFile()
+{
+    this->close();
+    return;
+}
+
+bool MappedFile::open(const char* filename)
+{
+    this->close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    this->data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (this->data == NULL)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    this->file = file;
+    this->mapping = mapping;
+    this->size = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (mapped == MAP_FAILED)
+        return false;
+    this->data = (const unsigned char*)mapped;
+    this->size = (size_t)info.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (this->data == NULL)
+        return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(this->data);
+    CloseHandle((HANDLE)this->mapping);
+    CloseHandle((HANDLE)this->file);
+    this->file = NULL;
+    this->mapping = NULL;
+#else
+    munmap((void*)this->data, this->size);
+#endif
+    this->data = NULL;
+    this->size = 0;
+    return;
+}
+
+const unsigned char* MappedFile::get_data()
+{
+    return this->data;
+}
+
+size_t MappedFile::get_size()
+{
+    return this->size;
+}
+
+void MappedFile::release(size_t offset, size_t bytes)
+{
+    if (this->data == NULL || offset >= this->size)
+        return;
+
+#if defined(_WIN32)
+    // unlocking pages that are not locked just trims them from the working set
+    VirtualUnlock((void*)(this->data + offset), bytes);
+#else
+    // only whole pages inside the range, neighbours may still be in use
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t begin = (offset + page - 1) / page * page;
+    size_t end = (offset + bytes < this->size ? offset + bytes : this->size) / page * page;
+    if (end > begin)
+        madvise((void*)(this->data + begin), end - begin, MADV_DONTNEED);
+#endif
+    return;
+}
@@ -0,0 +1,72 @@
+#ifndef CHUNKED_MESH_H
+#define CHUNKED_MESH_H
+
+#include <cstddef>
+
+// on-disk layout of an out-of-core mesh: a header, the vertex and index data of every LOD level,
+// then the node and level tables. Nodes form an octree whose children are stored contiguously,
+// root first. Leaves carry a chain of levels from full resolution to coarse, inner nodes one
+// proxy simplified from their children. Vertices are position and normal, indices 32 bit.
+const unsigned int CHUNKED_MESH_MAGIC = 0x434f4f47; // "GOOC"
+const unsigned int CHUNKED_MESH_VERSION = 1;
+
+struct ChunkedMeshHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int node_num;
+    unsigned int level_num;
+    float min[3];
+    float max[3];
+    unsigned long long node_offset;
+    unsigned long long level_offset;
+    unsigned long long source_faces;
+};
+
+struct ChunkedMeshNode
+{
+    float min[3];
+    float max[3];
+    int first_child; // -1 for a leaf
+    int child_num;
+    int first_level;
+    int level_num; // finest first
+};
+
+struct ChunkedMeshLevel
+{
+    unsigned long long offset; // vertices, immediately followed by the indices
+    unsigned int vertex_num;
+    unsigned int index_num;
+    float error; // largest distance a vertex moved, in mesh units; 0 at full resolution
+    unsigned int padding;
+};
+
+// read-only memory mapping of a whole file. release() hands the pages of a range back to the
+// system after they were consumed, so touching a huge file never pins it in resident memory.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const char* filename);
+    void close();
+
+    const unsigned char* get_data();
+    size_t get_size();
+    void release(size_t offset, size_t bytes);
+
+private:
+    const unsigned char* data;
+    size_t size;
+#if defined(_WIN32)
+    void* file;
+    void* mapping;
+#endif
+};
+
+#endif
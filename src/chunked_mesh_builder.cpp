@@ -0,0 +1,929 @@
+#include "chunked_mesh_builder.h"
+
+#include "chunked_mesh.h"
+#include "mesh_lod.h"
+#include "morton.h"
+#include "process_memory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+void set_default_chunked_mesh_params(ChunkedMeshBuildParams& params)
+{
+    params.leaf_faces = 65536;
+    params.lod_num = 3;
+    params.leaf_grid = 64;
+    params.proxy_grid = 32;
+    params.memory_budget = (size_t)256 * 1024 * 1024;
+    return;
+}
+
+enum PlyType
+{
+    PLY_NONE,
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64
+};
+
+static PlyType ply_type_from_name(const string& name)
+{
+    if (name == "char" || name == "int8")
+        return PLY_INT8;
+    if (name == "uchar" || name == "uint8")
+        return PLY_UINT8;
+    if (name == "short" || name == "int16")
+        return PLY_INT16;
+    if (name == "ushort" || name == "uint16")
+        return PLY_UINT16;
+    if (name == "int" || name == "int32")
+        return PLY_INT32;
+    if (name == "uint" || name == "uint32")
+        return PLY_UINT32;
+    if (name == "float" || name == "float32")
+        return PLY_FLOAT32;
+    if (name == "double" || name == "float64")
+        return PLY_FLOAT64;
+    return PLY_NONE;
+}
+
+static int ply_type_size(PlyType type)
+{
+    static const int SIZES[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+    return SIZES[type];
+}
+
+// little endian, which is every platform this builds on
+static double read_ply_value(const unsigned char* p, PlyType type)
+{
+    switch (type)
+    {
+    case PLY_INT8: { int8_t v; memcpy(&v, p, 1); return v; }
+    case PLY_UINT8: { uint8_t v; memcpy(&v, p, 1); return v; }
+    case PLY_INT16: { int16_t v; memcpy(&v, p, 2); return v; }
+    case PLY_UINT16: { uint16_t v; memcpy(&v, p, 2); return v; }
+    case PLY_INT32: { int32_t v; memcpy(&v, p, 4); return v; }
+    case PLY_UINT32: { uint32_t v; memcpy(&v, p, 4); return v; }
+    case PLY_FLOAT32: { float v; memcpy(&v, p, 4); return v; }
+    case PLY_FLOAT64: { double v; memcpy(&v, p, 8); return v; }
+    default: return 0.0;
+    }
+}
+
+// where x, y, z and the face indices sit in each record. Faces may carry scalar properties
+// around their index list, they are skipped.
+struct PlyLayout
+{
+    bool binary;
+    long long vertex_num;
+    long long face_num;
+    int vertex_property_num;
+    int vertex_bytes;
+    int coord_property[3];
+    int coord_offset[3];
+    PlyType coord_type[3];
+    PlyType count_type;
+    PlyType index_type;
+    int face_skip_before; // bytes in binary files, tokens in ascii ones
+    int face_skip_after;
+};
+
+// sequential reader with a large buffer, the source may be far bigger than memory
+struct FileReader
+{
+    FILE* file;
+    vector<unsigned char> buffer;
+    size_t pos;
+    size_t end;
+
+    bool fill()
+    {
+        if (this->pos < this->end)
+            memmove(this->buffer.data(), this->buffer.data() + this->pos, this->end - this->pos);
+        this->end -= this->pos;
+        this->pos = 0;
+        this->end += fread(this->buffer.data() + this->end, 1, this->buffer.size() - this->end, this->file);
+        return this->end > 0;
+    }
+
+    const unsigned char* read(size_t bytes)
+    {
+        if (this->end - this->pos < bytes)
+        {
+            this->fill();
+            if (this->end - this->pos < bytes)
+                return NULL;
+        }
+        const unsigned char* data = this->buffer.data() + this->pos;
+        this->pos += bytes;
+        return data;
+    }
+
+    bool read_line(string& line)
+    {
+        line.clear();
+        while (true)
+        {
+            if (this->pos == this->end && !this->fill())
+                return !line.empty();
+            const unsigned char* begin = this->buffer.data() + this->pos;
+            const unsigned char* newline = (const unsigned char*)memchr(begin, '\n', this->end - this->pos);
+            if (newline != NULL)
+            {
+                line.append((const char*)begin, newline - begin);
+                this->pos += newline - begin + 1;
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                return true;
+            }
+            line.append((const char*)begin, this->end - this->pos);
+            this->pos = this->end;
+        }
+    }
+};
+
+static bool read_ply_layout(FileReader& reader, PlyLayout& layout, string& error)
+{
+    string line;
+    if (!reader.read_line(line) || line != "ply")
+    {
+        error = "not a PLY file";
+        return false;
+    }
+
+    layout.binary = false;
+    layout.vertex_num = -1;
+    layout.face_num = -1;
+    layout.vertex_property_num = 0;
+    layout.vertex_bytes = 0;
+    layout.count_type = PLY_NONE;
+    layout.index_type = PLY_NONE;
+    layout.face_skip_before = 0;
+    layout.face_skip_after = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        layout.coord_property[i] = -1;
+        layout.coord_offset[i] = 0;
+        layout.coord_type[i] = PLY_NONE;
+    }
+
+    int element = 0; // 0-none, 1-vertex, 2-face, 3-ignored trailing element
+    while (reader.read_line(line))
+    {
+        istringstream tokens(line);
+        string keyword;
+        tokens >> keyword;
+        if (keyword == "format")
+        {
+            string format;
+            tokens >> format;
+            if (format == "binary_little_endian")
+                layout.binary = true;
+            else if (format != "ascii")
+            {
+                error = "unsupported format " + format;
+                return false;
+            }
+        }
+        else if (keyword == "element")
+        {
+            string name;
+            long long count = 0;
+            tokens >> name >> count;
+            if (name == "vertex" && element == 0)
+            {
+                element = 1;
+                layout.vertex_num = count;
+            }
+            else if (name == "face" && element == 1)
+            {
+                element = 2;
+                layout.face_num = count;
+            }
+            else if (element == 2 || element == 3)
+                element = 3;
+            else
+            {
+                error = "element " + name + " before vertex and face is not supported";
+                return false;
+            }
+        }
+        else if (keyword == "property")
+        {
+            string type;
+            tokens >> type;
+            if (element == 1)
+            {
+                string name;
+                tokens >> name;
+                PlyType valueType = ply_type_from_name(type);
+                if (valueType == PLY_NONE)
+                {
+                    error = "unsupported vertex property " + line;
+                    return false;
+                }
+                int axis = name == "x" ? 0 : name == "y" ? 1 : name == "z" ? 2 : -1;
+                if (axis >= 0)
+                {
+                    layout.coord_property[axis] = layout.vertex_property_num;
+                    layout.coord_offset[axis] = layout.vertex_bytes;
+                    layout.coord_type[axis] = valueType;
+                }
+                layout.vertex_property_num++;
+                layout.vertex_bytes += ply_type_size(valueType);
+            }
+            else if (element == 2)
+            {
+                if (type == "list")
+                {
+                    string countType, indexType;
+                    tokens >> countType >> indexType;
+                    layout.count_type = ply_type_from_name(countType);
+                    layout.index_type = ply_type_from_name(indexType);
+                    if (layout.count_type == PLY_NONE || layout.index_type == PLY_NONE)
+                    {
+                        error = "unsupported face list " + line;
+                        return false;
+                    }
+                }
+                else
+                {
+                    PlyType valueType = ply_type_from_name(type);
+                    if (valueType == PLY_NONE)
+                    {
+                        error = "unsupported face property " + line;
+                        return false;
+                    }
+                    int skip = layout.binary ? ply_type_size(valueType) : 1;
+                    if (layout.index_type == PLY_NONE)
+                        layout.face_skip_before += skip;
+                    else
+                        layout.face_skip_after += skip;
+                }
+            }
+        }
+        else if (keyword == "end_header")
+        {
+            if (layout.vertex_num <= 0 || layout.face_num <= 0 || layout.index_type == PLY_NONE)
+            {
+                error = "missing vertex or face element";
+                return false;
+            }
+            for (int i = 0; i < 3; ++i)
+            {
+                if (layout.coord_property[i] < 0)
+                {
+                    error = "missing vertex coordinate";
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    error = "truncated header";
+    return false;
+}
+
+static bool read_vertex(FileReader& reader, const PlyLayout& layout, string& line, float p[3])
+{
+    if (layout.binary)
+    {
+        const unsigned char* record = reader.read(layout.vertex_bytes);
+        if (record == NULL)
+            return false;
+        for (int i = 0; i < 3; ++i)
+        {
+            p[i] = (float)read_ply_value(record + layout.coord_offset[i], layout.coord_type[i]);
+        }
+        return true;
+    }
+
+    if (!reader.read_line(line))
+        return false;
+    const char* cursor = line.c_str();
+    for (int property = 0; property < layout.vertex_property_num; ++property)
+    {
+        char* next = NULL;
+        double value = strtod(cursor, &next);
+        if (next == cursor)
+            return false;
+        cursor = next;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (layout.coord_property[i] == property)
+                p[i] = (float)value;
+        }
+    }
+    return true;
+}
+
+static bool read_face(FileReader& reader, const PlyLayout& layout, string& line, vector<unsigned long long>& indices)
+{
+    indices.clear();
+    if (layout.binary)
+    {
+        if (layout.face_skip_before > 0 && reader.read(layout.face_skip_before) == NULL)
+            return false;
+        const unsigned char* count = reader.read(ply_type_size(layout.count_type));
+        if (count == NULL)
+            return false;
+        long long n = (long long)read_ply_value(count, layout.count_type);
+        int indexSize = ply_type_size(layout.index_type);
+        const unsigned char* list = n > 0 ? reader.read((size_t)n * indexSize) : NULL;
+        if (n > 0 && list == NULL)
+            return false;
+        for (long long i = 0; i < n; ++i)
+        {
+            double index = read_ply_value(list + i * indexSize, layout.index_type);
+            indices.push_back(index < 0 ? ~0ull : (unsigned long long)index);
+        }
+        if (layout.face_skip_after > 0 && reader.read(layout.face_skip_after) == NULL)
+            return false;
+        return true;
+    }
+
+    if (!reader.read_line(line))
+        return false;
+    const char* cursor = line.c_str();
+    char* next = NULL;
+    for (int i = 0; i < layout.face_skip_before; ++i)
+    {
+        strtod(cursor, &next);
+        cursor = next;
+    }
+    long long n = strtoll(cursor, &next, 10);
+    if (next == cursor)
+        return false;
+    cursor = next;
+    for (long long i = 0; i < n; ++i)
+    {
+        long long index = strtoll(cursor, &next, 10);
+        if (next == cursor)
+            return false;
+        cursor = next;
+        indices.push_back(index < 0 ? ~0ull : (unsigned long long)index);
+    }
+    return true;
+}
+
+// a run of one cell's triangles in the spill file
+struct SpillBlock
+{
+    size_t offset;
+    size_t triangle_num;
+};
+
+struct CellBucket
+{
+    vector<float> buffered; // 9 floats per triangle
+    vector<SpillBlock> blocks;
+};
+
+// one reduced level of a node, positions only until it is written
+struct NodeGeometry
+{
+    MeshLod mesh;
+    float error;
+};
+
+struct BuildContext
+{
+    const ChunkedMeshBuildParams* params;
+    int depth;
+    vector<uint32_t> keys; // occupied leaf cells, Morton order
+    unordered_map<uint32_t, CellBucket>* buckets;
+    MappedFile spill;
+    FILE* out;
+    size_t out_bytes;
+    vector<ChunkedMeshNode> nodes;
+    vector<ChunkedMeshLevel> levels;
+    bool write_failed;
+};
+
+struct PositionKey
+{
+    float p[3];
+
+    bool operator==(const PositionKey& other) const
+    {
+        return memcmp(this->p, other.p, sizeof(this->p)) == 0;
+    }
+};
+
+struct PositionHash
+{
+    size_t operator()(const PositionKey& key) const
+    {
+        uint32_t bits[3];
+        memcpy(bits, key.p, sizeof(bits));
+        return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+    }
+};
+
+static void mesh_bounds(const MeshLod& mesh, float lo[3], float hi[3])
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        lo[i] = 1e30f;
+        hi[i] = -1e30f;
+    }
+    for (size_t v = 0; v < mesh.vertices.size(); v += 3)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            lo[i] = min(lo[i], mesh.vertices[v + i]);
+            hi[i] = max(hi[i], mesh.vertices[v + i]);
+        }
+    }
+    return;
+}
+
+static float mesh_extent(const MeshLod& mesh)
+{
+    float lo[3], hi[3];
+    mesh_bounds(mesh, lo, hi);
+    return max(hi[0] - lo[0], max(hi[1] - lo[1], hi[2] - lo[2]));
+}
+
+// area weighted vertex normals, interleaved with the positions and appended to the output
+static void write_level(BuildContext& ctx, const MeshLod& mesh, float error)
+{
+    size_t vertexNum = mesh.vertices.size() / 3;
+    vector<float> normals(mesh.vertices.size(), 0.0f);
+    for (size_t f = 0; f + 2 < mesh.indices.size(); f += 3)
+    {
+        const float* a = &mesh.vertices[3 * mesh.indices[f]];
+        const float* b = &mesh.vertices[3 * mesh.indices[f + 1]];
+        const float* c = &mesh.vertices[3 * mesh.indices[f + 2]];
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        for (int k = 0; k < 3; ++k)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                normals[3 * mesh.indices[f + k] + i] += n[i];
+            }
+        }
+    }
+
+    vector<float> interleaved(6 * vertexNum);
+    for (size_t v = 0; v < vertexNum; ++v)
+    {
+        float* n = &normals[3 * v];
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        float inverse = length > 0 ? 1.0f / length : 0.0f;
+        for (int i = 0; i < 3; ++i)
+        {
+            interleaved[6 * v + i] = mesh.vertices[3 * v + i];
+            interleaved[6 * v + 3 + i] = n[i] * inverse;
+        }
+    }
+
+    ChunkedMeshLevel level;
+    level.offset = ctx.out_bytes;
+    level.vertex_num = (unsigned int)vertexNum;
+    level.index_num = (unsigned int)mesh.indices.size();
+    level.error = error;
+    level.padding = 0;
+    ctx.levels.push_back(level);
+
+    size_t vertexBytes = sizeof(float) * interleaved.size();
+    size_t indexBytes = sizeof(unsigned int) * mesh.indices.size();
+    if ((vertexBytes > 0 && fwrite(interleaved.data(), 1, vertexBytes, ctx.out) != vertexBytes)
+        || (indexBytes > 0 && fwrite(mesh.indices.data(), 1, indexBytes, ctx.out) != indexBytes))
+    {
+        ctx.write_failed = true;
+    }
+    ctx.out_bytes += vertexBytes + indexBytes;
+    return;
+}
+
+// gathers a leaf cell's triangles from the spill file and welds identical positions
+static void load_leaf(BuildContext& ctx, uint32_t key, MeshLod& mesh)
+{
+    CellBucket& bucket = (*ctx.buckets)[key];
+    size_t triangleNum = 0;
+    for (size_t b = 0; b < bucket.blocks.size(); ++b)
+    {
+        triangleNum += bucket.blocks[b].triangle_num;
+    }
+
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.indices.reserve(3 * triangleNum);
+    unordered_map<PositionKey, unsigned int, PositionHash> welded;
+    welded.reserve(triangleNum);
+    for (size_t b = 0; b < bucket.blocks.size(); ++b)
+    {
+        const SpillBlock& block = bucket.blocks[b];
+        const float* triangles = (const float*)(ctx.spill.get_data() + block.offset);
+        for (size_t t = 0; t < block.triangle_num; ++t)
+        {
+            unsigned int corner[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                PositionKey position;
+                memcpy(position.p, triangles + 9 * t + 3 * k, sizeof(position.p));
+                unordered_map<PositionKey, unsigned int, PositionHash>::iterator it = welded.find(position);
+                if (it == welded.end())
+                {
+                    it = welded.insert(make_pair(position, (unsigned int)(mesh.vertices.size() / 3))).first;
+                    mesh.vertices.insert(mesh.vertices.end(), position.p, position.p + 3);
+                }
+                corner[k] = it->second;
+            }
+            if (corner[0] == corner[1] || corner[1] == corner[2] || corner[0] == corner[2])
+                continue;
+            mesh.indices.insert(mesh.indices.end(), corner, corner + 3);
+        }
+        ctx.spill.release(block.offset, sizeof(float) * 9 * block.triangle_num);
+    }
+
+    vector<SpillBlock>().swap(bucket.blocks);
+    return;
+}
+
+// fills nodes[index] for the cell holding keys[begin, end) at octree level `level` and
+// returns its coarsest geometry, which the parent simplifies further into its proxy
+static void build_node(BuildContext& ctx, int index, int level, size_t begin, size_t end, NodeGeometry& coarse)
+{
+    const ChunkedMeshBuildParams& params = *ctx.params;
+    ChunkedMeshNode node;
+
+    if (level == ctx.depth)
+    {
+        NodeGeometry full;
+        load_leaf(ctx, ctx.keys[begin], full.mesh);
+        full.error = 0.0f;
+        mesh_bounds(full.mesh, node.min, node.max);
+        float extent = mesh_extent(full.mesh);
+
+        node.first_child = -1;
+        node.child_num = 0;
+        node.first_level = (int)ctx.levels.size();
+        write_level(ctx, full.mesh, 0.0f);
+        coarse.mesh.vertices.swap(full.mesh.vertices);
+        coarse.mesh.indices.swap(full.mesh.indices);
+        coarse.error = 0.0f;
+        for (int k = 1; k < params.lod_num; ++k)
+        {
+            int grid = max(1, params.leaf_grid >> (2 * (k - 1)));
+            NodeGeometry reduced;
+            build_lod(coarse.mesh.vertices.data(), 3, (int)(coarse.mesh.vertices.size() / 3), coarse.mesh.indices.data(), (int)(coarse.mesh.indices.size() / 3), grid, reduced.mesh);
+            if (reduced.mesh.indices.empty())
+                break;
+            // a clustered vertex moves at most one cell diagonal
+            reduced.error = extent / grid * 1.7320508f;
+            write_level(ctx, reduced.mesh, reduced.error);
+            coarse.mesh.vertices.swap(reduced.mesh.vertices);
+            coarse.mesh.indices.swap(reduced.mesh.indices);
+            coarse.error = reduced.error;
+        }
+        node.level_num = (int)ctx.levels.size() - node.first_level;
+        ctx.nodes[index] = node;
+        return;
+    }
+
+    // keys are sorted, so every child octant is a contiguous run
+    int shift = 3 * (ctx.depth - level - 1);
+    vector<size_t> childBegin;
+    for (size_t k = begin; k < end; ++k)
+    {
+        if (k == begin || ((ctx.keys[k] >> shift) & 7) != ((ctx.keys[k - 1] >> shift) & 7))
+            childBegin.push_back(k);
+    }
+    childBegin.push_back(end);
+
+    int childNum = (int)childBegin.size() - 1;
+    int firstChild = (int)ctx.nodes.size();
+    ctx.nodes.resize(ctx.nodes.size() + childNum);
+
+    MeshLod merged;
+    float childError = 0.0f;
+    for (int c = 0; c < childNum; ++c)
+    {
+        NodeGeometry child;
+        build_node(ctx, firstChild + c, level + 1, childBegin[c], childBegin[c + 1], child);
+        unsigned int base = (unsigned int)(merged.vertices.size() / 3);
+        merged.vertices.insert(merged.vertices.end(), child.mesh.vertices.begin(), child.mesh.vertices.end());
+        for (size_t i = 0; i < child.mesh.indices.size(); ++i)
+        {
+            merged.indices.push_back(base + child.mesh.indices[i]);
+        }
+        childError = max(childError, child.error);
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        node.min[i] = 1e30f;
+        node.max[i] = -1e30f;
+        for (int c = 0; c < childNum; ++c)
+        {
+            node.min[i] = min(node.min[i], ctx.nodes[firstChild + c].min[i]);
+            node.max[i] = max(node.max[i], ctx.nodes[firstChild + c].max[i]);
+        }
+    }
+    float extent = max(node.max[0] - node.min[0], max(node.max[1] - node.min[1], node.max[2] - node.min[2]));
+
+    build_lod(merged.vertices.data(), 3, (int)(merged.vertices.size() / 3), merged.indices.data(), (int)(merged.indices.size() / 3), params.proxy_grid, coarse.mesh);
+    // errors accumulate, so a proxy is never finer than what it stands in for
+    coarse.error = childError + extent / params.proxy_grid * 1.7320508f;
+
+    node.first_child = firstChild;
+    node.child_num = childNum;
+    node.first_level = (int)ctx.levels.size();
+    node.level_num = 1;
+    write_level(ctx, coarse.mesh, coarse.error);
+    ctx.nodes[index] = node;
+    return;
+}
+
+// appends every buffered triangle to the spill file and frees the buffers
+static bool flush_buckets(unordered_map<uint32_t, CellBucket>& buckets, FILE* spill, size_t& spillBytes)
+{
+    for (unordered_map<uint32_t, CellBucket>::iterator it = buckets.begin(); it != buckets.end(); ++it)
+    {
+        CellBucket& bucket = it->second;
+        if (bucket.buffered.empty())
+            continue;
+
+        SpillBlock block;
+        block.offset = spillBytes;
+        block.triangle_num = bucket.buffered.size() / 9;
+        size_t bytes = sizeof(float) * bucket.buffered.size();
+        if (fwrite(bucket.buffered.data(), 1, bytes, spill) != bytes)
+            return false;
+        spillBytes += bytes;
+        bucket.blocks.push_back(block);
+        vector<float>().swap(bucket.buffered);
+    }
+    return true;
+}
+
+bool build_chunked_mesh(const char* ply_file, const char* output_file, const ChunkedMeshBuildParams& params, ChunkedMeshBuildReport& report, string& error)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    memset(&report, 0, sizeof(report));
+
+    FILE* source = fopen(ply_file, "rb");
+    if (source == NULL)
+    {
+        error = string("cannot open ") + ply_file;
+        return false;
+    }
+    FileReader reader;
+    reader.file = source;
+    reader.buffer.resize(1 << 20);
+    reader.pos = 0;
+    reader.end = 0;
+
+    PlyLayout layout = PlyLayout();
+    if (!read_ply_layout(reader, layout, error))
+    {
+        fclose(source);
+        return false;
+    }
+
+    // pass 1: vertices go to a flat xyz file that is mapped for the face pass
+    string vertexFile = string(output_file) + ".vertices.tmp";
+    string spillFile = string(output_file) + ".triangles.tmp";
+    FILE* vertexOut = fopen(vertexFile.c_str(), "wb");
+    if (vertexOut == NULL)
+    {
+        fclose(source);
+        error = "cannot write " + vertexFile;
+        return false;
+    }
+
+    float lo[3] = { 1e30f, 1e30f, 1e30f };
+    float hi[3] = { -1e30f, -1e30f, -1e30f };
+    string line;
+    vector<float> vertexBlock;
+    vertexBlock.reserve(3 * 65536);
+    bool ok = true;
+    for (long long v = 0; v < layout.vertex_num && ok; ++v)
+    {
+        float p[3];
+        if (!read_vertex(reader, layout, line, p))
+        {
+            error = "truncated vertex list";
+            ok = false;
+            break;
+        }
+        for (int i = 0; i < 3; ++i)
+        {
+            lo[i] = min(lo[i], p[i]);
+            hi[i] = max(hi[i], p[i]);
+        }
+        vertexBlock.insert(vertexBlock.end(), p, p + 3);
+        if (vertexBlock.size() == vertexBlock.capacity() || v + 1 == layout.vertex_num)
+        {
+            if (fwrite(vertexBlock.data(), sizeof(float), vertexBlock.size(), vertexOut) != vertexBlock.size())
+            {
+                error = "cannot write " + vertexFile;
+                ok = false;
+            }
+            vertexBlock.clear();
+        }
+    }
+    fclose(vertexOut);
+
+    MappedFile vertexMap;
+    if (ok && !vertexMap.open(vertexFile.c_str()))
+    {
+        error = "cannot map " + vertexFile;
+        ok = false;
+    }
+
+    // pass 2: fan triangulate and bin each triangle by its centroid into a leaf cell. Surfaces
+    // fill about four of the eight children per level, hence log4 for the depth.
+    double cellNum = (double)layout.face_num / max(1, params.leaf_faces);
+    int depth = cellNum > 1 ? (int)ceil(log(cellNum) / log(4.0)) : 0;
+    depth = min(depth, 10);
+    int side = 1 << depth;
+    float extent = max(hi[0] - lo[0], max(hi[1] - lo[1], hi[2] - lo[2]));
+    float scale = extent > 0 ? side / extent : 0.0f;
+
+    unordered_map<uint32_t, CellBucket> buckets;
+    FILE* spillOut = ok ? fopen(spillFile.c_str(), "wb") : NULL;
+    if (ok && spillOut == NULL)
+    {
+        error = "cannot write " + spillFile;
+        ok = false;
+    }
+
+    const float* positions = (const float*)vertexMap.get_data();
+    size_t bufferedBytes = 0;
+    size_t spillBytes = 0;
+    size_t flushBytes = max((size_t)1 << 20, params.memory_budget / 2); // vector growth may double it
+    long long sinceRelease = 0;
+    vector<unsigned long long> corners;
+    for (long long f = 0; f < layout.face_num && ok; ++f)
+    {
+        if (!read_face(reader, layout, line, corners))
+        {
+            error = "truncated face list";
+            ok = false;
+            break;
+        }
+
+        for (size_t k = 2; k < corners.size(); ++k)
+        {
+            unsigned long long a = corners[0], b = corners[k - 1], c = corners[k];
+            if (a >= (unsigned long long)layout.vertex_num || b >= (unsigned long long)layout.vertex_num || c >= (unsigned long long)layout.vertex_num)
+                continue;
+
+            float triangle[9];
+            memcpy(triangle, positions + 3 * a, sizeof(float) * 3);
+            memcpy(triangle + 3, positions + 3 * b, sizeof(float) * 3);
+            memcpy(triangle + 6, positions + 3 * c, sizeof(float) * 3);
+            uint32_t q[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                float centroid = (triangle[i] + triangle[3 + i] + triangle[6 + i]) / 3.0f;
+                q[i] = (uint32_t)max(0, min(side - 1, (int)((centroid - lo[i]) * scale)));
+            }
+            uint32_t key = spread_bits(q[0]) << 2 | spread_bits(q[1]) << 1 | spread_bits(q[2]);
+
+            vector<float>& buffered = buckets[key].buffered;
+            buffered.insert(buffered.end(), triangle, triangle + 9);
+            bufferedBytes += sizeof(triangle);
+            report.face_num++;
+            sinceRelease++;
+        }
+
+        if (bufferedBytes >= flushBytes)
+        {
+            if (!flush_buckets(buckets, spillOut, spillBytes))
+            {
+                error = "cannot write " + spillFile;
+                ok = false;
+            }
+            bufferedBytes = 0;
+            sinceRelease = 1 << 22;
+        }
+        // random index order touches the whole vertex map, hand its pages back now and then
+        if (sinceRelease >= (1 << 22))
+        {
+            vertexMap.release(0, vertexMap.get_size());
+            sinceRelease = 0;
+        }
+    }
+    fclose(source);
+    if (ok && !flush_buckets(buckets, spillOut, spillBytes))
+    {
+        error = "cannot write " + spillFile;
+        ok = false;
+    }
+    if (spillOut != NULL)
+        fclose(spillOut);
+    vertexMap.close();
+    remove(vertexFile.c_str());
+
+    if (ok && report.face_num == 0)
+    {
+        error = "no valid faces";
+        ok = false;
+    }
+
+    BuildContext ctx;
+    ctx.params = &params;
+    ctx.depth = depth;
+    ctx.buckets = &buckets;
+    ctx.out = NULL;
+    ctx.out_bytes = 0;
+    ctx.write_failed = false;
+    if (ok && !ctx.spill.open(spillFile.c_str()))
+    {
+        error = "cannot map " + spillFile;
+        ok = false;
+    }
+    if (ok)
+    {
+        ctx.out = fopen(output_file, "wb");
+        if (ctx.out == NULL)
+        {
+            error = string("cannot write ") + output_file;
+            ok = false;
+        }
+    }
+
+    if (ok)
+    {
+        for (unordered_map<uint32_t, CellBucket>::iterator it = buckets.begin(); it != buckets.end(); ++it)
+        {
+            ctx.keys.push_back(it->first);
+        }
+        sort(ctx.keys.begin(), ctx.keys.end());
+
+        // header first as a placeholder, patched once the tables are known
+        ChunkedMeshHeader header;
+        memset(&header, 0, sizeof(header));
+        fwrite(&header, sizeof(header), 1, ctx.out);
+        ctx.out_bytes = sizeof(header);
+
+        ctx.nodes.resize(1);
+        NodeGeometry root;
+        build_node(ctx, 0, 0, 0, ctx.keys.size(), root);
+
+        header.magic = CHUNKED_MESH_MAGIC;
+        header.version = CHUNKED_MESH_VERSION;
+        header.node_num = (unsigned int)ctx.nodes.size();
+        header.level_num = (unsigned int)ctx.levels.size();
+        for (int i = 0; i < 3; ++i)
+        {
+            header.min[i] = ctx.nodes[0].min[i];
+            header.max[i] = ctx.nodes[0].max[i];
+        }
+        header.source_faces = (unsigned long long)report.face_num;
+        header.node_offset = ctx.out_bytes;
+        fwrite(ctx.nodes.data(), sizeof(ChunkedMeshNode), ctx.nodes.size(), ctx.out);
+        ctx.out_bytes += sizeof(ChunkedMeshNode) * ctx.nodes.size();
+        header.level_offset = ctx.out_bytes;
+        fwrite(ctx.levels.data(), sizeof(ChunkedMeshLevel), ctx.levels.size(), ctx.out);
+        ctx.out_bytes += sizeof(ChunkedMeshLevel) * ctx.levels.size();
+        fseek(ctx.out, 0, SEEK_SET);
+        if (fwrite(&header, sizeof(header), 1, ctx.out) != 1 || ctx.write_failed)
+        {
+            error = string("cannot write ") + output_file;
+            ok = false;
+        }
+    }
+    if (ctx.out != NULL && fclose(ctx.out) != 0)
+    {
+        error = string("cannot write ") + output_file;
+        ok = false;
+    }
+    ctx.spill.close();
+    remove(spillFile.c_str());
+    if (!ok)
+    {
+        remove(output_file);
+        return false;
+    }
+
+    report.vertex_num = layout.vertex_num;
+    report.leaf_num = (int)ctx.keys.size();
+    report.node_num = (int)ctx.nodes.size();
+    report.output_bytes = ctx.out_bytes;
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    report.peak_rss_bytes = get_peak_rss();
+    return true;
+}
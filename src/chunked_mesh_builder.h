@@ -0,0 +1,34 @@
+#ifndef CHUNKED_MESH_BUILDER_H
+#define CHUNKED_MESH_BUILDER_H
+
+#include <cstddef>
+#include <string>
+
+struct ChunkedMeshBuildParams
+{
+    int leaf_faces; // target triangles per leaf chunk
+    int lod_num; // levels per leaf, full resolution included
+    int leaf_grid; // clustering grid of the first reduced leaf level, each further level a quarter of it
+    int proxy_grid; // clustering grid of inner node proxies
+    size_t memory_budget; // triangles buffered per pass before they are spilled to disk
+};
+
+struct ChunkedMeshBuildReport
+{
+    long long vertex_num;
+    long long face_num; // triangles after fan triangulation
+    int leaf_num;
+    int node_num;
+    size_t output_bytes;
+    double seconds;
+    size_t peak_rss_bytes; // 0 where the platform does not expose it
+};
+
+void set_default_chunked_mesh_params(ChunkedMeshBuildParams& params);
+
+// converts a PLY of any size (ascii or binary little endian) into a chunked mesh file. Memory
+// stays bounded by the budget: vertices go to a temporary file that is mapped, triangles are
+// bucketed into octree cells and spilled, and every leaf is then welded and reduced on its own.
+bool build_chunked_mesh(const char* ply_file, const char* output_file, const ChunkedMeshBuildParams& params, ChunkedMeshBuildReport& report, std::string& error);
+
+#endif
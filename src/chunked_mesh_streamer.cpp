@@ -0,0 +1,439 @@
+#include "chunked_mesh_streamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+
+#include <glad/glad.h>
+
+#include "frame_profiler.h"
+
+using namespace std;
+
+ChunkedMeshStreamer::ChunkedMeshStreamer()
+{
+    memset(&this->header, 0, sizeof(this->header));
+    this->gpu_budget = 0;
+    this->uploads_per_frame = 1;
+    this->pixel_error = 1.0f;
+    this->frame = 0;
+    this->initialized = false;
+    this->stats = ChunkedMeshStats();
+    return;
+}
+
+bool ChunkedMeshStreamer::init(const char* filename, size_t gpu_budget, int uploads_per_frame, float pixel_error)
+{
+    this->destroy();
+    if (!this->file.open(filename))
+        return false;
+
+    // the tables are small and read once, the geometry stays in the mapping
+    const unsigned char* data = this->file.get_data();
+    size_t size = this->file.get_size();
+    if (size < sizeof(ChunkedMeshHeader))
+    {
+        this->file.close();
+        return false;
+    }
+    memcpy(&this->header, data, sizeof(this->header));
+    if (this->header.magic != CHUNKED_MESH_MAGIC || this->header.version != CHUNKED_MESH_VERSION || this->header.node_num == 0
+        || this->header.node_offset + sizeof(ChunkedMeshNode) * this->header.node_num > size
+        || this->header.level_offset + sizeof(ChunkedMeshLevel) * this->header.level_num > size)
+    {
+        this->file.close();
+        return false;
+    }
+    this->nodes.resize(this->header.node_num);
+    memcpy(this->nodes.data(), data + this->header.node_offset, sizeof(ChunkedMeshNode) * this->header.node_num);
+    this->levels.resize(this->header.level_num);
+    memcpy(this->levels.data(), data + this->header.level_offset, sizeof(ChunkedMeshLevel) * this->header.level_num);
+    for (size_t i = 0; i < this->levels.size(); ++i)
+    {
+        const ChunkedMeshLevel& level = this->levels[i];
+        if (level.offset + sizeof(float) * 6 * level.vertex_num + sizeof(unsigned int) * level.index_num > size)
+        {
+            this->file.close();
+            return false;
+        }
+    }
+    // traversal trusts these, children always come after their parent so it cannot loop
+    long long nodeNum = (long long)this->nodes.size(), levelNum = (long long)this->levels.size();
+    for (long long i = 0; i < nodeNum; ++i)
+    {
+        const ChunkedMeshNode& node = this->nodes[i];
+        bool levelsValid = node.first_level >= 0 && node.level_num > 0 && (long long)node.first_level + node.level_num <= levelNum;
+        bool childrenValid = node.first_child < 0 || (node.first_child > i && node.child_num > 0 && (long long)node.first_child + node.child_num <= nodeNum);
+        if (!levelsValid || !childrenValid)
+        {
+            this->file.close();
+            return false;
+        }
+    }
+    this->file.release(0, size);
+
+    LevelSlot empty;
+    memset(&empty, 0, sizeof(empty));
+    this->slots.assign(this->levels.size(), empty);
+    this->gpu_budget = gpu_budget;
+    this->uploads_per_frame = max(1, uploads_per_frame);
+    this->pixel_error = pixel_error;
+    this->frame = 0;
+    this->stats = ChunkedMeshStats();
+    this->stats.node_num = (int)this->nodes.size();
+    this->stats.gpu_budget = gpu_budget;
+    this->initialized = true;
+
+    // the coarsest root level is pinned, so there is always something to draw
+    const ChunkedMeshNode& root = this->nodes[0];
+    this->upload(root.first_level + root.level_num - 1);
+    return true;
+}
+
+void ChunkedMeshStreamer::destroy()
+{
+    if (!this->initialized)
+        return;
+
+    for (size_t i = 0; i < this->slots.size(); ++i)
+    {
+        this->release_level((int)i);
+    }
+    this->slots.clear();
+    this->targets.clear();
+    this->nodes.clear();
+    this->levels.clear();
+    this->selected.clear();
+    this->requests.clear();
+    this->file.close();
+    this->initialized = false;
+    return;
+}
+
+void ChunkedMeshStreamer::update(const Frustum& frustum, const float camera[3], float pixel_scale, bool wait)
+{
+    if (!this->initialized)
+        return;
+
+    this->frame++;
+    this->plan(frustum, camera, pixel_scale);
+    int uploaded = 0;
+    while (true)
+    {
+        this->selected.clear();
+        this->requests.clear();
+        this->select(0, camera, pixel_scale);
+        for (size_t i = 0; i < this->selected.size(); ++i)
+        {
+            this->slots[this->selected[i]].last_used = this->frame;
+        }
+
+        // the most visible errors first
+        sort(this->requests.begin(), this->requests.end(), [](const pair<float, int>& a, const pair<float, int>& b) { return a.first > b.first; });
+        int passUploads = 0;
+        for (size_t i = 0; i < this->requests.size(); ++i)
+        {
+            if (!wait && uploaded >= this->uploads_per_frame)
+                break;
+            int level = this->requests[i].second;
+            if (this->slots[level].resident)
+                continue;
+            if (!this->upload(level))
+                break;
+            uploaded++;
+            passUploads++;
+        }
+        if (!wait || passUploads == 0)
+            break;
+    }
+
+    this->stats.wanted = 0;
+    for (size_t i = 0; i < this->requests.size(); ++i)
+    {
+        if (!this->slots[this->requests[i].second].resident)
+            this->stats.wanted++;
+    }
+    return;
+}
+
+void ChunkedMeshStreamer::draw()
+{
+    this->stats.drawn = 0;
+    this->stats.triangles = 0;
+    for (size_t i = 0; i < this->selected.size(); ++i)
+    {
+        const LevelSlot& slot = this->slots[this->selected[i]];
+        if (!slot.resident || slot.vao == 0)
+            continue;
+
+        int count = (int)this->levels[this->selected[i]].index_num;
+        glBindVertexArray(slot.vao);
+        glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, 0);
+        count_draw(count / 3);
+        this->stats.drawn++;
+        this->stats.triangles += count / 3;
+    }
+    glBindVertexArray(0);
+    return;
+}
+
+bool ChunkedMeshStreamer::is_loaded() const
+{
+    return this->initialized;
+}
+
+void ChunkedMeshStreamer::get_bounds(float min[3], float max[3]) const
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        min[i] = this->header.min[i];
+        max[i] = this->header.max[i];
+    }
+    return;
+}
+
+void ChunkedMeshStreamer::get_stats(ChunkedMeshStats& stats)
+{
+    stats = this->stats;
+    this->stats.uploaded = 0;
+    this->stats.evicted = 0;
+    return;
+}
+
+size_t ChunkedMeshStreamer::level_bytes(int level) const
+{
+    return sizeof(float) * 6 * this->levels[level].vertex_num + sizeof(unsigned int) * this->levels[level].index_num;
+}
+
+float ChunkedMeshStreamer::projected_error(int level, const ChunkedMeshNode& node, const float camera[3], float pixel_scale) const
+{
+    float distance2 = 0.0f;
+    for (int i = 0; i < 3; ++i)
+    {
+        float d = max(node.min[i] - camera[i], max(0.0f, camera[i] - node.max[i]));
+        distance2 += d * d;
+    }
+    return this->levels[level].error * pixel_scale / max(sqrtf(distance2), 1e-4f);
+}
+
+bool ChunkedMeshStreamer::can_draw(int node) const
+{
+    const ChunkedMeshNode& info = this->nodes[node];
+    if (info.first_child >= 0)
+        return this->slots[info.first_level].resident;
+    return this->nearest_resident(info, info.first_level) >= 0;
+}
+
+// the resident leaf level closest to the wanted one, coarser before finer
+int ChunkedMeshStreamer::nearest_resident(const ChunkedMeshNode& node, int level) const
+{
+    int last = node.first_level + node.level_num - 1;
+    for (int d = 0; d < node.level_num; ++d)
+    {
+        if (level + d <= last && this->slots[level + d].resident)
+            return level + d;
+        if (d > 0 && level - d >= node.first_level && this->slots[level - d].resident)
+            return level - d;
+    }
+    return -1;
+}
+
+// the cut the camera wants, independent of what is resident. A quarter of the budget is left
+// for the levels still drawn while that cut streams in, so planning never starves uploads.
+void ChunkedMeshStreamer::plan(const Frustum& frustum, const float camera[3], float pixel_scale)
+{
+    this->targets.assign(this->nodes.size(), HIDDEN);
+    const ChunkedMeshNode& root = this->nodes[0];
+    if (!aabb_in_frustum(frustum, root.min, root.max))
+        return;
+
+    size_t limit = this->gpu_budget / 4 * 3;
+    priority_queue<pair<float, int> > candidates;
+    this->targets[0] = root.first_level + root.level_num - 1;
+    size_t bytes = this->level_bytes(this->targets[0]);
+    float error = this->projected_error(this->targets[0], root, camera, pixel_scale);
+    if (error > this->pixel_error)
+        candidates.push(make_pair(error, 0));
+
+    while (!candidates.empty())
+    {
+        int node = candidates.top().second;
+        candidates.pop();
+        const ChunkedMeshNode& info = this->nodes[node];
+        size_t current = this->level_bytes(this->targets[node]);
+
+        if (info.first_child < 0)
+        {
+            // leaf levels get finer towards first_level
+            int finer = this->targets[node] - 1;
+            if (finer < info.first_level || bytes - current + this->level_bytes(finer) > limit)
+                continue;
+            bytes = bytes - current + this->level_bytes(finer);
+            this->targets[node] = finer;
+            error = this->projected_error(finer, info, camera, pixel_scale);
+            if (error > this->pixel_error)
+                candidates.push(make_pair(error, node));
+            continue;
+        }
+
+        size_t childBytes = 0;
+        for (int c = info.first_child; c < info.first_child + info.child_num; ++c)
+        {
+            const ChunkedMeshNode& child = this->nodes[c];
+            if (aabb_in_frustum(frustum, child.min, child.max))
+                childBytes += this->level_bytes(child.first_level + child.level_num - 1);
+        }
+        if (bytes - current + childBytes > limit)
+            continue;
+        bytes = bytes - current + childBytes;
+        this->targets[node] = REFINED;
+        for (int c = info.first_child; c < info.first_child + info.child_num; ++c)
+        {
+            const ChunkedMeshNode& child = this->nodes[c];
+            if (!aabb_in_frustum(frustum, child.min, child.max))
+                continue;
+            this->targets[c] = child.first_level + child.level_num - 1;
+            error = this->projected_error(this->targets[c], child, camera, pixel_scale);
+            if (error > this->pixel_error)
+                candidates.push(make_pair(error, c));
+        }
+    }
+    return;
+}
+
+// draws the planned cut where it is resident and falls back to coarser levels where it is not
+void ChunkedMeshStreamer::select(int node, const float camera[3], float pixel_scale)
+{
+    const ChunkedMeshNode& info = this->nodes[node];
+    int target = this->targets[node];
+    if (target == HIDDEN)
+        return;
+
+    if (info.first_child < 0)
+    {
+        int drawn = target;
+        if (!this->slots[target].resident)
+        {
+            this->request(target, this->projected_error(info.first_level + info.level_num - 1, info, camera, pixel_scale));
+            drawn = this->nearest_resident(info, target);
+        }
+        if (drawn >= 0)
+            this->selected.push_back(drawn);
+        return;
+    }
+
+    float error = this->projected_error(info.first_level, info, camera, pixel_scale);
+    if (target == REFINED)
+    {
+        bool ready = true;
+        for (int c = info.first_child; c < info.first_child + info.child_num; ++c)
+        {
+            if (this->targets[c] == HIDDEN || this->can_draw(c))
+                continue;
+            ready = false;
+            // a refined child still needs its own proxy first
+            this->request(this->targets[c] == REFINED ? this->nodes[c].first_level : this->targets[c], error);
+        }
+        if (ready)
+        {
+            for (int c = info.first_child; c < info.first_child + info.child_num; ++c)
+            {
+                this->select(c, camera, pixel_scale);
+            }
+            return;
+        }
+    }
+
+    if (this->slots[info.first_level].resident)
+        this->selected.push_back(info.first_level);
+    else
+        this->request(info.first_level, error);
+    return;
+}
+
+void ChunkedMeshStreamer::request(int level, float priority)
+{
+    this->requests.push_back(make_pair(priority, level));
+    return;
+}
+
+bool ChunkedMeshStreamer::upload(int level)
+{
+    const ChunkedMeshLevel& info = this->levels[level];
+    size_t vertexBytes = sizeof(float) * 6 * info.vertex_num;
+    size_t indexBytes = sizeof(unsigned int) * info.index_num;
+    if (!this->evict_for(vertexBytes + indexBytes))
+        return false;
+
+    LevelSlot& slot = this->slots[level];
+    if (info.index_num > 0)
+    {
+        const unsigned char* data = this->file.get_data() + info.offset;
+        glGenVertexArrays(1, &slot.vao);
+        glGenBuffers(1, &slot.vbo);
+        glGenBuffers(1, &slot.ebo);
+        glBindVertexArray(slot.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, slot.vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, data, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, slot.ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, data + vertexBytes, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        // the driver has its copy, drop the pages so the mapping never grows resident memory
+        this->file.release(info.offset, vertexBytes + indexBytes);
+    }
+
+    slot.bytes = vertexBytes + indexBytes;
+    slot.last_used = this->frame;
+    slot.resident = true;
+    this->stats.resident++;
+    this->stats.uploaded++;
+    this->stats.gpu_bytes += slot.bytes;
+    return true;
+}
+
+// least recently drawn levels go first, never one drawn this frame or the pinned root level
+bool ChunkedMeshStreamer::evict_for(size_t bytes)
+{
+    int pinned = this->nodes[0].first_level + this->nodes[0].level_num - 1;
+    while (this->stats.gpu_bytes + bytes > this->gpu_budget)
+    {
+        int victim = -1;
+        for (size_t i = 0; i < this->slots.size(); ++i)
+        {
+            const LevelSlot& slot = this->slots[i];
+            if (!slot.resident || slot.last_used >= this->frame || (int)i == pinned)
+                continue;
+            if (victim < 0 || slot.last_used < this->slots[victim].last_used)
+                victim = (int)i;
+        }
+        if (victim < 0)
+            return this->stats.resident == 0; // a first level bigger than the budget still loads
+        this->release_level(victim);
+        this->stats.evicted++;
+    }
+    return true;
+}
+
+void ChunkedMeshStreamer::release_level(int level)
+{
+    LevelSlot& slot = this->slots[level];
+    if (!slot.resident)
+        return;
+
+    if (slot.vao != 0)
+    {
+        glDeleteVertexArrays(1, &slot.vao);
+        glDeleteBuffers(1, &slot.vbo);
+        glDeleteBuffers(1, &slot.ebo);
+    }
+    this->stats.resident--;
+    this->stats.gpu_bytes -= slot.bytes;
+    memset(&slot, 0, sizeof(slot));
+    return;
+}
@@ -0,0 +1,87 @@
+#ifndef CHUNKED_MESH_STREAMER_H
+#define CHUNKED_MESH_STREAMER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "chunked_mesh.h"
+#include "frustum.h"
+
+struct ChunkedMeshStats
+{
+    int node_num;
+    int resident; // levels on the GPU
+    int drawn;
+    int wanted; // selected levels still waiting for their upload
+    int uploaded; // since the last get_stats
+    int evicted; // since the last get_stats
+    long long triangles;
+    size_t gpu_bytes;
+    size_t gpu_budget;
+};
+
+// draws a chunked mesh file far bigger than memory. The file is mapped, not read: every frame
+// the node tree is refined, largest screen-space error first, until the error bound is met or
+// the planned levels would fill three quarters of the GPU budget. Missing levels are uploaded
+// straight from the mapping (a few per frame) and the least recently drawn ones are evicted.
+// A node only refines once all its visible children can draw, until then its own proxy stands
+// in for them, so the surface never shows holes.
+class ChunkedMeshStreamer
+{
+public:
+    ChunkedMeshStreamer();
+
+    bool init(const char* filename, size_t gpu_budget, int uploads_per_frame, float pixel_error);
+    void destroy();
+
+    // frustum and camera in the mesh's local space; pixel_scale is viewport height / (2 tan(fovy / 2)).
+    // wait uploads until the selection is complete, for deterministic headless frames
+    void update(const Frustum& frustum, const float camera[3], float pixel_scale, bool wait);
+    void draw(); // position at location 0, normal at 1
+
+    bool is_loaded() const;
+    void get_bounds(float min[3], float max[3]) const;
+    void get_stats(ChunkedMeshStats& stats);
+
+private:
+    struct LevelSlot
+    {
+        unsigned int vao;
+        unsigned int vbo;
+        unsigned int ebo;
+        size_t bytes;
+        unsigned long long last_used;
+        bool resident;
+    };
+
+    MappedFile file;
+    ChunkedMeshHeader header;
+    std::vector<ChunkedMeshNode> nodes;
+    std::vector<ChunkedMeshLevel> levels;
+    std::vector<LevelSlot> slots; // one per level
+    std::vector<int> targets; // per node: the planned level, or HIDDEN / REFINED
+    std::vector<int> selected;
+    std::vector<std::pair<float, int> > requests; // projected error, level
+    size_t gpu_budget;
+    int uploads_per_frame;
+    float pixel_error;
+    unsigned long long frame;
+    bool initialized;
+
+    ChunkedMeshStats stats;
+
+    enum { HIDDEN = -1, REFINED = -2 };
+
+    size_t level_bytes(int level) const;
+    float projected_error(int level, const ChunkedMeshNode& node, const float camera[3], float pixel_scale) const;
+    void plan(const Frustum& frustum, const float camera[3], float pixel_scale);
+    bool can_draw(int node) const;
+    int nearest_resident(const ChunkedMeshNode& node, int level) const;
+    void select(int node, const float camera[3], float pixel_scale);
+    void request(int level, float priority);
+    bool upload(int level);
+    bool evict_for(size_t bytes);
+    void release_level(int level);
+};
+
+#endif
@@ -0,0 +1,9 @@
+#include "collision.h"
+
+bool check_collision(float ax, float az, float aSize, float bx, float bz, float bSize) 
+{
+    bool collisionX = ax + aSize >= bx && bx + bSize >= ax;
+    bool collisionZ = az + aSize >= bz && bz + bSize >= az;
+
+    return collisionX && collisionZ;
+}
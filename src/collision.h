@@ -0,0 +1,7 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+// 2D AABB overlap on the ground plane, boxes given by min corner and edge length
+bool check_collision(float ax, float az, float aSize, float bx, float bz, float bSize);
+
+#endif
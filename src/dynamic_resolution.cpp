@@ -0,0 +1,211 @@
+#include "dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glad/glad.h>
+
+using namespace std;
+
+static const int QUALITY_LEVELS = 3;
+static const float SCALE_STEP = 0.05f; // scales stay on a grid so small jitters do not reallocate anything
+static const double RECOVER_HEADROOM = 0.75; // step back up only below this share of the budget
+static const double MAX_SAMPLE_MS = 1000.0; // longer GPU frames are broken queries or stalls, not load
+
+ResolutionGovernor::ResolutionGovernor()
+{
+    this->budget_ms = 16.6;
+    this->smoothed_ms = 0.0;
+    this->scale = 1.0f;
+    this->min_scale = 0.5f;
+    this->quality_level = 0;
+    this->settle_frames = 8;
+    this->frames_since_change = 0;
+    this->sample_num = 0;
+    this->changes = 0;
+    return;
+}
+
+void ResolutionGovernor::init(double budget_ms, float min_scale, int settle_frames)
+{
+    this->budget_ms = budget_ms;
+    this->min_scale = max(SCALE_STEP, min(min_scale, 1.0f));
+    this->settle_frames = max(1, settle_frames);
+    this->scale = 1.0f;
+    this->quality_level = 0;
+    this->smoothed_ms = 0.0;
+    this->frames_since_change = 0;
+    this->sample_num = 0;
+    this->changes = 0;
+    return;
+}
+
+void ResolutionGovernor::set_budget(double budget_ms)
+{
+    this->budget_ms = budget_ms;
+    return;
+}
+
+void ResolutionGovernor::add_sample(double gpu_ms)
+{
+    // a broken reading would seed or drag the average for hundreds of frames; the negated test also drops NaN
+    if (!(gpu_ms >= 0.0 && gpu_ms <= MAX_SAMPLE_MS))
+        return;
+
+    // exponential moving average, single slow frames should not move the scale
+    if (this->sample_num == 0)
+        this->smoothed_ms = gpu_ms;
+    else
+        this->smoothed_ms += 0.2 * (gpu_ms - this->smoothed_ms);
+    this->sample_num++;
+    this->frames_since_change++;
+    if (this->frames_since_change < this->settle_frames || this->budget_ms <= 0.0)
+        return;
+
+    float oldScale = this->scale;
+    int oldLevel = this->quality_level;
+    if (this->smoothed_ms > this->budget_ms)
+    {
+        // pixel cost goes with the area, so the side shrinks by the square root of the overshoot
+        float target = this->scale * (float)sqrt(this->budget_ms / this->smoothed_ms);
+        float stepped = floor(target / SCALE_STEP) * SCALE_STEP;
+        stepped = min(stepped, this->scale - SCALE_STEP);
+        if (this->scale > this->min_scale)
+            this->scale = max(this->min_scale, stepped);
+        else if (this->quality_level < QUALITY_LEVELS - 1)
+            this->quality_level++;
+    }
+    else if (this->smoothed_ms < this->budget_ms * RECOVER_HEADROOM)
+    {
+        if (this->quality_level > 0)
+            this->quality_level--;
+        else if (this->scale < 1.0f)
+            this->scale = min(1.0f, this->scale + SCALE_STEP);
+    }
+
+    if (this->scale != oldScale || this->quality_level != oldLevel)
+    {
+        this->frames_since_change = 0;
+        this->changes++;
+    }
+    return;
+}
+
+float ResolutionGovernor::get_scale() const
+{
+    return this->scale;
+}
+
+float ResolutionGovernor::get_lod_bias() const
+{
+    return 1.0f + 0.5f * this->quality_level;
+}
+
+int ResolutionGovernor::get_shadow_radius() const
+{
+    return this->quality_level > 0 ? 0 : 1;
+}
+
+void ResolutionGovernor::get_stats(GovernorStats& stats) const
+{
+    stats.scale = this->scale;
+    stats.quality_level = this->quality_level;
+    stats.smoothed_ms = this->smoothed_ms;
+    stats.budget_ms = this->budget_ms;
+    stats.changes = this->changes;
+    return;
+}
+
+ScaledRenderTarget::ScaledRenderTarget()
+{
+    this->fbo = 0;
+    this->color_texture = 0;
+    this->depth_rbo = 0;
+    this->width = 0;
+    this->height = 0;
+    this->active = false;
+    this->saved_fbo = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        this->output_viewport[i] = 0;
+    }
+    this->scaled_width = 0;
+    this->scaled_height = 0;
+    return;
+}
+
+void ScaledRenderTarget::destroy()
+{
+    if (this->fbo == 0)
+        return;
+
+    glDeleteFramebuffers(1, &this->fbo);
+    glDeleteTextures(1, &this->color_texture);
+    glDeleteRenderbuffers(1, &this->depth_rbo);
+    this->fbo = 0;
+    this->color_texture = 0;
+    this->depth_rbo = 0;
+    this->width = 0;
+    this->height = 0;
+    return;
+}
+
+void ScaledRenderTarget::begin(float scale)
+{
+    glGetIntegerv(GL_VIEWPORT, this->output_viewport);
+    this->active = scale < 1.0f;
+    if (!this->active)
+        return;
+
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &this->saved_fbo);
+    if (this->output_viewport[2] != this->width || this->output_viewport[3] != this->height)
+        this->resize(this->output_viewport[2], this->output_viewport[3]);
+
+    this->scaled_width = max(1, (int)(this->output_viewport[2] * scale + 0.5f));
+    this->scaled_height = max(1, (int)(this->output_viewport[3] * scale + 0.5f));
+    glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+    glViewport(0, 0, this->scaled_width, this->scaled_height);
+    return;
+}
+
+void ScaledRenderTarget::end()
+{
+    if (!this->active)
+        return;
+
+    const int* out = this->output_viewport;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, this->fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->saved_fbo);
+    glBlitFramebuffer(0, 0, this->scaled_width, this->scaled_height, out[0], out[1], out[0] + out[2], out[1] + out[3], GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->saved_fbo);
+    glViewport(out[0], out[1], out[2], out[3]);
+    this->active = false;
+    return;
+}
+
+// sized for full scale, so the governor can move between scales without reallocating
+void ScaledRenderTarget::resize(int width, int height)
+{
+    this->destroy();
+    this->width = width;
+    this->height = height;
+
+    glGenTextures(1, &this->color_texture);
+    glBindTexture(GL_TEXTURE_2D, this->color_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &this->depth_rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->depth_rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &this->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->color_texture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depth_rbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->saved_fbo);
+    return;
+}
@@ -0,0 +1,71 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+struct GovernorStats
+{
+    float scale; // internal resolution over the window's, per axis
+    int quality_level; // 0 is full LOD and shadow quality
+    double smoothed_ms; // GPU frame time the decisions are based on
+    double budget_ms;
+    int changes; // scale or quality steps so far
+};
+
+// holds a GPU frame time budget. Over budget it lowers the render scale first and, once the scale is at
+// its floor, steps down LOD and shadow quality; well under budget it undoes those in reverse order.
+// Decisions are spaced out because GPU times arrive a few frames late.
+class ResolutionGovernor
+{
+public:
+    ResolutionGovernor();
+
+    void init(double budget_ms, float min_scale, int settle_frames);
+    void set_budget(double budget_ms);
+    void add_sample(double gpu_ms);
+
+    float get_scale() const;
+    float get_lod_bias() const; // distances and screen errors are multiplied by this
+    int get_shadow_radius() const; // PCF kernel of (2r + 1)^2 taps
+    void get_stats(GovernorStats& stats) const;
+
+private:
+    double budget_ms;
+    double smoothed_ms;
+    float scale;
+    float min_scale;
+    int quality_level;
+    int settle_frames;
+    int frames_since_change;
+    int sample_num;
+    int changes;
+};
+
+// offscreen colour and depth at the window's size. Frames are drawn into its lower left corner at the
+// governor's scale, then blitted up to the caller's framebuffer with linear filtering.
+class ScaledRenderTarget
+{
+public:
+    ScaledRenderTarget();
+
+    void destroy();
+
+    // binds the target and sets the scaled viewport; at full scale it leaves the caller's framebuffer bound
+    void begin(float scale);
+    void end(); // upscale into the caller's framebuffer and viewport
+
+private:
+    unsigned int fbo;
+    unsigned int color_texture;
+    unsigned int depth_rbo;
+    int width;
+    int height;
+
+    bool active; // drawing into the target this frame
+    int saved_fbo;
+    int output_viewport[4];
+    int scaled_width;
+    int scaled_height;
+
+    void resize(int width, int height);
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "file_watcher.h"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#define FILE_WATCHER_INOTIFY 1
+#endif
+
+using namespace std;
+
+static const int SCAN_INTERVAL_MS = 250; // modification time polling only
+
+static filesystem::file_time_type get_write_time(const string& path)
+{
+    error_code error;
+    filesystem::file_time_type time = filesystem::last_write_time(path, error);
+    return error ? filesystem::file_time_type::min() : time;
+}
+
+FileWatcher::FileWatcher()
+{
+    this->inotify_fd = -1;
+    this->initialized = false;
+    return;
+}
+
+bool FileWatcher::init()
+{
+#if FILE_WATCHER_INOTIFY
+    this->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    this->last_scan = chrono::steady_clock::now();
+    this->initialized = true;
+    return true;
+}
+
+void FileWatcher::destroy()
+{
+    if (!this->initialized)
+        return;
+
+#if FILE_WATCHER_INOTIFY
+    if (this->inotify_fd >= 0)
+        close(this->inotify_fd); // drops every watch with it
+#endif
+    this->inotify_fd = -1;
+    this->files.clear();
+    this->initialized = false;
+    return;
+}
+
+int FileWatcher::add_file(const string& path)
+{
+    for (size_t i = 0; i < this->files.size(); ++i)
+    {
+        if (this->files[i].path == path)
+            return (int)i;
+    }
+
+    filesystem::path fullPath(path);
+    string directory = fullPath.parent_path().string();
+    WatchedFile file;
+    file.path = path;
+    file.name = fullPath.filename().string();
+    file.watch = -1;
+    file.write_time = get_write_time(path);
+#if FILE_WATCHER_INOTIFY
+    // one watch per directory, inotify hands back the same descriptor for a directory watched twice
+    if (this->inotify_fd >= 0)
+        file.watch = inotify_add_watch(this->inotify_fd, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+#endif
+
+    this->files.push_back(file);
+    return (int)this->files.size() - 1;
+}
+
+void FileWatcher::poll(vector<int>& changed)
+{
+    changed.clear();
+    if (!this->initialized)
+        return;
+
+#if FILE_WATCHER_INOTIFY
+    if (this->inotify_fd >= 0)
+    {
+        alignas(inotify_event) char buffer[4096];
+        while (true)
+        {
+            ssize_t length = read(this->inotify_fd, buffer, sizeof(buffer));
+            if (length <= 0)
+                break;
+
+            for (char* p = buffer; p < buffer + length;)
+            {
+                const inotify_event* event = (const inotify_event*)p;
+                p += sizeof(inotify_event) + event->len;
+                if (event->len == 0)
+                    continue;
+
+                for (size_t i = 0; i < this->files.size(); ++i)
+                {
+                    if (this->files[i].watch == event->wd && this->files[i].name == event->name)
+                        changed.push_back((int)i);
+                }
+            }
+        }
+    }
+#endif
+    this->scan_write_times(changed);
+
+    sort(changed.begin(), changed.end());
+    changed.erase(unique(changed.begin(), changed.end()), changed.end());
+    return;
+}
+
+const string& FileWatcher::get_path(int id)
+{
+    return this->files[id].path;
+}
+
+bool FileWatcher::is_native()
+{
+    return this->inotify_fd >= 0;
+}
+
+void FileWatcher::scan_write_times(vector<int>& changed)
+{
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if (chrono::duration_cast<chrono::milliseconds>(now - this->last_scan).count() < SCAN_INTERVAL_MS)
+        return;
+    this->last_scan = now;
+
+    for (size_t i = 0; i < this->files.size(); ++i)
+    {
+        WatchedFile& file = this->files[i];
+        if (file.watch >= 0)
+            continue;
+
+        filesystem::file_time_type time = get_write_time(file.path);
+        if (time != file.write_time)
+        {
+            file.write_time = time;
+            changed.push_back((int)i);
+        }
+    }
+    return;
+}
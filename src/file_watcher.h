@@ -0,0 +1,43 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// reports which of a set of files changed on disk. On Linux it watches the parent directories
+// with inotify (close-after-write and rename-into, so editors that save through a temporary file
+// are caught too); elsewhere it compares modification times a few times per second.
+class FileWatcher
+{
+public:
+    FileWatcher();
+
+    bool init();
+    void destroy();
+
+    int add_file(const std::string& path); // returns the id poll reports, the same id for the same path
+    void poll(std::vector<int>& changed); // never blocks, every changed id at most once
+
+    const std::string& get_path(int id);
+    bool is_native(); // false when falling back to polling modification times
+
+private:
+    struct WatchedFile
+    {
+        std::string path;
+        std::string name; // without the directory
+        int watch; // inotify watch of the directory, -1 when polling
+        std::filesystem::file_time_type write_time;
+    };
+
+    std::vector<WatchedFile> files;
+    int inotify_fd;
+    bool initialized;
+    std::chrono::steady_clock::time_point last_scan;
+
+    void scan_write_times(std::vector<int>& changed);
+};
+
+#endif
@@ -0,0 +1,417 @@
+#include "frame_profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+static const size_t MAX_TRACE_EVENTS = 1 << 16; // bounded history kept for export
+static const size_t MAX_TRACE_FRAMES = 600;
+static const size_t MAX_RECORD_FRAMES = 1 << 14;
+static const uint32_t GPU_TRACE_THREAD = 0xFFFF;
+
+FrameProfiler frameProfiler;
+DrawCounts frameDraws = DrawCounts();
+
+static thread_local ProfileRing* threadRing = NULL;
+
+ProfileRing::ProfileRing(uint32_t thread_id)
+{
+    this->head.store(0);
+    this->tail = 0;
+    this->thread_id = thread_id;
+    return;
+}
+
+void ProfileRing::push(const char* name, uint64_t start_ns, uint64_t end_ns)
+{
+    uint32_t h = this->head.load(memory_order_relaxed);
+    ProfileEvent& slot = this->events[h & (CAPACITY - 1)];
+    slot.name = name;
+    slot.start_ns = start_ns;
+    slot.end_ns = end_ns;
+    this->head.store(h + 1, memory_order_release);
+    return;
+}
+
+void ProfileRing::drain(vector<ProfileEvent>& out)
+{
+    uint32_t headNow = this->head.load(memory_order_acquire);
+    if (headNow - this->tail > CAPACITY)
+    {
+        this->tail = headNow - CAPACITY; // producer lapped us, the oldest events are lost
+    }
+
+    uint32_t first = this->tail;
+    size_t outStart = out.size();
+    for (uint32_t i = first; i != headNow; ++i)
+    {
+        out.push_back(this->events[i & (CAPACITY - 1)]);
+    }
+
+    // drop entries the producer may have overwritten while we were copying; while it writes index h,
+    // head is still h, so index i is unsafe once head reaches i + CAPACITY
+    uint32_t headAfter = this->head.load(memory_order_acquire);
+    if (headAfter - first >= CAPACITY)
+    {
+        size_t overwritten = min((size_t)(headAfter - first - CAPACITY + 1), out.size() - outStart);
+        out.erase(out.begin() + outStart, out.begin() + outStart + overwritten);
+    }
+
+    this->tail = headNow;
+    return;
+}
+
+uint32_t ProfileRing::get_thread_id()
+{
+    return this->thread_id;
+}
+
+RollingStat::RollingStat()
+{
+    this->count = 0;
+    this->next = 0;
+    for (int i = 0; i < WINDOW; ++i)
+    {
+        this->samples[i] = 0.0;
+    }
+    return;
+}
+
+void RollingStat::add_sample(double value)
+{
+    this->samples[this->next] = value;
+    this->next = (this->next + 1) % WINDOW;
+    if (this->count < WINDOW)
+    {
+        this->count++;
+    }
+    return;
+}
+
+double RollingStat::get_percentile(double p)
+{
+    if (this->count == 0)
+        return 0.0;
+
+    double sorted[WINDOW];
+    copy(this->samples, this->samples + this->count, sorted);
+    int k = (int)(p / 100.0 * (this->count - 1) + 0.5);
+    nth_element(sorted, sorted + k, sorted + this->count);
+    return sorted[k];
+}
+
+double RollingStat::get_last()
+{
+    if (this->count == 0)
+        return 0.0;
+
+    return this->samples[(this->next + WINDOW - 1) % WINDOW];
+}
+
+int RollingStat::get_count()
+{
+    return this->count;
+}
+
+FrameProfiler::FrameProfiler()
+{
+    this->frame_index = 0;
+    this->frame_start_ns = 0;
+    return;
+}
+
+uint64_t FrameProfiler::now_ns()
+{
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ProfileRing* FrameProfiler::get_thread_ring()
+{
+    if (threadRing == NULL)
+    {
+        lock_guard<mutex> lock(this->ring_mutex);
+        this->rings.push_back(unique_ptr<ProfileRing>(new ProfileRing((uint32_t)this->rings.size())));
+        threadRing = this->rings.back().get();
+    }
+    return threadRing;
+}
+
+void FrameProfiler::record_cpu_event(const char* name, uint64_t start_ns, uint64_t end_ns)
+{
+    this->get_thread_ring()->push(name, start_ns, end_ns);
+    return;
+}
+
+void FrameProfiler::begin_frame()
+{
+    this->frame_start_ns = now_ns();
+    reset_draw_counts();
+    this->frame_starts[this->frame_index] = this->frame_start_ns;
+    while (this->frame_starts.size() > MAX_TRACE_FRAMES)
+    {
+        this->frame_starts.erase(this->frame_starts.begin());
+    }
+    return;
+}
+
+void FrameProfiler::end_frame()
+{
+    uint64_t frameEnd = now_ns();
+    double cpuMs = (frameEnd - this->frame_start_ns) / 1.0e6;
+    this->cpu_frame_ms.add_sample(cpuMs);
+
+    FrameRecord& record = this->frame_records[this->frame_index];
+    record.cpu_ms = cpuMs;
+    record.gpu_ms = -1.0;
+    record.draw_calls = frameDraws.draw_calls;
+    record.triangles = frameDraws.triangles;
+    while (this->frame_records.size() > MAX_RECORD_FRAMES)
+    {
+        this->frame_records.erase(this->frame_records.begin());
+    }
+
+    this->drain_rings();
+    this->frame_index++;
+    return;
+}
+
+int FrameProfiler::get_scope_id(const char* name)
+{
+    map<const char*, int>::iterator it = this->scope_ids.find(name);
+    if (it != this->scope_ids.end())
+        return it->second;
+
+    // first sight of this literal; an equal name from another literal shares its statistic
+    RollingStat* stat = &this->pass_ms[string("cpu/") + name];
+    int id = -1;
+    for (size_t i = 0; i < this->scope_totals.size(); ++i)
+    {
+        if (this->scope_totals[i].stat == stat)
+            id = (int)i;
+    }
+    if (id < 0)
+    {
+        ScopeTotal total;
+        total.stat = stat;
+        total.frame_ns = 0;
+        total.touched = false;
+        id = (int)this->scope_totals.size();
+        this->scope_totals.push_back(total);
+    }
+    this->scope_ids[name] = id;
+    return id;
+}
+
+void FrameProfiler::drain_rings()
+{
+    lock_guard<mutex> lock(this->ring_mutex);
+    for (size_t r = 0; r < this->rings.size(); ++r)
+    {
+        this->drain_buffer.clear();
+        this->rings[r]->drain(this->drain_buffer);
+        for (size_t i = 0; i < this->drain_buffer.size(); ++i)
+        {
+            const ProfileEvent& e = this->drain_buffer[i];
+            this->trace_events.push_back(e);
+            this->trace_threads.push_back(this->rings[r]->get_thread_id());
+
+            int id = this->get_scope_id(e.name);
+            ScopeTotal& total = this->scope_totals[id];
+            if (!total.touched)
+            {
+                total.touched = true;
+                this->frame_scopes.push_back(id);
+            }
+            total.frame_ns += e.end_ns - e.start_ns;
+        }
+    }
+
+    while (this->trace_events.size() > MAX_TRACE_EVENTS)
+    {
+        this->trace_events.pop_front();
+        this->trace_threads.pop_front();
+    }
+
+    // per-scope time spent in this frame
+    for (size_t i = 0; i < this->frame_scopes.size(); ++i)
+    {
+        ScopeTotal& total = this->scope_totals[this->frame_scopes[i]];
+        total.stat->add_sample(total.frame_ns / 1.0e6);
+        total.frame_ns = 0;
+        total.touched = false;
+    }
+    this->frame_scopes.clear();
+    return;
+}
+
+void FrameProfiler::record_gpu_pass(const char* name, uint64_t frame_index, uint64_t elapsed_ns)
+{
+    GpuEvent e;
+    e.name = name;
+    e.frame_index = frame_index;
+    e.elapsed_ns = elapsed_ns;
+    this->gpu_events.push_back(e);
+    while (this->gpu_events.size() > MAX_TRACE_EVENTS)
+    {
+        this->gpu_events.pop_front();
+    }
+
+    map<const char*, RollingStat*>::iterator it = this->gpu_pass_stats.find(name);
+    if (it == this->gpu_pass_stats.end())
+    {
+        it = this->gpu_pass_stats.insert(make_pair(name, &this->pass_ms[string("gpu/") + name])).first;
+    }
+    it->second->add_sample(elapsed_ns / 1.0e6);
+    return;
+}
+
+void FrameProfiler::end_gpu_frame(uint64_t frame_index, uint64_t total_ns)
+{
+    this->gpu_frame_ms.add_sample(total_ns / 1.0e6);
+
+    map<uint64_t, FrameRecord>::iterator it = this->frame_records.find(frame_index);
+    if (it != this->frame_records.end())
+    {
+        it->second.gpu_ms = total_ns / 1.0e6;
+    }
+    return;
+}
+
+void FrameProfiler::record_value(const char* name, double value)
+{
+    map<const char*, RollingStat*>::iterator it = this->value_stats.find(name);
+    if (it == this->value_stats.end())
+    {
+        it = this->value_stats.insert(make_pair(name, &this->values[name])).first;
+    }
+    it->second->add_sample(value);
+    return;
+}
+
+void FrameProfiler::get_frame_stats(FrameStats& stats)
+{
+    stats.frames = this->cpu_frame_ms.get_count();
+    stats.cpu_p50_ms = this->cpu_frame_ms.get_percentile(50);
+    stats.cpu_p99_ms = this->cpu_frame_ms.get_percentile(99);
+    stats.gpu_p50_ms = this->gpu_frame_ms.get_percentile(50);
+    stats.gpu_p99_ms = this->gpu_frame_ms.get_percentile(99);
+    return;
+}
+
+double FrameProfiler::get_pass_percentile(const string& name, double p)
+{
+    map<string, RollingStat>::iterator it = this->pass_ms.find(name);
+    if (it == this->pass_ms.end())
+        return 0.0;
+
+    return it->second.get_percentile(p);
+}
+
+bool FrameProfiler::get_frame_record(uint64_t frame_index, FrameRecord& record)
+{
+    map<uint64_t, FrameRecord>::iterator it = this->frame_records.find(frame_index);
+    if (it == this->frame_records.end())
+        return false;
+
+    record = it->second;
+    return true;
+}
+
+double FrameProfiler::get_value_percentile(const string& name, double p)
+{
+    map<string, RollingStat>::iterator it = this->values.find(name);
+    if (it == this->values.end())
+        return 0.0;
+
+    return it->second.get_percentile(p);
+}
+
+uint64_t FrameProfiler::get_frame_index()
+{
+    return this->frame_index;
+}
+
+void FrameProfiler::print_frame_stats()
+{
+    FrameStats stats;
+    this->get_frame_stats(stats);
+
+    cout << "Frame Stats (last " << stats.frames << " frames): " << endl;
+    cout << "cpu p50 " << stats.cpu_p50_ms << " ms, p99 " << stats.cpu_p99_ms << " ms" << endl;
+    cout << "gpu p50 " << stats.gpu_p50_ms << " ms, p99 " << stats.gpu_p99_ms << " ms" << endl;
+    for (map<string, RollingStat>::iterator it = this->pass_ms.begin(); it != this->pass_ms.end(); ++it)
+    {
+        cout << "  " << it->first << ": p50 " << it->second.get_percentile(50) << " ms, p99 " << it->second.get_percentile(99) << " ms" << endl;
+    }
+    for (map<string, RollingStat>::iterator it = this->values.begin(); it != this->values.end(); ++it)
+    {
+        cout << "  " << it->first << ": p50 " << it->second.get_percentile(50) << ", last " << it->second.get_last() << endl;
+    }
+
+    return;
+}
+
+bool FrameProfiler::export_chrome_trace(const char* filename)
+{
+    ofstream trace(filename);
+    if (trace.fail())
+    {
+        cout << "Fail to open file: " << filename << endl;
+        return false;
+    }
+
+    uint64_t origin = this->frame_starts.empty() ? 0 : this->frame_starts.begin()->second;
+
+    trace << "{\"traceEvents\":[" << endl;
+    trace << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_TRACE_THREAD << ",\"args\":{\"name\":\"GPU\"}}";
+
+    for (size_t i = 0; i < this->trace_events.size(); ++i)
+    {
+        const ProfileEvent& e = this->trace_events[i];
+        if (e.start_ns < origin)
+            continue;
+
+        trace << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << this->trace_threads[i]
+            << ",\"ts\":" << (e.start_ns - origin) / 1000.0 << ",\"dur\":" << (e.end_ns - e.start_ns) / 1000.0 << "}";
+    }
+
+    // gpu passes only carry durations, so lay them out back to back from their frame start
+    uint64_t cursorFrame = (uint64_t)-1;
+    uint64_t cursor = 0;
+    for (size_t i = 0; i < this->gpu_events.size(); ++i)
+    {
+        const GpuEvent& e = this->gpu_events[i];
+        map<uint64_t, uint64_t>::iterator start = this->frame_starts.find(e.frame_index);
+        if (start == this->frame_starts.end())
+            continue;
+
+        if (e.frame_index != cursorFrame)
+        {
+            cursorFrame = e.frame_index;
+            cursor = start->second - origin;
+        }
+        trace << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << GPU_TRACE_THREAD
+            << ",\"ts\":" << cursor / 1000.0 << ",\"dur\":" << e.elapsed_ns / 1000.0 << "}";
+        cursor += e.elapsed_ns;
+    }
+
+    trace << "\n]}" << endl;
+    trace.close();
+    return true;
+}
+
+ProfileScope::ProfileScope(const char* name)
+{
+    this->name = name;
+    this->start_ns = FrameProfiler::now_ns();
+    return;
+}
+
+ProfileScope::~ProfileScope()
+{
+    frameProfiler.record_cpu_event(this->name, this->start_ns, FrameProfiler::now_ns());
+    return;
+}
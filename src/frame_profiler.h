@@ -0,0 +1,201 @@
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+// build with -DENABLE_FRAME_PROFILER=0 to compile every marker away
+#ifndef ENABLE_FRAME_PROFILER
+#define ENABLE_FRAME_PROFILER 1
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ProfileEvent
+{
+    const char* name; // must point to a string literal
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+// single-producer ring owned by one thread, drained by the frame owner
+class ProfileRing
+{
+public:
+    static const uint32_t CAPACITY = 4096; // power of two
+
+    ProfileRing(uint32_t thread_id);
+
+    void push(const char* name, uint64_t start_ns, uint64_t end_ns);
+    void drain(std::vector<ProfileEvent>& out);
+
+    uint32_t get_thread_id();
+
+private:
+    std::atomic<uint32_t> head; // written by the producer only
+    uint32_t tail; // read position of the consumer
+    uint32_t thread_id;
+    ProfileEvent events[CAPACITY];
+};
+
+// fixed window of samples for rolling percentiles
+class RollingStat
+{
+public:
+    static const int WINDOW = 240;
+
+    RollingStat();
+
+    void add_sample(double value);
+    double get_percentile(double p);
+    double get_last();
+    int get_count();
+
+private:
+    double samples[WINDOW];
+    int count;
+    int next;
+};
+
+struct FrameRecord
+{
+    double cpu_ms;
+    double gpu_ms; // negative until the timer queries resolve
+    int draw_calls;
+    long long triangles;
+};
+
+// draw calls and triangles of the current frame; counted in every build, the benchmark report reads them
+struct DrawCounts
+{
+    int draw_calls;
+    long long triangles;
+};
+
+extern DrawCounts frameDraws;
+
+inline void count_draw(int triangles)
+{
+    frameDraws.draw_calls++;
+    frameDraws.triangles += triangles;
+    return;
+}
+
+inline void reset_draw_counts()
+{
+    frameDraws.draw_calls = 0;
+    frameDraws.triangles = 0;
+    return;
+}
+
+struct FrameStats
+{
+    int frames;
+    double cpu_p50_ms;
+    double cpu_p99_ms;
+    double gpu_p50_ms;
+    double gpu_p99_ms;
+};
+
+class FrameProfiler
+{
+public:
+    FrameProfiler();
+
+    void begin_frame();
+    void end_frame();
+
+    // per-thread entry point used by ProfileScope
+    void record_cpu_event(const char* name, uint64_t start_ns, uint64_t end_ns);
+    // resolved GL timer results arrive here a few frames late
+    void record_gpu_pass(const char* name, uint64_t frame_index, uint64_t elapsed_ns);
+    void end_gpu_frame(uint64_t frame_index, uint64_t total_ns);
+
+    void record_value(const char* name, double value); // rolling per-frame statistic, e.g. a cull rate; name must be a literal
+
+    void get_frame_stats(FrameStats& stats);
+    double get_pass_percentile(const std::string& name, double p);
+    double get_value_percentile(const std::string& name, double p);
+    bool get_frame_record(uint64_t frame_index, FrameRecord& record);
+    uint64_t get_frame_index();
+
+    void print_frame_stats();
+    bool export_chrome_trace(const char* filename);
+
+    static uint64_t now_ns();
+
+private:
+    struct GpuEvent
+    {
+        const char* name;
+        uint64_t frame_index;
+        uint64_t elapsed_ns;
+    };
+
+    std::mutex ring_mutex; // only taken when a new thread registers
+    std::vector<std::unique_ptr<ProfileRing>> rings;
+
+    uint64_t frame_index;
+    uint64_t frame_start_ns;
+    std::map<uint64_t, uint64_t> frame_starts; // cpu start of recent frames, for gpu events
+    std::deque<ProfileEvent> trace_events;
+    std::deque<uint32_t> trace_threads;
+    std::deque<GpuEvent> gpu_events;
+    std::vector<ProfileEvent> drain_buffer;
+    std::map<uint64_t, FrameRecord> frame_records;
+
+    RollingStat cpu_frame_ms;
+    RollingStat gpu_frame_ms;
+    std::map<std::string, RollingStat> pass_ms;
+    std::map<std::string, RollingStat> values;
+
+    // cpu scope totals of the current frame; literals are resolved to a statistic once, by content
+    struct ScopeTotal
+    {
+        RollingStat* stat;
+        uint64_t frame_ns;
+        bool touched;
+    };
+    std::map<const char*, int> scope_ids;
+    std::vector<ScopeTotal> scope_totals;
+    std::vector<int> frame_scopes; // ids touched this frame
+    std::map<const char*, RollingStat*> gpu_pass_stats;
+    std::map<const char*, RollingStat*> value_stats;
+
+    ProfileRing* get_thread_ring();
+    int get_scope_id(const char* name);
+    void drain_rings();
+};
+
+extern FrameProfiler frameProfiler;
+
+class ProfileScope
+{
+public:
+    ProfileScope(const char* name);
+    ~ProfileScope();
+
+private:
+    const char* name;
+    uint64_t start_ns;
+};
+
+#if ENABLE_FRAME_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_BEGIN_FRAME() frameProfiler.begin_frame()
+#define PROFILE_END_FRAME() frameProfiler.end_frame()
+#define PROFILE_VALUE(name, value) frameProfiler.record_value(name, value)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_BEGIN_FRAME() ((void)0)
+#define PROFILE_END_FRAME() ((void)0)
+#define PROFILE_VALUE(name, value) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,235 @@
+#include "frame_ring_buffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <glad/glad.h>
+
+// buffer storage is GL 4.4 / ARB_buffer_storage, loaded by hand on a 3.3 context
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (APIENTRY* BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+using namespace std;
+
+FrameRingBuffer::FrameRingBuffer()
+{
+    this->buffer = 0;
+    this->texture = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        this->fences[i] = NULL;
+    }
+    this->mapped = NULL;
+    this->record_bytes = 0;
+    this->records_per_frame = 0;
+    this->frame_num = 0;
+    this->static_num = 0;
+    this->region = 0;
+    this->cursor = 0;
+    this->initialized = false;
+    this->stats = RingBufferStats();
+    return;
+}
+
+bool FrameRingBuffer::init(ShaderProcLoader loader, size_t record_bytes, int records_per_frame, int frame_num, int static_num)
+{
+    if (record_bytes == 0 || record_bytes % 16 != 0 || records_per_frame <= 0 || static_num < 0)
+        return false; // records are whole RGBA32F texels
+
+    this->record_bytes = record_bytes;
+    this->records_per_frame = records_per_frame;
+    this->frame_num = max(1, min(frame_num, 4));
+    this->static_num = static_num;
+    this->region = 0;
+    this->cursor = 0;
+    size_t bytes = record_bytes * (static_num + records_per_frame * this->frame_num);
+
+    glGenBuffers(1, &this->buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, this->buffer);
+    BufferStorageProc bufferStorage = NULL;
+    if (loader != NULL && has_gl_extension("GL_ARB_buffer_storage"))
+        bufferStorage = (BufferStorageProc)loader("glBufferStorage");
+    if (bufferStorage != NULL)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(GL_TEXTURE_BUFFER, bytes, NULL, flags);
+        this->mapped = (unsigned char*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, bytes, flags);
+    }
+    if (this->mapped == NULL)
+    {
+        // plain storage; an immutable buffer that failed to map cannot be respecified
+        if (bufferStorage != NULL)
+        {
+            glDeleteBuffers(1, &this->buffer);
+            glGenBuffers(1, &this->buffer);
+            glBindBuffer(GL_TEXTURE_BUFFER, this->buffer);
+        }
+        glBufferData(GL_TEXTURE_BUFFER, bytes, NULL, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glGenTextures(1, &this->texture);
+    glBindTexture(GL_TEXTURE_BUFFER, this->texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    this->stats = RingBufferStats();
+    this->stats.persistent = this->mapped != NULL;
+    this->initialized = true;
+    return true;
+}
+
+void FrameRingBuffer::destroy()
+{
+    if (!this->initialized)
+        return;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if (this->fences[i] != NULL)
+            glDeleteSync((GLsync)this->fences[i]);
+        this->fences[i] = NULL;
+    }
+    if (this->mapped != NULL)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, this->buffer);
+        glUnmapBuffer(GL_TEXTURE_BUFFER);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        this->mapped = NULL;
+    }
+    glDeleteTextures(1, &this->texture);
+    glDeleteBuffers(1, &this->buffer);
+    this->initialized = false;
+    return;
+}
+
+void FrameRingBuffer::begin_frame()
+{
+    this->stats.records = 0;
+    this->stats.overflows = 0;
+    this->stats.static_writes = 0;
+    this->stats.wait_ms = 0.0;
+    if (!this->initialized)
+        return;
+
+    this->cursor = 0;
+    GLsync fence = (GLsync)this->fences[this->region];
+    if (fence == NULL)
+        return;
+
+    // only stalls when the GPU is more than frame_num frames behind
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true)
+    {
+        GLenum result = glClientWaitSync(fence, flags, 1000000);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+            break;
+        flags = 0;
+    }
+    this->stats.wait_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    glDeleteSync(fence);
+    this->fences[this->region] = NULL;
+    return;
+}
+
+void FrameRingBuffer::end_frame()
+{
+    if (!this->initialized)
+        return;
+
+    this->fences[this->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    this->region = (this->region + 1) % this->frame_num;
+    return;
+}
+
+int FrameRingBuffer::push(const void* record)
+{
+    if (!this->initialized)
+        return -1;
+    if (this->cursor >= this->records_per_frame)
+    {
+        this->stats.overflows++;
+        return -1;
+    }
+
+    // the fence already guarantees the GPU is done with this region
+    int index = this->static_num + this->region * this->records_per_frame + this->cursor;
+    this->write(index, record);
+    this->cursor++;
+    this->stats.records++;
+    return index;
+}
+
+int FrameRingBuffer::set_static(int slot, const void* record)
+{
+    if (!this->initialized || slot < 0 || slot >= this->static_num)
+        return -1;
+
+    // earlier frames may still be drawing with the old record; buffer sub data is ordered by the driver
+    if (this->mapped != NULL)
+        this->wait_all();
+    this->write(slot, record);
+    this->stats.static_writes++;
+    return slot;
+}
+
+void FrameRingBuffer::write(int index, const void* record)
+{
+    size_t offset = this->record_bytes * index;
+    if (this->mapped != NULL)
+    {
+        // coherent: visible to every command issued after this write
+        memcpy(this->mapped + offset, record, this->record_bytes);
+    }
+    else
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, this->buffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, offset, this->record_bytes, record);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+    return;
+}
+
+// blocks until every fenced region is done, the fences stay for begin_frame to collect
+void FrameRingBuffer::wait_all()
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < this->frame_num; ++i)
+    {
+        GLsync fence = (GLsync)this->fences[i];
+        if (fence == NULL)
+            continue;
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (true)
+        {
+            GLenum result = glClientWaitSync(fence, flags, 1000000);
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+                break;
+            flags = 0;
+        }
+    }
+    this->stats.wait_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return;
+}
+
+void FrameRingBuffer::bind(int unit)
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, this->texture);
+    glActiveTexture(GL_TEXTURE0);
+    return;
+}
+
+void FrameRingBuffer::get_stats(RingBufferStats& stats)
+{
+    stats = this->stats;
+    return;
+}
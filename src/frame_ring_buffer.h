@@ -0,0 +1,58 @@
+#ifndef FRAME_RING_BUFFER_H
+#define FRAME_RING_BUFFER_H
+
+#include <cstddef>
+
+#include "shader_manager.h"
+
+struct RingBufferStats
+{
+    bool persistent; // ARB_buffer_storage mapping, otherwise glBufferSubData per record
+    int records; // written this frame
+    int overflows; // records that did not fit this frame
+    int static_writes; // static records rewritten this frame
+    double wait_ms; // blocked on the fence of the region being reused
+};
+
+// per-frame dynamic data as fixed-size records in an RGBA32F buffer texture, split into one region
+// per frame in flight. With ARB_buffer_storage the buffer is mapped once, persistently and
+// coherently, and records are written straight into it; a fence per region keeps the CPU from
+// overwriting what the GPU may still read, so no write ever waits on the driver.
+// Records that rarely change live in front of the ring and are only written when they do.
+// Shaders texelFetch a record by the absolute index push() or set_static() returns.
+class FrameRingBuffer
+{
+public:
+    FrameRingBuffer();
+
+    bool init(ShaderProcLoader loader, size_t record_bytes, int records_per_frame, int frame_num, int static_num);
+    void destroy();
+
+    void begin_frame(); // waits for the region three frames back, then writes start over
+    void end_frame(); // fences the region
+    int push(const void* record); // -1 when the region is full
+    int set_static(int slot, const void* record); // waits for frames in flight that may still read it
+    void bind(int unit);
+
+    void get_stats(RingBufferStats& stats);
+
+private:
+    unsigned int buffer;
+    unsigned int texture;
+    void* fences[4]; // GLsync of each region
+    unsigned char* mapped; // whole buffer, NULL without buffer storage
+    size_t record_bytes;
+    int records_per_frame;
+    int frame_num;
+    int static_num; // records before the first region
+    int region;
+    int cursor; // next record in the region
+    bool initialized;
+
+    RingBufferStats stats;
+
+    void write(int index, const void* record);
+    void wait_all();
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "frustum.h"
+
+#include <cmath>
+
+void extract_frustum(const float view_proj[16], Frustum& frustum)
+{
+    // rows of the matrix, m[col * 4 + row]
+    const float* m = view_proj;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int sign = 0; sign < 2; ++sign)
+        {
+            float* plane = frustum.planes[2 * i + sign];
+            float s = sign == 0 ? 1.0f : -1.0f;
+            for (int c = 0; c < 4; ++c)
+            {
+                plane[c] = m[c * 4 + 3] + s * m[c * 4 + i];
+            }
+
+            float length = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            for (int c = 0; c < 4; ++c)
+            {
+                plane[c] /= length;
+            }
+        }
+    }
+    return;
+}
+
+void transform_frustum(const Frustum& world, const float model[16], Frustum& local)
+{
+    // a plane p transforms as M^T p when points transform as M x
+    for (int i = 0; i < 6; ++i)
+    {
+        const float* p = world.planes[i];
+        float* out = local.planes[i];
+        for (int c = 0; c < 4; ++c)
+        {
+            out[c] = model[c * 4] * p[0] + model[c * 4 + 1] * p[1] + model[c * 4 + 2] * p[2] + model[c * 4 + 3] * p[3];
+        }
+
+        float length = sqrt(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+        for (int c = 0; c < 4; ++c)
+        {
+            out[c] /= length;
+        }
+    }
+    return;
+}
+
+bool sphere_in_frustum(const Frustum& frustum, const float center[3], float radius)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        const float* p = frustum.planes[i];
+        if (p[0] * center[0] + p[1] * center[1] + p[2] * center[2] + p[3] < -radius)
+            return false;
+    }
+    return true;
+}
+
+bool aabb_in_frustum(const Frustum& frustum, const float min[3], const float max[3])
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        // test the corner furthest along the plane normal
+        const float* p = frustum.planes[i];
+        float x = p[0] >= 0 ? max[0] : min[0];
+        float y = p[1] >= 0 ? max[1] : min[1];
+        float z = p[2] >= 0 ? max[2] : min[2];
+        if (p[0] * x + p[1] * y + p[2] * z + p[3] < 0)
+            return false;
+    }
+    return true;
+}
+
+void invert_affine(const float m[16], float out[16])
+{
+    // inverse of the upper 3x3 via cofactors, then the translation
+    float a = m[0], b = m[4], c = m[8];
+    float d = m[1], e = m[5], f = m[9];
+    float g = m[2], h = m[6], k = m[10];
+    float det = a * (e * k - f * h) - b * (d * k - f * g) + c * (d * h - e * g);
+    float inv = 1.0f / det;
+
+    out[0] = (e * k - f * h) * inv;
+    out[4] = (c * h - b * k) * inv;
+    out[8] = (b * f - c * e) * inv;
+    out[1] = (f * g - d * k) * inv;
+    out[5] = (a * k - c * g) * inv;
+    out[9] = (c * d - a * f) * inv;
+    out[2] = (d * h - e * g) * inv;
+    out[6] = (b * g - a * h) * inv;
+    out[10] = (a * e - b * d) * inv;
+
+    for (int r = 0; r < 3; ++r)
+    {
+        out[12 + r] = -(out[r] * m[12] + out[4 + r] * m[13] + out[8 + r] * m[14]);
+    }
+    out[3] = 0.0f;
+    out[7] = 0.0f;
+    out[11] = 0.0f;
+    out[15] = 1.0f;
+    return;
+}
+
+void transform_point(const float m[16], const float p[3], float out[3])
+{
+    for (int r = 0; r < 3; ++r)
+    {
+        out[r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] + m[12 + r];
+    }
+    return;
+}
+
+void multiply_matrices(const float a[16], const float b[16], float out[16])
+{
+    for (int col = 0; col < 4; ++col)
+    {
+        for (int row = 0; row < 4; ++row)
+        {
+            out[4 * col + row] = a[row] * b[4 * col] + a[4 + row] * b[4 * col + 1] + a[8 + row] * b[4 * col + 2] + a[12 + row] * b[4 * col + 3];
+        }
+    }
+    return;
+}
@@ -0,0 +1,25 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+// six planes (a, b, c, d) with a*x + b*y + c*z + d >= 0 inside, normals unit length
+struct Frustum
+{
+    float planes[6][4];
+};
+
+// view_proj is a column-major GL matrix (glm::value_ptr layout)
+void extract_frustum(const float view_proj[16], Frustum& frustum);
+
+// moves world-space planes into the local space of an object with the given model matrix
+void transform_frustum(const Frustum& world, const float model[16], Frustum& local);
+
+bool sphere_in_frustum(const Frustum& frustum, const float center[3], float radius);
+bool aabb_in_frustum(const Frustum& frustum, const float min[3], const float max[3]);
+
+// inverse of an affine column-major matrix, used to bring the camera into model space
+void invert_affine(const float m[16], float out[16]);
+void transform_point(const float m[16], const float p[3], float out[3]);
+// column-major out = a * b, out may not alias either input
+void multiply_matrices(const float a[16], const float b[16], float out[16]);
+
+#endif
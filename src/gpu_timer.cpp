@@ -0,0 +1,168 @@
+#include "gpu_timer.h"
+
+#include <glad/glad.h>
+
+GpuTimer::GpuTimer()
+{
+    this->frame_count = 0;
+    this->current = 0;
+    this->initialized = false;
+    this->in_pass = false;
+    this->has_new_frame = false;
+    this->last_frame_ms = 0.0;
+    this->resolved_num = 0;
+    this->discarded_num = 0;
+    for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        this->frames[i].frame_index = 0;
+        this->frames[i].start_ns = 0;
+        this->frames[i].pass_num = 0;
+        this->frames[i].pending = false;
+    }
+    return;
+}
+
+void GpuTimer::init()
+{
+    for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        glGenQueries(MAX_PASSES, this->frames[i].queries);
+    }
+    this->initialized = true;
+    return;
+}
+
+void GpuTimer::destroy()
+{
+    if (!this->initialized)
+        return;
+
+    for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        glDeleteQueries(MAX_PASSES, this->frames[i].queries);
+    }
+    this->initialized = false;
+    return;
+}
+
+void GpuTimer::begin_frame()
+{
+    if (!this->initialized)
+        return;
+
+    // the slot we are about to reuse was issued FRAMES_IN_FLIGHT frames ago
+    this->current = (int)(this->frame_count++ % FRAMES_IN_FLIGHT);
+    FrameQueries& frame = this->frames[this->current];
+    if (frame.pending)
+    {
+        this->collect(frame);
+    }
+
+    frame.frame_index = frameProfiler.get_frame_index();
+    frame.start_ns = FrameProfiler::now_ns();
+    frame.pass_num = 0;
+    frame.pending = false;
+    return;
+}
+
+void GpuTimer::begin_pass(const char* name)
+{
+    FrameQueries& frame = this->frames[this->current];
+    if (!this->initialized || this->in_pass || frame.pass_num >= MAX_PASSES)
+        return;
+
+    frame.names[frame.pass_num] = name;
+    glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.pass_num]);
+    this->in_pass = true;
+    return;
+}
+
+void GpuTimer::end_pass()
+{
+    if (!this->in_pass)
+        return;
+
+    FrameQueries& frame = this->frames[this->current];
+    glEndQuery(GL_TIME_ELAPSED);
+    frame.pass_num++;
+    frame.pending = true;
+    this->in_pass = false;
+    return;
+}
+
+void GpuTimer::flush()
+{
+    if (!this->initialized)
+        return;
+
+    // oldest first so results arrive in frame order
+    for (int i = 1; i <= FRAMES_IN_FLIGHT; ++i)
+    {
+        FrameQueries& frame = this->frames[(this->current + i) % FRAMES_IN_FLIGHT];
+        if (frame.pending)
+        {
+            this->collect(frame);
+        }
+    }
+    return;
+}
+
+void GpuTimer::collect(FrameQueries& frame)
+{
+    GLuint64 elapsed[MAX_PASSES];
+    uint64_t total = 0;
+    for (int i = 0; i < frame.pass_num; ++i)
+    {
+        elapsed[i] = 0;
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &elapsed[i]);
+        total += elapsed[i];
+    }
+    frame.pending = false;
+
+    // the GPU cannot have spent longer on the frame than has passed since the CPU began it
+    bool plausible = this->resolved_num > 0 && total <= FrameProfiler::now_ns() - frame.start_ns;
+    this->resolved_num++;
+    if (!plausible)
+    {
+        this->discarded_num++;
+        return;
+    }
+
+#if ENABLE_FRAME_PROFILER
+    for (int i = 0; i < frame.pass_num; ++i)
+    {
+        frameProfiler.record_gpu_pass(frame.names[i], frame.frame_index, elapsed[i]);
+    }
+    frameProfiler.end_gpu_frame(frame.frame_index, total);
+#endif
+    this->last_frame_ms = total / 1000000.0;
+    this->has_new_frame = true;
+    return;
+}
+
+bool GpuTimer::take_frame_ms(double& ms)
+{
+    if (!this->has_new_frame)
+        return false;
+
+    ms = this->last_frame_ms;
+    this->has_new_frame = false;
+    return true;
+}
+
+uint64_t GpuTimer::get_discarded_num() const
+{
+    return this->discarded_num;
+}
+
+GpuPassScope::GpuPassScope(GpuTimer& timer, const char* name) : timer(timer)
+{
+    this->timer.begin_pass(name);
+    return;
+}
+
+GpuPassScope::~GpuPassScope()
+{
+    this->timer.end_pass();
+    return;
+}
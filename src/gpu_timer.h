@@ -0,0 +1,72 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include "frame_profiler.h"
+
+#include <cstdint>
+
+// GL_TIME_ELAPSED queries around render passes, read back a few frames late so we never stall.
+// The first resolved frame and any frame whose passes add up to more than the wall time since it began
+// are dropped; drivers return garbage for queries issued before the context is warm
+class GpuTimer
+{
+public:
+    static const int FRAMES_IN_FLIGHT = 4;
+    static const int MAX_PASSES = 32;
+
+    GpuTimer();
+
+    void init();
+    void destroy();
+
+    void begin_frame(); // called every frame in every build, the resolution governor reads the totals
+    void begin_pass(const char* name);
+    void end_pass();
+    void flush(); // resolve every outstanding query, e.g. before a benchmark report
+    bool take_frame_ms(double& ms); // total of the latest resolved frame, false when none arrived since the last call
+    uint64_t get_discarded_num() const;
+
+private:
+    struct FrameQueries
+    {
+        uint64_t frame_index;
+        uint64_t start_ns; // CPU clock at begin_frame
+        int pass_num;
+        bool pending;
+        const char* names[MAX_PASSES];
+        unsigned int queries[MAX_PASSES];
+    };
+
+    FrameQueries frames[FRAMES_IN_FLIGHT];
+    uint64_t frame_count; // slots rotate on this, the profiler's frame index stands still when it is compiled out
+    int current;
+    bool initialized;
+    bool in_pass;
+    bool has_new_frame;
+    double last_frame_ms;
+    uint64_t resolved_num; // frames read back, kept or not
+    uint64_t discarded_num;
+
+    void collect(FrameQueries& frame);
+};
+
+class GpuPassScope
+{
+public:
+    GpuPassScope(GpuTimer& timer, const char* name);
+    ~GpuPassScope();
+
+private:
+    GpuTimer& timer;
+};
+
+// queries cannot nest, so the frame is timed as one pass only when the per-pass scopes are compiled out
+#if ENABLE_FRAME_PROFILER
+#define PROFILE_GPU_SCOPE(timer, name) GpuPassScope PROFILE_CONCAT(gpuPassScope, __LINE__)(timer, name)
+#define GPU_FRAME_SCOPE(timer) ((void)0)
+#else
+#define PROFILE_GPU_SCOPE(timer, name) ((void)0)
+#define GPU_FRAME_SCOPE(timer) GpuPassScope gpuFrameScope(timer, "frame")
+#endif
+
+#endif
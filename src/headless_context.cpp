@@ -0,0 +1,188 @@
+#include "headless_context.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <iostream>
+
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define HEADLESS_HAS_EGL 1
+#endif
+
+using namespace std;
+
+HeadlessContext::HeadlessContext()
+{
+    this->width = 0;
+    this->height = 0;
+    this->display = NULL;
+    this->context = NULL;
+    this->fbo = 0;
+    this->color_rbo = 0;
+    this->depth_rbo = 0;
+    return;
+}
+
+bool HeadlessContext::init(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+
+#ifdef HEADLESS_HAS_EGL
+    // prefer the surfaceless platform so no X server or GPU is required
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != NULL)
+    {
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY)
+    {
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+    {
+        cout << "Failed to initialize EGL display" << endl;
+        return false;
+    }
+    eglBindAPI(EGL_OPENGL_API);
+
+    // the config only has to describe the context, rendering goes to our own FBO
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configNum = 0;
+    if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &configNum) || configNum == 0)
+    {
+        cout << "Failed to choose EGL config" << endl;
+        eglTerminate(eglDisplay);
+        return false;
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+    if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+    {
+        cout << "Failed to create surfaceless EGL context" << endl;
+        eglTerminate(eglDisplay);
+        return false;
+    }
+    this->display = eglDisplay;
+    this->context = eglContext;
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+    {
+        cout << "Failed to initialize GLAD" << endl;
+        this->destroy();
+        return false;
+    }
+#else
+    cout << "Headless rendering needs EGL, which is not available on this platform" << endl;
+    return false;
+#endif
+
+    // offscreen render target replacing the default framebuffer
+    glGenFramebuffers(1, &this->fbo);
+    glGenRenderbuffers(1, &this->color_rbo);
+    glGenRenderbuffers(1, &this->depth_rbo);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, this->color_rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->depth_rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->color_rbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->depth_rbo);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        cout << "ERROR::FRAMEBUFFER::INCOMPLETE" << endl;
+        this->destroy();
+        return false;
+    }
+
+    glViewport(0, 0, width, height);
+    cout << "Headless context: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << endl;
+    return true;
+}
+
+void HeadlessContext::destroy()
+{
+    if (this->fbo != 0)
+    {
+        glDeleteFramebuffers(1, &this->fbo);
+        glDeleteRenderbuffers(1, &this->color_rbo);
+        glDeleteRenderbuffers(1, &this->depth_rbo);
+        this->fbo = 0;
+    }
+
+#ifdef HEADLESS_HAS_EGL
+    if (this->display != NULL)
+    {
+        eglMakeCurrent((EGLDisplay)this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (this->context != NULL)
+        {
+            eglDestroyContext((EGLDisplay)this->display, (EGLContext)this->context);
+        }
+        eglTerminate((EGLDisplay)this->display);
+    }
+#endif
+    this->display = NULL;
+    this->context = NULL;
+    return;
+}
+
+void HeadlessContext::bind_framebuffer()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+    glViewport(0, 0, this->width, this->height);
+    return;
+}
+
+void HeadlessContext::read_pixels(vector<unsigned char>& rgb)
+{
+    int rowSize = 3 * this->width;
+    vector<unsigned char> flipped(rowSize * this->height);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, this->fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, this->width, this->height, GL_RGB, GL_UNSIGNED_BYTE, flipped.data());
+
+    // GL returns the bottom row first
+    rgb.resize(flipped.size());
+    for (int y = 0; y < this->height; ++y)
+    {
+        copy(flipped.begin() + (this->height - 1 - y) * rowSize, flipped.begin() + (this->height - y) * rowSize, rgb.begin() + y * rowSize);
+    }
+    return;
+}
+
+int HeadlessContext::get_width()
+{
+    return this->width;
+}
+
+int HeadlessContext::get_height()
+{
+    return this->height;
+}
+
+void* HeadlessContext::get_proc_address(const char* name)
+{
+#ifdef HEADLESS_HAS_EGL
+    return (void*)eglGetProcAddress(name);
+#else
+    return NULL;
+#endif
+}
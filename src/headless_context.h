@@ -0,0 +1,35 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <vector>
+
+// offscreen GL 3.3 core context (EGL surfaceless, works on Mesa llvmpipe) rendering into an FBO
+class HeadlessContext
+{
+public:
+    HeadlessContext();
+
+    bool init(int width, int height);
+    void destroy();
+
+    void bind_framebuffer();
+    void read_pixels(std::vector<unsigned char>& rgb); // tightly packed, top row first
+
+    int get_width();
+    int get_height();
+
+    static void* get_proc_address(const char* name); // for entry points beyond GL 3.3
+
+private:
+    int width;
+    int height;
+
+    void* display;
+    void* context;
+
+    unsigned int fbo;
+    unsigned int color_rbo;
+    unsigned int depth_rbo;
+};
+
+#endif
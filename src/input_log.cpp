@@ -0,0 +1,184 @@
+#include "input_log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+static const char LOG_MAGIC[4] = { 'G', 'L', 'I', 'L' };
+static const unsigned int LOG_VERSION = 1;
+
+// fields go out one by one, so the layout does not depend on struct padding
+template <typename T>
+static void write_value(FILE* file, const T& value)
+{
+    fwrite(&value, sizeof(T), 1, file);
+    return;
+}
+
+template <typename T>
+static bool read_value(FILE* file, T& value)
+{
+    return fread(&value, sizeof(T), 1, file) == 1;
+}
+
+InputLog::InputLog()
+{
+    this->file = NULL;
+    this->replaying = false;
+    this->seed = 0;
+    this->frame_num = 0;
+    this->cursor = 0;
+    return;
+}
+
+InputLog::~InputLog()
+{
+    this->close();
+    return;
+}
+
+bool InputLog::open_record(const char* filename, unsigned int seed)
+{
+    this->close();
+    this->file = fopen(filename, "wb");
+    if (this->file == NULL)
+    {
+        cout << "Fail to create input log: " << filename << endl;
+        return false;
+    }
+
+    this->seed = seed;
+    fwrite(LOG_MAGIC, 1, sizeof(LOG_MAGIC), this->file);
+    write_value(this->file, LOG_VERSION);
+    write_value(this->file, seed);
+    return true;
+}
+
+bool InputLog::open_replay(const char* filename)
+{
+    this->close();
+    FILE* source = fopen(filename, "rb");
+    if (source == NULL)
+    {
+        cout << "Fail to open input log: " << filename << endl;
+        return false;
+    }
+
+    char magic[4];
+    unsigned int version = 0;
+    if (fread(magic, 1, sizeof(magic), source) != sizeof(magic) || memcmp(magic, LOG_MAGIC, sizeof(magic)) != 0
+        || !read_value(source, version) || version != LOG_VERSION || !read_value(source, this->seed))
+    {
+        cout << "Not an input log: " << filename << endl;
+        fclose(source);
+        return false;
+    }
+
+    // a session that was killed may end in a partial frame, which is dropped
+    while (true)
+    {
+        InputFrame frame;
+        unsigned short buttons, eventNum;
+        if (!read_value(source, frame.delta_time) || !read_value(source, buttons) || !read_value(source, eventNum))
+            break;
+        frame.buttons = buttons;
+
+        bool complete = true;
+        for (int i = 0; i < eventNum && complete; ++i)
+        {
+            unsigned char type;
+            InputEvent event;
+            complete = read_value(source, type) && read_value(source, event.x) && read_value(source, event.y);
+            event.type = type;
+            frame.events.push_back(event);
+        }
+        if (!complete)
+            break;
+        this->frames.push_back(frame);
+    }
+    fclose(source);
+
+    this->replaying = true;
+    this->frame_num = (int)this->frames.size();
+    this->cursor = 0;
+    return true;
+}
+
+void InputLog::close()
+{
+    if (this->file != NULL)
+        fclose(this->file);
+    this->file = NULL;
+    this->replaying = false;
+    this->pending.clear();
+    this->frames.clear();
+    this->frame_num = 0;
+    this->cursor = 0;
+    return;
+}
+
+bool InputLog::is_recording() const
+{
+    return this->file != NULL;
+}
+
+bool InputLog::is_replaying() const
+{
+    return this->replaying;
+}
+
+unsigned int InputLog::get_seed() const
+{
+    return this->seed;
+}
+
+int InputLog::get_frame_num() const
+{
+    return this->frame_num;
+}
+
+void InputLog::add_event(int type, double x, double y)
+{
+    if (this->file == NULL)
+        return;
+
+    InputEvent event;
+    event.type = type;
+    event.x = x;
+    event.y = y;
+    this->pending.push_back(event);
+    return;
+}
+
+void InputLog::record_frame(float delta_time, unsigned int buttons)
+{
+    if (this->file == NULL)
+        return;
+
+    // more than 65535 events between two frames would be a stall of minutes, the rest go with the next frame
+    size_t eventNum = min(this->pending.size(), (size_t)0xffff);
+    write_value(this->file, delta_time);
+    write_value(this->file, (unsigned short)buttons);
+    write_value(this->file, (unsigned short)eventNum);
+    for (size_t i = 0; i < eventNum; ++i)
+    {
+        write_value(this->file, (unsigned char)this->pending[i].type);
+        write_value(this->file, this->pending[i].x);
+        write_value(this->file, this->pending[i].y);
+    }
+    this->pending.erase(this->pending.begin(), this->pending.begin() + eventNum);
+    this->frame_num++;
+    return;
+}
+
+bool InputLog::next_frame(InputFrame& frame)
+{
+    if (!this->replaying || this->cursor >= (int)this->frames.size())
+        return false;
+
+    frame = this->frames[this->cursor];
+    this->cursor++;
+    return true;
+}
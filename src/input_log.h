@@ -0,0 +1,55 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <cstdio>
+#include <vector>
+
+enum InputEventType { INPUT_CURSOR = 0, INPUT_SCROLL = 1 };
+
+struct InputEvent
+{
+    int type;
+    double x, y; // cursor position or scroll offsets, as the callback received them
+};
+
+// everything one frame's simulation reads from the outside
+struct InputFrame
+{
+    float delta_time;
+    unsigned int buttons; // one bit per logged key or mouse button, held down this frame
+    std::vector<InputEvent> events; // arrived since the previous frame, in order
+};
+
+// compact binary log of per-frame input, delta time and the simulation seed. The file is a header
+// ("GLIL", version, seed) followed by frames of delta time, a 16-bit button mask, a 16-bit event count
+// and the events as a type byte and two doubles. Replays load the whole log before the first frame.
+class InputLog
+{
+public:
+    InputLog();
+    ~InputLog();
+
+    bool open_record(const char* filename, unsigned int seed);
+    bool open_replay(const char* filename);
+    void close();
+
+    bool is_recording() const;
+    bool is_replaying() const;
+    unsigned int get_seed() const;
+    int get_frame_num() const; // recorded so far, or in the replayed log
+
+    void add_event(int type, double x, double y); // goes out with the next recorded frame
+    void record_frame(float delta_time, unsigned int buttons);
+    bool next_frame(InputFrame& frame); // false once the replay is over
+
+private:
+    FILE* file;
+    bool replaying;
+    unsigned int seed;
+    std::vector<InputEvent> pending;
+    std::vector<InputFrame> frames;
+    int frame_num;
+    int cursor;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#include "instance_buffer.h"
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+InstanceBuffer::InstanceBuffer()
+{
+    this->buffer = 0;
+    this->texture = 0;
+    this->initialized = false;
+    return;
+}
+
+void InstanceBuffer::init()
+{
+    glGenBuffers(1, &this->buffer);
+    glGenTextures(1, &this->texture);
+
+    // one identity instance, so the texture has storage before the first upload
+    InstanceMatrices identity = {
+        { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f },
+        { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f }
+    };
+    glBindBuffer(GL_TEXTURE_BUFFER, this->buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(identity), &identity, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glBindTexture(GL_TEXTURE_BUFFER, this->texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    this->initialized = true;
+    return;
+}
+
+void InstanceBuffer::destroy()
+{
+    if (!this->initialized)
+        return;
+
+    glDeleteTextures(1, &this->texture);
+    glDeleteBuffers(1, &this->buffer);
+    this->initialized = false;
+    return;
+}
+
+void InstanceBuffer::upload(const std::vector<InstanceMatrices>& matrices)
+{
+    if (!this->initialized || matrices.empty())
+        return;
+
+    size_t bytes = sizeof(InstanceMatrices) * matrices.size();
+    glBindBuffer(GL_TEXTURE_BUFFER, this->buffer);
+    glBufferData(GL_TEXTURE_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, matrices.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    return;
+}
+
+void InstanceBuffer::bind(int unit)
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, this->texture);
+    glActiveTexture(GL_TEXTURE0);
+    return;
+}
@@ -0,0 +1,27 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <vector>
+
+#include "instance_transforms.h"
+
+// per-instance model and normal matrices as an RGBA32F buffer texture, seven texels per instance;
+// the vertex shader fetches its instance by index instead of reading a model matrix uniform
+class InstanceBuffer
+{
+public:
+    InstanceBuffer();
+
+    void init();
+    void destroy();
+
+    void upload(const std::vector<InstanceMatrices>& matrices); // orphans and refills
+    void bind(int unit);
+
+private:
+    unsigned int buffer;
+    unsigned int texture;
+    bool initialized;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "instance_transforms.h"
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define INSTANCE_TRANSFORMS_SSE 1
+#endif
+
+using namespace std;
+
+// upper 3x3 entries in column-major order inside a 4x4
+static const int LINEAR_ENTRIES[9] = { 0, 1, 2, 4, 5, 6, 8, 9, 10 };
+
+static void compose_model(const InstanceTransform& t, float m[16])
+{
+    float cx = cos(t.rotation[0]), sx = sin(t.rotation[0]);
+    float cy = cos(t.rotation[1]), sy = sin(t.rotation[1]);
+    float cz = cos(t.rotation[2]), sz = sin(t.rotation[2]);
+
+    // R = Rz * Ry * Rx, each column scaled by its axis
+    m[0] = cz * cy * t.scale[0];
+    m[1] = sz * cy * t.scale[0];
+    m[2] = -sy * t.scale[0];
+    m[3] = 0.0f;
+    m[4] = (cz * sy * sx - sz * cx) * t.scale[1];
+    m[5] = (sz * sy * sx + cz * cx) * t.scale[1];
+    m[6] = cy * sx * t.scale[1];
+    m[7] = 0.0f;
+    m[8] = (cz * sy * cx + sz * sx) * t.scale[2];
+    m[9] = (sz * sy * cx - cz * sx) * t.scale[2];
+    m[10] = cy * cx * t.scale[2];
+    m[11] = 0.0f;
+    m[12] = t.position[0];
+    m[13] = t.position[1];
+    m[14] = t.position[2];
+    m[15] = 1.0f;
+    return;
+}
+
+void normal_matrix(const float m[16], float n[12])
+{
+    // columns of the inverse transpose are c1 x c2, c2 x c0 and c0 x c1 over det
+    float c0[3] = { m[0], m[1], m[2] }, c1[3] = { m[4], m[5], m[6] }, c2[3] = { m[8], m[9], m[10] };
+    const float* a[3] = { c1, c2, c0 };
+    const float* b[3] = { c2, c0, c1 };
+    for (int col = 0; col < 3; ++col)
+    {
+        n[4 * col] = a[col][1] * b[col][2] - a[col][2] * b[col][1];
+        n[4 * col + 1] = a[col][2] * b[col][0] - a[col][0] * b[col][2];
+        n[4 * col + 2] = a[col][0] * b[col][1] - a[col][1] * b[col][0];
+        n[4 * col + 3] = 0.0f;
+    }
+
+    float det = c0[0] * n[0] + c0[1] * n[1] + c0[2] * n[2];
+    float invDet = det != 0.0f ? 1.0f / det : 0.0f;
+    for (int i = 0; i < 12; ++i)
+    {
+        n[i] *= invDet;
+    }
+    return;
+}
+
+void compute_instance_matrices(const vector<InstanceTransform>& transforms, vector<InstanceMatrices>& matrices)
+{
+    size_t instanceNum = transforms.size();
+    matrices.resize(instanceNum);
+    for (size_t i = 0; i < instanceNum; ++i)
+    {
+        compose_model(transforms[i], matrices[i].model);
+    }
+
+    size_t i = 0;
+#if INSTANCE_TRANSFORMS_SSE
+    for (; i + 4 <= instanceNum; i += 4)
+    {
+        // gather the four upper 3x3 blocks into SoA, one register per matrix entry
+        __m128 e[9];
+        for (int k = 0; k < 9; ++k)
+        {
+            int entry = LINEAR_ENTRIES[k];
+            e[k] = _mm_set_ps(matrices[i + 3].model[entry], matrices[i + 2].model[entry], matrices[i + 1].model[entry], matrices[i].model[entry]);
+        }
+
+        __m128 n[9];
+        n[0] = _mm_sub_ps(_mm_mul_ps(e[4], e[8]), _mm_mul_ps(e[5], e[7]));
+        n[1] = _mm_sub_ps(_mm_mul_ps(e[5], e[6]), _mm_mul_ps(e[3], e[8]));
+        n[2] = _mm_sub_ps(_mm_mul_ps(e[3], e[7]), _mm_mul_ps(e[4], e[6]));
+        n[3] = _mm_sub_ps(_mm_mul_ps(e[7], e[2]), _mm_mul_ps(e[8], e[1]));
+        n[4] = _mm_sub_ps(_mm_mul_ps(e[8], e[0]), _mm_mul_ps(e[6], e[2]));
+        n[5] = _mm_sub_ps(_mm_mul_ps(e[6], e[1]), _mm_mul_ps(e[7], e[0]));
+        n[6] = _mm_sub_ps(_mm_mul_ps(e[1], e[5]), _mm_mul_ps(e[2], e[4]));
+        n[7] = _mm_sub_ps(_mm_mul_ps(e[2], e[3]), _mm_mul_ps(e[0], e[5]));
+        n[8] = _mm_sub_ps(_mm_mul_ps(e[0], e[4]), _mm_mul_ps(e[1], e[3]));
+
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], n[0]), _mm_mul_ps(e[1], n[1])), _mm_mul_ps(e[2], n[2]));
+        __m128 nonZero = _mm_cmpneq_ps(det, _mm_setzero_ps());
+        __m128 invDet = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), det), nonZero);
+
+        float lanes[4];
+        for (int k = 0; k < 9; ++k)
+        {
+            _mm_storeu_ps(lanes, _mm_mul_ps(n[k], invDet));
+            int slot = 4 * (k / 3) + k % 3;
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                matrices[i + lane].normal[slot] = lanes[lane];
+            }
+        }
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            matrices[i + lane].normal[3] = matrices[i + lane].normal[7] = matrices[i + lane].normal[11] = 0.0f;
+        }
+    }
+#endif
+    for (; i < instanceNum; ++i)
+    {
+        normal_matrix(matrices[i].model, matrices[i].normal);
+    }
+
+    return;
+}
+
+void set_instance_transform(InstanceTransform& transform, float x, float y, float z, float uniform_scale)
+{
+    transform.position[0] = x;
+    transform.position[1] = y;
+    transform.position[2] = z;
+    for (int i = 0; i < 3; ++i)
+    {
+        transform.rotation[i] = 0.0f;
+        transform.scale[i] = uniform_scale;
+    }
+    return;
+}
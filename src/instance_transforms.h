@@ -0,0 +1,30 @@
+#ifndef INSTANCE_TRANSFORMS_H
+#define INSTANCE_TRANSFORMS_H
+
+#include <vector>
+
+// placement of one mesh instance
+struct InstanceTransform
+{
+    float position[3];
+    float rotation[3]; // radians about x, then y, then z
+    float scale[3]; // may be non-uniform
+};
+
+// laid out as seven RGBA texels for the instance buffer texture
+struct InstanceMatrices
+{
+    float model[16]; // column-major
+    float normal[12]; // inverse transpose of the model's upper 3x3, three columns padded to vec4
+};
+
+// builds model matrices, then derives the normal matrices four instances at a time with SSE
+// (cofactors over the determinant), so no shader ever has to invert a matrix
+void compute_instance_matrices(const std::vector<InstanceTransform>& transforms, std::vector<InstanceMatrices>& matrices);
+
+// scalar path for the leftover instances, and the reference the SSE path is checked against
+void normal_matrix(const float m[16], float n[12]);
+
+void set_instance_transform(InstanceTransform& transform, float x, float y, float z, float uniform_scale);
+
+#endif
@@ -0,0 +1,81 @@
+#include "light_buffers.h"
+
+#include <glad/glad.h>
+
+static const unsigned int BUFFER_FORMATS[LightBuffers::BUFFER_NUM] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+
+LightBuffers::LightBuffers()
+{
+    for (int i = 0; i < BUFFER_NUM; ++i)
+    {
+        this->buffers[i] = 0;
+        this->textures[i] = 0;
+    }
+    this->initialized = false;
+    return;
+}
+
+void LightBuffers::init()
+{
+    glGenBuffers(BUFFER_NUM, this->buffers);
+    glGenTextures(BUFFER_NUM, this->textures);
+    for (int i = 0; i < BUFFER_NUM; ++i)
+    {
+        // never leave a buffer texture without storage, even before the first upload
+        unsigned int empty[4] = { 0, 0, 0, 0 };
+        this->upload_buffer(i, empty, sizeof(empty));
+        glBindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, BUFFER_FORMATS[i], this->buffers[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    this->initialized = true;
+    return;
+}
+
+void LightBuffers::destroy()
+{
+    if (!this->initialized)
+        return;
+
+    glDeleteTextures(BUFFER_NUM, this->textures);
+    glDeleteBuffers(BUFFER_NUM, this->buffers);
+    this->initialized = false;
+    return;
+}
+
+void LightBuffers::upload(const std::vector<PointLight>& lights, const LightClusters& clusters)
+{
+    if (!this->initialized)
+        return;
+
+    const std::vector<unsigned int>& clusterData = clusters.get_cluster_data();
+    const std::vector<unsigned int>& indices = clusters.get_light_indices();
+    if (!lights.empty())
+        this->upload_buffer(0, lights.data(), sizeof(PointLight) * lights.size());
+    this->upload_buffer(1, clusterData.data(), sizeof(unsigned int) * clusterData.size());
+    if (!indices.empty())
+        this->upload_buffer(2, indices.data(), sizeof(unsigned int) * indices.size());
+    return;
+}
+
+void LightBuffers::bind(int first_unit)
+{
+    for (int i = 0; i < BUFFER_NUM; ++i)
+    {
+        glActiveTexture(GL_TEXTURE0 + first_unit + i);
+        glBindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    return;
+}
+
+void LightBuffers::upload_buffer(int index, const void* data, size_t bytes)
+{
+    // orphan first so the driver can hand out fresh storage instead of waiting on last frame's draws
+    glBindBuffer(GL_TEXTURE_BUFFER, this->buffers[index]);
+    glBufferData(GL_TEXTURE_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    return;
+}
@@ -0,0 +1,33 @@
+#ifndef LIGHT_BUFFERS_H
+#define LIGHT_BUFFERS_H
+
+#include <cstddef>
+#include <vector>
+
+#include "light_clusters.h"
+
+// buffer textures feeding the clustered shading loop (GL 3.3 has no SSBOs):
+// lights as RGBA32F, per-cluster (offset, count) as RG32UI and the light index list as R32UI
+class LightBuffers
+{
+public:
+    static const int BUFFER_NUM = 3;
+
+    LightBuffers();
+
+    void init();
+    void destroy();
+
+    // orphans and refills every buffer, called once per frame after binning
+    void upload(const std::vector<PointLight>& lights, const LightClusters& clusters);
+    void bind(int first_unit); // lights, clusters and indices on three consecutive units
+
+private:
+    unsigned int buffers[BUFFER_NUM];
+    unsigned int textures[BUFFER_NUM];
+    bool initialized;
+
+    void upload_buffer(int index, const void* data, size_t bytes);
+};
+
+#endif
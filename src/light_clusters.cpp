@@ -0,0 +1,234 @@
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define LIGHT_CLUSTERS_SSE 1
+#endif
+
+using namespace std;
+
+LightClusters::LightClusters()
+{
+    this->init(16, 9, 24, 0.1f, 100.0f);
+    return;
+}
+
+void LightClusters::init(int tiles_x, int tiles_y, int slices, float near_plane, float far_plane)
+{
+    this->tiles_x = tiles_x;
+    this->tiles_y = tiles_y;
+    this->slices = slices;
+    this->near_plane = near_plane;
+    this->far_plane = far_plane;
+    this->slice_scale = slices / log(far_plane / near_plane);
+
+    this->cluster_data.assign(2 * tiles_x * tiles_y * slices, 0);
+    this->light_indices.clear();
+    this->stats = LightClusterStats();
+    return;
+}
+
+void LightClusters::bin(const vector<PointLight>& lights, const float view[16], const float projection[16])
+{
+    size_t lightNum = lights.size();
+    this->ranges.resize(lightNum);
+
+    // view-space sphere -> depth interval [dn, df] and the NDC box covering it. x/d is monotonic
+    // in d, so the box corners at dn and df bound the whole sphere
+    size_t i = 0;
+#if LIGHT_CLUSTERS_SSE
+    __m128 v0 = _mm_set1_ps(view[0]), v1 = _mm_set1_ps(view[1]), v2 = _mm_set1_ps(view[2]);
+    __m128 v4 = _mm_set1_ps(view[4]), v5 = _mm_set1_ps(view[5]), v6 = _mm_set1_ps(view[6]);
+    __m128 v8 = _mm_set1_ps(view[8]), v9 = _mm_set1_ps(view[9]), v10 = _mm_set1_ps(view[10]);
+    __m128 v12 = _mm_set1_ps(view[12]), v13 = _mm_set1_ps(view[13]), v14 = _mm_set1_ps(view[14]);
+    __m128 p00 = _mm_set1_ps(projection[0]), p11 = _mm_set1_ps(projection[5]);
+    __m128 nearV = _mm_set1_ps(this->near_plane);
+    __m128 zero = _mm_setzero_ps();
+
+    float minX[4], maxX[4], minY[4], maxY[4], dn[4], df[4];
+    for (; i + 4 <= lightNum; i += 4)
+    {
+        // position and radius are the first four floats, transpose four lights into SoA
+        __m128 x = _mm_loadu_ps(lights[i].position);
+        __m128 y = _mm_loadu_ps(lights[i + 1].position);
+        __m128 z = _mm_loadu_ps(lights[i + 2].position);
+        __m128 r = _mm_loadu_ps(lights[i + 3].position);
+        _MM_TRANSPOSE4_PS(x, y, z, r);
+
+        __m128 vx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v0, x), _mm_mul_ps(v4, y)), _mm_add_ps(_mm_mul_ps(v8, z), v12));
+        __m128 vy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v1, x), _mm_mul_ps(v5, y)), _mm_add_ps(_mm_mul_ps(v9, z), v13));
+        __m128 vz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v2, x), _mm_mul_ps(v6, y)), _mm_add_ps(_mm_mul_ps(v10, z), v14));
+
+        __m128 depth = _mm_sub_ps(zero, vz);
+        __m128 nearDepth = _mm_max_ps(_mm_sub_ps(depth, r), nearV);
+        __m128 farDepth = _mm_add_ps(depth, r);
+        __m128 invNear = _mm_div_ps(_mm_set1_ps(1.0f), nearDepth);
+        __m128 invFar = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(farDepth, nearV));
+
+        __m128 lo = _mm_sub_ps(vx, r), hi = _mm_add_ps(vx, r);
+        _mm_storeu_ps(minX, _mm_mul_ps(p00, _mm_min_ps(_mm_mul_ps(lo, invNear), _mm_mul_ps(lo, invFar))));
+        _mm_storeu_ps(maxX, _mm_mul_ps(p00, _mm_max_ps(_mm_mul_ps(hi, invNear), _mm_mul_ps(hi, invFar))));
+        lo = _mm_sub_ps(vy, r);
+        hi = _mm_add_ps(vy, r);
+        _mm_storeu_ps(minY, _mm_mul_ps(p11, _mm_min_ps(_mm_mul_ps(lo, invNear), _mm_mul_ps(lo, invFar))));
+        _mm_storeu_ps(maxY, _mm_mul_ps(p11, _mm_max_ps(_mm_mul_ps(hi, invNear), _mm_mul_ps(hi, invFar))));
+        _mm_storeu_ps(dn, nearDepth);
+        _mm_storeu_ps(df, farDepth);
+
+        for (int k = 0; k < 4; ++k)
+        {
+            this->set_range(this->ranges[i + k], minX[k], maxX[k], minY[k], maxY[k], dn[k], df[k]);
+        }
+    }
+#endif
+    for (; i < lightNum; ++i)
+    {
+        const float* p = lights[i].position;
+        float r = lights[i].radius;
+        float vx = view[0] * p[0] + view[4] * p[1] + view[8] * p[2] + view[12];
+        float vy = view[1] * p[0] + view[5] * p[1] + view[9] * p[2] + view[13];
+        float vz = view[2] * p[0] + view[6] * p[1] + view[10] * p[2] + view[14];
+
+        float nearDepth = max(-vz - r, this->near_plane);
+        float farDepth = -vz + r;
+        float invNear = 1.0f / nearDepth;
+        float invFar = 1.0f / max(farDepth, this->near_plane);
+        float minX = projection[0] * min((vx - r) * invNear, (vx - r) * invFar);
+        float maxX = projection[0] * max((vx + r) * invNear, (vx + r) * invFar);
+        float minY = projection[5] * min((vy - r) * invNear, (vy - r) * invFar);
+        float maxY = projection[5] * max((vy + r) * invNear, (vy + r) * invFar);
+        this->set_range(this->ranges[i], minX, maxX, minY, maxY, nearDepth, farDepth);
+    }
+
+    // counting sort into one compact list: count, prefix sum, then fill
+    int clusterNum = this->tiles_x * this->tiles_y * this->slices;
+    fill(this->cluster_data.begin(), this->cluster_data.end(), 0);
+    this->stats = LightClusterStats();
+    this->stats.light_num = (int)lightNum;
+    for (size_t l = 0; l < lightNum; ++l)
+    {
+        const LightRange& range = this->ranges[l];
+        if (range.x0 > range.x1)
+            continue;
+
+        this->stats.visible_num++;
+        for (int z = range.z0; z <= range.z1; ++z)
+        {
+            for (int y = range.y0; y <= range.y1; ++y)
+            {
+                for (int x = range.x0; x <= range.x1; ++x)
+                {
+                    this->cluster_data[2 * ((z * this->tiles_y + y) * this->tiles_x + x) + 1]++;
+                }
+            }
+        }
+    }
+
+    unsigned int offset = 0;
+    for (int c = 0; c < clusterNum; ++c)
+    {
+        unsigned int count = this->cluster_data[2 * c + 1];
+        this->cluster_data[2 * c] = offset;
+        this->cluster_data[2 * c + 1] = 0; // reused as the fill cursor below
+        offset += count;
+        if (count > 0)
+            this->stats.occupied_clusters++;
+        this->stats.max_per_cluster = max(this->stats.max_per_cluster, (int)count);
+    }
+    this->stats.index_num = (int)offset;
+
+    this->light_indices.resize(offset);
+    for (size_t l = 0; l < lightNum; ++l)
+    {
+        const LightRange& range = this->ranges[l];
+        if (range.x0 > range.x1)
+            continue;
+
+        for (int z = range.z0; z <= range.z1; ++z)
+        {
+            for (int y = range.y0; y <= range.y1; ++y)
+            {
+                for (int x = range.x0; x <= range.x1; ++x)
+                {
+                    unsigned int* cluster = &this->cluster_data[2 * ((z * this->tiles_y + y) * this->tiles_x + x)];
+                    this->light_indices[cluster[0] + cluster[1]++] = (unsigned int)l;
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+const vector<unsigned int>& LightClusters::get_cluster_data() const
+{
+    return this->cluster_data;
+}
+
+const vector<unsigned int>& LightClusters::get_light_indices() const
+{
+    return this->light_indices;
+}
+
+int LightClusters::get_tiles_x() const
+{
+    return this->tiles_x;
+}
+
+int LightClusters::get_tiles_y() const
+{
+    return this->tiles_y;
+}
+
+int LightClusters::get_slices() const
+{
+    return this->slices;
+}
+
+float LightClusters::get_near() const
+{
+    return this->near_plane;
+}
+
+float LightClusters::get_far() const
+{
+    return this->far_plane;
+}
+
+float LightClusters::get_slice_scale() const
+{
+    return this->slice_scale;
+}
+
+void LightClusters::get_stats(LightClusterStats& stats) const
+{
+    stats = this->stats;
+    return;
+}
+
+int LightClusters::depth_slice(float depth) const
+{
+    int slice = (int)floor(log(depth / this->near_plane) * this->slice_scale);
+    return min(max(slice, 0), this->slices - 1);
+}
+
+void LightClusters::set_range(LightRange& range, float min_x, float max_x, float min_y, float max_y, float near_depth, float far_depth) const
+{
+    if (far_depth <= this->near_plane || near_depth >= this->far_plane || max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f)
+    {
+        range.x0 = 1;
+        range.x1 = 0;
+        return;
+    }
+
+    range.x0 = max(0, (int)floor((min_x * 0.5f + 0.5f) * this->tiles_x));
+    range.x1 = min(this->tiles_x - 1, (int)floor((max_x * 0.5f + 0.5f) * this->tiles_x));
+    range.y0 = max(0, (int)floor((min_y * 0.5f + 0.5f) * this->tiles_y));
+    range.y1 = min(this->tiles_y - 1, (int)floor((max_y * 0.5f + 0.5f) * this->tiles_y));
+    range.z0 = this->depth_slice(near_depth);
+    range.z1 = this->depth_slice(min(far_depth, this->far_plane));
+    return;
+}
@@ -0,0 +1,72 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <vector>
+
+// laid out as two RGBA texels for the light buffer texture
+struct PointLight
+{
+    float position[3]; // world space
+    float radius; // influence ends here
+    float color[3];
+    float padding;
+};
+
+struct LightClusterStats
+{
+    int light_num;
+    int visible_num; // lights touching at least one cluster
+    int occupied_clusters;
+    int max_per_cluster;
+    int index_num; // total light references over all clusters
+};
+
+// froxel grid: screen tiles times exponential depth slices. Lights are bound on the CPU
+// (view transform and screen bounds four lights at a time with SSE) and counting-sorted into
+// one compact index list, so a fragment only loops over the lights of its own cluster.
+class LightClusters
+{
+public:
+    LightClusters();
+
+    void init(int tiles_x, int tiles_y, int slices, float near_plane, float far_plane);
+
+    // view and projection are column-major; the projection must be a symmetric perspective
+    void bin(const std::vector<PointLight>& lights, const float view[16], const float projection[16]);
+
+    // per cluster (offset, count) into get_light_indices(), x fastest, then y, then slice
+    const std::vector<unsigned int>& get_cluster_data() const;
+    const std::vector<unsigned int>& get_light_indices() const;
+
+    int get_tiles_x() const;
+    int get_tiles_y() const;
+    int get_slices() const;
+    float get_near() const;
+    float get_far() const;
+    float get_slice_scale() const; // slices / log(far / near)
+
+    void get_stats(LightClusterStats& stats) const;
+
+private:
+    struct LightRange
+    {
+        int x0, x1, y0, y1, z0, z1; // inclusive, x0 > x1 when the light is not visible
+    };
+
+    int tiles_x;
+    int tiles_y;
+    int slices;
+    float near_plane;
+    float far_plane;
+    float slice_scale;
+
+    std::vector<LightRange> ranges;
+    std::vector<unsigned int> cluster_data;
+    std::vector<unsigned int> light_indices;
+    LightClusterStats stats;
+
+    int depth_slice(float depth) const;
+    void set_range(LightRange& range, float min_x, float max_x, float min_y, float max_y, float near_depth, float far_depth) const;
+};
+
+#endif
@@ -1,8 +1,17 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <string>
+#include <vector>
 #include <math.h>
+#include <float.h>
 
 #include "stb_image.h"
 #include "parameter_config.h"
@@ -10,17 +19,209 @@
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 #include "ply_model.h"
+#include "mesh_arena.h"
+#include "mesh_residency.h"
+#include "meshlet.h"
+#include "mesh_lod.h"
+#include "mesh_bvh.h"
+#include "frustum.h"
+#include "shadow_map.h"
+#include "light_clusters.h"
+#include "light_buffers.h"
+#include "instance_transforms.h"
+#include "instance_buffer.h"
+#include "transform_hierarchy.h"
+#include "frame_ring_buffer.h"
+#include "shader_manager.h"
+#include "terrain_streamer.h"
+#include "chunked_mesh_builder.h"
+#include "chunked_mesh_streamer.h"
+#include "occlusion_buffer.h"
+#include "multi_view.h"
+#include "dynamic_resolution.h"
+#include "file_watcher.h"
+#include "scene_description.h"
+#include "collision.h"
+#include "frame_profiler.h"
+#include "gpu_timer.h"
+#include "headless_context.h"
+#include "benchmark_harness.h"
+#include "input_log.h"
+
+// programs in build order; a scene file may swap in other sources, lit ones get clustered lighting
+enum ProgramIndex { PROGRAM_TEXTURED, PROGRAM_LIGHT, PROGRAM_MODEL, PROGRAM_SHADOW, PROGRAM_NUM };
+struct ProgramSources
+{
+    const char* name;
+    const char* vertex;
+    const char* fragment;
+    bool lit;
+};
+const ProgramSources programSources[PROGRAM_NUM] = {
+    { "TEXTURED", vertexShaderSource, fragmentShaderSource, true },
+    { "LIGHT", reducedVertexShaderSource, lightFragmentShaderSource, false },
+    { "MODEL", illumVertexShaderSource, illumModelFragmentShaderSource, true },
+    { "SHADOW", shadowDepthVertexShaderSource, shadowDepthFragmentShaderSource, false }
+};
+
+// files watched for hot reload and what they feed
+enum AssetKind { ASSET_SCENE, ASSET_MODEL, ASSET_TEXTURE, ASSET_SHADER };
+struct WatchedAsset
+{
+    AssetKind kind;
+    unsigned int target; // mesh id or texture name, unused for the scene and shader files
+};
+
+// parsed or decoded on a worker thread, swapped in at the next frame boundary
+struct ReloadResult
+{
+    PlyModel model;
+    std::vector<Meshlet> meshlets;
+    MeshLod shadowLod;
+    MeshBvh bvh;
+    unsigned char* pixels; // stb_image owned
+    int width, height;
+};
+
+struct PendingReload
+{
+    WatchedAsset asset;
+    std::string path;
+    std::chrono::steady_clock::time_point detected;
+    bool superseded; // the file changed again before this finished
+    std::future<std::shared_ptr<ReloadResult> > result;
+};
+
+// model matrix and colour of one textured or light draw, five texels in the frame ring
+struct DrawRecord
+{
+    float model[16];
+    float color[4];
+};
+
+// fixed places in the per-frame slot tables; the models follow, the scan takes the slot after them
+enum DrawSlot { SLOT_GROUND = 0, SLOT_BEARINGS = 1, SLOT_CROPS = 5, SLOT_CHARACTER = 14, SLOT_LIGHT = 15, SLOT_MODELS = 16 };
+
+// camera, tile and light bins of one view; the command list is rebuilt every frame
+struct RenderView
+{
+    glm::mat4 view, projection;
+    glm::vec3 position;
+    int viewport[4];
+    LightClusters clusters;
+    ViewCommandList commands;
+    std::vector<int> meshletCounts; // scratch for one model's visible meshlet ranges
+    std::vector<const void*> meshletOffsets;
+};
+
+// GL objects and meshes shared by the windowed and headless loops
+struct SceneResources
+{
+    std::unique_ptr<MeshArena> meshArena; // declared first so it outlives the models
+    PlyModel plyBunny;
+    PlyModel plyDragon;
+    PlyModel plyHappy;
+    MeshResidency residency;
+    int bunnyMesh, dragonMesh, happyMesh;
+    std::vector<InstanceTransform> plyInstances; // one per mesh, indexed like the mesh ids
+    std::vector<InstanceMatrices> plyMatrices;
+    bool instancesDirty; // matrices changed since the last upload
+    InstanceBuffer instanceBuffer;
+    TerrainStreamer terrain;
+    ChunkedMeshStreamer scan;
+    int scanInstance; // after the ply instances, -1 without a scan file
+    glm::vec3 scanBoundsMin, scanBoundsMax;
+    OcclusionBuffer occlusion;
+    std::vector<glm::vec3> plyBoundsMin, plyBoundsMax; // world space, indexed like the mesh ids
+    std::vector<MeshBvh> plyBvhs; // model space, indexed like the mesh ids; kept after the CPU copies go
+
+    ShaderManager shaders;
+    ShaderProcLoader procLoader;
+    FrameRingBuffer drawRing;
+    TransformHierarchy transforms;
+    int slotNodes[SLOT_MODELS]; // transform node of every fixed slot, under one scene root
+    std::vector<int> nodeSlots; // the other way round, -1 for the root
+    int programIds[PROGRAM_NUM];
+    unsigned int shaderProgram, illumProgram, illumObjectProgram, shadowProgram;
+    ShadowMap shadowMap;
+
+    std::vector<PointLight> pointLights;
+    std::vector<glm::vec3> lightAnchors; // each light circles around its anchor
+    float lightFieldTime;
+    LightBuffers lightBuffers;
+    unsigned int texture_soil, texture_crops, texture_tomoko;
+    unsigned int texture_bearing[4];
+    unsigned int VAO, VAO_char, VAO_brn, VAO_light;
+
+    SceneDescription description;
+    FileWatcher watcher;
+    std::vector<WatchedAsset> watchedAssets; // indexed by watcher id
+    std::vector<PendingReload> pendingReloads;
+    std::vector<std::pair<int, std::chrono::steady_clock::time_point> > pendingShaders; // ProgramIndex, change seen
+
+    ResolutionGovernor governor;
+    ScaledRenderTarget resolutionTarget;
+
+    RenderView views[MULTI_VIEW_MAX]; // the first is the free camera
+    MultiViewCuller viewCuller;
+    ViewJobRunner viewJobs;
+    std::vector<unsigned int> slotMasks; // views that may see each draw slot this frame
+    std::vector<int> slotRecords; // draw record or instance index of each slot, shared by all views
+};
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow* window);
+void processInput(GLFWwindow* window, const SceneResources& scene);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void character_random_move();
+void update_camera_front();
+void character_random_move(const SceneResources& scene);
+bool character_hits_model(const SceneResources& scene, float x, float z);
+bool pick_model(const SceneResources& scene, const glm::vec3& origin, const glm::vec3& dir, int& mesh_id, glm::vec3& point);
 void light_source_move();
-bool check_collision(float ax, float az, float aSize, float bx, float bz, float bSize);
-void create_shader(unsigned int& shader, const int shader_type, const char** source);
 void generate_texture(unsigned int& texture_id, const char* image_filename);
-void configure_object_with_ebo(unsigned int& VAO_obj, int coord_size, const float* vertex_coords, unsigned int* face_list, int v_size, int f_size);
+void configure_object_with_ebo(unsigned int& VAO_obj, int coord_size, const float* vertex_coords, unsigned int* face_list, int v_size, int f_size, unsigned int* VBO_out = NULL, unsigned int* EBO_out = NULL);
+void upload_mesh(MeshResidency& residency, int mesh_id);
+void add_ply_commands(SceneResources& scene, RenderView& rv, int view, int mesh_id);
+void create_ply_instances(SceneResources& scene);
+void place_ply_instances(SceneResources& scene);
+void update_scene_bounds(SceneResources& scene);
+glm::mat4 ply_model_matrix(const SceneResources& scene, int mesh_id);
+void render_shadow_map(SceneResources& scene);
+void submit_occluders(SceneResources& scene, const glm::mat4& view_proj);
+bool is_visible(SceneResources& scene, const glm::vec3& lo, const glm::vec3& hi);
+void create_light_field(SceneResources& scene, int light_num);
+void move_light_field(SceneResources& scene);
+void load_models(SceneResources& scene);
+void build_mesh_data(PlyModel& model, std::vector<Meshlet>& meshlets, MeshLod& shadow_lod, MeshBvh& bvh);
+void load_scene(SceneResources& scene);
+void load_scene_file(SceneResources& scene);
+void apply_scene_description(SceneResources& scene);
+void build_program(SceneResources& scene, int index, bool rebuild);
+void set_program_uniforms(SceneResources& scene);
+void init_hot_reload(SceneResources& scene);
+void poll_hot_reload(SceneResources& scene);
+void destroy_hot_reload(SceneResources& scene);
+void upload_texture_image(const unsigned char* data, int width, int height);
+void render_scene(SceneResources& scene, GpuTimer& gpuTimer);
+int run_headless(const BenchmarkOptions& options);
+int build_chunked_mesh_file(const char* ply_file, const char* output_file);
+int push_draw(SceneResources& scene, const float model[16], const glm::vec4& color);
+void create_transform_nodes(SceneResources& scene);
+void place_transform_nodes(SceneResources& scene);
+void move_transform_nodes(SceneResources& scene);
+int update_transforms(SceneResources& scene);
+void setup_views(SceneResources& scene, const int full_viewport[4], int view_num);
+void cull_views(SceneResources& scene, int view_num, const bool crop_hit[9]);
+unsigned int cull_slot(SceneResources& scene, const glm::vec3& lo, const glm::vec3& hi, bool occludable);
+void add_command(ViewCommandList& list, int kind, int slot, unsigned int program, unsigned int texture, unsigned int vao, int first, int count, int triangles);
+void build_view_commands(SceneResources& scene, int view);
+int set_view_uniforms(SceneResources& scene, unsigned int program, const RenderView& rv);
+int submit_view(SceneResources& scene, int view);
+void dump_profile(const std::string& trace_file);
+bool start_input_log(const BenchmarkOptions& options);
+std::string get_shader_cache_path(const BenchmarkOptions& options);
+bool begin_input_frame(GLFWwindow* window);
+bool input_down(int key);
 
 std::random_device rd;
 std::default_random_engine eng(rd());
@@ -30,22 +231,30 @@ std::uniform_real_distribution<float> distr3(0, PI);
 std::uniform_real_distribution<float> distr4(PI, 2*PI);
 float angle = distr1(eng);
 
+InputLog inputLog;
+unsigned int inputButtons = 0; // held this frame, polled live or replayed
+
+// keys processInput reads, bit i of the button mask is LOGGED_KEYS[i]
+const int LOGGED_KEYS[] = { GLFW_KEY_ESCAPE, GLFW_KEY_P, GLFW_KEY_M, GLFW_KEY_O, GLFW_KEY_R, GLFW_KEY_V, GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D };
+const int LOGGED_KEY_NUM = sizeof(LOGGED_KEYS) / sizeof(LOGGED_KEYS[0]);
+const unsigned int PICK_BUTTON_BIT = 1u << 15;
+
 int main(int argc, char** argv)
 {
-    // load ply models
-    auto plyBunny = new PlyModel();
-    plyBunny->get_ply_model("models/bun_zipper_res4.ply");
-    plyBunny->add_normal_vectors();
-    // plyBunny->print_all_lists(); // test
-    // plyBunny->print_bounding_box(); // test
+    if (argc == 4 && std::string(argv[1]) == "--build-chunked-mesh")
+    {
+        return build_chunked_mesh_file(argv[2], argv[3]);
+    }
 
-    auto plyDragon = new PlyModel();
-    plyDragon->get_ply_model("models/dragon_vrip_res4.ply");
-    plyDragon->add_normal_vectors();
+    BenchmarkOptions options;
+    if (BenchmarkHarness::parse_args(argc, argv, options))
+    {
+        return run_headless(options);
+    }
 
-    auto plyHappy = new PlyModel();
-    plyHappy->get_ply_model("models/happy_vrip_res4.ply");
-    plyHappy->add_normal_vectors();
+    // load ply models
+    SceneResources scene;
+    load_models(scene);
 
     // initialize and configure
     glfwInit();
@@ -63,8 +272,12 @@ int main(int argc, char** argv)
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    if (options.replay_file.empty())
+    {
+        // a replay feeds the logged events instead of the live ones
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+    }
 
     // initializing GLAD
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -73,84 +286,313 @@ int main(int argc, char** argv)
         return -1;
     }
 
+    scene.procLoader = (ShaderProcLoader)glfwGetProcAddress;
+    scene.shaders.init(scene.procLoader, get_shader_cache_path(options));
+    load_scene_file(scene);
+    load_scene(scene);
+    if (hotReload)
+        init_hot_reload(scene);
+    if (!start_input_log(options))
+        return -1;
+    if (inputLog.is_replaying())
+        glfwSwapInterval(0); // uncapped, the replay is a benchmark
+
+    // frame instrumentation
+    GpuTimer gpuTimer;
+    gpuTimer.init();
+
+    // render loop
+    std::chrono::steady_clock::time_point loopStart = std::chrono::steady_clock::now();
+    int frameNum = 0;
+    while (!glfwWindowShouldClose(window))
+    {
+        PROFILE_BEGIN_FRAME();
+        gpuTimer.begin_frame();
+
+        float currentFrame = glfwGetTime();
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+
+        if (!begin_input_frame(window))
+            break; // the replay is over
+        processInput(window, scene);
+        if (hotReload)
+            poll_hot_reload(scene); // swaps finished reloads in before anything is drawn
+
+        render_scene(scene, gpuTimer);
+
+        {
+            PROFILE_SCOPE("swap");
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+
+        PROFILE_END_FRAME();
+        frameNum++;
+    }
+
+    if (inputLog.is_replaying())
+    {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count();
+        std::cout << "replayed " << frameNum << " frames in " << seconds << " s, " << 1000.0 * seconds / std::max(frameNum, 1) << " ms per frame" << std::endl;
+    }
+    inputLog.close();
+    dump_profile(options.trace_file);
+    gpuTimer.destroy();
+
+    scene.terrain.destroy();
+    scene.scan.destroy();
+    scene.drawRing.destroy();
+    scene.occlusion.destroy();
+    scene.viewJobs.destroy();
+    scene.resolutionTarget.destroy();
+    destroy_hot_reload(scene);
+    scene.shaders.destroy();
+
+    glfwTerminate();
+    return 0;
+}
+
+int run_headless(const BenchmarkOptions& options)
+{
+    // a replayed session sets the frame count, the timestep of each frame and the camera
+    BenchmarkOptions runOptions = options;
+    if (!options.replay_file.empty())
+    {
+        if (!start_input_log(options))
+            return -1;
+        runOptions.frames = inputLog.get_frame_num();
+        runOptions.seed = inputLog.get_seed();
+    }
+
+    BenchmarkHarness harness;
+    if (!harness.init(runOptions))
+        return -1;
+
+    SceneResources scene;
+    load_models(scene);
+    if (options.lights >= 0)
+        lightFieldSize = options.lights;
+    posedModels = options.posed_models;
+
+    HeadlessContext context;
+    if (!context.init(options.width, options.height))
+        return -1;
+
+    scene.procLoader = HeadlessContext::get_proc_address;
+    scene.shaders.init(scene.procLoader, get_shader_cache_path(options));
+    load_scene_file(scene);
+    load_scene(scene);
+    hotReload = options.hot_reload;
+    if (hotReload)
+        init_hot_reload(scene);
+
+    GpuTimer gpuTimer;
+    gpuTimer.init();
+
+    // deterministic simulation: seeded character walk and a fixed timestep
+    eng.seed(runOptions.seed);
+    angle = distr1(eng);
+    deltaTime = options.timestep;
+    meshletCulling = options.meshlet_culling;
+    occlusionCulling = options.occlusion_culling;
+    viewCount = options.views;
+    adaptiveResolution = options.frame_budget > 0.0f; // GPU times vary between runs, reference frames need it off
+    if (adaptiveResolution)
+        scene.governor.set_budget(options.frame_budget);
+    terrainBlocking = true;
+
+    uint64_t firstFrame = frameProfiler.get_frame_index();
+    std::vector<unsigned char> pixels;
+    for (int i = 0; i < runOptions.frames; ++i)
+    {
+        PROFILE_BEGIN_FRAME();
+        gpuTimer.begin_frame();
+        reset_draw_counts();
+        harness.begin_frame(i);
+
+        if (inputLog.is_replaying())
+        {
+            begin_input_frame(NULL);
+            processInput(NULL, scene);
+        }
+        else
+        {
+            float pos[3];
+            harness.sample_camera(i * options.timestep, pos, yaw, pitch);
+            cameraPos = glm::vec3(pos[0], pos[1], pos[2]);
+            update_camera_front();
+        }
+
+        if (hotReload)
+            poll_hot_reload(scene);
+
+        context.bind_framebuffer();
+        render_scene(scene, gpuTimer);
+
+        harness.end_frame(frameDraws.draw_calls, frameDraws.triangles);
+        PROFILE_END_FRAME();
+
+        if (harness.wants_image(i))
+        {
+            context.read_pixels(pixels);
+            harness.process_image(i, pixels, context.get_width(), context.get_height());
+        }
+    }
+
+    gpuTimer.flush();
+    for (int i = 0; i < runOptions.frames; ++i)
+    {
+        FrameRecord record;
+        if (frameProfiler.get_frame_record(firstFrame + i, record))
+        {
+            harness.set_frame_gpu_ms(i, record.gpu_ms);
+        }
+    }
+
+    harness.write_report();
+    harness.print_summary();
+    std::cout << "GPU timer: " << gpuTimer.get_discarded_num() << " frames discarded (warm-up or implausible)" << std::endl;
+    dump_profile(options.trace_file); // per-pass timings and cull rates over the last frames
+
+    gpuTimer.destroy();
+    scene.terrain.destroy();
+    scene.scan.destroy();
+    scene.drawRing.destroy();
+    scene.occlusion.destroy();
+    scene.viewJobs.destroy();
+    scene.resolutionTarget.destroy();
+    destroy_hot_reload(scene);
+    context.destroy();
+    return harness.get_failed_images() > 0 ? 1 : 0;
+}
+
+int build_chunked_mesh_file(const char* ply_file, const char* output_file)
+{
+    ChunkedMeshBuildParams params;
+    set_default_chunked_mesh_params(params);
+    ChunkedMeshBuildReport report;
+    std::string error;
+    if (!build_chunked_mesh(ply_file, output_file, params, report, error))
+    {
+        std::cout << "Fail to build " << output_file << ": " << error << std::endl;
+        return 1;
+    }
+
+    std::cout << ply_file << ": " << report.face_num << " faces -> " << report.leaf_num << " leaves, " << report.node_num << " nodes, "
+        << report.output_bytes / (1024 * 1024) << " MB in " << report.seconds << " s";
+    if (report.peak_rss_bytes > 0)
+        std::cout << ", peak rss " << report.peak_rss_bytes / (1024 * 1024) << " MB";
+    std::cout << std::endl;
+    return 0;
+}
+
+// clusters reorder the faces, so the LOD and BVH are built from the final face order
+void build_mesh_data(PlyModel& model, std::vector<Meshlet>& meshlets, MeshLod& shadow_lod, MeshBvh& bvh)
+{
+    const float* vertices = model.get_model_vertices();
+    unsigned int* faces = model.get_model_faces();
+    build_meshlets(vertices, PlyModel::VERTEX_STRIDE, faces, model.get_face_num(), MESHLET_MAX_TRIANGLES, meshlets);
+    build_lod(vertices, PlyModel::VERTEX_STRIDE, model.get_vertex_num(), faces, model.get_face_num(), SHADOW_LOD_GRID, shadow_lod);
+    bvh.build(vertices, PlyModel::VERTEX_STRIDE, faces, model.get_face_num(), BVH_BUILD_THREADS);
+    return;
+}
+
+void load_models(SceneResources& scene)
+{
+    // all three meshes share one arena block, sized from the file headers
+    size_t arenaBytes = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        arenaBytes += PlyModel::peek_buffer_bytes(ply_filenames[i]) + 2 * MeshArena::ALIGNMENT;
+    }
+    scene.meshArena.reset(new MeshArena(arenaBytes));
+
+    scene.plyBunny = PlyModel(scene.meshArena.get());
+    scene.plyBunny.get_ply_model(ply_filenames[0]);
+    scene.plyBunny.add_normal_vectors();
+    // scene.plyBunny.print_all_lists(); // test
+    // scene.plyBunny.print_bounding_box(); // test
+
+    scene.plyDragon = PlyModel(scene.meshArena.get());
+    scene.plyDragon.get_ply_model(ply_filenames[1]);
+    scene.plyDragon.add_normal_vectors();
+
+    scene.plyHappy = PlyModel(scene.meshArena.get());
+    scene.plyHappy.get_ply_model(ply_filenames[2]);
+    scene.plyHappy.add_normal_vectors();
+
+    // nothing needs the CPU copies yet, so none are pinned
+    scene.bunnyMesh = scene.residency.register_mesh("bunny", &scene.plyBunny, false);
+    scene.dragonMesh = scene.residency.register_mesh("dragon", &scene.plyDragon, false);
+    scene.happyMesh = scene.residency.register_mesh("happy", &scene.plyHappy, false);
+
+    // cluster the faces, reduce the shadow casters and build the picking hierarchies while the CPU copy is still around
+    scene.plyBvhs.resize(scene.residency.get_mesh_num());
+    for (int i = 0; i < scene.residency.get_mesh_num(); ++i)
+    {
+        MeshRecord& record = scene.residency.get_record(i);
+        build_mesh_data(*record.model, record.meshlets, record.shadow_lod, scene.plyBvhs[i]);
+        BvhStats bvhStats;
+        scene.plyBvhs[i].get_stats(bvhStats);
+        std::cout << record.name << " shadow LOD: " << record.index_count / 3 << " -> " << record.shadow_lod.indices.size() / 3 << " faces, BVH: "
+            << bvhStats.node_num << " nodes, depth " << bvhStats.max_depth << " in " << bvhStats.build_ms << " ms" << std::endl;
+    }
+
+    return;
+}
+
+void load_scene(SceneResources& scene)
+{
     glEnable(GL_DEPTH_TEST); // enabling Z-buffer
 
-    // create vertex shader
-    unsigned int vertexShader, reducedVertexShader, illumVertexShader;
-    create_shader(vertexShader, GL_VERTEX_SHADER, &vertexShaderSource);
-    create_shader(reducedVertexShader, GL_VERTEX_SHADER, &reducedVertexShaderSource);
-    create_shader(illumVertexShader, GL_VERTEX_SHADER, &illumVertexShaderSource);
-
-    // create fragment shader
-    unsigned int fragmentShader, illumModelFragmentShader, lightFragmentShader;
-    create_shader(fragmentShader, GL_FRAGMENT_SHADER, &fragmentShaderSource);
-    create_shader(illumModelFragmentShader, GL_FRAGMENT_SHADER, &illumModelFragmentShaderSource);
-    create_shader(lightFragmentShader, GL_FRAGMENT_SHADER, &lightFragmentShaderSource);
-
-    // create program and link shaders
-    unsigned int shaderProgram, illumProgram, illumObjectProgram;
-
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-
-    illumProgram = glCreateProgram();
-    glAttachShader(illumProgram, reducedVertexShader);
-    glAttachShader(illumProgram, lightFragmentShader);
-    glLinkProgram(illumProgram);
-
-    illumObjectProgram = glCreateProgram();
-    glAttachShader(illumObjectProgram, illumVertexShader);
-    glAttachShader(illumObjectProgram, illumModelFragmentShader);
-    glLinkProgram(illumObjectProgram);
-
-    int  success;
-    char infoLog[512];
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success); // exception handling
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINK_FAILED\n" << infoLog << std::endl;
-    }
-    glGetProgramiv(illumProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(illumProgram, 512, NULL, infoLog);
-        std::cout << "ERROR::ILLUM::PROGRAM::LINK_FAILED\n" << infoLog << std::endl;
-    }
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-    glDeleteShader(reducedVertexShader);
-    glDeleteShader(lightFragmentShader);
-    glDeleteShader(illumModelFragmentShader);
+    // every program permutation is compiled in one batch; the driver works on it while textures and buffers load
+    for (int i = 0; i < PROGRAM_NUM; i++)
+    {
+        build_program(scene, i, false);
+    }
+    scene.shaders.begin_build();
 
     // generate texture
-    unsigned int texture_soil, texture_crops, texture_tomoko;
-    unsigned int texture_bearing[4];
-
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     stbi_set_flip_vertically_on_load(true);
 
-    generate_texture(texture_soil, "img/soil.jpg");
-    generate_texture(texture_crops, "img/cornfield.jpg");
-    generate_texture(texture_tomoko, "img/tomoko.jpg");
+    generate_texture(scene.texture_soil, texture_filenames[0]);
+    generate_texture(scene.texture_crops, texture_filenames[1]);
+    generate_texture(scene.texture_tomoko, texture_filenames[2]);
     for (int i = 0; i < 4; i++)
     {
-        generate_texture(texture_bearing[i], bearing_filenames[i]);
+        generate_texture(scene.texture_bearing[i], bearing_filenames[i]);
     }
 
-    // configure ground
-    unsigned int VAO_soil;
-    configure_object_with_ebo(VAO_soil, 5, vertices, indices, sizeof(vertices), sizeof(indices));
+    // ground: heightfield chunks streamed around the camera, flat over the farm
+    TerrainParams terrainParams;
+    set_default_terrain_params(terrainParams);
+    scene.terrain.init(terrainParams, TERRAIN_VIEW_RADIUS, TERRAIN_MEMORY_BUDGET, TERRAIN_WORKERS, TERRAIN_UPLOADS_PER_FRAME);
+    scene.occlusion.init(OCCLUSION_WIDTH, OCCLUSION_HEIGHT, OCCLUSION_BANDS, OCCLUSION_WORKERS);
+    scene.drawRing.init(scene.procLoader, sizeof(DrawRecord), DRAW_RECORDS_PER_FRAME, DRAW_FRAMES_IN_FLIGHT, SLOT_MODELS);
+    create_transform_nodes(scene);
+    RingBufferStats ringStats;
+    scene.drawRing.get_stats(ringStats);
+    std::cout << "draw data: " << (ringStats.persistent ? "persistent mapped" : "buffer sub data") << " ring, " << DRAW_FRAMES_IN_FLIGHT << " frames" << std::endl;
+    scene.scanInstance = -1;
+    if (scene.scan.init(CHUNKED_MESH_FILE, CHUNKED_MESH_GPU_BUDGET, CHUNKED_MESH_UPLOADS_PER_FRAME, CHUNKED_MESH_PIXEL_ERROR))
+    {
+        scene.scanInstance = scene.residency.get_mesh_num();
+        ChunkedMeshStats scanStats;
+        scene.scan.get_stats(scanStats);
+        std::cout << CHUNKED_MESH_FILE << ": " << scanStats.node_num << " nodes, streamed within " << CHUNKED_MESH_GPU_BUDGET / (1024 * 1024) << " MB" << std::endl;
+    }
 
     // configure others
-    unsigned int VBO, VAO;
-    glGenVertexArrays(1, &VAO);
+    unsigned int VBO;
+    glGenVertexArrays(1, &scene.VAO);
     glGenBuffers(1, &VBO);
 
-    glBindVertexArray(VAO);
+    glBindVertexArray(scene.VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
@@ -162,11 +604,11 @@ int main(int argc, char** argv)
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
-    unsigned int VBO_char, VAO_char;
-    glGenVertexArrays(1, &VAO_char);
+    unsigned int VBO_char;
+    glGenVertexArrays(1, &scene.VAO_char);
     glGenBuffers(1, &VBO_char);
 
-    glBindVertexArray(VAO_char);
+    glBindVertexArray(scene.VAO_char);
     glBindBuffer(GL_ARRAY_BUFFER, VBO_char);
     glBufferData(GL_ARRAY_BUFFER, sizeof(character_vertices), character_vertices, GL_STATIC_DRAW);
 
@@ -175,31 +617,22 @@ int main(int argc, char** argv)
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
-    unsigned int VAO_brn;
-    configure_object_with_ebo(VAO_brn, 5, brn_vertices, indices, sizeof(brn_vertices), sizeof(indices));
-
-    // configure ply models
-    unsigned int VAO_bunny, VAO_dragon, VAO_happy;
-    int v_num = plyBunny->get_vertex_num();
-    int f_num = plyBunny->get_face_num();
-    int v_size = sizeof(float) * 6 * v_num;
-    int f_size = sizeof(unsigned int) * 3 * f_num;
-    configure_object_with_ebo(VAO_bunny, 6, plyBunny->get_model_vertices(), plyBunny->get_model_faces(), v_size, f_size);
+    configure_object_with_ebo(scene.VAO_brn, 5, brn_vertices, indices, sizeof(brn_vertices), sizeof(indices));
 
-    v_size = sizeof(float) * 6 * plyDragon->get_vertex_num();
-    f_size = sizeof(unsigned int) * 3 * plyDragon->get_face_num();
-    configure_object_with_ebo(VAO_dragon, 6, plyDragon->get_model_vertices(), plyDragon->get_model_faces(), v_size, f_size);
-
-    v_size = sizeof(float) * 6 * plyHappy->get_vertex_num();
-    f_size = sizeof(unsigned int) * 3 * plyHappy->get_face_num();
-    configure_object_with_ebo(VAO_happy, 6, plyHappy->get_model_vertices(), plyHappy->get_model_faces(), v_size, f_size);
+    // configure ply models, unpinned CPU copies are dropped as soon as they are uploaded
+    scene.meshArena->print_memory_report("ply models loaded");
+    for (int i = 0; i < scene.residency.get_mesh_num(); ++i)
+    {
+        upload_mesh(scene.residency, i);
+    }
+    scene.residency.print_memory_report();
 
     // configure light source
-    unsigned int VBO_light, VAO_light;
-    glGenVertexArrays(1, &VAO_light);
+    unsigned int VBO_light;
+    glGenVertexArrays(1, &scene.VAO_light);
     glGenBuffers(1, &VBO_light);
 
-    glBindVertexArray(VAO_light);
+    glBindVertexArray(scene.VAO_light);
     glBindBuffer(GL_ARRAY_BUFFER, VBO_light);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
 
@@ -208,250 +641,840 @@ int main(int argc, char** argv)
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
-    // constant settings
-    glUseProgram(illumObjectProgram);
-    int objColorLoc = glGetUniformLocation(illumObjectProgram, "objectColor");
-    int lightColorLoc = glGetUniformLocation(illumObjectProgram, "lightColor");
-    int lightPosLoc;
-    glUniform3f(objColorLoc, 1.0f, 0.5f, 0.31f);
-    glUniform3f(lightColorLoc, 1.0f, 1.0f, 1.0f);
+    // shadow casters: crops, ply models and the area the character walks in; the ground receives
+    scene.shadowMap.init(SHADOW_MAP_SIZE, SHADOW_LIGHT_THRESHOLD);
+    create_ply_instances(scene);
+    update_scene_bounds(scene);
 
-    // render loop
-    while (!glfwWindowShouldClose(window))
+    scene.shaders.finish_build();
+    scene.shaders.print_report();
+
+    // clustered point lights
+    create_light_field(scene, lightFieldSize);
+    for (int v = 0; v < MULTI_VIEW_MAX; v++)
     {
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        scene.views[v].clusters.init(CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES, NEAR_PLANE, FAR_PLANE);
+    }
+    scene.viewJobs.init(VIEW_WORKERS);
+    scene.governor.init(frameBudgetMs, RENDER_SCALE_MIN, GOVERNOR_SETTLE_FRAMES);
+    scene.lightBuffers.init();
+    set_program_uniforms(scene);
 
-        processInput(window);
+    return;
+}
 
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glClear(GL_COLOR_BUFFER_BIT);
+// uniforms that never change; set again whenever a reloaded program replaces an old one
+void set_program_uniforms(SceneResources& scene)
+{
+    scene.shaderProgram = scene.shaders.get_program(scene.programIds[PROGRAM_TEXTURED]);
+    scene.illumProgram = scene.shaders.get_program(scene.programIds[PROGRAM_LIGHT]);
+    scene.illumObjectProgram = scene.shaders.get_program(scene.programIds[PROGRAM_MODEL]);
+    scene.shadowProgram = scene.shaders.get_program(scene.programIds[PROGRAM_SHADOW]);
 
-        glUseProgram(shaderProgram);
+    unsigned int litPrograms[] = { scene.shaderProgram, scene.illumObjectProgram };
+    for (int i = 0; i < 2; i++)
+    {
+        glUseProgram(litPrograms[i]);
+        glUniform1i(glGetUniformLocation(litPrograms[i], "lightData"), LIGHT_BUFFER_UNIT);
+        glUniform1i(glGetUniformLocation(litPrograms[i], "clusterData"), LIGHT_BUFFER_UNIT + 1);
+        glUniform1i(glGetUniformLocation(litPrograms[i], "lightIndices"), LIGHT_BUFFER_UNIT + 2);
+        glUniform3i(glGetUniformLocation(litPrograms[i], "clusterDims"), CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES);
+        glUniform3f(glGetUniformLocation(litPrograms[i], "clusterDepth"), NEAR_PLANE, FAR_PLANE, scene.views[0].clusters.get_slice_scale());
+    }
 
-        // update camera
-        glm::mat4 view;
-        view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-        glm::mat4 projection = glm::perspective(glm::radians(fov), 800.0f / 600.0f, 0.1f, 100.0f);
+    // constant settings
+    glUseProgram(scene.shaderProgram);
+    glUniform1i(glGetUniformLocation(scene.shaderProgram, "shadowMap"), 1);
+    glUniform1i(glGetUniformLocation(scene.shaderProgram, "drawData"), DRAW_DATA_UNIT);
 
-        // draw ground
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    glUseProgram(scene.illumProgram);
+    glUniform1i(glGetUniformLocation(scene.illumProgram, "drawData"), DRAW_DATA_UNIT);
 
-        int modelLoc = glGetUniformLocation(shaderProgram, "model");
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        int viewLoc = glGetUniformLocation(shaderProgram, "view");
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        int projLoc = glGetUniformLocation(shaderProgram, "projection");
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-        int colorLocation = glGetUniformLocation(shaderProgram, "ourColor");
-        glUniform4f(colorLocation, 0.5f, 0.5f, 0.5f, 1.0f);
+    glUseProgram(scene.illumObjectProgram);
+    int objColorLoc = glGetUniformLocation(scene.illumObjectProgram, "objectColor");
+    int lightColorLoc = glGetUniformLocation(scene.illumObjectProgram, "lightColor");
+    glUniform3f(objColorLoc, 1.0f, 0.5f, 0.31f);
+    glUniform3f(lightColorLoc, 1.0f, 1.0f, 1.0f);
+    glUniform1i(glGetUniformLocation(scene.illumObjectProgram, "shadowMap"), 1);
+    glUniform1i(glGetUniformLocation(scene.illumObjectProgram, "instanceData"), INSTANCE_BUFFER_UNIT);
 
-        glBindTexture(GL_TEXTURE_2D, texture_soil);
-        glBindVertexArray(VAO_soil);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    return;
+}
 
-        // draw bearing signs
-        model = glm::mat4(1.0f);
+void render_scene(SceneResources& scene, GpuTimer& gpuTimer)
+{
+    // per-draw records are written once into this frame's ring region, shaders fetch them by index
+    scene.drawRing.begin_frame();
+    scene.drawRing.bind(DRAW_DATA_UNIT);
 
-        for (int i = 0; i < 4; i++)
+    // model and normal matrices of the instances, uploaded again only after they were placed
+    int matricesUpdated = 0;
+    {
+        PROFILE_SCOPE("instances");
+        if (scene.instancesDirty)
         {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, brnPositions[i]);
-            model = glm::rotate(model, glm::radians((i+1) * 90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            modelLoc = glGetUniformLocation(shaderProgram, "model");
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-            colorLocation = glGetUniformLocation(shaderProgram, "ourColor");
-            glUniform4f(colorLocation, 1.0f, 1.0f, 1.0f, 1.0f);
-
-            glBindTexture(GL_TEXTURE_2D, texture_bearing[i]);
-            glBindVertexArray(VAO_brn);
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+            scene.instanceBuffer.upload(scene.plyMatrices);
+            matricesUpdated += (int)scene.plyMatrices.size();
+            scene.instancesDirty = false;
         }
+        scene.instanceBuffer.bind(INSTANCE_BUFFER_UNIT);
+    }
 
-        // draw others
-        glBindTexture(GL_TEXTURE_2D, texture_crops);
-        glBindVertexArray(VAO);
-        bool judgeCollision;
-        for (unsigned int i = 0; i < 9; i++)
-        {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            modelLoc = glGetUniformLocation(shaderProgram, "model");
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    // hold the frame budget: the governor sees the latest resolved GPU frame and picks this frame's scale and quality
+    float renderScale = 1.0f;
+    float lodBias = 1.0f;
+    if (adaptiveResolution)
+    {
+        double gpuMs;
+        if (gpuTimer.take_frame_ms(gpuMs))
+            scene.governor.add_sample(gpuMs);
+        renderScale = scene.governor.get_scale();
+        lodBias = scene.governor.get_lod_bias();
+    }
+    scene.terrain.set_lod_bias(lodBias);
+    scene.resolutionTarget.begin(renderScale);
+
+    // update cameras, the first view is the free camera
+    int frameViewport[4];
+    glGetIntegerv(GL_VIEWPORT, frameViewport);
+    int viewNum = std::max(1, std::min(viewCount, MULTI_VIEW_MAX));
+    setup_views(scene, frameViewport, viewNum);
+    const RenderView& mainView = scene.views[0];
+
+    // the occlusion workers rasterize from the free camera while the shadow pass is submitted
+    if (occlusionCulling)
+    {
+        PROFILE_SCOPE("occluders");
+        submit_occluders(scene, mainView.projection * mainView.view);
+    }
 
-            colorLocation = glGetUniformLocation(shaderProgram, "ourColor");
-            judgeCollision = check_collision(currentX-0.8, currentZ-0.8, 1.6, cubePositions[i][0]-1, cubePositions[i][2]-1, 2);
-            if (judgeCollision)
-            {
-                glUniform4f(colorLocation, 2.0f, 2.0f, 2.0f, 1.0f);
-            }
-            else
-            {
-                glUniform4f(colorLocation, 0.7f, 0.7f, 0.7f, 1.0f);
-            }
+    GPU_FRAME_SCOPE(gpuTimer);
 
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-        } // crops
+    // shadow pass first, it renders into its own framebuffer
+    {
+        PROFILE_SCOPE("shadow");
+        PROFILE_GPU_SCOPE(gpuTimer, "shadow");
+        render_shadow_map(scene);
+    }
 
-        // draw character
-        character_random_move(); // calculate current position
-        glBindTexture(GL_TEXTURE_2D, texture_tomoko);
-        glBindVertexArray(VAO_char);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(currentX, 1.6f, currentZ));
-        model = glm::scale(model, glm::vec3(0.8f, 0.8f, 0.8f));
-        modelLoc = glGetUniformLocation(shaderProgram, "model");
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        colorLocation = glGetUniformLocation(shaderProgram, "ourColor");
-        glUniform4f(colorLocation, 1.0f, 1.0f, 1.0f, 1.0f);
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, scene.shadowMap.get_depth_texture());
+    glActiveTexture(GL_TEXTURE0);
+    scene.lightBuffers.bind(LIGHT_BUFFER_UNIT);
 
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+    // move everything once per frame, whatever the number of views
+    bool cropHit[9];
+    {
+        PROFILE_SCOPE("simulation");
 
-        // Now we switch to 'Illumination Sector'
-        glUseProgram(illumProgram);
+        move_light_field(scene);
+        scene.terrain.update(cameraPos[0], cameraPos[2], terrainBlocking);
 
-        // draw light source
+        // crops light up where the character stood before this step
+        for (int i = 0; i < 9; i++)
+        {
+            cropHit[i] = check_collision(currentX-0.8, currentZ-0.8, 1.6, cubePositions[i][0]-1, cubePositions[i][2]-1, 2);
+        }
+        character_random_move(scene); // calculate current position
         light_source_move();
-        projLoc = glGetUniformLocation(illumProgram, "projection");
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-        viewLoc = glGetUniformLocation(illumProgram, "view");
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        move_transform_nodes(scene);
+        matricesUpdated += update_transforms(scene);
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, lightPosition);
-        model = glm::scale(model, glm::vec3(0.4f, 0.4f, 0.4f));
-        modelLoc = glGetUniformLocation(illumProgram, "model");
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-        glBindVertexArray(VAO_light);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // draw models
-        glUseProgram(illumObjectProgram);
-
-        lightPosLoc = glGetUniformLocation(illumObjectProgram, "lightPos");
-        glUniform3f(lightPosLoc, lightPosition[0], lightPosition[1], lightPosition[2]);
-        projLoc = glGetUniformLocation(illumObjectProgram, "projection");
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-        viewLoc = glGetUniformLocation(illumObjectProgram, "view");
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        modelLoc = glGetUniformLocation(illumObjectProgram, "model");
-               
-        int viewPosLoc = glGetUniformLocation(illumObjectProgram, "viewPos");
-        glUniform3f(viewPosLoc, cameraPos[0], cameraPos[1], cameraPos[2]);
+        if (scene.scanInstance >= 0)
+        {
+            // refine in the scan's own space for the free camera, the error bound is scale invariant
+            Frustum frustum;
+            glm::mat4 viewProj = mainView.projection * mainView.view;
+            extract_frustum(glm::value_ptr(viewProj), frustum);
+            glm::mat4 scanModel = ply_model_matrix(scene, scene.scanInstance);
+            Frustum localFrustum;
+            transform_frustum(frustum, glm::value_ptr(scanModel), localFrustum);
+            float inverse[16], localCamera[3];
+            invert_affine(glm::value_ptr(scanModel), inverse);
+            transform_point(inverse, glm::value_ptr(cameraPos), localCamera);
+            float pixelScale = mainView.viewport[3] / (2.0f * tanf(glm::radians(fov) * 0.5f)) / lodBias;
+            scene.scan.update(localFrustum, localCamera, pixelScale, terrainBlocking);
+        }
+    }
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, bunnyPosition);
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 10.0f));
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    // one box test against all views, then one draw record per object for every view that sees it
+    {
+        PROFILE_SCOPE("view culling");
+        cull_views(scene, viewNum, cropHit);
+    }
 
-        glBindVertexArray(VAO_bunny);
-        f_num = plyBunny->get_face_num();
-        glDrawElements(GL_TRIANGLES, 3 * f_num, GL_UNSIGNED_INT, 0);
+    // command lists for all views side by side; nothing in here touches GL
+    {
+        PROFILE_SCOPE("view commands");
+        scene.viewJobs.run(viewNum, [&scene](int view) { build_view_commands(scene, view); });
+    }
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, dragonPosition);
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 10.0f));
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    // submit view by view, state only changes where consecutive commands differ
+    double submitMs = 0.0;
+    int submitObjects = 0;
+    {
+        PROFILE_SCOPE("submit");
+        PROFILE_GPU_SCOPE(gpuTimer, "views");
 
-        glBindVertexArray(VAO_dragon);
-        f_num = plyDragon->get_face_num();
-        glDrawElements(GL_TRIANGLES, 3 * f_num, GL_UNSIGNED_INT, 0);
+        std::chrono::steady_clock::time_point submitStart = std::chrono::steady_clock::now();
+        for (int v = 0; v < viewNum; v++)
+        {
+            submitObjects += submit_view(scene, v);
+            if (v == 0)
+            {
+                TerrainStats terrainStats;
+                scene.terrain.get_stats(terrainStats);
+                PROFILE_VALUE("terrain chunks resident", terrainStats.resident);
+                PROFILE_VALUE("terrain chunks pending", terrainStats.pending);
+                PROFILE_VALUE("terrain chunks drawn", terrainStats.drawn);
+                PROFILE_VALUE("terrain MB", terrainStats.gpu_bytes / (1024.0 * 1024.0));
+                if (terrainStats.generated > 0)
+                    PROFILE_VALUE("terrain chunk generate ms", terrainStats.generate_ms / terrainStats.generated);
+            }
+        }
+        glViewport(frameViewport[0], frameViewport[1], frameViewport[2], frameViewport[3]);
+        submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
+    }
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, happyPosition);
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 10.0f));
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    {
+        PROFILE_SCOPE("upscale");
+        PROFILE_GPU_SCOPE(gpuTimer, "upscale");
+        scene.resolutionTarget.end();
+    }
 
-        glBindVertexArray(VAO_happy);
-        f_num = plyHappy->get_face_num();
-        glDrawElements(GL_TRIANGLES, 3 * f_num, GL_UNSIGNED_INT, 0);
+    // stats of the free camera, plus what the extra views cost
+    LightClusterStats lightStats;
+    mainView.clusters.get_stats(lightStats);
+    PROFILE_VALUE("lights visible", lightStats.visible_num);
+    PROFILE_VALUE("lights per cluster max", lightStats.max_per_cluster);
+    PROFILE_VALUE("lights per occupied cluster", lightStats.occupied_clusters > 0 ? (double)lightStats.index_num / lightStats.occupied_clusters : 0.0);
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    const MeshletCullStats& cullStats = mainView.commands.cull_stats;
+    if (cullStats.meshlet_num > 0)
+    {
+        PROFILE_VALUE("meshlets rejected %", 100.0 * (cullStats.frustum_culled + cullStats.backface_culled) / cullStats.meshlet_num);
+        PROFILE_VALUE("meshlet vertex shader savings %", 100.0 * cullStats.indices_culled / cullStats.index_num);
+        PROFILE_VALUE("meshlet draw ranges", cullStats.draw_ranges);
     }
 
-    glDeleteProgram(shaderProgram);
-    glDeleteProgram(illumProgram);
+    if (scene.scanInstance >= 0)
+    {
+        ChunkedMeshStats scanStats;
+        scene.scan.get_stats(scanStats);
+        PROFILE_VALUE("scan levels drawn", scanStats.drawn);
+        PROFILE_VALUE("scan levels resident", scanStats.resident);
+        PROFILE_VALUE("scan levels wanted", scanStats.wanted);
+        PROFILE_VALUE("scan uploads", scanStats.uploaded);
+        PROFILE_VALUE("scan evictions", scanStats.evicted);
+        PROFILE_VALUE("scan MB", scanStats.gpu_bytes / (1024.0 * 1024.0));
+    }
 
-    glfwTerminate();
-    return 0;
+    if (occlusionCulling)
+    {
+        OcclusionStats occlusionStats;
+        scene.occlusion.get_stats(occlusionStats);
+        PROFILE_VALUE("occluded objects", occlusionStats.occluded);
+        PROFILE_VALUE("occlusion tested objects", occlusionStats.tested);
+        PROFILE_VALUE("occlusion raster ms", occlusionStats.raster_ms);
+    }
+
+    if (viewNum > 1)
+    {
+        MultiViewStats viewStats;
+        scene.viewCuller.get_stats(viewStats);
+        PROFILE_VALUE("views", viewNum);
+        PROFILE_VALUE("view union rejected", viewStats.union_rejected);
+        PROFILE_VALUE("view tests per object", viewStats.tested > 0 ? (double)viewStats.view_tests / viewStats.tested : 0.0);
+    }
+
+    PROFILE_VALUE("matrices updated", matricesUpdated);
+
+    if (adaptiveResolution)
+    {
+        GovernorStats governorStats;
+        scene.governor.get_stats(governorStats);
+        PROFILE_VALUE("render scale", governorStats.scale);
+        PROFILE_VALUE("quality level", governorStats.quality_level);
+        PROFILE_VALUE("governor gpu ms", governorStats.smoothed_ms);
+        PROFILE_VALUE("governor changes", governorStats.changes);
+    }
+
+    RingBufferStats ringStats;
+    scene.drawRing.get_stats(ringStats);
+    PROFILE_VALUE("draw records", ringStats.records);
+    if (ringStats.static_writes > 0)
+        PROFILE_VALUE("static draw records written", ringStats.static_writes);
+    PROFILE_VALUE("draw ring wait ms", ringStats.wait_ms);
+    if (ringStats.overflows > 0)
+        PROFILE_VALUE("draw ring overflows", ringStats.overflows);
+    if (submitObjects > 0)
+        PROFILE_VALUE("submit us per object", 1000.0 * submitMs / submitObjects);
+    scene.drawRing.end_frame();
+
+    return;
 }
 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+// free camera, overhead, follow-character and field corner, each in its own tile of the framebuffer
+void setup_views(SceneResources& scene, const int full_viewport[4], int view_num)
 {
-    glViewport(0, 0, width, height);
+    for (int v = 0; v < view_num; v++)
+    {
+        RenderView& rv = scene.views[v];
+        split_viewport(full_viewport, view_num, v, rv.viewport);
+        float aspect = (float)rv.viewport[2] / (float)std::max(rv.viewport[3], 1);
+        float viewFov = 45.0f;
+
+        glm::vec3 target = glm::vec3(0.0f);
+        glm::vec3 up = cameraUp;
+        if (v == 0)
+        {
+            rv.position = cameraPos;
+            target = cameraPos + cameraFront;
+            viewFov = fov;
+        }
+        else if (v == 1)
+        {
+            rv.position = overheadViewPosition;
+            up = glm::vec3(0.0f, 0.0f, -1.0f); // looking straight down, north stays up
+        }
+        else if (v == 2)
+        {
+            target = glm::vec3(currentX, 1.6f, currentZ);
+            rv.position = target - followViewDistance * glm::vec3(cos(angle), 0.0f, sin(angle)) + glm::vec3(0.0f, followViewHeight, 0.0f);
+        }
+        else
+        {
+            rv.position = cornerViewPosition;
+        }
+
+        rv.view = glm::lookAt(rv.position, target, up);
+        rv.projection = glm::perspective(glm::radians(viewFov), aspect, NEAR_PLANE, FAR_PLANE);
+    }
+    return;
 }
 
-void processInput(GLFWwindow* window)
+// masks every draw slot with the views that may see it and writes its draw record once for all of them
+void cull_views(SceneResources& scene, int view_num, const bool crop_hit[9])
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+    float viewProjs[MULTI_VIEW_MAX][16];
+    const float* viewProjPointers[MULTI_VIEW_MAX];
+    for (int v = 0; v < view_num; v++)
+    {
+        glm::mat4 viewProj = scene.views[v].projection * scene.views[v].view;
+        memcpy(viewProjs[v], glm::value_ptr(viewProj), sizeof(viewProjs[v]));
+        viewProjPointers[v] = viewProjs[v];
+    }
+    scene.viewCuller.begin(viewProjPointers, view_num);
 
-    float cameraSpeed = 2.5f * deltaTime;
-    glm::vec3 tempPos;
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        tempPos = cameraPos + cameraSpeed * cameraFront;
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        tempPos = cameraPos - cameraSpeed * cameraFront;
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        tempPos = cameraPos - glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        tempPos = cameraPos + glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+    int slotNum = SLOT_MODELS + scene.residency.get_mesh_num() + 1;
+    scene.slotMasks.assign(slotNum, 0);
+    scene.slotRecords.assign(slotNum, 0);
 
-    if (tempPos[1] < 0.005 || tempPos[1] > 20)
-        return;
-    else if (tempPos[0] < -19.995 || tempPos[0] > 19.995)
+    // the ground and the signs are in every view, chunks are culled per view when they are drawn;
+    // static slots draw with the record written when they were last placed
+    scene.slotMasks[SLOT_GROUND] = (1u << view_num) - 1;
+    scene.slotRecords[SLOT_GROUND] = SLOT_GROUND;
+    for (int i = 0; i < 4; i++)
     {
-        tempPos[0] = 0 - tempPos[0];
+        scene.slotMasks[SLOT_BEARINGS + i] = scene.slotMasks[SLOT_GROUND];
+        scene.slotRecords[SLOT_BEARINGS + i] = SLOT_BEARINGS + i;
     }
-    else if (tempPos[2] < -19.995 || tempPos[2] > 19.995)
+
+    for (int i = 0; i < 9; i++)
     {
-        tempPos[2] = 0 - tempPos[2];
+        scene.slotMasks[SLOT_CROPS + i] = cull_slot(scene, cubePositions[i] - glm::vec3(1.0f), cubePositions[i] + glm::vec3(1.0f), true);
+        scene.slotRecords[SLOT_CROPS + i] = SLOT_CROPS + i;
+        if (scene.slotMasks[SLOT_CROPS + i] != 0 && crop_hit[i])
+            scene.slotRecords[SLOT_CROPS + i] = push_draw(scene, scene.transforms.get_world(scene.slotNodes[SLOT_CROPS + i]), cropHitColor);
     }
 
-    cameraPos = tempPos;
+    // moving slots write a fresh record every frame
+    glm::vec3 characterPos = glm::vec3(currentX, 1.6f, currentZ);
+    scene.slotMasks[SLOT_CHARACTER] = cull_slot(scene, characterPos - glm::vec3(0.8f), characterPos + glm::vec3(0.8f), true);
+    if (scene.slotMasks[SLOT_CHARACTER] != 0)
+        scene.slotRecords[SLOT_CHARACTER] = push_draw(scene, scene.transforms.get_world(scene.slotNodes[SLOT_CHARACTER]), characterColor);
+
+    scene.slotMasks[SLOT_LIGHT] = cull_slot(scene, lightPosition - glm::vec3(0.4f), lightPosition + glm::vec3(0.4f), false);
+    if (scene.slotMasks[SLOT_LIGHT] != 0)
+        scene.slotRecords[SLOT_LIGHT] = push_draw(scene, scene.transforms.get_world(scene.slotNodes[SLOT_LIGHT]), glm::vec4(1.0f));
+
+    // models read their matrices from the instance buffer
+    for (int i = 0; i < scene.residency.get_mesh_num(); i++)
+    {
+        scene.slotMasks[SLOT_MODELS + i] = cull_slot(scene, scene.plyBoundsMin[i], scene.plyBoundsMax[i], true);
+        scene.slotRecords[SLOT_MODELS + i] = i;
+    }
+    if (scene.scanInstance >= 0)
+    {
+        scene.slotMasks[SLOT_MODELS + scene.scanInstance] = cull_slot(scene, scene.scanBoundsMin, scene.scanBoundsMax, true);
+        scene.slotRecords[SLOT_MODELS + scene.scanInstance] = scene.scanInstance;
+    }
     return;
 }
 
-void mouse_callback(GLFWwindow* window, double xpos, double ypos)
+unsigned int cull_slot(SceneResources& scene, const glm::vec3& lo, const glm::vec3& hi, bool occludable)
 {
-    if (firstMouse)
-    {
-        lastX = xpos;
-        lastY = ypos;
-        firstMouse = false;
-    }
+    unsigned int mask = scene.viewCuller.cull(glm::value_ptr(lo), glm::value_ptr(hi));
 
-    float xoffset = xpos - lastX;
-    float yoffset = lastY - ypos;
-    lastX = xpos;
-    lastY = ypos;
+    // the occlusion buffer is rendered from the free camera only
+    if (occludable && (mask & 1u) != 0 && !is_visible(scene, lo, hi))
+        mask &= ~1u;
+    return mask;
+}
 
-    float sensitivity = 0.05;
-    xoffset *= sensitivity;
-    yoffset *= sensitivity;
+void add_command(ViewCommandList& list, int kind, int slot, unsigned int program, unsigned int texture, unsigned int vao, int first, int count, int triangles)
+{
+    DrawCommand command;
+    command.kind = kind;
+    command.slot = slot;
+    command.program = program;
+    command.texture = texture;
+    command.vao = vao;
+    command.first = first;
+    command.count = count;
+    command.triangles = triangles;
+    command.cull_back = false;
+    list.commands.push_back(command);
+    return;
+}
 
-    yaw += xoffset;
-    pitch += yoffset;
+// runs on the view workers: bins the point lights for this view and lists its draws in submission order
+void build_view_commands(SceneResources& scene, int view)
+{
+    RenderView& rv = scene.views[view];
+    ViewCommandList& list = rv.commands;
+    list.commands.clear();
+    list.counts.clear();
+    list.offsets.clear();
+    reset_cull_stats(list.cull_stats);
+    unsigned int bit = 1u << view;
 
-    if (pitch > 89.0f)
-        pitch = 89.0f;
-    if (pitch < -89.0f)
-        pitch = -89.0f;
+    rv.clusters.bin(scene.pointLights, glm::value_ptr(rv.view), glm::value_ptr(rv.projection));
 
-    glm::vec3 front;
-    front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-    front.y = sin(glm::radians(pitch));
+    add_command(list, DRAW_TERRAIN, SLOT_GROUND, scene.shaderProgram, scene.texture_soil, 0, 0, 0, 0);
+    for (int i = 0; i < 4; i++)
+    {
+        if (scene.slotMasks[SLOT_BEARINGS + i] & bit)
+            add_command(list, DRAW_ELEMENTS, SLOT_BEARINGS + i, scene.shaderProgram, scene.texture_bearing[i], scene.VAO_brn, 0, 6, 2);
+    }
+    for (int i = 0; i < 9; i++)
+    {
+        if (scene.slotMasks[SLOT_CROPS + i] & bit)
+            add_command(list, DRAW_ARRAYS, SLOT_CROPS + i, scene.shaderProgram, scene.texture_crops, scene.VAO, 0, 36, 12);
+    }
+    if (scene.slotMasks[SLOT_CHARACTER] & bit)
+        add_command(list, DRAW_ARRAYS, SLOT_CHARACTER, scene.shaderProgram, scene.texture_tomoko, scene.VAO_char, 0, 36, 12);
+    if (scene.slotMasks[SLOT_LIGHT] & bit)
+        add_command(list, DRAW_ARRAYS, SLOT_LIGHT, scene.illumProgram, 0, scene.VAO_light, 0, 36, 12);
+
+    int plyMeshes[] = { scene.bunnyMesh, scene.dragonMesh, scene.happyMesh };
+    for (int i = 0; i < 3; i++)
+    {
+        if (scene.slotMasks[SLOT_MODELS + plyMeshes[i]] & bit)
+            add_ply_commands(scene, rv, view, plyMeshes[i]);
+    }
+    if (scene.scanInstance >= 0 && (scene.slotMasks[SLOT_MODELS + scene.scanInstance] & bit))
+        add_command(list, DRAW_SCAN, SLOT_MODELS + scene.scanInstance, scene.illumObjectProgram, 0, 0, 0, 0, 0);
+    return;
+}
+
+// view, projection and the per-view lighting inputs of a program; returns where its draw or instance index goes
+int set_view_uniforms(SceneResources& scene, unsigned int program, const RenderView& rv)
+{
+    glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(rv.view));
+    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(rv.projection));
+    if (program == scene.illumProgram)
+        return glGetUniformLocation(program, "drawIndex");
+
+    // fragments find their cluster relative to the view's own tile
+    glUniformMatrix4fv(glGetUniformLocation(program, "lightSpace"), 1, GL_FALSE, glm::value_ptr(scene.shadowMap.get_light_space()));
+    glUniform2f(glGetUniformLocation(program, "clusterTileSize"), (float)rv.viewport[2] / CLUSTER_TILES_X, (float)rv.viewport[3] / CLUSTER_TILES_Y);
+    glUniform2f(glGetUniformLocation(program, "clusterOrigin"), (float)rv.viewport[0], (float)rv.viewport[1]);
+    glUniform1i(glGetUniformLocation(program, "shadowRadius"), adaptiveResolution ? scene.governor.get_shadow_radius() : 1);
+    if (program != scene.illumObjectProgram)
+        return glGetUniformLocation(program, "drawIndex");
+
+    glUniform3f(glGetUniformLocation(program, "lightPos"), lightPosition[0], lightPosition[1], lightPosition[2]);
+    glUniform3f(glGetUniformLocation(program, "viewPos"), rv.position[0], rv.position[1], rv.position[2]);
+    return glGetUniformLocation(program, "instanceIndex");
+}
+
+// replays one view's command list into its tile, returns the number of draws
+int submit_view(SceneResources& scene, int view)
+{
+    const RenderView& rv = scene.views[view];
+    const ViewCommandList& list = rv.commands;
+    glViewport(rv.viewport[0], rv.viewport[1], rv.viewport[2], rv.viewport[3]);
+    scene.lightBuffers.upload(scene.pointLights, rv.clusters); // orphaned, earlier views keep their lights
+
+    unsigned int program = 0, texture = 0, vao = 0;
+    int indexLoc = -1;
+    bool cullBack = false;
+    for (size_t i = 0; i < list.commands.size(); i++)
+    {
+        const DrawCommand& command = list.commands[i];
+        if (command.cull_back != cullBack)
+        {
+            cullBack = command.cull_back;
+            if (cullBack)
+                glEnable(GL_CULL_FACE);
+            else
+                glDisable(GL_CULL_FACE);
+        }
+        if (command.program != program)
+        {
+            program = command.program;
+            glUseProgram(program);
+            indexLoc = set_view_uniforms(scene, program, rv);
+        }
+        if (command.texture != 0 && command.texture != texture)
+        {
+            texture = command.texture;
+            glBindTexture(GL_TEXTURE_2D, texture);
+        }
+        if (command.vao != 0 && command.vao != vao)
+        {
+            vao = command.vao;
+            glBindVertexArray(vao);
+        }
+        glUniform1i(indexLoc, scene.slotRecords[command.slot]);
+
+        switch (command.kind)
+        {
+        case DRAW_ARRAYS:
+            glDrawArrays(GL_TRIANGLES, command.first, command.count);
+            break;
+        case DRAW_ELEMENTS:
+            glDrawElements(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, 0);
+            break;
+        case DRAW_MULTI_ELEMENTS:
+            glMultiDrawElements(GL_TRIANGLES, &list.counts[command.first], GL_UNSIGNED_INT, &list.offsets[command.first], command.count);
+            break;
+        case DRAW_TERRAIN:
+            scene.terrain.draw(scene.viewCuller.get_frustum(view), glm::value_ptr(rv.position));
+            vao = 0; // chunks bind their own arrays
+            break;
+        case DRAW_SCAN:
+            scene.scan.draw();
+            vao = 0;
+            break;
+        }
+        if (command.triangles > 0)
+            count_draw(command.triangles);
+    }
+    if (cullBack)
+        glDisable(GL_CULL_FACE);
+    return (int)list.commands.size();
+}
+
+int push_draw(SceneResources& scene, const float model[16], const glm::vec4& color)
+{
+    DrawRecord record;
+    memcpy(record.model, model, sizeof(record.model));
+    memcpy(record.color, glm::value_ptr(color), sizeof(record.color));
+    int index = scene.drawRing.push(&record);
+    return index >= 0 ? index : 0; // overflow draws with the first record rather than garbage
+}
+
+// one node per fixed slot, all children of a scene root at the origin
+void create_transform_nodes(SceneResources& scene)
+{
+    scene.transforms.clear();
+    scene.nodeSlots.clear();
+    int root = scene.transforms.add_node(-1);
+    scene.nodeSlots.push_back(-1);
+    for (int slot = 0; slot < SLOT_MODELS; slot++)
+    {
+        scene.slotNodes[slot] = scene.transforms.add_node(root);
+        scene.nodeSlots.push_back(slot);
+    }
+    place_transform_nodes(scene);
+    update_transforms(scene);
+    return;
+}
+
+// every slot from the scene settings, the static ones change only here
+void place_transform_nodes(SceneResources& scene)
+{
+    glm::mat4 model = glm::mat4(1.0f); // chunks are built in world space
+    scene.transforms.set_local(scene.slotNodes[SLOT_GROUND], glm::value_ptr(model));
+    for (int i = 0; i < 4; i++)
+    {
+        model = glm::mat4(1.0f);
+        model = glm::translate(model, brnPositions[i]);
+        model = glm::rotate(model, glm::radians((i+1) * 90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        scene.transforms.set_local(scene.slotNodes[SLOT_BEARINGS + i], glm::value_ptr(model));
+    }
+    for (int i = 0; i < 9; i++)
+    {
+        model = glm::mat4(1.0f);
+        model = glm::translate(model, cubePositions[i]);
+        scene.transforms.set_local(scene.slotNodes[SLOT_CROPS + i], glm::value_ptr(model));
+    }
+    move_transform_nodes(scene);
+    return;
+}
+
+// the character and the light cube move every frame
+void move_transform_nodes(SceneResources& scene)
+{
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(currentX, 1.6f, currentZ));
+    model = glm::scale(model, glm::vec3(0.8f, 0.8f, 0.8f));
+    scene.transforms.set_local(scene.slotNodes[SLOT_CHARACTER], glm::value_ptr(model));
+
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, lightPosition);
+    model = glm::scale(model, glm::vec3(0.4f, 0.4f, 0.4f));
+    scene.transforms.set_local(scene.slotNodes[SLOT_LIGHT], glm::value_ptr(model));
+    return;
+}
+
+// recomputes what was moved or placed and rewrites the static records among it
+int update_transforms(SceneResources& scene)
+{
+    int updated = scene.transforms.update();
+    const std::vector<int>& changed = scene.transforms.get_changed();
+    for (size_t i = 0; i < changed.size(); i++)
+    {
+        int slot = scene.nodeSlots[changed[i]];
+        if (slot < 0 || slot >= SLOT_CHARACTER)
+            continue;
+
+        glm::vec4 color = slot == SLOT_GROUND ? groundColor : (slot < SLOT_CROPS ? bearingColor : cropColor);
+        DrawRecord record;
+        memcpy(record.model, scene.transforms.get_world(changed[i]), sizeof(record.model));
+        memcpy(record.color, glm::value_ptr(color), sizeof(record.color));
+        scene.drawRing.set_static(slot, &record);
+    }
+    return updated;
+}
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    glViewport(0, 0, width, height);
+}
+
+// --shader-cache wins ("none" turns the cache off); otherwise the cache sits next to the executable,
+// so runs from the source tree don't leave it behind
+std::string get_shader_cache_path(const BenchmarkOptions& options)
+{
+    if (options.shader_cache == "none")
+        return "";
+    if (!options.shader_cache.empty())
+        return options.shader_cache;
+
+    std::error_code error;
+    std::filesystem::path executable = std::filesystem::read_symlink("/proc/self/exe", error);
+    if (error)
+        return SHADER_CACHE_FILE;
+    return (executable.parent_path() / SHADER_CACHE_FILE).string();
+}
+
+// --record seeds the character walk itself and logs the seed, --replay takes it from the log
+bool start_input_log(const BenchmarkOptions& options)
+{
+    if (!options.replay_file.empty())
+    {
+        if (!inputLog.open_replay(options.replay_file.c_str()))
+            return false;
+        std::cout << "replaying " << inputLog.get_frame_num() << " frames from " << options.replay_file << std::endl;
+    }
+    else if (!options.record_file.empty())
+    {
+        if (!inputLog.open_record(options.record_file.c_str(), rd()))
+            return false;
+        std::cout << "recording input to " << options.record_file << std::endl;
+    }
+    else
+    {
+        return true;
+    }
+
+    eng.seed(inputLog.get_seed());
+    angle = distr1(eng);
+    return true;
+}
+
+// the input one frame sees: polled live and logged when recording, or the next logged frame when replaying
+bool begin_input_frame(GLFWwindow* window)
+{
+    if (inputLog.is_replaying())
+    {
+        InputFrame frame;
+        if (!inputLog.next_frame(frame))
+            return false;
+
+        deltaTime = frame.delta_time;
+        inputButtons = frame.buttons;
+        for (size_t i = 0; i < frame.events.size(); i++)
+        {
+            const InputEvent& event = frame.events[i];
+            if (event.type == INPUT_CURSOR)
+                mouse_callback(window, event.x, event.y);
+            else if (event.type == INPUT_SCROLL)
+                scroll_callback(window, event.x, event.y);
+        }
+        return true;
+    }
+
+    inputButtons = 0;
+    for (int i = 0; i < LOGGED_KEY_NUM; i++)
+    {
+        if (glfwGetKey(window, LOGGED_KEYS[i]) == GLFW_PRESS)
+            inputButtons |= 1u << i;
+    }
+    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS)
+        inputButtons |= PICK_BUTTON_BIT;
+    inputLog.record_frame(deltaTime, inputButtons);
+    return true;
+}
+
+bool input_down(int key)
+{
+    for (int i = 0; i < LOGGED_KEY_NUM; i++)
+    {
+        if (LOGGED_KEYS[i] == key)
+            return (inputButtons & (1u << i)) != 0;
+    }
+    return false;
+}
+
+void processInput(GLFWwindow* window, const SceneResources& scene)
+{
+    if (input_down(GLFW_KEY_ESCAPE) && window != NULL)
+        glfwSetWindowShouldClose(window, true);
+
+    // P prints frame stats and writes a chrome trace
+    static bool profileKeyDown = false;
+    bool profileKey = input_down(GLFW_KEY_P);
+    if (profileKey && !profileKeyDown)
+        dump_profile("frame_trace.json");
+    profileKeyDown = profileKey;
+
+    // M toggles meshlet culling for A/B comparison
+    static bool meshletKeyDown = false;
+    bool meshletKey = input_down(GLFW_KEY_M);
+    if (meshletKey && !meshletKeyDown)
+        meshletCulling = !meshletCulling;
+    meshletKeyDown = meshletKey;
+
+    // O toggles occlusion culling
+    static bool occlusionKeyDown = false;
+    bool occlusionKey = input_down(GLFW_KEY_O);
+    if (occlusionKey && !occlusionKeyDown)
+        occlusionCulling = !occlusionCulling;
+    occlusionKeyDown = occlusionKey;
+
+    // R toggles the adaptive resolution governor
+    static bool governorKeyDown = false;
+    bool governorKey = input_down(GLFW_KEY_R);
+    if (governorKey && !governorKeyDown)
+        adaptiveResolution = !adaptiveResolution;
+    governorKeyDown = governorKey;
+
+    // V cycles through one to four views
+    static bool viewKeyDown = false;
+    bool viewKey = input_down(GLFW_KEY_V);
+    if (viewKey && !viewKeyDown)
+        viewCount = viewCount % MULTI_VIEW_MAX + 1;
+    viewKeyDown = viewKey;
+
+    // left click picks the model under the crosshair and measures from the previous pick
+    static bool pickButtonDown = false;
+    static bool lastPickValid = false;
+    static glm::vec3 lastPick;
+    bool pickButton = (inputButtons & PICK_BUTTON_BIT) != 0;
+    if (pickButton && !pickButtonDown)
+    {
+        std::chrono::steady_clock::time_point pickStart = std::chrono::steady_clock::now();
+        int meshId;
+        glm::vec3 point;
+        if (pick_model(scene, cameraPos, glm::normalize(cameraFront), meshId, point))
+        {
+            double pickUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - pickStart).count();
+            std::cout << "picked " << ply_filenames[meshId] << " at " << glm::length(point - cameraPos) << " units (" << pickUs << " us)";
+            if (lastPickValid)
+                std::cout << ", " << glm::length(point - lastPick) << " units from the previous pick";
+            std::cout << std::endl;
+            lastPick = point;
+            lastPickValid = true;
+        }
+    }
+    pickButtonDown = pickButton;
+
+    // nothing to move or clamp without a movement key; replays depend on this being deterministic
+    if (!input_down(GLFW_KEY_W) && !input_down(GLFW_KEY_S) && !input_down(GLFW_KEY_A) && !input_down(GLFW_KEY_D))
+        return;
+
+    float cameraSpeed = 2.5f * deltaTime;
+    glm::vec3 tempPos = cameraPos;
+    if (input_down(GLFW_KEY_W))
+        tempPos = cameraPos + cameraSpeed * cameraFront;
+    if (input_down(GLFW_KEY_S))
+        tempPos = cameraPos - cameraSpeed * cameraFront;
+    if (input_down(GLFW_KEY_A))
+        tempPos = cameraPos - glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+    if (input_down(GLFW_KEY_D))
+        tempPos = cameraPos + glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+
+    // stay between the terrain and 20 units above it, inside the world limit
+    float ground = scene.terrain.get_height(tempPos[0], tempPos[2]);
+    if (tempPos[1] < ground + 0.005 || tempPos[1] > ground + 20)
+        return;
+    else if (fabs(tempPos[0]) > TERRAIN_WORLD_LIMIT || fabs(tempPos[2]) > TERRAIN_WORLD_LIMIT)
+        return;
+
+    cameraPos = tempPos;
+    return;
+}
+
+void mouse_callback(GLFWwindow* window, double xpos, double ypos)
+{
+    inputLog.add_event(INPUT_CURSOR, xpos, ypos);
+    if (firstMouse)
+    {
+        lastX = xpos;
+        lastY = ypos;
+        firstMouse = false;
+    }
+
+    float xoffset = xpos - lastX;
+    float yoffset = lastY - ypos;
+    lastX = xpos;
+    lastY = ypos;
+
+    float sensitivity = 0.05;
+    xoffset *= sensitivity;
+    yoffset *= sensitivity;
+
+    yaw += xoffset;
+    pitch += yoffset;
+
+    update_camera_front();
+}
+
+void update_camera_front()
+{
+    if (pitch > 89.0f)
+        pitch = 89.0f;
+    if (pitch < -89.0f)
+        pitch = -89.0f;
+
+    glm::vec3 front;
+    front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
+    front.y = sin(glm::radians(pitch));
     front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
     cameraFront = glm::normalize(front);
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
+    inputLog.add_event(INPUT_SCROLL, xoffset, yoffset);
     if (fov >= 1.0f && fov <= 45.0f)
         fov -= yoffset;
     if (fov <= 1.0f)
@@ -471,12 +1494,19 @@ void light_source_move()
     return;
 }
 
-void character_random_move() 
+void character_random_move(const SceneResources& scene) 
 {
     float newX = currentX + delta * cos(angle);
     float newZ = currentZ + delta * sin(angle);
 
-    if (newX < -8)
+    if (character_hits_model(scene, newX, newZ) && !character_hits_model(scene, currentX, currentZ))
+    {
+        // bounce off the model and wait a step, so the new heading is checked too; a character
+        // that starts inside a model is let out
+        angle = angle + PI;
+        return;
+    }
+    else if (newX < -8)
     {     
         angle = distr1(eng);
     }
@@ -505,38 +1535,65 @@ void character_random_move()
     return;
 }
 
-bool check_collision(float ax, float az, float aSize, float bx, float bz, float bSize) 
+// tests the character cube against the model triangles, not just their bounding boxes
+bool character_hits_model(const SceneResources& scene, float x, float z)
 {
-    bool collisionX = ax + aSize >= bx && bx + bSize >= ax;
-    bool collisionZ = az + aSize >= bz && bz + bSize >= az;
-
-    return collisionX && collisionZ;
+    glm::vec3 lo = glm::vec3(x - 0.8f, 0.8f, z - 0.8f);
+    glm::vec3 hi = glm::vec3(x + 0.8f, 2.4f, z + 0.8f);
+    for (size_t i = 0; i < scene.plyBvhs.size(); i++)
+    {
+        if (i >= scene.plyBoundsMin.size())
+            continue;
+        const glm::vec3& boundsMin = scene.plyBoundsMin[i];
+        const glm::vec3& boundsMax = scene.plyBoundsMax[i];
+        if (lo.x > boundsMax.x || lo.y > boundsMax.y || lo.z > boundsMax.z || hi.x < boundsMin.x || hi.y < boundsMin.y || hi.z < boundsMin.z)
+            continue;
+
+        // the cube's box in model space, exact unless the model is rotated
+        glm::mat4 model = ply_model_matrix(scene, (int)i);
+        float inverse[16];
+        invert_affine(glm::value_ptr(model), inverse);
+        float localLo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, localHi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (int corner = 0; corner < 8; corner++)
+        {
+            float p[3] = { corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y, corner & 4 ? hi.z : lo.z };
+            float local[3];
+            transform_point(inverse, p, local);
+            for (int k = 0; k < 3; k++)
+            {
+                localLo[k] = std::min(localLo[k], local[k]);
+                localHi[k] = std::max(localHi[k], local[k]);
+            }
+        }
+        if (scene.plyBvhs[i].overlaps_box(localLo, localHi))
+            return true;
+    }
+    return false;
 }
 
-void create_shader(unsigned int& shader, const int shader_type, const char** source)
+// nearest model hit along a world-space ray, dir normalized so t is a world distance
+bool pick_model(const SceneResources& scene, const glm::vec3& origin, const glm::vec3& dir, int& mesh_id, glm::vec3& point)
 {
-    shader = glCreateShader(shader_type);
-
-    glShaderSource(shader, 1, source, NULL);
-    glCompileShader(shader);
-
-    int  success;
-    char infoLog[512];
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success); // exception handling
-    if (!success)
+    mesh_id = -1;
+    float nearest = PICK_DISTANCE;
+    for (size_t i = 0; i < scene.plyBvhs.size(); i++)
     {
-        glGetShaderInfoLog(shader, 512, NULL, infoLog);
-        if (shader_type == GL_VERTEX_SHADER)
-        {
-            std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-        }
-        else
+        glm::mat4 model = ply_model_matrix(scene, (int)i);
+        float inverse[16];
+        invert_affine(glm::value_ptr(model), inverse);
+        glm::mat4 toLocal = glm::make_mat4(inverse);
+        glm::vec3 localOrigin = glm::vec3(toLocal * glm::vec4(origin, 1.0f));
+        glm::vec3 localDir = glm::vec3(toLocal * glm::vec4(dir, 0.0f)); // not renormalized, keeps t in world units
+
+        RayHit hit;
+        if (scene.plyBvhs[i].intersect(glm::value_ptr(localOrigin), glm::value_ptr(localDir), nearest, hit))
         {
-            std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+            nearest = hit.t;
+            mesh_id = (int)i;
         }
     }
-
-    return;
+    point = origin + nearest * dir;
+    return mesh_id >= 0;
 }
 
 void generate_texture(unsigned int& texture_id, const char* image_filename)
@@ -548,8 +1605,7 @@ void generate_texture(unsigned int& texture_id, const char* image_filename)
     unsigned char* data = stbi_load(image_filename, &width, &height, &nrChannels, 0);
     if (data)
     {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        upload_texture_image(data, width, height);
     }
     else
     {
@@ -560,7 +1616,14 @@ void generate_texture(unsigned int& texture_id, const char* image_filename)
     return;
 }
 
-void configure_object_with_ebo(unsigned int& VAO_obj, int coord_size, const float* vertex_coords, unsigned int* face_list, int v_size, int f_size)
+void upload_texture_image(const unsigned char* data, int width, int height)
+{
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    return;
+}
+
+void configure_object_with_ebo(unsigned int& VAO_obj, int coord_size, const float* vertex_coords, unsigned int* face_list, int v_size, int f_size, unsigned int* VBO_out, unsigned int* EBO_out)
 {
     unsigned int VBO_obj, EBO_obj;
     glGenVertexArrays(1, &VAO_obj);
@@ -596,6 +1659,660 @@ void configure_object_with_ebo(unsigned int& VAO_obj, int coord_size, const floa
     {
         std::cout << "Error: Unexpected dimention of coordinates which may cause ambiguity." << std::endl;
     }
+
+    if (VBO_out != NULL)
+        *VBO_out = VBO_obj;
+    if (EBO_out != NULL)
+        *EBO_out = EBO_obj;
     
     return;
 }
+
+void upload_mesh(MeshResidency& residency, int mesh_id)
+{
+    PlyModel* model = residency.get_record(mesh_id).model;
+    unsigned int VAO_obj, VBO_obj, EBO_obj;
+
+    int v_size = sizeof(float) * 6 * model->get_vertex_num();
+    int f_size = sizeof(unsigned int) * 3 * model->get_face_num();
+    configure_object_with_ebo(VAO_obj, 6, model->get_model_vertices(), model->get_model_faces(), v_size, f_size, &VBO_obj, &EBO_obj);
+    residency.mark_uploaded(mesh_id, VAO_obj, VBO_obj, EBO_obj);
+
+    // position-only LOD for the shadow pass
+    MeshLod& lod = residency.get_record(mesh_id).shadow_lod;
+    if (!lod.indices.empty())
+    {
+        unsigned int VAO_shadow, VBO_shadow, EBO_shadow;
+        configure_object_with_ebo(VAO_shadow, 3, lod.vertices.data(), lod.indices.data(), sizeof(float) * lod.vertices.size(), sizeof(unsigned int) * lod.indices.size(), &VBO_shadow, &EBO_shadow);
+        residency.mark_shadow_uploaded(mesh_id, VAO_shadow, VBO_shadow, EBO_shadow);
+    }
+
+    return;
+}
+
+// one model in one view: a single draw without meshlets, otherwise one multi-draw of the ranges that survive culling
+void add_ply_commands(SceneResources& scene, RenderView& rv, int view, int mesh_id)
+{
+    ViewCommandList& list = rv.commands;
+    MeshRecord& record = scene.residency.get_record(mesh_id);
+    int slot = SLOT_MODELS + mesh_id;
+
+    // back faces are culled whether or not meshlets are, so the cone test only saves work and never
+    // changes what shows through the holes of the open scans
+    if (!meshletCulling || record.meshlets.empty())
+    {
+        add_command(list, DRAW_ELEMENTS, slot, scene.illumObjectProgram, 0, record.vao, 0, record.index_count, record.index_count / 3);
+        list.commands.back().cull_back = true;
+        return;
+    }
+
+    // cull in model space, so rotated or scaled models need no special casing
+    glm::mat4 model = ply_model_matrix(scene, mesh_id);
+    float invModel[16], localCamera[3];
+    Frustum localFrustum;
+    invert_affine(glm::value_ptr(model), invModel);
+    transform_point(invModel, glm::value_ptr(rv.position), localCamera);
+    transform_frustum(scene.viewCuller.get_frustum(view), glm::value_ptr(model), localFrustum);
+
+    long long culledBefore = list.cull_stats.indices_culled;
+    cull_meshlets(record.meshlets, localFrustum, localCamera, rv.meshletCounts, rv.meshletOffsets, list.cull_stats);
+    if (!rv.meshletCounts.empty())
+    {
+        int first = (int)list.counts.size();
+        list.counts.insert(list.counts.end(), rv.meshletCounts.begin(), rv.meshletCounts.end());
+        list.offsets.insert(list.offsets.end(), rv.meshletOffsets.begin(), rv.meshletOffsets.end());
+        int triangles = (int)((record.index_count - (list.cull_stats.indices_culled - culledBefore)) / 3);
+        add_command(list, DRAW_MULTI_ELEMENTS, slot, scene.illumObjectProgram, 0, record.vao, first, (int)rv.meshletCounts.size(), triangles);
+        list.commands.back().cull_back = true;
+    }
+
+    return;
+}
+
+void create_ply_instances(SceneResources& scene)
+{
+    place_ply_instances(scene);
+    scene.instanceBuffer.init();
+    return;
+}
+
+void place_ply_instances(SceneResources& scene)
+{
+    glm::vec3 plyPositions[] = { bunnyPosition, dragonPosition, happyPosition };
+    int plyMeshes[] = { scene.bunnyMesh, scene.dragonMesh, scene.happyMesh };
+    scene.plyInstances.resize(scene.residency.get_mesh_num() + (scene.scanInstance >= 0 ? 1 : 0));
+    for (int i = 0; i < 3; i++)
+    {
+        InstanceTransform& instance = scene.plyInstances[plyMeshes[i]];
+        set_instance_transform(instance, plyPositions[i][0], plyPositions[i][1], plyPositions[i][2], modelScales[i]);
+        if (posedModels)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                instance.rotation[c] = posedRotations[i][c];
+                instance.scale[c] = posedScales[i][c];
+            }
+        }
+    }
+    if (scene.scanInstance >= 0)
+    {
+        set_instance_transform(scene.plyInstances[scene.scanInstance], scanPosition[0], scanPosition[1], scanPosition[2], scanScale);
+    }
+
+    compute_instance_matrices(scene.plyInstances, scene.plyMatrices);
+    scene.instancesDirty = true;
+    return;
+}
+
+// caster and receiver bounds for the shadow frustum, and the model boxes the occlusion test uses
+void update_scene_bounds(SceneResources& scene)
+{
+    scene.shadowMap.clear_bounds();
+    for (int i = 0; i < 9; i++)
+    {
+        scene.shadowMap.add_caster_bounds(cubePositions[i] - glm::vec3(1.0f), cubePositions[i] + glm::vec3(1.0f));
+    }
+    scene.plyBoundsMin.clear();
+    scene.plyBoundsMax.clear();
+    for (int i = 0; i < scene.residency.get_mesh_num(); i++)
+    {
+        // rotated models need all eight corners of their box
+        const MeshBounds& bounds = scene.residency.get_bounds(i);
+        glm::mat4 model = ply_model_matrix(scene, i);
+        glm::vec3 lo = glm::vec3(FLT_MAX), hi = glm::vec3(-FLT_MAX);
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 p = glm::vec4(corner & 1 ? bounds.max[0] : bounds.min[0], corner & 2 ? bounds.max[1] : bounds.min[1], corner & 4 ? bounds.max[2] : bounds.min[2], 1.0f);
+            glm::vec3 world = glm::vec3(model * p);
+            lo = glm::min(lo, world);
+            hi = glm::max(hi, world);
+        }
+        scene.shadowMap.add_caster_bounds(lo, hi);
+        scene.plyBoundsMin.push_back(lo);
+        scene.plyBoundsMax.push_back(hi);
+    }
+    if (scene.scanInstance >= 0)
+    {
+        // the scan only receives, streaming levels in and out of a cached shadow map would make it flicker
+        float lo[3], hi[3];
+        scene.scan.get_bounds(lo, hi);
+        scene.scanBoundsMin = scanPosition + glm::make_vec3(lo) * scanScale;
+        scene.scanBoundsMax = scanPosition + glm::make_vec3(hi) * scanScale;
+    }
+    scene.shadowMap.add_caster_bounds(glm::vec3(-limitCoord - 0.8f, 0.0f, -limitCoord - 0.8f), glm::vec3(limitCoord + 0.8f, 3.2f, limitCoord + 0.8f));
+    scene.shadowMap.add_receiver_bounds(glm::vec3(-20.0f, 0.0f, -20.0f), glm::vec3(20.0f, 0.0f, 20.0f));
+    return;
+}
+
+glm::mat4 ply_model_matrix(const SceneResources& scene, int mesh_id)
+{
+    return glm::make_mat4(scene.plyMatrices[mesh_id].model);
+}
+
+void submit_occluders(SceneResources& scene, const glm::mat4& view_proj)
+{
+    // opaque, simple and large: the flat farm ground, the crops and the bearing signs
+    scene.occlusion.begin_frame(glm::value_ptr(view_proj));
+
+    const float r = OCCLUDER_GROUND_RADIUS;
+    const float ground[] = { -r, 0.0f, -r,   r, 0.0f, -r,   r, 0.0f, r,   -r, 0.0f, r };
+    glm::mat4 model = glm::mat4(1.0f);
+    scene.occlusion.add_occluder_quads(ground, 1, glm::value_ptr(model));
+
+    for (int i = 0; i < 9; i++)
+    {
+        scene.occlusion.add_occluder_quads(cube_occluder_quads, 6, scene.transforms.get_world(scene.slotNodes[SLOT_CROPS + i]));
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        scene.occlusion.add_occluder_quads(brn_occluder_quad, 1, scene.transforms.get_world(scene.slotNodes[SLOT_BEARINGS + i]));
+    }
+
+    scene.occlusion.rasterize_async();
+    return;
+}
+
+bool is_visible(SceneResources& scene, const glm::vec3& lo, const glm::vec3& hi)
+{
+    if (!occlusionCulling)
+        return true;
+
+    return !scene.occlusion.is_occluded(glm::value_ptr(lo), glm::value_ptr(hi));
+}
+
+void render_shadow_map(SceneResources& scene)
+{
+    glUseProgram(scene.shadowProgram);
+    int modelLoc = glGetUniformLocation(scene.shadowProgram, "model");
+    int lightSpaceLoc = glGetUniformLocation(scene.shadowProgram, "lightSpace");
+    glm::mat4 model;
+    int triangles = 0;
+
+    // static casters are redrawn only once the light has moved far enough
+    if (scene.shadowMap.needs_static_update(lightPosition))
+    {
+        scene.shadowMap.update_light(lightPosition);
+        glUniformMatrix4fv(lightSpaceLoc, 1, GL_FALSE, glm::value_ptr(scene.shadowMap.get_light_space()));
+        scene.shadowMap.begin_static();
+
+        glBindVertexArray(scene.VAO);
+        for (unsigned int i = 0; i < 9; i++)
+        {
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, scene.transforms.get_world(scene.slotNodes[SLOT_CROPS + i]));
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            count_draw(12);
+            triangles += 12;
+        }
+
+        for (int i = 0; i < scene.residency.get_mesh_num(); i++)
+        {
+            MeshRecord& record = scene.residency.get_record(i);
+            if (record.shadow_vao == 0)
+                continue;
+
+            model = ply_model_matrix(scene, i);
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+            glBindVertexArray(record.shadow_vao);
+            glDrawElements(GL_TRIANGLES, record.shadow_index_count, GL_UNSIGNED_INT, 0);
+            count_draw(record.shadow_index_count / 3);
+            triangles += record.shadow_index_count / 3;
+        }
+
+        scene.shadowMap.end();
+    }
+
+    // the character moves every frame, it goes on top of the cached depth where it stood after the last step
+    glUniformMatrix4fv(lightSpaceLoc, 1, GL_FALSE, glm::value_ptr(scene.shadowMap.get_light_space()));
+    scene.shadowMap.begin_dynamic();
+
+    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, scene.transforms.get_world(scene.slotNodes[SLOT_CHARACTER]));
+    glBindVertexArray(scene.VAO_char);
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+    count_draw(12);
+    triangles += 12;
+
+    scene.shadowMap.end();
+
+    PROFILE_VALUE("shadow triangles", triangles);
+    PROFILE_VALUE("shadow static redraws", scene.shadowMap.get_static_renders());
+    return;
+}
+
+void create_light_field(SceneResources& scene, int light_num)
+{
+    // fixed seed: the light layout is part of the scene, not of the random walk
+    std::default_random_engine lightEng(647);
+    std::uniform_real_distribution<float> field(-18.0f, 18.0f);
+    std::uniform_real_distribution<float> height(0.5f, 3.0f);
+    std::uniform_real_distribution<float> radius(3.0f, 6.0f);
+    std::uniform_real_distribution<float> channel(0.1f, 0.6f);
+
+    scene.pointLights.resize(light_num);
+    scene.lightAnchors.resize(light_num);
+    scene.lightFieldTime = 0.0f;
+    for (int i = 0; i < light_num; i++)
+    {
+        PointLight& light = scene.pointLights[i];
+        scene.lightAnchors[i] = glm::vec3(field(lightEng), height(lightEng), field(lightEng));
+        light.radius = radius(lightEng);
+        light.color[0] = channel(lightEng);
+        light.color[1] = channel(lightEng);
+        light.color[2] = channel(lightEng);
+        light.padding = 0.0f;
+    }
+    move_light_field(scene);
+
+    return;
+}
+
+void move_light_field(SceneResources& scene)
+{
+    scene.lightFieldTime += deltaTime;
+    for (size_t i = 0; i < scene.pointLights.size(); i++)
+    {
+        glm::vec3 position;
+        if (i == 0)
+        {
+            position = glm::vec3(currentX, 2.5f, currentZ); // the character carries a lantern
+        }
+        else
+        {
+            float phase = scene.lightFieldTime * (0.3f + 0.1f * (i % 7)) + 2.4f * i;
+            position = scene.lightAnchors[i] + 1.5f * glm::vec3(cos(phase), 0.0f, sin(phase));
+        }
+
+        PointLight& light = scene.pointLights[i];
+        light.position[0] = position[0];
+        light.position[1] = position[1];
+        light.position[2] = position[2];
+    }
+
+    return;
+}
+
+void load_scene_file(SceneResources& scene)
+{
+    // start from the compiled-in scene, the file only overrides what it lists
+    SceneDescription& description = scene.description;
+    glm::vec3 plyPositions[] = { bunnyPosition, dragonPosition, happyPosition };
+    for (int i = 0; i < SCENE_CROP_NUM; i++)
+        description.crops[i] = cubePositions[i];
+    for (int i = 0; i < SCENE_BEARING_NUM; i++)
+        description.bearings[i] = brnPositions[i];
+    for (int i = 0; i < SCENE_MODEL_NUM; i++)
+    {
+        description.model_positions[i] = plyPositions[i];
+        description.model_scales[i] = modelScales[i];
+    }
+    description.ground_color = groundColor;
+    description.crop_color = cropColor;
+    description.crop_hit_color = cropHitColor;
+    description.bearing_color = bearingColor;
+    description.character_color = characterColor;
+    description.shaders.clear();
+
+    std::string error;
+    if (!load_scene_description(SCENE_FILE, description, error))
+    {
+        std::cout << error << ", using the built-in scene" << std::endl;
+        return;
+    }
+    apply_scene_description(scene);
+    return;
+}
+
+void apply_scene_description(SceneResources& scene)
+{
+    const SceneDescription& description = scene.description;
+    glm::vec3* plyPositions[] = { &bunnyPosition, &dragonPosition, &happyPosition };
+    for (int i = 0; i < SCENE_CROP_NUM; i++)
+        cubePositions[i] = description.crops[i];
+    for (int i = 0; i < SCENE_BEARING_NUM; i++)
+        brnPositions[i] = description.bearings[i];
+    for (int i = 0; i < SCENE_MODEL_NUM; i++)
+    {
+        *plyPositions[i] = description.model_positions[i];
+        modelScales[i] = description.model_scales[i];
+    }
+    groundColor = description.ground_color;
+    cropColor = description.crop_color;
+    cropHitColor = description.crop_hit_color;
+    bearingColor = description.bearing_color;
+    characterColor = description.character_color;
+    return;
+}
+
+// adds a program, or rebuilds it in place, from the scene file's shader files or the built-in sources
+void build_program(SceneResources& scene, int index, bool rebuild)
+{
+    const ProgramSources& builtin = programSources[index];
+    std::string vertexText = builtin.vertex, fragmentText = builtin.fragment;
+    for (size_t i = 0; i < scene.description.shaders.size(); i++)
+    {
+        const ShaderFiles& files = scene.description.shaders[i];
+        if (files.program != builtin.name)
+            continue;
+
+        std::string vertexFile, fragmentFile;
+        if (read_text_file(files.vertex_file, vertexFile) && read_text_file(files.fragment_file, fragmentFile))
+        {
+            vertexText = vertexFile;
+            fragmentText = fragmentFile;
+        }
+        else
+        {
+            std::cout << "Failed to read the shader files of " << builtin.name << ", using the built-in sources" << std::endl;
+        }
+    }
+
+    if (rebuild)
+    {
+        scene.shaders.rebuild_program(scene.programIds[index], vertexText.c_str(), fragmentText.c_str());
+        return;
+    }
+
+    std::vector<std::string> defines;
+    if (builtin.lit && lightFieldSize > 0)
+        defines.push_back("CLUSTERED_LIGHTING");
+    scene.programIds[index] = scene.shaders.add_program(builtin.name, vertexText.c_str(), fragmentText.c_str(), defines);
+    return;
+}
+
+void watch_asset(SceneResources& scene, const std::string& path, AssetKind kind, unsigned int target)
+{
+    int id = scene.watcher.add_file(path);
+    if (id >= (int)scene.watchedAssets.size())
+        scene.watchedAssets.resize(id + 1);
+    scene.watchedAssets[id].kind = kind;
+    scene.watchedAssets[id].target = target;
+    return;
+}
+
+void init_hot_reload(SceneResources& scene)
+{
+    scene.watcher.init();
+    watch_asset(scene, SCENE_FILE, ASSET_SCENE, 0);
+
+    int plyMeshes[] = { scene.bunnyMesh, scene.dragonMesh, scene.happyMesh };
+    for (int i = 0; i < 3; i++)
+    {
+        watch_asset(scene, ply_filenames[i], ASSET_MODEL, plyMeshes[i]);
+    }
+    unsigned int textures[] = { scene.texture_soil, scene.texture_crops, scene.texture_tomoko };
+    for (int i = 0; i < 3; i++)
+    {
+        watch_asset(scene, texture_filenames[i], ASSET_TEXTURE, textures[i]);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        watch_asset(scene, bearing_filenames[i], ASSET_TEXTURE, scene.texture_bearing[i]);
+    }
+    for (size_t i = 0; i < scene.description.shaders.size(); i++)
+    {
+        watch_asset(scene, scene.description.shaders[i].vertex_file, ASSET_SHADER, 0);
+        watch_asset(scene, scene.description.shaders[i].fragment_file, ASSET_SHADER, 0);
+    }
+
+    std::cout << "hot reload: watching " << scene.watchedAssets.size() << " files" << (scene.watcher.is_native() ? " with inotify" : " by modification time") << std::endl;
+    return;
+}
+
+void report_reload(const std::string& path, const std::chrono::steady_clock::time_point& detected)
+{
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - detected).count();
+    PROFILE_VALUE("reload latency ms", ms);
+    std::cout << "reloaded " << path << " in " << ms << " ms" << std::endl;
+    return;
+}
+
+void rebuild_shaders(SceneResources& scene, int index, const std::chrono::steady_clock::time_point& detected)
+{
+    build_program(scene, index, true);
+    scene.pendingShaders.push_back(std::make_pair(index, detected));
+    return;
+}
+
+// positions and colours take effect right away; programs whose shader files changed are rebuilt
+void reload_scene_file(SceneResources& scene, const std::chrono::steady_clock::time_point& detected)
+{
+    std::vector<ShaderFiles> oldShaders = scene.description.shaders;
+    std::string error;
+    if (!load_scene_description(SCENE_FILE, scene.description, error))
+    {
+        std::cout << error << ", keeping the current scene" << std::endl;
+        return;
+    }
+    apply_scene_description(scene);
+    place_ply_instances(scene);
+    place_transform_nodes(scene);
+    update_scene_bounds(scene);
+
+    for (int i = 0; i < PROGRAM_NUM; i++)
+    {
+        std::string oldFiles, newFiles;
+        for (size_t j = 0; j < oldShaders.size(); j++)
+        {
+            if (oldShaders[j].program == programSources[i].name)
+                oldFiles += oldShaders[j].vertex_file + "|" + oldShaders[j].fragment_file + "|";
+        }
+        for (size_t j = 0; j < scene.description.shaders.size(); j++)
+        {
+            const ShaderFiles& files = scene.description.shaders[j];
+            if (files.program != programSources[i].name)
+                continue;
+            newFiles += files.vertex_file + "|" + files.fragment_file + "|";
+            watch_asset(scene, files.vertex_file, ASSET_SHADER, 0);
+            watch_asset(scene, files.fragment_file, ASSET_SHADER, 0);
+        }
+        if (oldFiles != newFiles)
+            rebuild_shaders(scene, i, detected);
+    }
+
+    report_reload(SCENE_FILE, detected);
+    return;
+}
+
+std::shared_ptr<ReloadResult> load_model_job(std::string path)
+{
+    std::shared_ptr<ReloadResult> result = std::make_shared<ReloadResult>();
+    result->pixels = NULL;
+    result->width = result->height = 0;
+    result->model.get_ply_model(path.c_str());
+    if (result->model.get_vertex_num() > 0 && result->model.get_face_num() > 0)
+    {
+        result->model.add_normal_vectors();
+        build_mesh_data(result->model, result->meshlets, result->shadowLod, result->bvh);
+    }
+    return result;
+}
+
+std::shared_ptr<ReloadResult> load_image_job(std::string path)
+{
+    std::shared_ptr<ReloadResult> result = std::make_shared<ReloadResult>();
+    int channels;
+    result->pixels = stbi_load(path.c_str(), &result->width, &result->height, &channels, 0);
+    return result;
+}
+
+// deletes a mesh's vertex arrays together with the buffers behind them
+void delete_mesh_objects(MeshRecord& record)
+{
+    unsigned int buffers[2] = { record.vbo, record.ebo };
+    glDeleteVertexArrays(1, &record.vao);
+    glDeleteBuffers(2, buffers);
+    if (record.shadow_vao != 0)
+    {
+        unsigned int shadowBuffers[2] = { record.shadow_vbo, record.shadow_ebo };
+        glDeleteVertexArrays(1, &record.shadow_vao);
+        glDeleteBuffers(2, shadowBuffers);
+    }
+    return;
+}
+
+bool swap_reload(SceneResources& scene, const WatchedAsset& asset, ReloadResult& result)
+{
+    if (asset.kind == ASSET_TEXTURE)
+    {
+        if (result.pixels == NULL)
+            return false;
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, asset.target);
+        upload_texture_image(result.pixels, result.width, result.height);
+        stbi_image_free(result.pixels);
+        result.pixels = NULL;
+        return true;
+    }
+
+    if (result.model.get_vertex_num() == 0 || result.model.get_face_num() == 0)
+        return false;
+
+    int meshId = (int)asset.target;
+    MeshRecord& record = scene.residency.get_record(meshId);
+    delete_mesh_objects(record);
+    *record.model = std::move(result.model);
+    scene.residency.replace_mesh(meshId);
+    record.meshlets.swap(result.meshlets);
+    record.shadow_lod = std::move(result.shadowLod);
+    scene.plyBvhs[meshId] = std::move(result.bvh);
+    upload_mesh(scene.residency, meshId);
+    update_scene_bounds(scene);
+    return true;
+}
+
+// called between frames: starts parsing changed files on worker threads and swaps in whatever has finished
+void poll_hot_reload(SceneResources& scene)
+{
+    PROFILE_SCOPE("hot reload");
+
+    std::vector<int> changed;
+    scene.watcher.poll(changed);
+    std::chrono::steady_clock::time_point detected = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < changed.size(); i++)
+    {
+        const WatchedAsset& asset = scene.watchedAssets[changed[i]];
+        const std::string& path = scene.watcher.get_path(changed[i]);
+        if (asset.kind == ASSET_SCENE)
+        {
+            reload_scene_file(scene, detected);
+        }
+        else if (asset.kind == ASSET_SHADER)
+        {
+            for (int p = 0; p < PROGRAM_NUM; p++)
+            {
+                for (size_t j = 0; j < scene.description.shaders.size(); j++)
+                {
+                    const ShaderFiles& files = scene.description.shaders[j];
+                    if (files.program == programSources[p].name && (files.vertex_file == path || files.fragment_file == path))
+                    {
+                        rebuild_shaders(scene, p, detected);
+                        break;
+                    }
+                }
+            }
+        }
+        else
+        {
+            // a reload still running for the same file is superseded; its result is dropped
+            for (size_t j = 0; j < scene.pendingReloads.size(); j++)
+            {
+                if (scene.pendingReloads[j].path == path)
+                    scene.pendingReloads[j].superseded = true;
+            }
+            PendingReload reload;
+            reload.asset = asset;
+            reload.path = path;
+            reload.detected = detected;
+            reload.superseded = false;
+            reload.result = std::async(std::launch::async, asset.kind == ASSET_MODEL ? load_model_job : load_image_job, path);
+            scene.pendingReloads.push_back(std::move(reload));
+        }
+    }
+
+    for (size_t i = 0; i < scene.pendingReloads.size();)
+    {
+        PendingReload& reload = scene.pendingReloads[i];
+        if (reload.result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            i++;
+            continue;
+        }
+
+        std::shared_ptr<ReloadResult> result = reload.result.get();
+        if (!reload.superseded)
+        {
+            if (swap_reload(scene, reload.asset, *result))
+                report_reload(reload.path, reload.detected);
+            else
+                std::cout << "Failed to reload " << reload.path << ", keeping the previous version" << std::endl;
+        }
+        if (result->pixels != NULL)
+            stbi_image_free(result->pixels);
+        scene.pendingReloads.erase(scene.pendingReloads.begin() + i);
+    }
+
+    std::vector<int> swapped, failed;
+    scene.shaders.poll_rebuilds(swapped, failed);
+    if (!swapped.empty())
+        set_program_uniforms(scene);
+    for (size_t i = 0; i < scene.pendingShaders.size();)
+    {
+        int index = scene.pendingShaders[i].first;
+        int id = scene.programIds[index];
+        bool isSwapped = std::find(swapped.begin(), swapped.end(), id) != swapped.end();
+        bool isFailed = std::find(failed.begin(), failed.end(), id) != failed.end();
+        if (!isSwapped && !isFailed)
+        {
+            i++;
+            continue;
+        }
+        if (isSwapped)
+            report_reload(programSources[index].name, scene.pendingShaders[i].second);
+        scene.pendingShaders.erase(scene.pendingShaders.begin() + i);
+    }
+
+    return;
+}
+
+void destroy_hot_reload(SceneResources& scene)
+{
+    for (size_t i = 0; i < scene.pendingReloads.size(); i++)
+    {
+        std::shared_ptr<ReloadResult> result = scene.pendingReloads[i].result.get();
+        if (result->pixels != NULL)
+            stbi_image_free(result->pixels);
+    }
+    scene.pendingReloads.clear();
+    scene.pendingShaders.clear();
+    scene.watcher.destroy();
+    return;
+}
+
+void dump_profile(const std::string& trace_file)
+{
+#if ENABLE_FRAME_PROFILER
+    frameProfiler.print_frame_stats();
+    if (!trace_file.empty())
+        frameProfiler.export_chrome_trace(trace_file.c_str());
+#endif
+    return;
+}
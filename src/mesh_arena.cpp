@@ -0,0 +1,166 @@
+#include "mesh_arena.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+using namespace std;
+
+MeshAllocator::MeshAllocator()
+{
+    this->stats.current_bytes = 0;
+    this->stats.peak_bytes = 0;
+    this->stats.reserved_bytes = 0;
+    this->stats.allocation_count = 0;
+    this->stats.block_count = 0;
+    return;
+}
+
+MeshAllocator::~MeshAllocator()
+{
+}
+
+void MeshAllocator::trim()
+{
+    return;
+}
+
+void MeshAllocator::on_allocate(size_t bytes, size_t reserved, size_t system_allocations)
+{
+    lock_guard<mutex> lock(this->stats_mutex);
+    this->stats.current_bytes += bytes;
+    this->stats.reserved_bytes += reserved;
+    this->stats.block_count += system_allocations;
+    this->stats.allocation_count++;
+    if (this->stats.current_bytes > this->stats.peak_bytes)
+    {
+        this->stats.peak_bytes = this->stats.current_bytes;
+    }
+    return;
+}
+
+void MeshAllocator::on_deallocate(size_t bytes, size_t reserved)
+{
+    lock_guard<mutex> lock(this->stats_mutex);
+    this->stats.current_bytes -= bytes;
+    this->stats.reserved_bytes -= reserved;
+    return;
+}
+
+void MeshAllocator::on_release()
+{
+    lock_guard<mutex> lock(this->stats_mutex);
+    this->stats.current_bytes = 0;
+    this->stats.reserved_bytes = 0;
+    return;
+}
+
+void MeshAllocator::get_stats(MemoryStats& stats)
+{
+    lock_guard<mutex> lock(this->stats_mutex);
+    stats = this->stats;
+    return;
+}
+
+void MeshAllocator::print_memory_report(const char* label)
+{
+    MemoryStats current;
+    this->get_stats(current);
+    cout << "Memory (" << label << "): " << endl;
+    cout << "in use " << current.current_bytes / 1024 << " KB, peak " << current.peak_bytes / 1024 << " KB, resident " << current.reserved_bytes / 1024 << " KB" << endl;
+    cout << current.allocation_count << " buffers from " << current.block_count << " system allocations" << endl;
+    return;
+}
+
+void* HeapAllocator::allocate(size_t bytes)
+{
+    void* p = ::operator new(bytes);
+    this->on_allocate(bytes, bytes, 1);
+    return p;
+}
+
+void HeapAllocator::deallocate(void* p, size_t bytes)
+{
+    if (p == NULL)
+        return;
+
+    ::operator delete(p);
+    this->on_deallocate(bytes, bytes);
+    return;
+}
+
+MeshArena::MeshArena(size_t block_size)
+{
+    this->block_size = block_size;
+    return;
+}
+
+MeshArena::~MeshArena()
+{
+    this->release();
+    return;
+}
+
+void* MeshArena::allocate(size_t bytes)
+{
+    size_t aligned = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    // only the newest block is bumped, so big one-off buffers do not strand a half-used block
+    size_t reserved = 0;
+    if (this->blocks.empty() || this->blocks.back().used + aligned > this->blocks.back().size)
+    {
+        Block block;
+        block.size = aligned > this->block_size ? aligned : this->block_size;
+        block.used = 0;
+        block.data = (char*)::operator new(block.size + ALIGNMENT);
+        this->blocks.push_back(block);
+        reserved = block.size + ALIGNMENT;
+    }
+
+    Block& block = this->blocks.back();
+    uintptr_t base = ((uintptr_t)block.data + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1);
+    void* p = (void*)(base + block.used);
+    block.used += aligned;
+
+    this->on_allocate(aligned, reserved, reserved > 0 ? 1 : 0);
+    return p;
+}
+
+void MeshArena::deallocate(void* p, size_t bytes)
+{
+    // memory comes back in bulk through release()
+    if (p == NULL)
+        return;
+
+    this->on_deallocate((bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1), 0);
+    return;
+}
+
+void MeshArena::trim()
+{
+    MemoryStats current;
+    this->get_stats(current);
+    if (current.current_bytes == 0)
+    {
+        this->release();
+    }
+    return;
+}
+
+void MeshArena::release()
+{
+    for (size_t i = 0; i < this->blocks.size(); ++i)
+    {
+        ::operator delete(this->blocks[i].data);
+    }
+    this->blocks.clear();
+    this->on_release();
+    return;
+}
+
+MeshAllocator* get_default_mesh_allocator()
+{
+    static HeapAllocator heapAllocator;
+    return &heapAllocator;
+}
@@ -0,0 +1,85 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+struct MemoryStats
+{
+    size_t current_bytes; // handed out and not yet freed
+    size_t peak_bytes;
+    size_t reserved_bytes; // resident backing memory, including arena slack
+    size_t allocation_count;
+    size_t block_count; // calls that actually reached the system heap
+};
+
+// storage provider for mesh buffers, so callers choose between heap and arena backing.
+// the accounting is locked, reload jobs share the default allocator with the main thread
+class MeshAllocator
+{
+public:
+    MeshAllocator();
+    virtual ~MeshAllocator();
+
+    virtual void* allocate(size_t bytes) = 0;
+    virtual void deallocate(void* p, size_t bytes) = 0;
+    virtual void trim(); // give unused backing memory back to the system
+
+    void get_stats(MemoryStats& stats);
+    void print_memory_report(const char* label);
+
+protected:
+    void on_allocate(size_t bytes, size_t reserved, size_t system_allocations);
+    void on_deallocate(size_t bytes, size_t reserved);
+    void on_release(); // every buffer and block dropped at once
+
+private:
+    std::mutex stats_mutex;
+    MemoryStats stats;
+};
+
+// plain new/delete, one system allocation per buffer
+class HeapAllocator : public MeshAllocator
+{
+public:
+    void* allocate(size_t bytes);
+    void deallocate(void* p, size_t bytes);
+};
+
+// bump allocator over large blocks; individual frees are no-ops and release() drops everything at once.
+// Only pays off for batches of many small meshes, size block_size to the batch; a buffer larger than a
+// block gets a block of its own. Not thread-safe, use one arena per loading thread
+class MeshArena : public MeshAllocator
+{
+public:
+    static const size_t ALIGNMENT = 64;
+
+    explicit MeshArena(size_t block_size);
+    ~MeshArena();
+
+    MeshArena(const MeshArena&) = delete;
+    MeshArena& operator=(const MeshArena&) = delete;
+
+    void* allocate(size_t bytes);
+    void deallocate(void* p, size_t bytes);
+    void trim(); // releases the blocks once every buffer in them has been freed
+
+    // frees every block; models still pointing into the arena must call release_buffers() first
+    void release();
+
+private:
+    struct Block
+    {
+        char* data;
+        size_t size;
+        size_t used;
+    };
+
+    size_t block_size;
+    std::vector<Block> blocks;
+};
+
+MeshAllocator* get_default_mesh_allocator();
+
+#endif
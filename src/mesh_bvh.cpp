@@ -0,0 +1,649 @@
+#include "mesh_bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <thread>
+#include <utility>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MESH_BVH_SSE 1
+#endif
+
+using namespace std;
+
+static const int BVH_BIN_NUM = 16;
+static const int BVH_LEAF_TRIANGLES = 4; // always a leaf at or below this
+static const int BVH_MAX_LEAF_TRIANGLES = 16; // SAH may stop splitting up to this
+static const int BVH_PARALLEL_MIN = 4096; // smaller subtrees are not worth a thread
+static const int BVH_MEDIAN_DEPTH = 64; // deeper nodes split at the median, bounding the depth
+static const int BVH_STACK_SIZE = 128;
+
+struct BvhBuildContext
+{
+    vector<float> boxes; // per triangle min x, y, z, max x, y, z
+    vector<float> centroids;
+    vector<int> order; // triangle ids, partitioned in place as the tree is built
+    int spawn_depth;
+};
+
+// ray with the direction inverted once for the slab tests
+struct BvhRay
+{
+    float origin[4];
+    float dir[4];
+    float inv_dir[4];
+};
+
+static int pack_count(int triangle_num)
+{
+    return (triangle_num + 3) / 4;
+}
+
+static float half_area(const float lo[3], const float hi[3])
+{
+    float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+    return dx * dy + dy * dz + dz * dx;
+}
+
+static void grow(float lo[3], float hi[3], const float box[6])
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        lo[i] = min(lo[i], box[i]);
+        hi[i] = max(hi[i], box[3 + i]);
+    }
+    return;
+}
+
+// appends the subtree over order[begin, end) to out in depth-first order. Leaves temporarily
+// keep their triangle range in offset/count; the packs are filled once the whole tree exists.
+static void build_subtree(BvhBuildContext& ctx, int begin, int end, int depth, vector<BvhNode>& out, int& max_depth)
+{
+    max_depth = max(max_depth, depth);
+    int nodeIndex = (int)out.size();
+    out.push_back(BvhNode());
+
+    float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+    float cLo[3] = { 1e30f, 1e30f, 1e30f }, cHi[3] = { -1e30f, -1e30f, -1e30f };
+    for (int i = begin; i < end; ++i)
+    {
+        int id = ctx.order[i];
+        grow(lo, hi, &ctx.boxes[6 * id]);
+        for (int k = 0; k < 3; ++k)
+        {
+            cLo[k] = min(cLo[k], ctx.centroids[3 * id + k]);
+            cHi[k] = max(cHi[k], ctx.centroids[3 * id + k]);
+        }
+    }
+    for (int k = 0; k < 3; ++k)
+    {
+        out[nodeIndex].min[k] = lo[k];
+        out[nodeIndex].max[k] = hi[k];
+    }
+
+    int n = end - begin;
+    out[nodeIndex].offset = begin;
+    out[nodeIndex].count = n;
+    if (n <= BVH_LEAF_TRIANGLES)
+        return;
+
+    // binned SAH over all three axes, counting in packs of four since that is what a leaf tests
+    int bestAxis = -1, bestSplit = 0;
+    float bestCost = 1e30f;
+    if (depth < BVH_MEDIAN_DEPTH)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float extent = cHi[axis] - cLo[axis];
+            if (extent <= 0.0f)
+                continue;
+            float scale = BVH_BIN_NUM * 0.9999f / extent;
+
+            int counts[BVH_BIN_NUM] = { 0 };
+            float binLo[BVH_BIN_NUM][3], binHi[BVH_BIN_NUM][3];
+            for (int b = 0; b < BVH_BIN_NUM; ++b)
+            {
+                binLo[b][0] = binLo[b][1] = binLo[b][2] = 1e30f;
+                binHi[b][0] = binHi[b][1] = binHi[b][2] = -1e30f;
+            }
+            for (int i = begin; i < end; ++i)
+            {
+                int id = ctx.order[i];
+                int b = (int)((ctx.centroids[3 * id + axis] - cLo[axis]) * scale);
+                counts[b]++;
+                grow(binLo[b], binHi[b], &ctx.boxes[6 * id]);
+            }
+
+            // right-to-left sweep first, then score each split on the way back
+            float rightArea[BVH_BIN_NUM];
+            int rightCount[BVH_BIN_NUM];
+            float accLo[3] = { 1e30f, 1e30f, 1e30f }, accHi[3] = { -1e30f, -1e30f, -1e30f };
+            int acc = 0;
+            for (int b = BVH_BIN_NUM - 1; b > 0; --b)
+            {
+                acc += counts[b];
+                if (counts[b] > 0)
+                {
+                    float box[6] = { binLo[b][0], binLo[b][1], binLo[b][2], binHi[b][0], binHi[b][1], binHi[b][2] };
+                    grow(accLo, accHi, box);
+                }
+                rightCount[b] = acc;
+                rightArea[b] = acc > 0 ? half_area(accLo, accHi) : 0.0f;
+            }
+            accLo[0] = accLo[1] = accLo[2] = 1e30f;
+            accHi[0] = accHi[1] = accHi[2] = -1e30f;
+            acc = 0;
+            for (int b = 1; b < BVH_BIN_NUM; ++b)
+            {
+                acc += counts[b - 1];
+                if (counts[b - 1] > 0)
+                {
+                    float box[6] = { binLo[b - 1][0], binLo[b - 1][1], binLo[b - 1][2], binHi[b - 1][0], binHi[b - 1][1], binHi[b - 1][2] };
+                    grow(accLo, accHi, box);
+                }
+                if (acc == 0 || rightCount[b] == 0)
+                    continue;
+                float cost = pack_count(acc) * half_area(accLo, accHi) + pack_count(rightCount[b]) * rightArea[b];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+    }
+
+    float area = half_area(lo, hi);
+    int mid = -1;
+    if (bestAxis >= 0)
+    {
+        // one box-pair test against the packs the leaf would test
+        if (n <= BVH_MAX_LEAF_TRIANGLES && area > 0.0f && 1.0f + bestCost / area >= pack_count(n))
+            return;
+        float scale = BVH_BIN_NUM * 0.9999f / (cHi[bestAxis] - cLo[bestAxis]);
+        float lowest = cLo[bestAxis];
+        const float* centroids = ctx.centroids.data();
+        int* split = partition(ctx.order.data() + begin, ctx.order.data() + end, [&](int id) {
+            return (int)((centroids[3 * id + bestAxis] - lowest) * scale) < bestSplit;
+        });
+        mid = (int)(split - ctx.order.data());
+    }
+    else if (n <= BVH_MAX_LEAF_TRIANGLES && depth < BVH_MEDIAN_DEPTH)
+    {
+        return; // every centroid coincides, splitting cannot separate anything
+    }
+    if (mid <= begin || mid >= end)
+    {
+        int axis = 0;
+        for (int k = 1; k < 3; ++k)
+        {
+            if (cHi[k] - cLo[k] > cHi[axis] - cLo[axis])
+                axis = k;
+        }
+        mid = (begin + end) / 2;
+        const float* centroids = ctx.centroids.data();
+        nth_element(ctx.order.data() + begin, ctx.order.data() + mid, ctx.order.data() + end, [&](int a, int b) {
+            return centroids[3 * a + axis] < centroids[3 * b + axis];
+        });
+    }
+
+    out[nodeIndex].count = 0;
+    if (depth < ctx.spawn_depth && n > BVH_PARALLEL_MIN)
+    {
+        // the halves touch disjoint ranges of order, so they can be built side by side
+        int rightDepth = 0;
+        future<vector<BvhNode> > right = async(launch::async, [&ctx, mid, end, depth, &rightDepth]() {
+            vector<BvhNode> nodes;
+            build_subtree(ctx, mid, end, depth + 1, nodes, rightDepth);
+            return nodes;
+        });
+        build_subtree(ctx, begin, mid, depth + 1, out, max_depth);
+        vector<BvhNode> rightNodes = right.get();
+        max_depth = max(max_depth, rightDepth);
+
+        int base = (int)out.size();
+        out[nodeIndex].offset = base;
+        for (size_t i = 0; i < rightNodes.size(); ++i)
+        {
+            if (rightNodes[i].count == 0)
+                rightNodes[i].offset += base;
+            out.push_back(rightNodes[i]);
+        }
+    }
+    else
+    {
+        build_subtree(ctx, begin, mid, depth + 1, out, max_depth);
+        out[nodeIndex].offset = (int)out.size();
+        build_subtree(ctx, mid, end, depth + 1, out, max_depth);
+    }
+    return;
+}
+
+#if MESH_BVH_SSE
+
+// lane 3 of the node loads is offset/count and is never looked at
+static inline bool ray_box(const BvhNode& node, const BvhRay& ray, float t_max, float& t_near)
+{
+    __m128 origin = _mm_loadu_ps(ray.origin);
+    __m128 invDir = _mm_loadu_ps(ray.inv_dir);
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min), origin), invDir);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max), origin), invDir);
+    __m128 lo = _mm_min_ps(t0, t1);
+    __m128 hi = _mm_max_ps(t0, t1);
+    __m128 nearT = _mm_max_ss(_mm_max_ss(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(2, 2, 2, 2)));
+    __m128 farT = _mm_min_ss(_mm_min_ss(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(2, 2, 2, 2)));
+    nearT = _mm_max_ss(nearT, _mm_setzero_ps());
+    farT = _mm_min_ss(farT, _mm_set_ss(t_max));
+    t_near = _mm_cvtss_f32(nearT);
+    return t_near <= _mm_cvtss_f32(farT);
+}
+
+// Moller-Trumbore on four triangles at once
+static inline void ray_pack(const BvhTrianglePack& pack, const BvhRay& ray, RayHit& hit)
+{
+    __m128 dx = _mm_set1_ps(ray.dir[0]), dy = _mm_set1_ps(ray.dir[1]), dz = _mm_set1_ps(ray.dir[2]);
+    __m128 e1x = _mm_loadu_ps(pack.e1[0]), e1y = _mm_loadu_ps(pack.e1[1]), e1z = _mm_loadu_ps(pack.e1[2]);
+    __m128 e2x = _mm_loadu_ps(pack.e2[0]), e2y = _mm_loadu_ps(pack.e2[1]), e2z = _mm_loadu_ps(pack.e2[2]);
+
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.origin[0]), _mm_loadu_ps(pack.v0[0]));
+    __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.origin[1]), _mm_loadu_ps(pack.v0[1]));
+    __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.origin[2]), _mm_loadu_ps(pack.v0[2]));
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+    // degenerate padding lanes have det == 0 and drop out here
+    __m128 zero = _mm_setzero_ps();
+    __m128 mask = _mm_cmpgt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), det), _mm_set1_ps(1e-20f));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(t, zero));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(hit.t)));
+    int bits = _mm_movemask_ps(mask);
+    if (bits == 0)
+        return;
+
+    float ts[4], us[4], vs[4];
+    _mm_storeu_ps(ts, t);
+    _mm_storeu_ps(us, u);
+    _mm_storeu_ps(vs, v);
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        if ((bits & (1 << lane)) && ts[lane] < hit.t)
+        {
+            hit.t = ts[lane];
+            hit.u = us[lane];
+            hit.v = vs[lane];
+            hit.triangle = pack.ids[lane];
+        }
+    }
+    return;
+}
+
+#else
+
+static inline bool ray_box(const BvhNode& node, const BvhRay& ray, float t_max, float& t_near)
+{
+    float nearT = 0.0f, farT = t_max;
+    for (int k = 0; k < 3; ++k)
+    {
+        float t0 = (node.min[k] - ray.origin[k]) * ray.inv_dir[k];
+        float t1 = (node.max[k] - ray.origin[k]) * ray.inv_dir[k];
+        nearT = max(nearT, min(t0, t1));
+        farT = min(farT, max(t0, t1));
+    }
+    t_near = nearT;
+    return nearT <= farT;
+}
+
+static inline void ray_pack(const BvhTrianglePack& pack, const BvhRay& ray, RayHit& hit)
+{
+    const float* d = ray.dir;
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        float e1[3] = { pack.e1[0][lane], pack.e1[1][lane], pack.e1[2][lane] };
+        float e2[3] = { pack.e2[0][lane], pack.e2[1][lane], pack.e2[2][lane] };
+        float p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+        float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (fabs(det) <= 1e-20f)
+            continue;
+        float invDet = 1.0f / det;
+        float s[3] = { ray.origin[0] - pack.v0[0][lane], ray.origin[1] - pack.v0[1][lane], ray.origin[2] - pack.v0[2][lane] };
+        float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+        float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+        float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * invDet;
+        float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+        if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < hit.t)
+        {
+            hit.t = t;
+            hit.u = u;
+            hit.v = v;
+            hit.triangle = pack.ids[lane];
+        }
+    }
+    return;
+}
+
+#endif
+
+// separating axis test of a triangle against a box given by center and half size
+static bool triangle_overlaps_box(const float center[3], const float half[3], const float a[3], const float b[3], const float c[3])
+{
+    float v[3][3];
+    for (int k = 0; k < 3; ++k)
+    {
+        v[0][k] = a[k] - center[k];
+        v[1][k] = b[k] - center[k];
+        v[2][k] = c[k] - center[k];
+    }
+
+    // box face normals
+    for (int k = 0; k < 3; ++k)
+    {
+        if (min(v[0][k], min(v[1][k], v[2][k])) > half[k] || max(v[0][k], max(v[1][k], v[2][k])) < -half[k])
+            return false;
+    }
+
+    float e[3][3];
+    for (int k = 0; k < 3; ++k)
+    {
+        e[0][k] = v[1][k] - v[0][k];
+        e[1][k] = v[2][k] - v[1][k];
+        e[2][k] = v[0][k] - v[2][k];
+    }
+
+    // triangle plane
+    float n[3] = { e[0][1] * e[1][2] - e[0][2] * e[1][1], e[0][2] * e[1][0] - e[0][0] * e[1][2], e[0][0] * e[1][1] - e[0][1] * e[1][0] };
+    float d = n[0] * v[0][0] + n[1] * v[0][1] + n[2] * v[0][2];
+    if (fabs(d) > half[0] * fabs(n[0]) + half[1] * fabs(n[1]) + half[2] * fabs(n[2]))
+        return false;
+
+    // cross products of the box axes with the triangle edges
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            float axis[3] = { 0.0f, 0.0f, 0.0f };
+            int k1 = (k + 1) % 3, k2 = (k + 2) % 3;
+            axis[k1] = -e[i][k2];
+            axis[k2] = e[i][k1];
+            float p0 = axis[k1] * v[0][k1] + axis[k2] * v[0][k2];
+            float p1 = axis[k1] * v[1][k1] + axis[k2] * v[1][k2];
+            float p2 = axis[k1] * v[2][k1] + axis[k2] * v[2][k2];
+            float r = half[k1] * fabs(axis[k1]) + half[k2] * fabs(axis[k2]);
+            if (min(p0, min(p1, p2)) > r || max(p0, max(p1, p2)) < -r)
+                return false;
+        }
+    }
+    return true;
+}
+
+MeshBvh::MeshBvh()
+{
+    this->stats = BvhStats();
+    return;
+}
+
+void MeshBvh::build(const float* vertices, int stride, const unsigned int* faces, int face_num, int thread_num)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    this->clear();
+    if (vertices == NULL || faces == NULL || face_num <= 0)
+        return;
+
+    BvhBuildContext ctx;
+    ctx.boxes.resize(6 * (size_t)face_num);
+    ctx.centroids.resize(3 * (size_t)face_num);
+    ctx.order.resize(face_num);
+    for (int f = 0; f < face_num; ++f)
+    {
+        float* box = &ctx.boxes[6 * (size_t)f];
+        box[0] = box[1] = box[2] = 1e30f;
+        box[3] = box[4] = box[5] = -1e30f;
+        for (int c = 0; c < 3; ++c)
+        {
+            const float* p = vertices + (size_t)stride * faces[3 * (size_t)f + c];
+            float point[6] = { p[0], p[1], p[2], p[0], p[1], p[2] };
+            grow(box, box + 3, point);
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            ctx.centroids[3 * (size_t)f + k] = 0.5f * (box[k] + box[3 + k]);
+        }
+        ctx.order[f] = f;
+    }
+    int hardwareThreads = (int)thread::hardware_concurrency();
+    if (hardwareThreads > 0)
+        thread_num = min(thread_num, hardwareThreads);
+    ctx.spawn_depth = 0;
+    while ((1 << ctx.spawn_depth) < thread_num)
+    {
+        ctx.spawn_depth++;
+    }
+
+    this->nodes.reserve(2 * (size_t)pack_count(face_num));
+    int maxDepth = 0;
+    build_subtree(ctx, 0, face_num, 0, this->nodes, maxDepth);
+
+    // leaves still hold a range of order; turn each into packs of four triangles
+    this->packs.reserve(pack_count(face_num) + this->nodes.size() / 2);
+    int leafNum = 0;
+    for (size_t i = 0; i < this->nodes.size(); ++i)
+    {
+        BvhNode& node = this->nodes[i];
+        if (node.count == 0)
+            continue;
+        int first = node.offset, num = node.count;
+        node.offset = (int)this->packs.size();
+        node.count = pack_count(num);
+        for (int j = 0; j < num; j += 4)
+        {
+            BvhTrianglePack pack = BvhTrianglePack();
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                pack.ids[lane] = -1;
+                if (j + lane >= num)
+                    continue;
+                int id = ctx.order[first + j + lane];
+                const float* a = vertices + (size_t)stride * faces[3 * (size_t)id];
+                const float* b = vertices + (size_t)stride * faces[3 * (size_t)id + 1];
+                const float* c = vertices + (size_t)stride * faces[3 * (size_t)id + 2];
+                for (int k = 0; k < 3; ++k)
+                {
+                    pack.v0[k][lane] = a[k];
+                    pack.e1[k][lane] = b[k] - a[k];
+                    pack.e2[k][lane] = c[k] - a[k];
+                }
+                pack.ids[lane] = id;
+            }
+            this->packs.push_back(pack);
+        }
+        leafNum++;
+    }
+
+    this->stats.node_num = (int)this->nodes.size();
+    this->stats.leaf_num = leafNum;
+    this->stats.triangle_num = face_num;
+    this->stats.max_depth = maxDepth;
+    this->stats.build_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return;
+}
+
+void MeshBvh::clear()
+{
+    vector<BvhNode>().swap(this->nodes);
+    vector<BvhTrianglePack>().swap(this->packs);
+    this->stats = BvhStats();
+    return;
+}
+
+bool MeshBvh::is_empty() const
+{
+    return this->nodes.empty();
+}
+
+bool MeshBvh::intersect(const float origin[3], const float dir[3], float t_max, RayHit& hit) const
+{
+    hit.t = t_max;
+    hit.triangle = -1;
+    hit.u = hit.v = 0.0f;
+    if (this->nodes.empty())
+        return false;
+
+    BvhRay ray;
+    for (int k = 0; k < 3; ++k)
+    {
+        // a zero component would turn the slab test into 0 * inf
+        float d = dir[k];
+        if (fabs(d) < 1e-20f)
+            d = d < 0.0f ? -1e-20f : 1e-20f;
+        ray.origin[k] = origin[k];
+        ray.dir[k] = dir[k];
+        ray.inv_dir[k] = 1.0f / d;
+    }
+    ray.origin[3] = ray.dir[3] = ray.inv_dir[3] = 0.0f;
+
+    float nearT;
+    if (!ray_box(this->nodes[0], ray, hit.t, nearT))
+        return false;
+
+    // near child first, the far one waits on the stack with its entry distance
+    int stack[BVH_STACK_SIZE];
+    float stackNear[BVH_STACK_SIZE];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    while (true)
+    {
+        const BvhNode& node = this->nodes[nodeIndex];
+        if (node.count > 0)
+        {
+            for (int p = 0; p < node.count; ++p)
+            {
+                ray_pack(this->packs[node.offset + p], ray, hit);
+            }
+        }
+        else
+        {
+            int left = nodeIndex + 1, right = node.offset;
+            float nearLeft, nearRight;
+            bool hitLeft = ray_box(this->nodes[left], ray, hit.t, nearLeft);
+            bool hitRight = ray_box(this->nodes[right], ray, hit.t, nearRight);
+            if (hitLeft && hitRight)
+            {
+                if (nearRight < nearLeft)
+                {
+                    swap(left, right);
+                    swap(nearLeft, nearRight);
+                }
+                stack[stackSize] = right;
+                stackNear[stackSize] = nearRight;
+                stackSize++;
+                nodeIndex = left;
+                continue;
+            }
+            if (hitLeft || hitRight)
+            {
+                nodeIndex = hitLeft ? left : right;
+                continue;
+            }
+        }
+
+        // skip anything that starts beyond the closest hit so far
+        bool found = false;
+        while (stackSize > 0)
+        {
+            stackSize--;
+            if (stackNear[stackSize] <= hit.t)
+            {
+                nodeIndex = stack[stackSize];
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            break;
+    }
+    return hit.triangle >= 0;
+}
+
+bool MeshBvh::overlaps_box(const float min[3], const float max[3]) const
+{
+    if (this->nodes.empty())
+        return false;
+
+    float center[3], half[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        center[k] = 0.5f * (min[k] + max[k]);
+        half[k] = 0.5f * (max[k] - min[k]);
+    }
+
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const BvhNode& node = this->nodes[stack[--stackSize]];
+        if (node.min[0] > max[0] || node.min[1] > max[1] || node.min[2] > max[2] ||
+            node.max[0] < min[0] || node.max[1] < min[1] || node.max[2] < min[2])
+            continue;
+
+        if (node.count == 0)
+        {
+            int nodeIndex = (int)(&node - this->nodes.data());
+            stack[stackSize++] = node.offset;
+            stack[stackSize++] = nodeIndex + 1;
+            continue;
+        }
+        for (int p = 0; p < node.count; ++p)
+        {
+            const BvhTrianglePack& pack = this->packs[node.offset + p];
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if (pack.ids[lane] < 0)
+                    continue;
+                float a[3], b[3], c[3];
+                for (int k = 0; k < 3; ++k)
+                {
+                    a[k] = pack.v0[k][lane];
+                    b[k] = a[k] + pack.e1[k][lane];
+                    c[k] = a[k] + pack.e2[k][lane];
+                }
+                if (triangle_overlaps_box(center, half, a, b, c))
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+void MeshBvh::get_bounds(float min[3], float max[3]) const
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        min[k] = this->nodes.empty() ? 0.0f : this->nodes[0].min[k];
+        max[k] = this->nodes.empty() ? 0.0f : this->nodes[0].max[k];
+    }
+    return;
+}
+
+void MeshBvh::get_stats(BvhStats& stats) const
+{
+    stats = this->stats;
+    return;
+}
@@ -0,0 +1,66 @@
+#ifndef MESH_BVH_H
+#define MESH_BVH_H
+
+#include <vector>
+
+// 32 bytes, two per cache line; an inner node's left child is the node right after it
+struct BvhNode
+{
+    float min[3];
+    int offset; // inner: right child index, leaf: first triangle pack
+    float max[3];
+    int count; // 0 for inner nodes, otherwise packs in the leaf
+};
+
+// four triangles side by side for the SIMD test, unused lanes are degenerate with id -1
+struct BvhTrianglePack
+{
+    float v0[3][4];
+    float e1[3][4]; // v1 - v0
+    float e2[3][4]; // v2 - v0
+    int ids[4]; // face index in the source face list
+};
+
+struct RayHit
+{
+    float t; // in units of the ray direction
+    int triangle; // -1 on a miss
+    float u, v; // barycentrics of v1 and v2
+};
+
+struct BvhStats
+{
+    int node_num;
+    int leaf_num;
+    int triangle_num;
+    int max_depth;
+    double build_ms;
+};
+
+// SAH-binned bounding volume hierarchy over a triangle mesh, for picking and collision.
+// Keeps its own copy of the triangles, so the source mesh may drop its buffers afterwards.
+class MeshBvh
+{
+public:
+    MeshBvh();
+
+    // stride is in floats; subtrees above a size threshold are built on up to thread_num threads
+    void build(const float* vertices, int stride, const unsigned int* faces, int face_num, int thread_num);
+    void clear();
+    bool is_empty() const;
+
+    // nearest hit with 0 <= t <= t_max, triangles are two-sided
+    bool intersect(const float origin[3], const float dir[3], float t_max, RayHit& hit) const;
+    // true if any triangle touches the box, exact separating axis test
+    bool overlaps_box(const float min[3], const float max[3]) const;
+
+    void get_bounds(float min[3], float max[3]) const;
+    void get_stats(BvhStats& stats) const;
+
+private:
+    std::vector<BvhNode> nodes;
+    std::vector<BvhTrianglePack> packs;
+    BvhStats stats;
+};
+
+#endif
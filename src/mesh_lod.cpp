@@ -0,0 +1,88 @@
+#include "mesh_lod.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+using namespace std;
+
+void build_lod(const float* vertices, int stride, int vertex_num, const unsigned int* faces, int face_num, int grid_resolution, MeshLod& lod)
+{
+    lod.vertices.clear();
+    lod.indices.clear();
+    if (vertices == NULL || faces == NULL || vertex_num == 0 || face_num == 0)
+        return;
+
+    float lo[3] = { 1e30f, 1e30f, 1e30f };
+    float hi[3] = { -1e30f, -1e30f, -1e30f };
+    for (int v = 0; v < vertex_num; ++v)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            lo[i] = min(lo[i], vertices[stride * v + i]);
+            hi[i] = max(hi[i], vertices[stride * v + i]);
+        }
+    }
+
+    // cubic cells sized by the longest axis, so flat meshes are not over-merged across the thin axis
+    float extent = max(hi[0] - lo[0], max(hi[1] - lo[1], hi[2] - lo[2]));
+    float scale = extent > 0 ? grid_resolution / extent : 0.0f;
+
+    vector<unsigned int> remap(vertex_num);
+    vector<float> sums;
+    vector<int> counts;
+    unordered_map<uint64_t, unsigned int> cells;
+    cells.reserve(vertex_num);
+    for (int v = 0; v < vertex_num; ++v)
+    {
+        const float* p = vertices + stride * v;
+        uint64_t key = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            uint64_t q = (uint64_t)min(grid_resolution - 1, (int)((p[i] - lo[i]) * scale));
+            key = (key << 21) | q;
+        }
+
+        unordered_map<uint64_t, unsigned int>::iterator it = cells.find(key);
+        if (it == cells.end())
+        {
+            it = cells.insert(make_pair(key, (unsigned int)counts.size())).first;
+            sums.push_back(0.0f);
+            sums.push_back(0.0f);
+            sums.push_back(0.0f);
+            counts.push_back(0);
+        }
+
+        unsigned int cell = it->second;
+        remap[v] = cell;
+        sums[3 * cell] += p[0];
+        sums[3 * cell + 1] += p[1];
+        sums[3 * cell + 2] += p[2];
+        counts[cell]++;
+    }
+
+    lod.vertices.resize(sums.size());
+    for (size_t c = 0; c < counts.size(); ++c)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            lod.vertices[3 * c + i] = sums[3 * c + i] / counts[c];
+        }
+    }
+
+    lod.indices.reserve(3 * face_num);
+    for (int f = 0; f < face_num; ++f)
+    {
+        unsigned int a = remap[faces[3 * f]];
+        unsigned int b = remap[faces[3 * f + 1]];
+        unsigned int c = remap[faces[3 * f + 2]];
+        if (a == b || b == c || a == c)
+            continue;
+
+        lod.indices.push_back(a);
+        lod.indices.push_back(b);
+        lod.indices.push_back(c);
+    }
+
+    return;
+}
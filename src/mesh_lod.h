@@ -0,0 +1,17 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <vector>
+
+// a reduced, position-only copy of a mesh, e.g. for shadow casters
+struct MeshLod
+{
+    std::vector<float> vertices; // x, y, z
+    std::vector<unsigned int> indices;
+};
+
+// vertex clustering: vertices falling into the same cell of a grid_resolution^3 grid over the
+// bounding box are merged at their average position, collapsed triangles are dropped
+void build_lod(const float* vertices, int stride, int vertex_num, const unsigned int* faces, int face_num, int grid_resolution, MeshLod& lod);
+
+#endif
@@ -0,0 +1,191 @@
+#include "mesh_residency.h"
+
+#include "process_memory.h"
+
+#include <iostream>
+
+using namespace std;
+
+MeshResidency::MeshResidency()
+{
+    this->released_bytes = 0;
+    return;
+}
+
+int MeshResidency::register_mesh(const char* name, PlyModel* model, bool pinned)
+{
+    MeshRecord record;
+    record.name = name;
+    record.model = model;
+    record.vao = 0;
+    record.vbo = 0;
+    record.ebo = 0;
+    record.vertex_num = model->get_vertex_num();
+    record.index_count = 3 * model->get_face_num();
+    model->get_bounding_box(record.bounds.min, record.bounds.max);
+    record.shadow_vao = 0;
+    record.shadow_vbo = 0;
+    record.shadow_ebo = 0;
+    record.shadow_index_count = 0;
+    record.cpu_bytes = sizeof(float) * 6 * record.vertex_num + sizeof(unsigned int) * record.index_count;
+    record.gpu_bytes = 0;
+    record.cpu_resident = model->get_model_vertices() != NULL;
+    record.gpu_resident = false;
+    record.pinned = pinned;
+
+    this->records.push_back(record);
+    return (int)this->records.size() - 1;
+}
+
+void MeshResidency::mark_uploaded(int mesh_id, unsigned int vao, unsigned int vbo, unsigned int ebo)
+{
+    MeshRecord& record = this->records[mesh_id];
+    record.vao = vao;
+    record.vbo = vbo;
+    record.ebo = ebo;
+    record.gpu_bytes = sizeof(float) * 6 * record.vertex_num + sizeof(unsigned int) * record.index_count;
+    record.gpu_resident = true;
+
+    if (!record.pinned)
+    {
+        this->drop_cpu_copy(record);
+    }
+    return;
+}
+
+void MeshResidency::mark_shadow_uploaded(int mesh_id, unsigned int vao, unsigned int vbo, unsigned int ebo)
+{
+    MeshRecord& record = this->records[mesh_id];
+    record.shadow_vao = vao;
+    record.shadow_vbo = vbo;
+    record.shadow_ebo = ebo;
+    record.shadow_index_count = (int)record.shadow_lod.indices.size();
+    record.gpu_bytes += sizeof(float) * record.shadow_lod.vertices.size() + sizeof(unsigned int) * record.shadow_lod.indices.size();
+
+    vector<float>().swap(record.shadow_lod.vertices);
+    vector<unsigned int>().swap(record.shadow_lod.indices);
+    return;
+}
+
+void MeshResidency::replace_mesh(int mesh_id)
+{
+    MeshRecord& record = this->records[mesh_id];
+    PlyModel* model = record.model;
+    record.vao = 0;
+    record.vbo = 0;
+    record.ebo = 0;
+    record.vertex_num = model->get_vertex_num();
+    record.index_count = 3 * model->get_face_num();
+    model->get_bounding_box(record.bounds.min, record.bounds.max);
+    record.shadow_vao = 0;
+    record.shadow_vbo = 0;
+    record.shadow_ebo = 0;
+    record.shadow_index_count = 0;
+    record.cpu_bytes = sizeof(float) * 6 * record.vertex_num + sizeof(unsigned int) * record.index_count;
+    record.gpu_bytes = 0;
+    record.cpu_resident = model->get_model_vertices() != NULL;
+    record.gpu_resident = false;
+    return;
+}
+
+void MeshResidency::set_pinned(int mesh_id, bool pinned)
+{
+    MeshRecord& record = this->records[mesh_id];
+    record.pinned = pinned;
+
+    // an unpinned mesh that already lives on the GPU has no reason to keep its CPU copy
+    if (!pinned && record.gpu_resident)
+    {
+        this->drop_cpu_copy(record);
+    }
+    return;
+}
+
+void MeshResidency::drop_cpu_copy(MeshRecord& record)
+{
+    if (!record.cpu_resident)
+        return;
+
+    record.model->release_buffers();
+    record.model->get_allocator()->trim();
+    record.cpu_resident = false;
+    this->released_bytes += record.cpu_bytes;
+    return;
+}
+
+unsigned int MeshResidency::get_vao(int mesh_id)
+{
+    return this->records[mesh_id].vao;
+}
+
+int MeshResidency::get_index_count(int mesh_id)
+{
+    return this->records[mesh_id].index_count;
+}
+
+const MeshBounds& MeshResidency::get_bounds(int mesh_id)
+{
+    return this->records[mesh_id].bounds;
+}
+
+MeshRecord& MeshResidency::get_record(int mesh_id)
+{
+    return this->records[mesh_id];
+}
+
+int MeshResidency::get_mesh_num()
+{
+    return (int)this->records.size();
+}
+
+void MeshResidency::get_report(ResidencyReport& report)
+{
+    report.mesh_num = (int)this->records.size();
+    report.cpu_resident_num = 0;
+    report.pinned_num = 0;
+    report.cpu_bytes = 0;
+    report.gpu_bytes = 0;
+    report.released_bytes = this->released_bytes;
+    report.process_rss_bytes = get_process_rss();
+
+    for (size_t i = 0; i < this->records.size(); ++i)
+    {
+        const MeshRecord& record = this->records[i];
+        if (record.cpu_resident)
+        {
+            report.cpu_resident_num++;
+            report.cpu_bytes += record.cpu_bytes;
+        }
+        if (record.gpu_resident)
+        {
+            report.gpu_bytes += record.gpu_bytes;
+        }
+        if (record.pinned)
+        {
+            report.pinned_num++;
+        }
+    }
+    return;
+}
+
+void MeshResidency::print_memory_report()
+{
+    ResidencyReport report;
+    this->get_report(report);
+
+    cout << "Mesh Residency: " << endl;
+    for (size_t i = 0; i < this->records.size(); ++i)
+    {
+        const MeshRecord& record = this->records[i];
+        cout << "[" << i << "] " << record.name << ": " << record.index_count / 3 << " faces, cpu "
+            << (record.cpu_resident ? record.cpu_bytes / 1024 : 0) << " KB" << (record.pinned ? " (pinned)" : "")
+            << ", gpu " << (record.gpu_resident ? record.gpu_bytes / 1024 : 0) << " KB" << endl;
+    }
+    cout << "cpu " << report.cpu_bytes / 1024 << " KB in " << report.cpu_resident_num << "/" << report.mesh_num << " meshes, gpu "
+        << report.gpu_bytes / 1024 << " KB, released " << report.released_bytes / 1024 << " KB" << endl;
+    if (report.process_rss_bytes > 0)
+    {
+        cout << "process rss " << report.process_rss_bytes / (1024 * 1024) << " MB" << endl;
+    }
+    return;
+}
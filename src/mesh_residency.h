@@ -0,0 +1,89 @@
+#ifndef MESH_RESIDENCY_H
+#define MESH_RESIDENCY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "ply_model.h"
+#include "meshlet.h"
+#include "mesh_lod.h"
+
+struct MeshBounds
+{
+    float min[3];
+    float max[3];
+};
+
+// a mesh's CPU copy, GPU buffers and draw metadata are tracked separately so each can go away on its own
+struct MeshRecord
+{
+    std::string name;
+    PlyModel* model;
+
+    unsigned int vao;
+    unsigned int vbo;
+    unsigned int ebo;
+
+    int vertex_num;
+    int index_count;
+    MeshBounds bounds;
+    std::vector<Meshlet> meshlets; // empty when the mesh is drawn in one call
+
+    MeshLod shadow_lod; // CPU side is freed once uploaded
+    unsigned int shadow_vao; // 0 when the mesh casts no shadow
+    unsigned int shadow_vbo;
+    unsigned int shadow_ebo;
+    int shadow_index_count;
+
+    size_t cpu_bytes;
+    size_t gpu_bytes;
+    bool cpu_resident;
+    bool gpu_resident;
+    bool pinned; // CPU copy is kept for collision or picking
+};
+
+struct ResidencyReport
+{
+    int mesh_num;
+    int cpu_resident_num;
+    int pinned_num;
+    size_t cpu_bytes;
+    size_t gpu_bytes;
+    size_t released_bytes; // CPU bytes dropped after upload so far
+    size_t process_rss_bytes; // 0 where the platform does not expose it
+};
+
+class MeshResidency
+{
+public:
+    MeshResidency();
+
+    int register_mesh(const char* name, PlyModel* model, bool pinned);
+
+    // call once the VBO/EBO hold the data; drops the CPU copy unless the mesh is pinned
+    void mark_uploaded(int mesh_id, unsigned int vao, unsigned int vbo, unsigned int ebo);
+    void set_pinned(int mesh_id, bool pinned);
+    // call once the shadow LOD is in its own VAO and buffers; frees the CPU side of the LOD
+    void mark_shadow_uploaded(int mesh_id, unsigned int vao, unsigned int vbo, unsigned int ebo);
+    // call after the record's model was reloaded in place and its old GL objects deleted;
+    // re-reads counts and bounds, the mesh is CPU resident again until the next upload
+    void replace_mesh(int mesh_id);
+
+    unsigned int get_vao(int mesh_id);
+    int get_index_count(int mesh_id);
+    const MeshBounds& get_bounds(int mesh_id);
+    MeshRecord& get_record(int mesh_id);
+    int get_mesh_num();
+
+    void get_report(ResidencyReport& report);
+    void print_memory_report();
+
+private:
+    std::vector<MeshRecord> records;
+    size_t released_bytes;
+
+    void drop_cpu_copy(MeshRecord& record);
+};
+
+#endif
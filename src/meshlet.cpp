@@ -0,0 +1,218 @@
+#include "meshlet.h"
+
+#include "morton.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+using namespace std;
+
+static int dominant_direction(const float n[3])
+{
+    // one of six buckets (+x, -x, +y, -y, +z, -z)
+    int axis = 0;
+    for (int i = 1; i < 3; ++i)
+    {
+        if (fabs(n[i]) > fabs(n[axis]))
+            axis = i;
+    }
+    return 2 * axis + (n[axis] < 0 ? 1 : 0);
+}
+
+void build_meshlets(const float* vertices, int stride, unsigned int* faces, int face_num, int max_triangles, vector<Meshlet>& meshlets)
+{
+    meshlets.clear();
+    if (face_num == 0 || vertices == NULL || faces == NULL)
+        return;
+
+    vector<float> normals(3 * face_num);
+    vector<float> centroids(3 * face_num);
+    float lo[3] = { 1e30f, 1e30f, 1e30f };
+    float hi[3] = { -1e30f, -1e30f, -1e30f };
+
+    for (int f = 0; f < face_num; ++f)
+    {
+        const float* a = vertices + stride * faces[3 * f];
+        const float* b = vertices + stride * faces[3 * f + 1];
+        const float* c = vertices + stride * faces[3 * f + 2];
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float* n = &normals[3 * f];
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+        float length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (int i = 0; i < 3; ++i)
+        {
+            n[i] = length > 0 ? n[i] / length : 0.0f; // degenerate faces keep a zero normal
+            centroids[3 * f + i] = (a[i] + b[i] + c[i]) / 3.0f;
+            lo[i] = min(lo[i], centroids[3 * f + i]);
+            hi[i] = max(hi[i], centroids[3 * f + i]);
+        }
+    }
+
+    // facing bucket first, then Morton order inside it, keeps clusters compact and their cones narrow
+    vector<pair<uint64_t, int>> keys(face_num);
+    for (int f = 0; f < face_num; ++f)
+    {
+        uint32_t q[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            float extent = hi[i] - lo[i];
+            float t = extent > 0 ? (centroids[3 * f + i] - lo[i]) / extent : 0.0f;
+            q[i] = (uint32_t)(t * 1023.0f);
+        }
+        uint64_t morton = spread_bits(q[0]) | (spread_bits(q[1]) << 1) | (spread_bits(q[2]) << 2);
+        keys[f] = make_pair(((uint64_t)dominant_direction(&normals[3 * f]) << 32) | morton, f);
+    }
+    sort(keys.begin(), keys.end());
+
+    vector<unsigned int> sortedFaces(3 * face_num);
+    vector<float> sortedNormals(3 * face_num);
+    for (int f = 0; f < face_num; ++f)
+    {
+        int src = keys[f].second;
+        for (int i = 0; i < 3; ++i)
+        {
+            sortedFaces[3 * f + i] = faces[3 * src + i];
+            sortedNormals[3 * f + i] = normals[3 * src + i];
+        }
+    }
+    copy(sortedFaces.begin(), sortedFaces.end(), faces);
+
+    int start = 0;
+    while (start < face_num)
+    {
+        int end = min(face_num, start + max_triangles);
+        // never let a cluster straddle two facing buckets
+        uint64_t bucket = keys[start].first >> 32;
+        for (int f = start + 1; f < end; ++f)
+        {
+            if ((keys[f].first >> 32) != bucket)
+            {
+                end = f;
+                break;
+            }
+        }
+
+        Meshlet meshlet;
+        meshlet.index_offset = 3 * start;
+        meshlet.index_count = 3 * (end - start);
+
+        float bmin[3] = { 1e30f, 1e30f, 1e30f };
+        float bmax[3] = { -1e30f, -1e30f, -1e30f };
+        float axis[3] = { 0, 0, 0 };
+        for (int f = start; f < end; ++f)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                const float* v = vertices + stride * faces[3 * f + k];
+                for (int i = 0; i < 3; ++i)
+                {
+                    bmin[i] = min(bmin[i], v[i]);
+                    bmax[i] = max(bmax[i], v[i]);
+                }
+            }
+            for (int i = 0; i < 3; ++i)
+            {
+                axis[i] += sortedNormals[3 * f + i];
+            }
+        }
+
+        float radius2 = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            meshlet.center[i] = 0.5f * (bmin[i] + bmax[i]);
+        }
+        for (int f = start; f < end; ++f)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                const float* v = vertices + stride * faces[3 * f + k];
+                float dx = v[0] - meshlet.center[0], dy = v[1] - meshlet.center[1], dz = v[2] - meshlet.center[2];
+                radius2 = max(radius2, dx * dx + dy * dy + dz * dz);
+            }
+        }
+        meshlet.radius = sqrt(radius2);
+
+        // cone: widest deviation of any face normal from the average
+        float axisLength = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        float minDot = 1.0f;
+        for (int i = 0; i < 3; ++i)
+        {
+            meshlet.cone_axis[i] = axisLength > 0 ? axis[i] / axisLength : 0.0f;
+        }
+        for (int f = start; f < end; ++f)
+        {
+            const float* n = &sortedNormals[3 * f];
+            if (n[0] == 0 && n[1] == 0 && n[2] == 0)
+                continue;
+            minDot = min(minDot, n[0] * meshlet.cone_axis[0] + n[1] * meshlet.cone_axis[1] + n[2] * meshlet.cone_axis[2]);
+        }
+        meshlet.cone_cutoff = (axisLength > 0 && minDot > 0) ? sqrt(1.0f - minDot * minDot) : 1.0f;
+
+        meshlets.push_back(meshlet);
+        start = end;
+    }
+
+    return;
+}
+
+void reset_cull_stats(MeshletCullStats& stats)
+{
+    stats.meshlet_num = 0;
+    stats.frustum_culled = 0;
+    stats.backface_culled = 0;
+    stats.draw_ranges = 0;
+    stats.index_num = 0;
+    stats.indices_culled = 0;
+    return;
+}
+
+void cull_meshlets(const vector<Meshlet>& meshlets, const Frustum& local_frustum, const float local_camera[3],
+    vector<int>& counts, vector<const void*>& offsets, MeshletCullStats& stats)
+{
+    counts.clear();
+    offsets.clear();
+
+    unsigned int rangeEnd = 0xFFFFFFFF; // end of the range currently being extended
+    for (size_t i = 0; i < meshlets.size(); ++i)
+    {
+        const Meshlet& m = meshlets[i];
+        stats.meshlet_num++;
+        stats.index_num += m.index_count;
+
+        if (!sphere_in_frustum(local_frustum, m.center, m.radius))
+        {
+            stats.frustum_culled++;
+            stats.indices_culled += m.index_count;
+            continue;
+        }
+
+        // every triangle faces away if the view direction lies inside the widened normal cone
+        float d[3] = { m.center[0] - local_camera[0], m.center[1] - local_camera[1], m.center[2] - local_camera[2] };
+        float distance = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        if (distance > m.radius && d[0] * m.cone_axis[0] + d[1] * m.cone_axis[1] + d[2] * m.cone_axis[2] >= m.cone_cutoff * distance + m.radius)
+        {
+            stats.backface_culled++;
+            stats.indices_culled += m.index_count;
+            continue;
+        }
+
+        if (m.index_offset == rangeEnd)
+        {
+            counts.back() += m.index_count;
+        }
+        else
+        {
+            counts.push_back(m.index_count);
+            offsets.push_back((const void*)(uintptr_t)(sizeof(unsigned int) * m.index_offset));
+        }
+        rangeEnd = m.index_offset + m.index_count;
+    }
+
+    stats.draw_ranges += (int)counts.size();
+    return;
+}
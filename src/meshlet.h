@@ -0,0 +1,38 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <vector>
+
+#include "frustum.h"
+
+// a contiguous range of the (reordered) face list with its culling bounds, all in model space
+struct Meshlet
+{
+    unsigned int index_offset; // first index in the EBO
+    unsigned int index_count;
+    float center[3]; // bounding sphere
+    float radius;
+    float cone_axis[3]; // average facing direction of the triangles
+    float cone_cutoff; // >= 1 means the cone is too wide to ever cull
+};
+
+struct MeshletCullStats
+{
+    int meshlet_num;
+    int frustum_culled;
+    int backface_culled;
+    int draw_ranges; // surviving meshlets merged into contiguous ranges
+    long long index_num;
+    long long indices_culled;
+};
+
+// sorts the faces into spatially and directionally coherent order and cuts them into meshlets
+void build_meshlets(const float* vertices, int stride, unsigned int* faces, int face_num, int max_triangles, std::vector<Meshlet>& meshlets);
+
+// local_frustum and local_camera must already be in the model space of the mesh
+void cull_meshlets(const std::vector<Meshlet>& meshlets, const Frustum& local_frustum, const float local_camera[3],
+    std::vector<int>& counts, std::vector<const void*>& offsets, MeshletCullStats& stats);
+
+void reset_cull_stats(MeshletCullStats& stats);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <cstdint>
+
+// 10-bit value to every third bit of 30; three of them interleave into a Morton code
+inline uint32_t spread_bits(uint32_t v)
+{
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+#endif
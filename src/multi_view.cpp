@@ -0,0 +1,240 @@
+#include "multi_view.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// the point where three planes meet, each a * x + b * y + c * z + d = 0
+static void plane_corner(const float a[4], const float b[4], const float c[4], float out[3])
+{
+    float bc[3] = { b[1] * c[2] - b[2] * c[1], b[2] * c[0] - b[0] * c[2], b[0] * c[1] - b[1] * c[0] };
+    float ca[3] = { c[1] * a[2] - c[2] * a[1], c[2] * a[0] - c[0] * a[2], c[0] * a[1] - c[1] * a[0] };
+    float ab[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+    float det = a[0] * bc[0] + a[1] * bc[1] + a[2] * bc[2];
+    for (int k = 0; k < 3; ++k)
+    {
+        out[k] = -(a[3] * bc[k] + b[3] * ca[k] + c[3] * ab[k]) / det;
+    }
+    return;
+}
+
+void split_viewport(const int full[4], int view_num, int view, int out[4])
+{
+    if (view_num <= 1)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            out[i] = full[i];
+        }
+        return;
+    }
+
+    int width = full[2] / 2;
+    if (view_num == 2)
+    {
+        out[0] = full[0] + view * width;
+        out[1] = full[1];
+        out[2] = width;
+        out[3] = full[3];
+        return;
+    }
+
+    // first row at the top, GL counts rows from the bottom
+    int height = full[3] / 2;
+    out[0] = full[0] + (view % 2) * width;
+    out[1] = full[1] + (1 - view / 2) * height;
+    out[2] = width;
+    out[3] = height;
+    return;
+}
+
+MultiViewCuller::MultiViewCuller()
+{
+    this->view_num = 0;
+    this->stats = MultiViewStats();
+    for (int k = 0; k < 3; ++k)
+    {
+        this->union_min[k] = 0.0f;
+        this->union_max[k] = 0.0f;
+    }
+    return;
+}
+
+void MultiViewCuller::begin(const float* const view_proj[], int view_num)
+{
+    this->view_num = max(0, min(view_num, MULTI_VIEW_MAX));
+    this->stats = MultiViewStats();
+    this->stats.view_num = this->view_num;
+
+    // planes are left, right, bottom, top, near, far; the union box spans all eight corners of every view
+    for (int k = 0; k < 3; ++k)
+    {
+        this->union_min[k] = 1e30f;
+        this->union_max[k] = -1e30f;
+    }
+    for (int v = 0; v < this->view_num; ++v)
+    {
+        extract_frustum(view_proj[v], this->frustums[v]);
+        const Frustum& f = this->frustums[v];
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            float p[3];
+            plane_corner(f.planes[corner & 1], f.planes[2 + ((corner >> 1) & 1)], f.planes[4 + (corner >> 2)], p);
+            for (int k = 0; k < 3; ++k)
+            {
+                this->union_min[k] = min(this->union_min[k], p[k]);
+                this->union_max[k] = max(this->union_max[k], p[k]);
+            }
+        }
+    }
+    return;
+}
+
+unsigned int MultiViewCuller::cull(const float min[3], const float max[3])
+{
+    this->stats.tested++;
+    for (int k = 0; k < 3; ++k)
+    {
+        if (min[k] > this->union_max[k] || max[k] < this->union_min[k])
+        {
+            this->stats.union_rejected++;
+            return 0;
+        }
+    }
+
+    unsigned int mask = 0;
+    for (int v = 0; v < this->view_num; ++v)
+    {
+        this->stats.view_tests++;
+        if (aabb_in_frustum(this->frustums[v], min, max))
+        {
+            mask |= 1u << v;
+            this->stats.visible[v]++;
+        }
+    }
+    return mask;
+}
+
+const Frustum& MultiViewCuller::get_frustum(int view) const
+{
+    return this->frustums[view];
+}
+
+int MultiViewCuller::get_view_num() const
+{
+    return this->view_num;
+}
+
+void MultiViewCuller::get_stats(MultiViewStats& stats) const
+{
+    stats = this->stats;
+    return;
+}
+
+ViewJobRunner::ViewJobRunner()
+{
+    this->job = NULL;
+    this->batch_id = 0;
+    this->job_num = 0;
+    this->next_job = 0;
+    this->jobs_done = 0;
+    this->stopping = false;
+    return;
+}
+
+void ViewJobRunner::init(int worker_num)
+{
+    this->stopping = false;
+    for (int i = 0; i < worker_num; ++i)
+    {
+        this->workers.push_back(thread(&ViewJobRunner::worker_loop, this));
+    }
+    return;
+}
+
+void ViewJobRunner::destroy()
+{
+    {
+        lock_guard<mutex> lock(this->job_mutex);
+        this->stopping = true;
+    }
+    this->start_signal.notify_all();
+    for (size_t i = 0; i < this->workers.size(); ++i)
+    {
+        this->workers[i].join();
+    }
+    this->workers.clear();
+    return;
+}
+
+void ViewJobRunner::run(int job_num, const function<void(int)>& job)
+{
+    // a single view is not worth waking anyone
+    if (this->workers.empty() || job_num <= 1)
+    {
+        for (int i = 0; i < job_num; ++i)
+        {
+            job(i);
+        }
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(this->job_mutex);
+        this->job = &job;
+        this->job_num = job_num;
+        this->next_job = 0;
+        this->jobs_done = 0;
+        this->batch_id++;
+    }
+    this->start_signal.notify_all();
+
+    while (this->run_next())
+    {
+    }
+
+    unique_lock<mutex> lock(this->job_mutex);
+    this->done_signal.wait(lock, [this]() { return this->jobs_done == this->job_num; });
+    this->job = NULL;
+    return;
+}
+
+void ViewJobRunner::worker_loop()
+{
+    unsigned int seenBatch = 0;
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(this->job_mutex);
+            this->start_signal.wait(lock, [&]() { return this->stopping || this->batch_id != seenBatch; });
+            if (this->stopping)
+                return;
+            seenBatch = this->batch_id;
+        }
+
+        while (this->run_next())
+        {
+        }
+    }
+}
+
+bool ViewJobRunner::run_next()
+{
+    const function<void(int)>* current;
+    int index;
+    {
+        lock_guard<mutex> lock(this->job_mutex);
+        if (this->job == NULL || this->next_job >= this->job_num)
+            return false;
+        current = this->job;
+        index = this->next_job++;
+    }
+
+    (*current)(index);
+
+    lock_guard<mutex> lock(this->job_mutex);
+    this->jobs_done++;
+    if (this->jobs_done == this->job_num)
+        this->done_signal.notify_all();
+    return true;
+}
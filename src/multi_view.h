@@ -0,0 +1,102 @@
+#ifndef MULTI_VIEW_H
+#define MULTI_VIEW_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "frustum.h"
+#include "meshlet.h"
+
+const int MULTI_VIEW_MAX = 4;
+
+enum DrawCommandKind { DRAW_ARRAYS, DRAW_ELEMENTS, DRAW_MULTI_ELEMENTS, DRAW_TERRAIN, DRAW_SCAN };
+
+// one draw in a view's command list; its record or instance index is looked up by slot when submitted,
+// so the per-object data written once per frame is shared by every view
+struct DrawCommand
+{
+    int kind;
+    int slot;
+    unsigned int program;
+    unsigned int texture; // 0 keeps whatever is bound
+    unsigned int vao; // 0 for kinds that bind their own
+    int first; // first vertex, or first range in the list's multi-draw arrays
+    int count; // vertices, indices or ranges
+    int triangles;
+    bool cull_back; // closed, consistently wound meshes only
+};
+
+struct ViewCommandList
+{
+    std::vector<DrawCommand> commands;
+    std::vector<int> counts; // ranges of every DRAW_MULTI_ELEMENTS command, back to back
+    std::vector<const void*> offsets;
+    MeshletCullStats cull_stats;
+};
+
+struct MultiViewStats
+{
+    int view_num;
+    int tested;
+    int union_rejected; // outside all views after one box test
+    int view_tests; // per-view tests of the boxes that survived the union test
+    int visible[MULTI_VIEW_MAX];
+};
+
+// tile of the full viewport (x, y, width, height): one view fills it, two sit side by side, three or four share a 2x2 grid
+void split_viewport(const int full[4], int view_num, int view, int out[4]);
+
+// frustum culling for several views of one scene. Each box is first tested against the bounds of all
+// frustums together, and only a survivor is tested against every view.
+class MultiViewCuller
+{
+public:
+    MultiViewCuller();
+
+    void begin(const float* const view_proj[], int view_num); // column-major, GL clip space
+    unsigned int cull(const float min[3], const float max[3]); // bit v set when the box may be visible in view v
+
+    const Frustum& get_frustum(int view) const;
+    int get_view_num() const;
+    void get_stats(MultiViewStats& stats) const;
+
+private:
+    Frustum frustums[MULTI_VIEW_MAX];
+    float union_min[3];
+    float union_max[3];
+    int view_num;
+    MultiViewStats stats;
+};
+
+// persistent threads for per-view work; run() hands out one job per view, takes jobs on the calling
+// thread as well and returns once all of them are done
+class ViewJobRunner
+{
+public:
+    ViewJobRunner();
+
+    void init(int worker_num);
+    void destroy();
+
+    void run(int job_num, const std::function<void(int)>& job);
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex job_mutex;
+    std::condition_variable start_signal;
+    std::condition_variable done_signal;
+    const std::function<void(int)>* job;
+    unsigned int batch_id;
+    int job_num;
+    int next_job;
+    int jobs_done;
+    bool stopping;
+
+    void worker_loop();
+    bool run_next(); // false once every job of the batch was taken
+};
+
+#endif
@@ -0,0 +1,435 @@
+#include "occlusion_buffer.h"
+
+#include "frustum.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_BUFFER_SSE 1
+#endif
+
+using namespace std;
+
+static unsigned long long now_ns()
+{
+    return (unsigned long long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+OcclusionBuffer::OcclusionBuffer()
+{
+    this->width = 0;
+    this->height = 0;
+    this->band_num = 1;
+    this->level_num = 1;
+    this->initialized = false;
+    this->stats = OcclusionStats();
+    this->frame_id = 0;
+    this->next_band = 0;
+    this->bands_done = 0;
+    this->running = false;
+    this->stopping = false;
+    this->kick_ns = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        this->view_proj[i] = i % 5 == 0 ? 1.0f : 0.0f;
+    }
+    return;
+}
+
+bool OcclusionBuffer::init(int width, int height, int band_num, int worker_num)
+{
+    // rows are processed four pixels at a time and every band builds its own part of the hierarchy
+    if (width <= 0 || width % 4 != 0 || band_num <= 0 || height % band_num != 0)
+        return false;
+
+    this->width = width;
+    this->height = height;
+    this->band_num = band_num;
+
+    int bandHeight = height / band_num;
+    this->level_num = 1;
+    while (bandHeight % (1 << this->level_num) == 0 && (width >> this->level_num) >= 1)
+    {
+        this->level_num++;
+    }
+    this->levels.resize(this->level_num);
+    for (int k = 0; k < this->level_num; ++k)
+    {
+        this->levels[k].assign((size_t)(width >> k) * (height >> k), 1.0f);
+    }
+
+    this->stopping = false;
+    for (int i = 0; i < max(1, worker_num); ++i)
+    {
+        this->workers.push_back(thread(&OcclusionBuffer::worker_loop, this));
+    }
+    this->initialized = true;
+    return true;
+}
+
+void OcclusionBuffer::destroy()
+{
+    if (!this->initialized)
+        return;
+
+    {
+        lock_guard<mutex> lock(this->frame_mutex);
+        this->stopping = true;
+    }
+    this->start_signal.notify_all();
+    for (size_t i = 0; i < this->workers.size(); ++i)
+    {
+        this->workers[i].join();
+    }
+    this->workers.clear();
+    this->initialized = false;
+    return;
+}
+
+void OcclusionBuffer::begin_frame(const float view_proj[16])
+{
+    this->wait();
+    for (int i = 0; i < 16; ++i)
+    {
+        this->view_proj[i] = view_proj[i];
+    }
+    this->polygons.clear();
+    this->stats = OcclusionStats();
+    return;
+}
+
+void OcclusionBuffer::add_occluder_quads(const float* corners, int quad_num, const float model[16])
+{
+    float mvp[16];
+    multiply_matrices(this->view_proj, model, mvp);
+
+    for (int q = 0; q < quad_num; ++q)
+    {
+        // clip space corners, then clip against the near plane z >= -w
+        float in[MAX_POLYGON_VERTICES][4], out[MAX_POLYGON_VERTICES][4];
+        for (int v = 0; v < 4; ++v)
+        {
+            const float* p = corners + 12 * q + 3 * v;
+            for (int r = 0; r < 4; ++r)
+            {
+                in[v][r] = mvp[r] * p[0] + mvp[4 + r] * p[1] + mvp[8 + r] * p[2] + mvp[12 + r];
+            }
+        }
+
+        int outNum = 0;
+        for (int v = 0; v < 4; ++v)
+        {
+            const float* a = in[v];
+            const float* b = in[(v + 1) % 4];
+            float da = a[2] + a[3], db = b[2] + b[3];
+            if (da >= 0.0f)
+            {
+                for (int r = 0; r < 4; ++r)
+                    out[outNum][r] = a[r];
+                outNum++;
+            }
+            if ((da >= 0.0f) != (db >= 0.0f))
+            {
+                float t = da / (da - db);
+                for (int r = 0; r < 4; ++r)
+                    out[outNum][r] = a[r] + (b[r] - a[r]) * t;
+                outNum++;
+            }
+        }
+        if (outNum < 3)
+            continue;
+
+        ScreenPolygon polygon;
+        polygon.vertex_num = outNum;
+        polygon.min_x = polygon.min_y = 1e30f;
+        polygon.max_x = polygon.max_y = -1e30f;
+        for (int v = 0; v < outNum; ++v)
+        {
+            float invW = 1.0f / max(out[v][3], 1e-6f);
+            polygon.x[v] = (out[v][0] * invW * 0.5f + 0.5f) * this->width;
+            polygon.y[v] = (out[v][1] * invW * 0.5f + 0.5f) * this->height;
+            polygon.z[v] = out[v][2] * invW;
+            polygon.min_x = min(polygon.min_x, polygon.x[v]);
+            polygon.max_x = max(polygon.max_x, polygon.x[v]);
+            polygon.min_y = min(polygon.min_y, polygon.y[v]);
+            polygon.max_y = max(polygon.max_y, polygon.y[v]);
+        }
+        if (polygon.max_x < 0.0f || polygon.min_x > this->width || polygon.max_y < 0.0f || polygon.min_y > this->height)
+            continue;
+
+        this->polygons.push_back(polygon);
+    }
+    return;
+}
+
+void OcclusionBuffer::rasterize_async()
+{
+    this->wait();
+    {
+        lock_guard<mutex> lock(this->frame_mutex);
+        this->stats.occluder_polygons = (int)this->polygons.size();
+        this->next_band = 0;
+        this->bands_done = 0;
+        this->running = true;
+        this->kick_ns = now_ns();
+        this->frame_id++;
+    }
+    this->start_signal.notify_all();
+    return;
+}
+
+void OcclusionBuffer::wait()
+{
+    unique_lock<mutex> lock(this->frame_mutex);
+    this->done_signal.wait(lock, [this]() { return !this->running; });
+    return;
+}
+
+bool OcclusionBuffer::is_occluded(const float min[3], const float max[3])
+{
+    this->wait();
+    this->stats.tested++;
+
+    // any corner at or behind the near plane makes the box potentially visible
+    float minX = 1e30f, maxX = -1e30f, minY = 1e30f, maxY = -1e30f, nearZ = 1e30f;
+    const float* m = this->view_proj;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        float p[3] = { corner & 1 ? max[0] : min[0], corner & 2 ? max[1] : min[1], corner & 4 ? max[2] : min[2] };
+        float clip[4];
+        for (int r = 0; r < 4; ++r)
+        {
+            clip[r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] + m[12 + r];
+        }
+        if (clip[3] <= 1e-6f || clip[2] < -clip[3])
+            return false;
+
+        float invW = 1.0f / clip[3];
+        float x = (clip[0] * invW * 0.5f + 0.5f) * this->width;
+        float y = (clip[1] * invW * 0.5f + 0.5f) * this->height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearZ = std::min(nearZ, clip[2] * invW);
+    }
+    if (maxX < 0.0f || minX >= this->width || maxY < 0.0f || minY >= this->height)
+        return false; // off screen, that is the frustum's business
+
+    // every pixel the rectangle touches, on the coarsest level that keeps it within 4x4 texels
+    int x0 = std::max(0, (int)floor(minX)), x1 = std::min(this->width - 1, (int)floor(maxX));
+    int y0 = std::max(0, (int)floor(minY)), y1 = std::min(this->height - 1, (int)floor(maxY));
+    int k = 0;
+    while (k < this->level_num - 1 && ((x1 >> k) - (x0 >> k) > 3 || (y1 >> k) - (y0 >> k) > 3))
+    {
+        k++;
+    }
+
+    const vector<float>& level = this->levels[k];
+    int levelWidth = this->width >> k;
+    for (int y = y0 >> k; y <= (y1 >> k); ++y)
+    {
+        for (int x = x0 >> k; x <= (x1 >> k); ++x)
+        {
+            if (level[(size_t)y * levelWidth + x] >= nearZ)
+                return false;
+        }
+    }
+
+    this->stats.occluded++;
+    return true;
+}
+
+void OcclusionBuffer::get_stats(OcclusionStats& stats)
+{
+    lock_guard<mutex> lock(this->frame_mutex);
+    stats = this->stats;
+    return;
+}
+
+int OcclusionBuffer::get_width()
+{
+    return this->width;
+}
+
+int OcclusionBuffer::get_height()
+{
+    return this->height;
+}
+
+const float* OcclusionBuffer::get_depth()
+{
+    this->wait();
+    return this->levels[0].data();
+}
+
+void OcclusionBuffer::worker_loop()
+{
+    unsigned int seenFrame = 0;
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(this->frame_mutex);
+            this->start_signal.wait(lock, [&]() { return this->stopping || this->frame_id != seenFrame; });
+            if (this->stopping)
+                return;
+            seenFrame = this->frame_id;
+        }
+
+        int finished = 0;
+        for (int band = this->next_band++; band < this->band_num; band = this->next_band++)
+        {
+            this->rasterize_band(band);
+            finished++;
+        }
+
+        if (finished > 0)
+        {
+            lock_guard<mutex> lock(this->frame_mutex);
+            this->bands_done += finished;
+            if (this->bands_done == this->band_num)
+            {
+                this->stats.raster_ms = (now_ns() - this->kick_ns) / 1e6;
+                this->running = false;
+                this->done_signal.notify_all();
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::rasterize_band(int band)
+{
+    int bandHeight = this->height / this->band_num;
+    int rowBegin = band * bandHeight, rowEnd = rowBegin + bandHeight;
+    fill(this->levels[0].begin() + (size_t)rowBegin * this->width, this->levels[0].begin() + (size_t)rowEnd * this->width, 1.0f);
+
+    for (size_t i = 0; i < this->polygons.size(); ++i)
+    {
+        const ScreenPolygon& polygon = this->polygons[i];
+        if (polygon.max_y <= rowBegin || polygon.min_y >= rowEnd)
+            continue;
+        this->rasterize_polygon(polygon, rowBegin, rowEnd);
+    }
+
+    this->build_band_levels(band);
+    return;
+}
+
+void OcclusionBuffer::rasterize_polygon(const ScreenPolygon& polygon, int row_begin, int row_end)
+{
+    int n = polygon.vertex_num;
+    float area = 0.0f;
+    for (int v = 0; v < n; ++v)
+    {
+        int w = (v + 1) % n;
+        area += polygon.x[v] * polygon.y[w] - polygon.x[w] * polygon.y[v];
+    }
+    if (fabs(area) < 1e-6f)
+        return;
+    float orientation = area > 0.0f ? 1.0f : -1.0f;
+
+    // edge functions A x + B y + C >= 0 inside; C is pulled in by half a pixel's extent along
+    // the edge normal, so evaluating at the pixel center only accepts fully covered pixels
+    float edgeA[MAX_POLYGON_VERTICES], edgeB[MAX_POLYGON_VERTICES], edgeC[MAX_POLYGON_VERTICES];
+    for (int v = 0; v < n; ++v)
+    {
+        int w = (v + 1) % n;
+        edgeA[v] = (polygon.y[v] - polygon.y[w]) * orientation;
+        edgeB[v] = (polygon.x[w] - polygon.x[v]) * orientation;
+        edgeC[v] = -(edgeA[v] * polygon.x[v] + edgeB[v] * polygon.y[v]) - 0.5f * (fabs(edgeA[v]) + fabs(edgeB[v]));
+    }
+
+    // depth plane from the widest fan triangle; the farthest depth inside a pixel is stored
+    int best = 1;
+    float bestCross = 0.0f;
+    for (int v = 1; v + 1 < n; ++v)
+    {
+        float cross = (polygon.x[v] - polygon.x[0]) * (polygon.y[v + 1] - polygon.y[0]) - (polygon.x[v + 1] - polygon.x[0]) * (polygon.y[v] - polygon.y[0]);
+        if (fabs(cross) > fabs(bestCross))
+        {
+            bestCross = cross;
+            best = v;
+        }
+    }
+    float dx1 = polygon.x[best] - polygon.x[0], dy1 = polygon.y[best] - polygon.y[0], dz1 = polygon.z[best] - polygon.z[0];
+    float dx2 = polygon.x[best + 1] - polygon.x[0], dy2 = polygon.y[best + 1] - polygon.y[0], dz2 = polygon.z[best + 1] - polygon.z[0];
+    float dzdx = (dz1 * dy2 - dz2 * dy1) / bestCross;
+    float dzdy = (dx1 * dz2 - dx2 * dz1) / bestCross;
+    float z0 = polygon.z[0] - dzdx * polygon.x[0] - dzdy * polygon.y[0] + 0.5f * (fabs(dzdx) + fabs(dzdy));
+
+    int y0 = max(row_begin, (int)ceil(polygon.min_y)), y1 = min(row_end, (int)floor(polygon.max_y));
+    int x0 = max(0, (int)ceil(polygon.min_x)) & ~3, x1 = min(this->width, (int)floor(polygon.max_x));
+    float* depth = this->levels[0].data();
+
+    for (int y = y0; y < y1; ++y)
+    {
+        float yc = y + 0.5f;
+        float* row = depth + (size_t)y * this->width;
+#if OCCLUSION_BUFFER_SSE
+        __m128 rowEdge[MAX_POLYGON_VERTICES], stepA[MAX_POLYGON_VERTICES];
+        for (int v = 0; v < n; ++v)
+        {
+            rowEdge[v] = _mm_set1_ps(edgeB[v] * yc + edgeC[v]);
+            stepA[v] = _mm_set1_ps(edgeA[v]);
+        }
+        __m128 rowZ = _mm_set1_ps(z0 + dzdy * yc);
+        __m128 stepZ = _mm_set1_ps(dzdx);
+        __m128 zero = _mm_setzero_ps();
+        for (int x = x0; x < x1; x += 4)
+        {
+            __m128 xc = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepA[0], xc), rowEdge[0]), zero);
+            for (int v = 1; v < n; ++v)
+            {
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepA[v], xc), rowEdge[v]), zero));
+            }
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+
+            __m128 z = _mm_add_ps(_mm_mul_ps(stepZ, xc), rowZ);
+            __m128 old = _mm_loadu_ps(row + x);
+            __m128 closer = _mm_min_ps(old, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, old)));
+        }
+#else
+        for (int x = x0; x < x1; ++x)
+        {
+            float xc = x + 0.5f;
+            bool inside = true;
+            for (int v = 0; v < n && inside; ++v)
+            {
+                inside = edgeA[v] * xc + edgeB[v] * yc + edgeC[v] >= 0.0f;
+            }
+            if (inside)
+                row[x] = min(row[x], z0 + dzdx * xc + dzdy * yc);
+        }
+#endif
+    }
+    return;
+}
+
+void OcclusionBuffer::build_band_levels(int band)
+{
+    int bandHeight = this->height / this->band_num;
+    for (int k = 1; k < this->level_num; ++k)
+    {
+        const vector<float>& fine = this->levels[k - 1];
+        vector<float>& coarse = this->levels[k];
+        int fineWidth = this->width >> (k - 1), coarseWidth = this->width >> k;
+        int rowBegin = (band * bandHeight) >> k, rowEnd = ((band + 1) * bandHeight) >> k;
+        for (int y = rowBegin; y < rowEnd; ++y)
+        {
+            const float* a = &fine[(size_t)(2 * y) * fineWidth];
+            const float* b = a + fineWidth;
+            float* out = &coarse[(size_t)y * coarseWidth];
+            for (int x = 0; x < coarseWidth; ++x)
+            {
+                out[x] = max(max(a[2 * x], a[2 * x + 1]), max(b[2 * x], b[2 * x + 1]));
+            }
+        }
+    }
+    return;
+}
@@ -0,0 +1,84 @@
+#ifndef OCCLUSION_BUFFER_H
+#define OCCLUSION_BUFFER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct OcclusionStats
+{
+    int occluder_polygons; // after near-plane clipping
+    int tested;
+    int occluded;
+    double raster_ms; // kick to last band done, on the workers
+};
+
+// low-resolution software depth buffer for occlusion culling. Occluders are convex quads,
+// rasterized with SSE by worker threads, one horizontal band each, into a max-depth
+// hierarchy. Only fully covered pixels are written, with the farthest depth inside them,
+// so a box reported as occluded is hidden at any resolution.
+class OcclusionBuffer
+{
+public:
+    OcclusionBuffer();
+
+    bool init(int width, int height, int band_num, int worker_num);
+    void destroy();
+
+    void begin_frame(const float view_proj[16]); // column-major, GL clip space
+    // quad_num quads of four corners (x, y, z), transformed by model into the scene
+    void add_occluder_quads(const float* corners, int quad_num, const float model[16]);
+
+    void rasterize_async(); // hands the frame to the workers and returns
+    void wait(); // blocks until the depth hierarchy is complete
+
+    bool is_occluded(const float min[3], const float max[3]); // world-space AABB
+    void get_stats(OcclusionStats& stats);
+
+    int get_width();
+    int get_height();
+    const float* get_depth(); // full resolution, row 0 at the bottom
+
+private:
+    static const int MAX_POLYGON_VERTICES = 8;
+
+    struct ScreenPolygon
+    {
+        int vertex_num;
+        float x[MAX_POLYGON_VERTICES];
+        float y[MAX_POLYGON_VERTICES];
+        float z[MAX_POLYGON_VERTICES];
+        float min_x, max_x, min_y, max_y;
+    };
+
+    int width;
+    int height;
+    int band_num;
+    int level_num;
+    bool initialized;
+
+    float view_proj[16];
+    std::vector<ScreenPolygon> polygons;
+    std::vector<std::vector<float> > levels; // max depth, level 0 is full resolution
+    OcclusionStats stats;
+
+    std::vector<std::thread> workers;
+    std::mutex frame_mutex;
+    std::condition_variable start_signal;
+    std::condition_variable done_signal;
+    unsigned int frame_id;
+    std::atomic<int> next_band;
+    int bands_done;
+    bool running; // a frame is in flight
+    bool stopping;
+    unsigned long long kick_ns;
+
+    void worker_loop();
+    void rasterize_band(int band);
+    void rasterize_polygon(const ScreenPolygon& polygon, int row_begin, int row_end);
+    void build_band_levels(int band);
+};
+
+#endif
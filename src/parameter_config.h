@@ -14,6 +14,80 @@ float currentX = -7.0;
 float currentZ = -7.0;
 float limitCoord = 8.0;
 
+// meshlet culling settings
+const int MESHLET_MAX_TRIANGLES = 96;
+bool meshletCulling = true;
+
+// occlusion culling settings
+const int OCCLUSION_WIDTH = 256;
+const int OCCLUSION_HEIGHT = 128;
+const int OCCLUSION_BANDS = 4; // horizontal strips handed out to the workers
+const int OCCLUSION_WORKERS = 2;
+const float OCCLUDER_GROUND_RADIUS = 24.0f; // the flat part of the terrain, see flat_radius
+bool occlusionCulling = true;
+
+// shadow settings
+const int SHADOW_MAP_SIZE = 1024;
+const float SHADOW_LIGHT_THRESHOLD = 0.25f; // light movement before static casters are redrawn
+const int SHADOW_LOD_GRID = 24; // vertex clustering cells along the longest axis of a caster
+
+// clustered lighting settings
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+const int CLUSTER_TILES_X = 16;
+const int CLUSTER_TILES_Y = 9;
+const int CLUSTER_SLICES = 24;
+const int LIGHT_BUFFER_UNIT = 2; // lights, clusters and light indices take units 2-4
+int lightFieldSize = 64; // dynamic point lights wandering over the field, the first follows the character
+
+// terrain settings, the heightfield shape itself is in set_default_terrain_params
+const float TERRAIN_VIEW_RADIUS = 112.0f; // chunks closer than this are streamed in
+const size_t TERRAIN_MEMORY_BUDGET = 4 << 20; // bytes of chunk vertices on the GPU
+const int TERRAIN_WORKERS = 2;
+const int TERRAIN_UPLOADS_PER_FRAME = 4;
+const float TERRAIN_WORLD_LIMIT = 4000.0f; // the camera stays inside +-limit
+bool terrainBlocking = false; // wait for every chunk in range each frame, keeps headless frames deterministic
+
+// out-of-core scan settings, build the file with --build-chunked-mesh scan.ply models/scan.ooc
+const char* CHUNKED_MESH_FILE = "models/scan.ooc"; // drawn when present
+const size_t CHUNKED_MESH_GPU_BUDGET = 64 << 20; // bytes of resident scan levels
+const int CHUNKED_MESH_UPLOADS_PER_FRAME = 4;
+const float CHUNKED_MESH_PIXEL_ERROR = 1.5f; // largest screen-space error of a drawn level
+
+// hot reload settings
+const char* SCENE_FILE = "scene.txt"; // positions, colours and shader files, see scene_description.h
+bool hotReload = true; // watch the scene file, models, images and shader files while running
+
+// shader settings
+const char* SHADER_CACHE_FILE = "shader_programs.cache"; // linked program binaries, keyed by source and driver; next to the executable unless --shader-cache is given
+
+// model instance settings
+const int INSTANCE_BUFFER_UNIT = 5; // model and normal matrices of every ply instance
+bool posedModels = false; // rotated, non-uniformly scaled models for checking the normal transform
+
+// per-draw data settings
+const int DRAW_DATA_UNIT = 6; // model matrix and colour of every textured and light draw
+const int DRAW_RECORDS_PER_FRAME = 256;
+const int DRAW_FRAMES_IN_FLIGHT = 3; // ring regions, each fenced until the GPU is done with it
+
+// picking and collision settings
+const int BVH_BUILD_THREADS = 4; // per model, subtrees are split across threads near the root
+const float PICK_DISTANCE = 200.0f; // camera rays stop here
+
+// multi-view settings
+const int VIEW_WORKERS = 3; // build the command lists of the extra views alongside the calling thread
+int viewCount = 1; // free camera, overhead, follow-character and field corner; V cycles through 1-4
+glm::vec3 overheadViewPosition = glm::vec3(0.0f, 30.0f, 0.0f);
+glm::vec3 cornerViewPosition = glm::vec3(-24.0f, 10.0f, -24.0f);
+float followViewDistance = 6.0f; // behind the character along its heading
+float followViewHeight = 3.0f;
+
+// adaptive resolution settings
+float frameBudgetMs = 16.6f; // GPU frame time the governor holds
+const float RENDER_SCALE_MIN = 0.5f; // of the window's width and height, LOD and shadow quality give way below it
+const int GOVERNOR_SETTLE_FRAMES = 8; // frames between decisions, GPU times arrive a few frames late
+bool adaptiveResolution = true; // R toggles, headless runs only with --frame-budget
+
 // process time
 float deltaTime = 0.0f; // ǰ֡һ֡ʱ
 float lastFrame = 0.0f; // һ֡ʱ
@@ -124,12 +198,18 @@ const float brn_vertices[] = {
     -4.0f,   4.0f, 0.0f,   1.0f, 1.0f
 };// bearings
 
-const float vertices[] = {
-    20.0f,   20.0f, 0.0f,   1.0f, 1.0f,
-    20.0f,  -20.0f, 0.0f,   1.0f, 0.0f,
-    -20.0f,  -20.0f, 0.0f,   0.0f, 0.0f,
-    -20.0f,   20.0f, 0.0f,   0.0f, 1.0f
-};// ground
+// occluder outlines: the six faces of the +-1 cube and the bearing sign, four corners each
+const float cube_occluder_quads[] = {
+    -1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,   1.0f,  1.0f, -1.0f,  -1.0f,  1.0f, -1.0f,
+    -1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,   1.0f,  1.0f,  1.0f,  -1.0f,  1.0f,  1.0f,
+    -1.0f, -1.0f, -1.0f,  -1.0f,  1.0f, -1.0f,  -1.0f,  1.0f,  1.0f,  -1.0f, -1.0f,  1.0f,
+     1.0f, -1.0f, -1.0f,   1.0f,  1.0f, -1.0f,   1.0f,  1.0f,  1.0f,   1.0f, -1.0f,  1.0f,
+    -1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,   1.0f, -1.0f,  1.0f,  -1.0f, -1.0f,  1.0f,
+    -1.0f,  1.0f, -1.0f,   1.0f,  1.0f, -1.0f,   1.0f,  1.0f,  1.0f,  -1.0f,  1.0f,  1.0f
+};
+const float brn_occluder_quad[] = {
+    4.0f, 4.0f, 0.0f,   4.0f, -4.0f, 0.0f,   -4.0f, -4.0f, 0.0f,   -4.0f, 4.0f, 0.0f
+};
 
 // object positions
 glm::vec3 cubePositions[] = {
@@ -159,6 +239,30 @@ glm::vec3 dragonPosition = glm::vec3(16.0f, -0.5f, 12.0f);
 
 glm::vec3 happyPosition = glm::vec3(12.0f, -0.5f, 16.0f);
 
+float modelScales[] = { 10.0f, 10.0f, 10.0f }; // bunny, dragon, happy
+
+glm::vec3 scanPosition = glm::vec3(0.0f, 0.0f, -60.0f);
+float scanScale = 1.0f;
+
+// object colours
+glm::vec4 groundColor = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+glm::vec4 cropColor = glm::vec4(0.7f, 0.7f, 0.7f, 1.0f);
+glm::vec4 cropHitColor = glm::vec4(2.0f, 2.0f, 2.0f, 1.0f); // a crop the character walks into
+glm::vec4 bearingColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+glm::vec4 characterColor = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+
+// bunny, dragon and happy when posedModels is set: rotation in radians about x, y, z and scale
+glm::vec3 posedRotations[] = {
+    glm::vec3(0.0f, 1.5708f, 0.0f),
+    glm::vec3(0.3f, -0.7854f, 0.0f),
+    glm::vec3(0.0f, 3.1416f, -0.2f)
+};
+glm::vec3 posedScales[] = {
+    glm::vec3(10.0f, 15.0f, 10.0f),
+    glm::vec3(14.0f, 10.0f, 7.0f),
+    glm::vec3(8.0f, 12.0f, 8.0f)
+};
+
 // object indices
 unsigned int indices[] = {
 0, 1, 3,
@@ -169,28 +273,99 @@ unsigned int indices[] = {
 glm::vec3 modelColor = glm::vec3(1.0f, 0.5f, 0.31f);
 glm::vec3 lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
 
+// shadow lookup shared by every receiving shader, (2r+1)^2 taps on a depth-compare sampler, 3x3 at full quality
+#define SHADOW_LOOKUP_SOURCE \
+"uniform sampler2DShadow shadowMap;\n" \
+"uniform int shadowRadius;\n" \
+"float shadow_visibility(vec4 lightSpacePos)\n" \
+"{\n" \
+"    if (lightSpacePos.w <= 0.0)\n" \
+"        return 1.0;\n" \
+"    vec3 p = lightSpacePos.xyz / lightSpacePos.w * 0.5 + 0.5;\n" \
+"    if (p.z > 1.0)\n" \
+"        return 1.0;\n" \
+"    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0));\n" \
+"    float visibility = 0.0;\n" \
+"    for (int x = -shadowRadius; x <= shadowRadius; ++x)\n" \
+"        for (int y = -shadowRadius; y <= shadowRadius; ++y)\n" \
+"            visibility += texture(shadowMap, vec3(p.xy + vec2(x, y) * texel, p.z));\n" \
+"    float side = float(2 * shadowRadius + 1);\n" \
+"    return visibility / (side * side);\n" \
+"}\n"
+
+// clustered point lights shared by every lit shader, only the lights binned into this fragment's cluster are visited.
+// Programs built without the CLUSTERED_LIGHTING define get a stub and none of the buffer lookups
+#define CLUSTERED_LIGHTS_SOURCE \
+"#ifdef CLUSTERED_LIGHTING\n" \
+"uniform samplerBuffer lightData;\n" \
+"uniform usamplerBuffer clusterData;\n" \
+"uniform usamplerBuffer lightIndices;\n" \
+"uniform ivec3 clusterDims;\n" \
+"uniform vec2 clusterTileSize;\n" \
+"uniform vec2 clusterOrigin;\n" \
+"uniform vec3 clusterDepth;\n" \
+"vec3 clustered_lights(vec3 fragPos, vec3 normal)\n" \
+"{\n" \
+"    float n = clusterDepth.x;\n" \
+"    float f = clusterDepth.y;\n" \
+"    float viewDepth = 2.0 * n * f / (f + n - (2.0 * gl_FragCoord.z - 1.0) * (f - n));\n" \
+"    ivec3 c = ivec3(ivec2((gl_FragCoord.xy - clusterOrigin) / clusterTileSize), int(floor(log(viewDepth / n) * clusterDepth.z)));\n" \
+"    c = clamp(c, ivec3(0), clusterDims - 1);\n" \
+"    uvec2 range = texelFetch(clusterData, (c.z * clusterDims.y + c.y) * clusterDims.x + c.x).xy;\n" \
+"    vec3 result = vec3(0.0);\n" \
+"    for (uint i = 0u; i < range.y; ++i)\n" \
+"    {\n" \
+"        int light = int(texelFetch(lightIndices, int(range.x + i)).x);\n" \
+"        vec4 posRadius = texelFetch(lightData, 2 * light);\n" \
+"        vec3 color = texelFetch(lightData, 2 * light + 1).rgb;\n" \
+"        vec3 toLight = posRadius.xyz - fragPos;\n" \
+"        float dist = length(toLight);\n" \
+"        float falloff = clamp(1.0 - dist / posRadius.w, 0.0, 1.0);\n" \
+"        result += color * max(dot(normal, toLight / max(dist, 1e-4)), 0.0) * falloff * falloff;\n" \
+"    }\n" \
+"    return result;\n" \
+"}\n" \
+"#else\n" \
+"vec3 clustered_lights(vec3 fragPos, vec3 normal) { return vec3(0.0); }\n" \
+"#endif\n"
+
 // shader source code
 const char* vertexShaderSource = "#version 330 core\n"
 "layout (location = 0) in vec3 aPos;\n"
 "layout (location = 1) in vec2 aTexCoord;\n"
 "out vec3 ourColor;\n"
 "out vec2 TexCoord;\n"
-"uniform mat4 model;\n"
+"out vec3 FragPos;\n"
+"out vec4 FragPosLightSpace;\n"
+"flat out vec4 drawColor;\n"
+"uniform samplerBuffer drawData;\n"
+"uniform int drawIndex;\n"
 "uniform mat4 view;\n"
 "uniform mat4 projection;\n"
+"uniform mat4 lightSpace;\n"
 "void main()\n"
 "{\n"
-"   gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
+"   // model matrix, then the colour, five texels per draw record\n"
+"   int base = 5 * drawIndex;\n"
+"   mat4 model = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1), texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));\n"
+"   drawColor = texelFetch(drawData, base + 4);\n"
+"   vec4 worldPos = model * vec4(aPos, 1.0);\n"
+"   gl_Position = projection * view * worldPos;\n"
 "   TexCoord = aTexCoord;\n"
+"   FragPos = worldPos.xyz;\n"
+"   FragPosLightSpace = lightSpace * worldPos;\n"
 "}\0";
 
 const char* reducedVertexShaderSource = "#version 330 core\n"
 "layout (location = 0) in vec3 aPos;\n"
-"uniform mat4 model;\n"
+"uniform samplerBuffer drawData;\n"
+"uniform int drawIndex;\n"
 "uniform mat4 view;\n"
 "uniform mat4 projection;\n"
 "void main()\n"
 "{\n"
+"   int base = 5 * drawIndex;\n"
+"   mat4 model = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1), texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));\n"
 "   gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
 "}\0";
 
@@ -199,53 +374,87 @@ const char* illumVertexShaderSource = "#version 330 core\n"
 "layout (location = 1) in vec3 aNormal;\n"
 "out vec3 FragPos;\n"
 "out vec3 Normal;\n"
-"uniform mat4 model;\n"
+"out vec4 FragPosLightSpace;\n"
+"uniform samplerBuffer instanceData;\n"
+"uniform int instanceIndex;\n"
 "uniform mat4 view;\n"
 "uniform mat4 projection;\n"
+"uniform mat4 lightSpace;\n"
 "void main()\n"
 "{\n"
+"    // model matrix, then the precomputed normal matrix, seven texels per instance\n"
+"    int base = 7 * instanceIndex;\n"
+"    mat4 model = mat4(texelFetch(instanceData, base), texelFetch(instanceData, base + 1), texelFetch(instanceData, base + 2), texelFetch(instanceData, base + 3));\n"
+"    mat3 normalMatrix = mat3(texelFetch(instanceData, base + 4).xyz, texelFetch(instanceData, base + 5).xyz, texelFetch(instanceData, base + 6).xyz);\n"
 "    FragPos = vec3(model * vec4(aPos, 1.0));\n"
-"    Normal = aNormal;\n"
+"    Normal = normalMatrix * aNormal;\n"
+"    FragPosLightSpace = lightSpace * vec4(FragPos, 1.0);\n"
 "   gl_Position = projection * view * vec4(FragPos, 1.0);\n"
 "}\0";
 
 const char* fragmentShaderSource = "#version 330 core\n"
 "out vec4 FragColor;\n"
 "in vec2 TexCoord;\n"
-"uniform vec4 ourColor;"
+"in vec3 FragPos;\n"
+"in vec4 FragPosLightSpace;\n"
+"flat in vec4 drawColor;\n"
 "uniform sampler2D ourTexture;\n"
+SHADOW_LOOKUP_SOURCE
+CLUSTERED_LIGHTS_SOURCE
 "void main()\n"
 "{\n"
-"    FragColor = texture(ourTexture, TexCoord) * ourColor;\n"
+"    // crops, ground and signs are flat, so a face normal from the derivatives is enough\n"
+"    vec3 normal = normalize(cross(dFdx(FragPos), dFdy(FragPos)));\n"
+"    vec3 shade = vec3(0.5 + 0.5 * shadow_visibility(FragPosLightSpace)) + clustered_lights(FragPos, normal);\n"
+"    FragColor = texture(ourTexture, TexCoord) * drawColor * vec4(shade, 1.0);\n"
 "}\0";
 
 const char* illumModelFragmentShaderSource = "#version 330 core\n"
 "out vec4 FragColor;\n"
 "in vec3 Normal;\n"
 "in vec3 FragPos;\n"
+"in vec4 FragPosLightSpace;\n"
 "uniform vec3 lightPos;\n"
 "uniform vec3 viewPos;\n"
 "uniform vec3 objectColor;\n"
 "uniform vec3 lightColor;\n"
+SHADOW_LOOKUP_SOURCE
+CLUSTERED_LIGHTS_SOURCE
 "void main()\n"
 "{\n"
 "    float ambientStrength = 0.1;\n"
 "    vec3 ambient = ambientStrength * lightColor;\n"
 "\n"
+"    vec3 norm = normalize(Normal);\n"
 "    vec3 lightDir = normalize(lightPos - FragPos);\n"
-"    float diff = max(dot(Normal, lightDir), 0.0);\n"
+"    float diff = max(dot(norm, lightDir), 0.0);\n"
 "    vec3 diffuse = diff * lightColor;\n"
 "\n"
 "    float specularStrength = 0.5;\n"
 "    vec3 viewDir = normalize(viewPos - FragPos);\n"
-"    vec3 reflectDir = reflect(-lightDir, Normal);\n"
+"    vec3 reflectDir = reflect(-lightDir, norm);\n"
 "    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);\n"
 "    vec3 specular = specularStrength * spec * lightColor;\n"
 "\n"
-"    vec3 result = (ambient + diffuse + specular) * objectColor;\n"
+"    float visibility = shadow_visibility(FragPosLightSpace);\n"
+"    vec3 result = (ambient + visibility * (diffuse + specular) + clustered_lights(FragPos, norm)) * objectColor;\n"
 "    FragColor = vec4(result, 1.0);\n"
 "}\0";
 
+const char* shadowDepthVertexShaderSource = "#version 330 core\n"
+"layout (location = 0) in vec3 aPos;\n"
+"uniform mat4 model;\n"
+"uniform mat4 lightSpace;\n"
+"void main()\n"
+"{\n"
+"   gl_Position = lightSpace * model * vec4(aPos, 1.0);\n"
+"}\0";
+
+const char* shadowDepthFragmentShaderSource = "#version 330 core\n"
+"void main()\n"
+"{\n"
+"}\0";
+
 const char* lightFragmentShaderSource = "#version 330 core\n"
 "out vec4 FragColor;\n"
 "void main()\n"
@@ -255,5 +464,7 @@ const char* lightFragmentShaderSource = "#version 330 core\n"
 
 // filenames
 const char* bearing_filenames[] = { "img/W.jpg", "img/S.jpg", "img/E.jpg", "img/N.jpg" };
+const char* texture_filenames[] = { "img/soil.jpg", "img/cornfield.jpg", "img/tomoko.jpg" }; // ground, crops, character
+const char* ply_filenames[] = { "models/bun_zipper_res4.ply", "models/dragon_vrip_res4.ply", "models/happy_vrip_res4.ply" };
 
 #endif
\ No newline at end of file
@@ -1,92 +1,152 @@
 #include "ply_model.h"
 
 #include <cmath>
-#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <sstream>
-#include <string>
+#include <vector>
 
 using namespace std;
 
+// reads the whole file into one buffer and parses it in place, so a load costs the two mesh buffers and the read buffer
 void PlyModel::get_ply_model(const char* filename)
 {
-    ifstream plyObject;
-    char plyNewLine[128];
-    string newLineStr;
-    int readSectionFlag = 0; // 0-header, 1-vertex, 2-face
+    this->release_buffers(); // loading twice must not leak the previous mesh
+    this->reset();
 
-    plyObject.open(filename);
-    if (plyObject.fail())
+    FILE* plyObject = fopen(filename, "rb");
+    if (plyObject == NULL)
     {
         cout << "Fail to open file: " << filename << endl;
         return;
     }
 
-    do
+    fseek(plyObject, 0, SEEK_END);
+    long fileSize = ftell(plyObject);
+    fseek(plyObject, 0, SEEK_SET);
+    vector<char> text(fileSize > 0 ? fileSize + 1 : 1);
+    size_t readSize = fileSize > 0 ? fread(text.data(), 1, fileSize, plyObject) : 0;
+    fclose(plyObject);
+    text[readSize] = '\0'; // strtof/strtoul stop here at the latest
+
+    // read header
+    char* cursor = text.data();
+    bool headerDone = false;
+    while (*cursor != '\0' && !headerDone)
     {
-        if (readSectionFlag == 0) // read header
+        if (strncmp(cursor, "element vertex", 14) == 0)
         {
-            plyObject.getline(plyNewLine, 128);
-            newLineStr = plyNewLine;
-            // cout << plyNewLine << endl; // test
-
-            if ("element vertex" == newLineStr.substr(0, 14))
-            {
-                this->vertex_num = stoi(newLineStr.substr(15));
-                int list_size = 6 * this->vertex_num;
-                this->vertex_list = new float[list_size];
-            }
-            else if ("element face" == newLineStr.substr(0, 12))
-            {
-                this->face_num = stoi(newLineStr.substr(13));
-                int list_size = 3 * this->face_num;
-                this->face_list = new unsigned int[list_size];
-            }
-            else if ("end_header" == newLineStr)
-            {
-                readSectionFlag = 1;
-            }
+            this->vertex_num = (int)strtol(cursor + 14, NULL, 10);
+            int list_size = 6 * this->vertex_num;
+            this->vertex_list = (float*)this->allocator->allocate(sizeof(float) * list_size);
         }
-        else if (readSectionFlag == 1) // read vertex list
+        else if (strncmp(cursor, "element face", 12) == 0)
         {
-            for (int i = 0; i < this->vertex_num; ++i)
-            {
-                plyObject.getline(plyNewLine, 128);
-                newLineStr = plyNewLine;
-                // cout << plyNewLine << endl; // test
-
-                this->parse_vertex_line(newLineStr);
-            }
-
-            readSectionFlag = 2;
+            this->face_num = (int)strtol(cursor + 12, NULL, 10);
+            int list_size = 3 * this->face_num;
+            this->face_list = (unsigned int*)this->allocator->allocate(sizeof(unsigned int) * list_size);
         }
-        else if (readSectionFlag == 2) // read face list
+        else if (strncmp(cursor, "end_header", 10) == 0)
         {
-            for (int i = 0; i < this->face_num; ++i)
-            {
-                plyObject.getline(plyNewLine, 128);
-                newLineStr = plyNewLine;
-                // cout << plyNewLine << endl; // test
+            headerDone = true;
+        }
+        this->skip_line(cursor);
+    }
 
-                this->parse_face_line(newLineStr);
-            }
+    bool complete = headerDone;
+    for (int i = 0; complete && i < this->vertex_num; ++i) // read vertex list
+    {
+        complete = this->parse_vertex_line(cursor);
+    }
+    for (int i = 0; complete && i < this->face_num; ++i) // read face list
+    {
+        complete = this->parse_face_line(cursor);
+    }
 
-            break;
-        }
-    } while (!plyObject.eof());
+    if (!complete)
+    {
+        cout << "Truncated or malformed file: " << filename << endl;
+        this->release_buffers(); // half-filled buffers would be read as garbage
+        this->reset();
+    }
+    return;
+}
+
+size_t PlyModel::peek_buffer_bytes(const char* filename)
+{
+    FILE* plyObject = fopen(filename, "rb");
+    if (plyObject == NULL)
+        return 0;
+
+    char plyNewLine[128];
+    size_t bytes = 0;
+    while (fgets(plyNewLine, sizeof(plyNewLine), plyObject) != NULL && strncmp(plyNewLine, "end_header", 10) != 0)
+    {
+        if (strncmp(plyNewLine, "element vertex", 14) == 0)
+            bytes += sizeof(float) * 6 * strtoul(plyNewLine + 14, NULL, 10);
+        else if (strncmp(plyNewLine, "element face", 12) == 0)
+            bytes += sizeof(unsigned int) * 3 * strtoul(plyNewLine + 12, NULL, 10);
+    }
+    fclose(plyObject);
+    return bytes;
+}
+
+PlyModel::PlyModel(MeshAllocator* allocator)
+{
+    this->allocator = allocator != NULL ? allocator : get_default_mesh_allocator();
+    this->vertex_list = NULL;
+    this->face_list = NULL;
+    this->reset();
+    return;
+}
+
+PlyModel::~PlyModel()
+{
+    this->release_buffers();
+    return;
+}
 
-    plyObject.close();
+PlyModel::PlyModel(PlyModel&& other) noexcept
+{
+    this->allocator = other.allocator;
+    this->vertex_list = NULL;
+    this->face_list = NULL;
+    *this = std::move(other);
     return;
 }
 
-PlyModel::PlyModel()
+PlyModel& PlyModel::operator=(PlyModel&& other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    this->release_buffers();
+    this->allocator = other.allocator;
+    this->vertex_num = other.vertex_num;
+    this->face_num = other.face_num;
+    this->current_vertex = other.current_vertex;
+    this->current_face = other.current_face;
+    this->vertex_list = other.vertex_list;
+    this->face_list = other.face_list;
+    for (int i = 0; i < 3; ++i)
+    {
+        this->max_coord[i] = other.max_coord[i];
+        this->min_coord[i] = other.min_coord[i];
+    }
+
+    other.vertex_list = NULL;
+    other.face_list = NULL;
+    other.reset();
+    return *this;
+}
+
+void PlyModel::reset()
 {
     this->vertex_num = 0; // overall size of vertex list
     this->face_num = 0; // overall size of face list
     this->current_vertex = -1;
     this->current_face = -1;
-    this->vertex_list = NULL;
-    this->face_list = NULL;
     for (int i = 0; i < 3; ++i)
     {
         this->max_coord[i] = -100000.0;
@@ -95,6 +155,21 @@ PlyModel::PlyModel()
     return;
 }
 
+void PlyModel::release_buffers()
+{
+    if (this->vertex_list != NULL)
+    {
+        this->allocator->deallocate(this->vertex_list, sizeof(float) * 6 * this->vertex_num);
+        this->vertex_list = NULL;
+    }
+    if (this->face_list != NULL)
+    {
+        this->allocator->deallocate(this->face_list, sizeof(unsigned int) * 3 * this->face_num);
+        this->face_list = NULL;
+    }
+    return;
+}
+
 int PlyModel::get_vertex_num()
 {
     return this->vertex_num;
@@ -105,6 +180,11 @@ int PlyModel::get_face_num()
     return this->face_num;
 }
 
+MeshAllocator* PlyModel::get_allocator()
+{
+    return this->allocator;
+}
+
 float* PlyModel::get_model_vertices()
 {
     return this->vertex_list;
@@ -115,17 +195,32 @@ unsigned int* PlyModel::get_model_faces()
     return this->face_list;
 }
 
-void PlyModel::parse_vertex_line(string line)
+void PlyModel::skip_line(char*& cursor)
 {
-    string temp;
+    while (*cursor != '\0' && *cursor != '\n')
+    {
+        ++cursor;
+    }
+    if (*cursor == '\n')
+    {
+        ++cursor;
+    }
+    return;
+}
+
+// the first three properties are the position; the rest of the line is ignored
+bool PlyModel::parse_vertex_line(char*& cursor)
+{
+    char* end;
     float coord;
 
-    istringstream is(line);
     for (int i = 0; i < 3; ++i)
     {
-        is >> temp;
+        coord = strtof(cursor, &end);
+        if (end == cursor)
+            return false;
+        cursor = end;
         this->current_vertex++;
-        coord = stof(temp);
         this->vertex_list[this->current_vertex] = coord;
 
         // update model's bounding box
@@ -140,20 +235,68 @@ void PlyModel::parse_vertex_line(string line)
     }
 
     this->current_vertex += 3;
-    return;
+    this->skip_line(cursor);
+    return true;
 }
 
-void PlyModel::parse_face_line(string line)
+// skips the vertex count, faces are triangles
+bool PlyModel::parse_face_line(char*& cursor)
 {
-    string temp;
+    char* end;
 
-    istringstream is(line);
-    is >> temp;
+    strtoul(cursor, &end, 10);
+    if (end == cursor)
+        return false;
+    cursor = end;
     for (int i = 0; i < 3; ++i)
     {
-        is >> temp;
+        unsigned long index = strtoul(cursor, &end, 10);
+        if (end == cursor)
+            return false;
+        cursor = end;
         this->current_face++;
-        this->face_list[this->current_face] = (unsigned int)stoi(temp);
+        this->face_list[this->current_face] = (unsigned int)index;
+    }
+
+    this->skip_line(cursor);
+    return true;
+}
+
+void PlyModel::get_bounding_box(float min_out[3], float max_out[3])
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        min_out[i] = this->min_coord[i];
+        max_out[i] = this->max_coord[i];
+    }
+    return;
+}
+
+void PlyModel::compute_bounding_box()
+{
+    if (this->vertex_list == NULL)
+        return;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        this->max_coord[i] = -100000.0;
+        this->min_coord[i] = 100000.0;
+    }
+
+    for (int v = 0; v < this->vertex_num; ++v)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            float coord = this->vertex_list[6 * v + i];
+            if (coord < this->min_coord[i])
+            {
+                this->min_coord[i] = coord;
+            }
+            if (coord > this->max_coord[i])
+            {
+                this->max_coord[i] = coord;
+            }
+        }
     }
 
     return;
@@ -161,6 +304,9 @@ void PlyModel::parse_face_line(string line)
 
 void PlyModel::print_all_lists()
 {
+    if (this->vertex_list == NULL || this->face_list == NULL)
+        return;
+
     cout << "Vertex List: " << endl;
     for (int i = 0; i < this->vertex_num; ++i)
     {
@@ -188,20 +334,17 @@ void PlyModel::print_bounding_box()
 
 void PlyModel::add_normal_vectors()
 {
-    if (this->vertex_num == 0 || this->face_num == 0)
+    if (this->vertex_num == 0 || this->face_num == 0 || this->vertex_list == NULL)
         return;
 
     float r1, r2, r3;
     int v1, v2, v3; // vertex indices from a face
     float vec_length; // length of a vector
-    int v_num = this->vertex_num;
-    float** normal_vecs = new float* [v_num];
-    for (int i = 0; i < v_num; ++i)
+    vector<float> normal_buffer(3 * this->vertex_num, 0.0f); // one block instead of one per vertex
+    vector<float*> normal_vecs(this->vertex_num);
+    for (int i = 0; i < this->vertex_num; ++i)
     {
-        normal_vecs[i] = new float[3];
-        normal_vecs[i][0] = 0;
-        normal_vecs[i][1] = 0;
-        normal_vecs[i][2] = 0;
+        normal_vecs[i] = &normal_buffer[3 * i];
     }
 
     for (int i = 0; i < this->face_num; ++i)
@@ -233,7 +376,6 @@ void PlyModel::add_normal_vectors()
         this->vertex_list[6 * i + 5] = normal_vecs[i][2] / vec_length;
     }
 
-    delete []normal_vecs;
     return;
 }
 
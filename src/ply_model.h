@@ -2,26 +2,49 @@
 #define PLY_MODEL_H
 
 #include <string>
+#include <vector>
 
+#include "mesh_arena.h"
+
+// owns its vertex/face buffers; move-only so a buffer is never freed twice
 class PlyModel
 {
 public:
-    PlyModel();
+    static const int VERTEX_STRIDE = 6; // floats per vertex: position, then normal
+
+    PlyModel(MeshAllocator* allocator = NULL); // NULL uses the default heap allocator
+    ~PlyModel();
+
+    PlyModel(const PlyModel&) = delete;
+    PlyModel& operator=(const PlyModel&) = delete;
+    PlyModel(PlyModel&& other) noexcept;
+    PlyModel& operator=(PlyModel&& other) noexcept;
 
     void get_ply_model(const char* filename);
+    // bytes get_ply_model will allocate for a file, read from its header only; 0 if it can't be opened
+    static size_t peek_buffer_bytes(const char* filename);
+
+    // drops the CPU copy, e.g. after GPU upload; counts and bounding box stay valid
+    void release_buffers();
 
     void add_normal_vectors();
+    void compute_bounding_box();
 
     int get_vertex_num();
     int get_face_num();
 
+    MeshAllocator* get_allocator();
+
     float* get_model_vertices();
     unsigned int* get_model_faces();
+    void get_bounding_box(float min_out[3], float max_out[3]);
 
     void print_all_lists();
     void print_bounding_box();
 
 private:
+    MeshAllocator* allocator;
+
     int vertex_num;  // overall size of vertex list
     int face_num;  // overall size of face list
 
@@ -34,8 +57,10 @@ private:
     float max_coord[3]; // AABB bounding box (x_max, y_max, z_max)
     float min_coord[3]; // AABB bounding box (x_min, y_min, z_min)
 
-    void parse_vertex_line(std::string line);
-    void parse_face_line(std::string line);
+    void reset();
+    void skip_line(char*& cursor);
+    bool parse_vertex_line(char*& cursor); // false on a short or malformed line
+    bool parse_face_line(char*& cursor);
 
     void get_3d_cross_product(float& r1, float& r2, float&r3, float x1, float x2, float x3, float y1, float y2, float y3);
 };
@@ -0,0 +1,40 @@
+#include "process_memory.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+size_t get_process_rss()
+{
+#if defined(__linux__)
+    ifstream statm("/proc/self/statm");
+    size_t pages = 0, residentPages = 0;
+    if (statm >> pages >> residentPages)
+    {
+        return residentPages * (size_t)sysconf(_SC_PAGESIZE);
+    }
+#endif
+    return 0;
+}
+
+size_t get_peak_rss()
+{
+#if defined(__linux__)
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line))
+    {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+        {
+            return (size_t)strtoull(line.c_str() + 6, NULL, 10) * 1024;
+        }
+    }
+#endif
+    return 0;
+}
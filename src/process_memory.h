@@ -0,0 +1,11 @@
+#ifndef PROCESS_MEMORY_H
+#define PROCESS_MEMORY_H
+
+#include <cstddef>
+
+// resident set of this process in bytes, 0 where the platform does not expose it
+size_t get_process_rss();
+// high-water mark of the resident set, 0 where the platform does not expose it
+size_t get_peak_rss();
+
+#endif
@@ -0,0 +1,114 @@
+#include "scene_description.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+static const char* MODEL_NAMES[SCENE_MODEL_NUM] = { "bunny", "dragon", "happy" };
+
+static bool read_vec3(istringstream& line, glm::vec3& value)
+{
+    return (bool)(line >> value.x >> value.y >> value.z);
+}
+
+static bool read_index(istringstream& line, int count, int& index)
+{
+    return (bool)(line >> index) && index >= 0 && index < count;
+}
+
+static glm::vec4* find_color(SceneDescription& description, const string& name)
+{
+    if (name == "ground")
+        return &description.ground_color;
+    if (name == "crop")
+        return &description.crop_color;
+    if (name == "crop_hit")
+        return &description.crop_hit_color;
+    if (name == "bearing")
+        return &description.bearing_color;
+    if (name == "character")
+        return &description.character_color;
+    return NULL;
+}
+
+bool load_scene_description(const char* filename, SceneDescription& description, string& error)
+{
+    ifstream file(filename);
+    if (!file)
+    {
+        error = string("cannot open ") + filename;
+        return false;
+    }
+
+    // parse into a copy so a half-written file never leaks into the scene
+    SceneDescription parsed = description;
+    parsed.shaders.clear();
+    string text;
+    int lineNum = 0;
+    while (getline(file, text))
+    {
+        lineNum++;
+        size_t comment = text.find('#');
+        if (comment != string::npos)
+            text.erase(comment);
+        istringstream line(text);
+        string key;
+        if (!(line >> key))
+            continue;
+
+        bool valid = false;
+        int index = 0;
+        if (key == "crop")
+        {
+            valid = read_index(line, SCENE_CROP_NUM, index) && read_vec3(line, parsed.crops[index]);
+        }
+        else if (key == "bearing")
+        {
+            valid = read_index(line, SCENE_BEARING_NUM, index) && read_vec3(line, parsed.bearings[index]);
+        }
+        else if (key == "model")
+        {
+            string name;
+            line >> name;
+            for (index = 0; index < SCENE_MODEL_NUM && name != MODEL_NAMES[index]; ++index)
+                ;
+            valid = index < SCENE_MODEL_NUM && read_vec3(line, parsed.model_positions[index]) && (bool)(line >> parsed.model_scales[index]);
+        }
+        else if (key == "color")
+        {
+            string name;
+            line >> name;
+            glm::vec4* color = find_color(parsed, name);
+            valid = color != NULL && (bool)(line >> color->x >> color->y >> color->z >> color->w);
+        }
+        else if (key == "shader")
+        {
+            ShaderFiles files;
+            valid = (bool)(line >> files.program >> files.vertex_file >> files.fragment_file);
+            if (valid)
+                parsed.shaders.push_back(files);
+        }
+
+        if (!valid)
+        {
+            error = string(filename) + ":" + to_string(lineNum) + ": cannot parse '" + text + "'";
+            return false;
+        }
+    }
+
+    description = parsed;
+    return true;
+}
+
+bool read_text_file(const string& filename, string& text)
+{
+    ifstream file(filename, ios::binary);
+    if (!file)
+        return false;
+
+    ostringstream buffer;
+    buffer << file.rdbuf();
+    text = buffer.str();
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef SCENE_DESCRIPTION_H
+#define SCENE_DESCRIPTION_H
+
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+const int SCENE_CROP_NUM = 9;
+const int SCENE_BEARING_NUM = 4;
+const int SCENE_MODEL_NUM = 3; // bunny, dragon, happy
+
+struct ShaderFiles
+{
+    std::string program; // name given to ShaderManager::add_program
+    std::string vertex_file;
+    std::string fragment_file;
+};
+
+// the runtime-editable part of the scene, read from a text file with one entry per line:
+//   crop <index> x y z              bearing <index> x y z
+//   model <bunny|dragon|happy> x y z scale
+//   color <ground|crop|crop_hit|bearing|character> r g b a
+//   shader <program> <vertex file> <fragment file>
+// entries that are left out keep their current value; '#' starts a comment
+struct SceneDescription
+{
+    glm::vec3 crops[SCENE_CROP_NUM];
+    glm::vec3 bearings[SCENE_BEARING_NUM];
+    glm::vec3 model_positions[SCENE_MODEL_NUM];
+    float model_scales[SCENE_MODEL_NUM];
+    glm::vec4 ground_color;
+    glm::vec4 crop_color;
+    glm::vec4 crop_hit_color;
+    glm::vec4 bearing_color;
+    glm::vec4 character_color;
+    std::vector<ShaderFiles> shaders; // programs built from files instead of parameter_config.h
+};
+
+// on a parse error description is left untouched and error names the line
+bool load_scene_description(const char* filename, SceneDescription& description, std::string& error);
+
+bool read_text_file(const std::string& filename, std::string& text);
+
+#endif
@@ -0,0 +1,505 @@
+#include "shader_manager.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <glad/glad.h>
+
+// program binaries are GL 4.1 / ARB_get_program_binary, parallel compile is KHR or ARB
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRY* ProgramBinaryProc)(GLuint program, GLenum format, const void* binary, GLsizei length);
+typedef void (APIENTRY* GetProgramBinaryProc)(GLuint program, GLsizei buf_size, GLsizei* length, GLenum* format, void* binary);
+typedef void (APIENTRY* ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRY* MaxShaderCompilerThreadsProc)(GLuint count);
+
+using namespace std;
+
+static const char CACHE_MAGIC[4] = { 'G', 'L', 'S', 'C' };
+static const size_t MAX_CACHED_BINARIES = 64; // oldest entries go first, e.g. stale permutations
+
+static double elapsed_ms(const chrono::steady_clock::time_point& start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// FNV-1a, chained over every part of the key
+static unsigned long long hash_string(const string& text, unsigned long long hash)
+{
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= 0xff; // separator, so "ab" + "c" differs from "a" + "bc"
+    hash *= 1099511628211ULL;
+    return hash;
+}
+
+// the defines go right after the #version line, which has to stay first
+static string specialize(const char* source, const vector<string>& defines)
+{
+    string text = source;
+    size_t lineEnd = text.find('\n');
+    string header;
+    for (size_t i = 0; i < defines.size(); ++i)
+    {
+        header += "#define " + defines[i] + "\n";
+    }
+    if (lineEnd == string::npos)
+        return header + text;
+    return text.substr(0, lineEnd + 1) + header + text.substr(lineEnd + 1);
+}
+
+bool has_gl_extension(const char* name)
+{
+    int extensionNum = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionNum);
+    for (int i = 0; i < extensionNum; ++i)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension != NULL && strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+ShaderManager::ShaderManager()
+{
+    this->cache_dirty = false;
+    this->report = ShaderLoadReport();
+    this->program_binary = NULL;
+    this->get_program_binary = NULL;
+    this->program_parameter = NULL;
+    this->max_compiler_threads = NULL;
+    return;
+}
+
+void ShaderManager::init(ShaderProcLoader loader, const string& cache_file)
+{
+    this->cache_file = cache_file;
+    this->driver = string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+
+    if (loader != NULL && has_gl_extension("GL_ARB_get_program_binary"))
+    {
+        int formatNum = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatNum);
+        if (formatNum > 0)
+        {
+            this->program_binary = loader("glProgramBinary");
+            this->get_program_binary = loader("glGetProgramBinary");
+            this->program_parameter = loader("glProgramParameteri");
+        }
+    }
+    this->report.program_binaries = this->program_binary != NULL && this->get_program_binary != NULL && this->program_parameter != NULL;
+
+    if (loader != NULL && has_gl_extension("GL_KHR_parallel_shader_compile"))
+        this->max_compiler_threads = loader("glMaxShaderCompilerThreadsKHR");
+    else if (loader != NULL && has_gl_extension("GL_ARB_parallel_shader_compile"))
+        this->max_compiler_threads = loader("glMaxShaderCompilerThreadsARB");
+    if (this->max_compiler_threads != NULL)
+    {
+        ((MaxShaderCompilerThreadsProc)this->max_compiler_threads)(0xFFFFFFFFu); // let the driver pick
+        this->report.parallel_compile = true;
+    }
+
+    if (this->report.program_binaries && !this->cache_file.empty())
+        this->read_cache();
+    return;
+}
+
+void ShaderManager::destroy()
+{
+    for (size_t i = 0; i < this->programs.size(); ++i)
+    {
+        glDeleteProgram(this->programs[i].program);
+    }
+    for (size_t i = 0; i < this->rebuilds.size(); ++i)
+    {
+        this->discard_build(this->rebuilds[i].second);
+        glDeleteProgram(this->rebuilds[i].second.program);
+    }
+    this->programs.clear();
+    this->rebuilds.clear();
+    return;
+}
+
+int ShaderManager::add_program(const string& name, const char* vertex_source, const char* fragment_source, const vector<string>& defines)
+{
+    ProgramEntry entry;
+    entry.name = name;
+    entry.defines = defines;
+    this->set_sources(entry, vertex_source, fragment_source);
+    entry.program = 0;
+    entry.shaders[0] = entry.shaders[1] = 0;
+    entry.from_cache = false;
+    entry.pending = true;
+
+    this->programs.push_back(entry);
+    this->report.program_num++;
+    return (int)this->programs.size() - 1;
+}
+
+void ShaderManager::begin_build()
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for (size_t i = 0; i < this->programs.size(); ++i)
+    {
+        ProgramEntry& entry = this->programs[i];
+        if (!entry.pending || entry.program != 0)
+            continue;
+
+        this->issue_build(entry);
+    }
+
+    this->report.issue_ms += elapsed_ms(start);
+    return;
+}
+
+bool ShaderManager::finish_build()
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // with parallel compile, poll the non-blocking completion status until every link is done
+    if (this->report.parallel_compile)
+    {
+        bool done = false;
+        while (!done)
+        {
+            done = true;
+            for (size_t i = 0; i < this->programs.size() && done; ++i)
+            {
+                const ProgramEntry& entry = this->programs[i];
+                if (!entry.pending || entry.from_cache)
+                    continue;
+                int complete = 0;
+                glGetProgramiv(entry.program, GL_COMPLETION_STATUS_KHR, &complete);
+                done = complete != 0;
+            }
+        }
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < this->programs.size(); ++i)
+    {
+        ProgramEntry& entry = this->programs[i];
+        if (!entry.pending)
+            continue;
+        entry.pending = false;
+        if (entry.from_cache)
+            continue;
+
+        if (!this->complete_build(entry))
+        {
+            this->report.failed++;
+            success = false;
+        }
+    }
+
+    if (this->cache_dirty)
+        this->write_cache();
+
+    this->report.wait_ms += elapsed_ms(start);
+    return success;
+}
+
+int ShaderManager::find_program(const string& name)
+{
+    for (size_t i = 0; i < this->programs.size(); ++i)
+    {
+        if (this->programs[i].name == name)
+            return (int)i;
+    }
+    return -1;
+}
+
+void ShaderManager::rebuild_program(int id, const char* vertex_source, const char* fragment_source)
+{
+    // a newer edit supersedes a rebuild that is still compiling
+    for (size_t i = 0; i < this->rebuilds.size(); ++i)
+    {
+        if (this->rebuilds[i].first != id)
+            continue;
+        this->discard_build(this->rebuilds[i].second);
+        glDeleteProgram(this->rebuilds[i].second.program);
+        this->rebuilds.erase(this->rebuilds.begin() + i);
+        break;
+    }
+
+    ProgramEntry entry;
+    entry.name = this->programs[id].name;
+    entry.defines = this->programs[id].defines;
+    this->set_sources(entry, vertex_source, fragment_source);
+    entry.program = 0;
+    entry.shaders[0] = entry.shaders[1] = 0;
+    entry.from_cache = false;
+    entry.pending = true;
+    this->issue_build(entry);
+    this->rebuilds.push_back(make_pair(id, entry));
+    return;
+}
+
+void ShaderManager::poll_rebuilds(vector<int>& swapped, vector<int>& failed)
+{
+    swapped.clear();
+    failed.clear();
+    for (size_t i = 0; i < this->rebuilds.size();)
+    {
+        int id = this->rebuilds[i].first;
+        ProgramEntry& entry = this->rebuilds[i].second;
+
+        // without parallel compile there is no way to ask, the status query below may block
+        if (this->report.parallel_compile && !entry.from_cache)
+        {
+            int complete = 0;
+            glGetProgramiv(entry.program, GL_COMPLETION_STATUS_KHR, &complete);
+            if (!complete)
+            {
+                ++i;
+                continue;
+            }
+        }
+
+        entry.pending = false;
+        if (entry.from_cache || this->complete_build(entry))
+        {
+            glDeleteProgram(this->programs[id].program);
+            this->programs[id] = entry;
+            swapped.push_back(id);
+        }
+        else
+        {
+            cout << "shader " << entry.name << " kept its previous version" << endl;
+            glDeleteProgram(entry.program);
+            failed.push_back(id);
+        }
+        this->rebuilds.erase(this->rebuilds.begin() + i);
+    }
+
+    if (this->cache_dirty)
+        this->write_cache();
+    return;
+}
+
+unsigned int ShaderManager::get_program(int id)
+{
+    return this->programs[id].program;
+}
+
+void ShaderManager::get_report(ShaderLoadReport& report)
+{
+    report = this->report;
+    return;
+}
+
+void ShaderManager::print_report()
+{
+    cout << "shaders: " << this->report.program_num << " programs, " << this->report.cache_hits << " from cache, " << this->report.failed << " failed, "
+        << this->report.issue_ms << " ms issuing + " << this->report.wait_ms << " ms waiting (parallel compile "
+        << (this->report.parallel_compile ? "on" : "off") << ", program binaries " << (this->report.program_binaries ? "on" : "off") << ")" << endl;
+    return;
+}
+
+void ShaderManager::set_sources(ProgramEntry& entry, const char* vertex_source, const char* fragment_source)
+{
+    entry.vertex_source = specialize(vertex_source, entry.defines);
+    entry.fragment_source = specialize(fragment_source, entry.defines);
+    entry.key = hash_string(entry.fragment_source, hash_string(entry.vertex_source, hash_string(this->driver, 14695981039346656037ULL)));
+    return;
+}
+
+void ShaderManager::issue_build(ProgramEntry& entry)
+{
+    entry.program = glCreateProgram();
+    if (this->load_binary(entry))
+        return;
+
+    // no status queries here: a blocking query would serialize the driver's compiler threads
+    const char* sources[2] = { entry.vertex_source.c_str(), entry.fragment_source.c_str() };
+    GLenum stages[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    for (int s = 0; s < 2; ++s)
+    {
+        entry.shaders[s] = glCreateShader(stages[s]);
+        glShaderSource(entry.shaders[s], 1, &sources[s], NULL);
+        glCompileShader(entry.shaders[s]);
+        glAttachShader(entry.program, entry.shaders[s]);
+    }
+    if (this->report.program_binaries)
+        ((ProgramParameteriProc)this->program_parameter)(entry.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(entry.program);
+    return;
+}
+
+bool ShaderManager::complete_build(ProgramEntry& entry)
+{
+    bool compiled = this->check_shader(entry, 0) && this->check_shader(entry, 1);
+    int linked = 0;
+    glGetProgramiv(entry.program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        char infoLog[512];
+        glGetProgramInfoLog(entry.program, 512, NULL, infoLog);
+        cout << "ERROR::SHADER::" << entry.name << "::LINK_FAILED\n" << infoLog << endl;
+    }
+    else if (compiled)
+    {
+        this->store_binary(entry);
+    }
+
+    this->discard_build(entry);
+    return linked && compiled;
+}
+
+void ShaderManager::discard_build(ProgramEntry& entry)
+{
+    for (int s = 0; s < 2; ++s)
+    {
+        if (entry.shaders[s] == 0)
+            continue;
+        glDetachShader(entry.program, entry.shaders[s]);
+        glDeleteShader(entry.shaders[s]);
+        entry.shaders[s] = 0;
+    }
+    return;
+}
+
+bool ShaderManager::load_binary(ProgramEntry& entry)
+{
+    if (!this->report.program_binaries)
+        return false;
+
+    for (size_t i = 0; i < this->cache.size(); ++i)
+    {
+        const CachedBinary& binary = this->cache[i];
+        if (binary.key != entry.key)
+            continue;
+
+        ((ProgramBinaryProc)this->program_binary)(entry.program, binary.format, binary.data.data(), (GLsizei)binary.data.size());
+        int linked = 0;
+        glGetProgramiv(entry.program, GL_LINK_STATUS, &linked);
+        if (linked)
+        {
+            entry.from_cache = true;
+            this->report.cache_hits++;
+            return true;
+        }
+
+        // rejected (e.g. the driver changed its binary format), drop it and compile from source
+        this->cache.erase(this->cache.begin() + i);
+        this->cache_dirty = true;
+        break;
+    }
+    return false;
+}
+
+void ShaderManager::store_binary(ProgramEntry& entry)
+{
+    if (!this->report.program_binaries)
+        return;
+
+    int length = 0;
+    glGetProgramiv(entry.program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    CachedBinary binary;
+    binary.key = entry.key;
+    binary.data.resize(length);
+    GLenum format = 0;
+    ((GetProgramBinaryProc)this->get_program_binary)(entry.program, length, NULL, &format, binary.data.data());
+    binary.format = format;
+
+    if (this->cache.size() >= MAX_CACHED_BINARIES)
+        this->cache.erase(this->cache.begin());
+    this->cache.push_back(binary);
+    this->cache_dirty = true;
+    return;
+}
+
+bool ShaderManager::check_shader(const ProgramEntry& entry, int stage)
+{
+    int success = 0;
+    glGetShaderiv(entry.shaders[stage], GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        char infoLog[512];
+        glGetShaderInfoLog(entry.shaders[stage], 512, NULL, infoLog);
+        cout << "ERROR::SHADER::" << entry.name << (stage == 0 ? "::VERTEX" : "::FRAGMENT") << "::COMPILATION_FAILED\n" << infoLog << endl;
+    }
+    return success != 0;
+}
+
+// magic, entry count, then per entry key, format, byte count and the bytes
+void ShaderManager::read_cache()
+{
+    this->cache.clear();
+    ifstream file(this->cache_file.c_str(), ios::binary);
+    if (!file)
+        return;
+
+    char magic[4];
+    unsigned int entryNum = 0;
+    file.read(magic, 4);
+    file.read((char*)&entryNum, sizeof(entryNum));
+    if (!file || memcmp(magic, CACHE_MAGIC, 4) != 0)
+        return;
+
+    for (unsigned int i = 0; i < entryNum; ++i)
+    {
+        CachedBinary binary;
+        unsigned int length = 0;
+        file.read((char*)&binary.key, sizeof(binary.key));
+        file.read((char*)&binary.format, sizeof(binary.format));
+        file.read((char*)&length, sizeof(length));
+        if (!file || length > (64u << 20))
+            break;
+        binary.data.resize(length);
+        file.read((char*)binary.data.data(), length);
+        if (!file)
+            break;
+        this->cache.push_back(binary);
+    }
+    return;
+}
+
+void ShaderManager::write_cache()
+{
+    if (this->cache_file.empty())
+        return;
+
+    ofstream file(this->cache_file.c_str(), ios::binary | ios::trunc);
+    if (!file)
+    {
+        cout << "Failed to write shader cache " << this->cache_file << endl;
+        return;
+    }
+
+    unsigned int entryNum = (unsigned int)this->cache.size();
+    file.write(CACHE_MAGIC, 4);
+    file.write((const char*)&entryNum, sizeof(entryNum));
+    for (size_t i = 0; i < this->cache.size(); ++i)
+    {
+        const CachedBinary& binary = this->cache[i];
+        unsigned int length = (unsigned int)binary.data.size();
+        file.write((const char*)&binary.key, sizeof(binary.key));
+        file.write((const char*)&binary.format, sizeof(binary.format));
+        file.write((const char*)&length, sizeof(length));
+        file.write((const char*)binary.data.data(), length);
+    }
+    this->cache_dirty = false;
+    return;
+}
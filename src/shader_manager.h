@@ -0,0 +1,100 @@
+#ifndef SHADER_MANAGER_H
+#define SHADER_MANAGER_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef void* (*ShaderProcLoader)(const char* name);
+
+// searches the current context's extension strings
+bool has_gl_extension(const char* name);
+
+struct ShaderLoadReport
+{
+    int program_num;
+    int cache_hits; // programs restored from a stored binary
+    int failed;
+    double issue_ms; // handing sources and binaries to the driver
+    double wait_ms; // blocked on compile and link results
+    bool parallel_compile;
+    bool program_binaries;
+};
+
+// compiles every program permutation in one batch. Sources are specialized by prepending
+// #defines, all compiles and links are issued before any status is queried (so drivers with
+// KHR_parallel_shader_compile work on them concurrently), and linked programs are kept as
+// binaries in a cache file keyed by a hash of the sources and the driver string.
+class ShaderManager
+{
+public:
+    ShaderManager();
+
+    // loader resolves the entry points GL 3.3 does not guarantee
+    void init(ShaderProcLoader loader, const std::string& cache_file); // empty cache_file keeps no cache
+    void destroy();
+
+    int add_program(const std::string& name, const char* vertex_source, const char* fragment_source, const std::vector<std::string>& defines);
+
+    void begin_build(); // issues everything added since the last build, returns without waiting
+    bool finish_build(); // waits, checks every compile and link, stores new binaries; false if anything failed
+
+    int find_program(const std::string& name); // -1 if there is none
+
+    // recompiles one program from new sources with its original defines. The old program stays
+    // in use until poll_rebuilds sees the new one linked, and is kept if the new one fails.
+    void rebuild_program(int id, const char* vertex_source, const char* fragment_source);
+    // non-blocking with parallel compile; ids whose program was replaced and ids whose rebuild failed
+    void poll_rebuilds(std::vector<int>& swapped, std::vector<int>& failed);
+
+    unsigned int get_program(int id);
+    void get_report(ShaderLoadReport& report);
+    void print_report();
+
+private:
+    struct ProgramEntry
+    {
+        std::string name;
+        std::vector<std::string> defines;
+        std::string vertex_source;
+        std::string fragment_source;
+        unsigned long long key;
+        unsigned int program;
+        unsigned int shaders[2];
+        bool from_cache;
+        bool pending;
+    };
+
+    struct CachedBinary
+    {
+        unsigned long long key;
+        unsigned int format;
+        std::vector<unsigned char> data;
+    };
+
+    std::vector<ProgramEntry> programs;
+    std::vector<std::pair<int, ProgramEntry> > rebuilds; // target id, replacement still compiling
+    std::vector<CachedBinary> cache;
+    std::string cache_file;
+    std::string driver;
+    bool cache_dirty;
+    ShaderLoadReport report;
+
+    void* program_binary; // glProgramBinary
+    void* get_program_binary; // glGetProgramBinary
+    void* program_parameter; // glProgramParameteri
+    void* max_compiler_threads; // glMaxShaderCompilerThreadsKHR / ARB
+
+    void set_sources(ProgramEntry& entry, const char* vertex_source, const char* fragment_source);
+    void issue_build(ProgramEntry& entry);
+    bool complete_build(ProgramEntry& entry); // checks compile and link, stores the binary
+    void discard_build(ProgramEntry& entry); // drops the shader objects once linking is over
+
+    bool load_binary(ProgramEntry& entry);
+    void store_binary(ProgramEntry& entry);
+    bool check_shader(const ProgramEntry& entry, int stage);
+    void read_cache();
+    void write_cache();
+};
+
+#endif
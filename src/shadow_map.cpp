@@ -0,0 +1,271 @@
+#include "shadow_map.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+static const float MIN_NEAR = 0.1f;
+static const float FALLBACK_SLOPE = 1.732f; // tan(60), used when the light sits among the casters
+static const float MAX_SLOPE = 3.732f; // tan(75)
+
+static void add_box_corners(std::vector<glm::vec3>& points, const glm::vec3& min, const glm::vec3& max)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        points.push_back(glm::vec3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z));
+    }
+    return;
+}
+
+ShadowMap::ShadowMap()
+{
+    this->size = 0;
+    this->move_threshold = 0.0f;
+    this->initialized = false;
+    this->static_valid = false;
+    this->static_renders = 0;
+    this->cached_light = glm::vec3(0.0f);
+    this->light_space = glm::mat4(1.0f);
+    this->static_fbo = 0;
+    this->static_depth = 0;
+    this->fbo = 0;
+    this->depth_texture = 0;
+    this->saved_fbo = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        this->saved_viewport[i] = 0;
+    }
+    return;
+}
+
+bool ShadowMap::init(int size, float move_threshold)
+{
+    this->size = size;
+    this->move_threshold = move_threshold;
+
+    glGenRenderbuffers(1, &this->static_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->static_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+
+    glGenFramebuffers(1, &this->static_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->static_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->static_depth);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    // hardware depth compare gives bilinear PCF per tap; outside the map everything is lit
+    float border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glGenTextures(1, &this->depth_texture);
+    glBindTexture(GL_TEXTURE_2D, this->depth_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &this->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->depth_texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (!complete)
+    {
+        std::cout << "Shadow map framebuffer is not complete" << std::endl;
+        this->destroy();
+        return false;
+    }
+
+    this->initialized = true;
+    this->static_valid = false;
+    return true;
+}
+
+void ShadowMap::destroy()
+{
+    if (this->fbo != 0)
+        glDeleteFramebuffers(1, &this->fbo);
+    if (this->static_fbo != 0)
+        glDeleteFramebuffers(1, &this->static_fbo);
+    if (this->depth_texture != 0)
+        glDeleteTextures(1, &this->depth_texture);
+    if (this->static_depth != 0)
+        glDeleteRenderbuffers(1, &this->static_depth);
+
+    this->fbo = 0;
+    this->static_fbo = 0;
+    this->depth_texture = 0;
+    this->static_depth = 0;
+    this->initialized = false;
+    this->static_valid = false;
+    return;
+}
+
+void ShadowMap::clear_bounds()
+{
+    this->caster_points.clear();
+    this->receiver_points.clear();
+    this->static_valid = false;
+    return;
+}
+
+void ShadowMap::add_caster_bounds(const glm::vec3& min, const glm::vec3& max)
+{
+    add_box_corners(this->caster_points, min, max);
+    this->static_valid = false;
+    return;
+}
+
+void ShadowMap::add_receiver_bounds(const glm::vec3& min, const glm::vec3& max)
+{
+    add_box_corners(this->receiver_points, min, max);
+    this->static_valid = false;
+    return;
+}
+
+bool ShadowMap::needs_static_update(const glm::vec3& light_pos)
+{
+    if (!this->static_valid)
+        return true;
+
+    return glm::length(light_pos - this->cached_light) > this->move_threshold;
+}
+
+void ShadowMap::update_light(const glm::vec3& light_pos)
+{
+    this->cached_light = light_pos;
+    this->static_valid = false;
+    if (this->caster_points.empty())
+        return;
+
+    // aim at the centre of the casters
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (size_t i = 0; i < this->caster_points.size(); ++i)
+    {
+        lo = glm::min(lo, this->caster_points[i]);
+        hi = glm::max(hi, this->caster_points[i]);
+    }
+    glm::vec3 dir = 0.5f * (lo + hi) - light_pos;
+    if (glm::length(dir) < 1e-4f)
+    {
+        dir = glm::vec3(0.0f, -1.0f, 0.0f);
+    }
+    dir = glm::normalize(dir);
+    glm::vec3 up = fabs(dir.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 view = glm::lookAt(light_pos, light_pos + dir, up);
+
+    // shadows stay inside the cone spanned by the casters, so the casters alone fix its slopes;
+    // receivers behind them only need to lie before the far plane
+    float left = 1e30f, right = -1e30f, bottom = 1e30f, top = -1e30f;
+    float nearPlane = 1e30f, farPlane = 0.0f;
+    bool lightAmongCasters = false;
+    for (size_t i = 0; i < this->caster_points.size(); ++i)
+    {
+        glm::vec4 p = view * glm::vec4(this->caster_points[i], 1.0f);
+        float depth = -p.z;
+        if (depth < MIN_NEAR)
+        {
+            lightAmongCasters = true;
+            continue;
+        }
+        left = std::min(left, p.x / depth);
+        right = std::max(right, p.x / depth);
+        bottom = std::min(bottom, p.y / depth);
+        top = std::max(top, p.y / depth);
+        nearPlane = std::min(nearPlane, depth);
+        farPlane = std::max(farPlane, depth);
+    }
+    for (size_t i = 0; i < this->receiver_points.size(); ++i)
+    {
+        glm::vec4 p = view * glm::vec4(this->receiver_points[i], 1.0f);
+        farPlane = std::max(farPlane, -p.z);
+    }
+
+    if (lightAmongCasters || nearPlane > farPlane)
+    {
+        left = bottom = -FALLBACK_SLOPE;
+        right = top = FALLBACK_SLOPE;
+        nearPlane = MIN_NEAR;
+    }
+    left = std::max(left, -MAX_SLOPE);
+    right = std::min(right, MAX_SLOPE);
+    bottom = std::max(bottom, -MAX_SLOPE);
+    top = std::min(top, MAX_SLOPE);
+    nearPlane = std::max(MIN_NEAR, 0.95f * nearPlane);
+    farPlane = std::max(1.01f * farPlane, nearPlane + 1.0f);
+
+    glm::mat4 projection = glm::frustum(left * nearPlane, right * nearPlane, bottom * nearPlane, top * nearPlane, nearPlane, farPlane);
+    this->light_space = projection * view;
+    return;
+}
+
+void ShadowMap::begin_static()
+{
+    this->save_target();
+    this->bind_target(this->static_fbo);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    this->static_valid = true;
+    this->static_renders++;
+    return;
+}
+
+void ShadowMap::begin_dynamic()
+{
+    this->save_target();
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, this->static_fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->fbo);
+    glBlitFramebuffer(0, 0, this->size, this->size, 0, 0, this->size, this->size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    this->bind_target(this->fbo);
+    return;
+}
+
+void ShadowMap::end()
+{
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->saved_fbo);
+    glViewport(this->saved_viewport[0], this->saved_viewport[1], this->saved_viewport[2], this->saved_viewport[3]);
+    return;
+}
+
+const glm::mat4& ShadowMap::get_light_space()
+{
+    return this->light_space;
+}
+
+unsigned int ShadowMap::get_depth_texture()
+{
+    return this->depth_texture;
+}
+
+int ShadowMap::get_static_renders()
+{
+    return this->static_renders;
+}
+
+void ShadowMap::save_target()
+{
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &this->saved_fbo);
+    glGetIntegerv(GL_VIEWPORT, this->saved_viewport);
+    return;
+}
+
+void ShadowMap::bind_target(unsigned int target)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    glViewport(0, 0, this->size, this->size);
+
+    // slope-scaled offset keeps lit surfaces from shadowing themselves
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+    return;
+}
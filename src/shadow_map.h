@@ -0,0 +1,59 @@
+#ifndef SHADOW_MAP_H
+#define SHADOW_MAP_H
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// perspective shadow map for the point light. Static casters are drawn into a cached depth buffer
+// that is only redrawn once the light has moved past a threshold; every frame the cached depth is
+// copied into the sampled map and the dynamic casters are drawn on top.
+class ShadowMap
+{
+public:
+    ShadowMap();
+
+    bool init(int size, float move_threshold);
+    void destroy();
+
+    // casters define the light frustum's cone and near plane, receivers only push the far plane out
+    void add_caster_bounds(const glm::vec3& min, const glm::vec3& max);
+    void add_receiver_bounds(const glm::vec3& min, const glm::vec3& max);
+    void clear_bounds(); // e.g. before re-adding moved objects
+
+    bool needs_static_update(const glm::vec3& light_pos);
+    void update_light(const glm::vec3& light_pos); // refits the light frustum, invalidates the cache
+
+    void begin_static(); // render target: the cached static depth
+    void begin_dynamic(); // render target: the sampled map, seeded with the cached static depth
+    void end(); // restores the caller's framebuffer and viewport
+
+    const glm::mat4& get_light_space();
+    unsigned int get_depth_texture();
+    int get_static_renders();
+
+private:
+    int size;
+    float move_threshold;
+    bool initialized;
+    bool static_valid;
+    int static_renders;
+
+    glm::vec3 cached_light;
+    glm::mat4 light_space;
+    std::vector<glm::vec3> caster_points;
+    std::vector<glm::vec3> receiver_points;
+
+    unsigned int static_fbo;
+    unsigned int static_depth; // renderbuffer, only ever blitted
+    unsigned int fbo;
+    unsigned int depth_texture;
+
+    int saved_fbo;
+    int saved_viewport[4];
+
+    void save_target();
+    void bind_target(unsigned int target);
+};
+
+#endif
@@ -0,0 +1,252 @@
+#include "terrain.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TERRAIN_SSE2 1
+#endif
+
+using namespace std;
+
+void set_default_terrain_params(TerrainParams& params)
+{
+    params.chunk_size = 32.0f;
+    params.chunk_quads = 32;
+    params.lod_levels = 4;
+    params.amplitude = 14.0f;
+    params.frequency = 1.0f / 48.0f;
+    params.octaves = 5;
+    params.flat_radius = 24.0f;
+    params.ramp_width = 32.0f;
+    params.skirt_depth = 2.0f;
+    params.seed = 647;
+    return;
+}
+
+// lattice hash in [0, 1), integer-only so both paths agree bit for bit
+static inline float lattice_value(int x, int z, unsigned int seed)
+{
+    unsigned int h = (unsigned int)x * 374761393u + (unsigned int)z * 668265263u + seed;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    h ^= h >> 16;
+    return (float)(h & 0xffffff) * (1.0f / 16777216.0f);
+}
+
+static inline float fade(float t)
+{
+    return t * t * (3.0f - 2.0f * t);
+}
+
+// 0 on the farm, 1 once the hills are fully grown
+static inline float ramp(const TerrainParams& params, float x, float z)
+{
+    float d = max(fabs(x), fabs(z)) - params.flat_radius;
+    float t = min(max(d / params.ramp_width, 0.0f), 1.0f);
+    return fade(t);
+}
+
+float terrain_height(const TerrainParams& params, float x, float z)
+{
+    float sum = 0.0f, amplitude = 1.0f, frequency = params.frequency;
+    for (int o = 0; o < params.octaves; ++o)
+    {
+        float px = x * frequency, pz = z * frequency;
+        float fx = floor(px), fz = floor(pz);
+        int ix = (int)fx, iz = (int)fz;
+        float tx = fade(px - fx), tz = fade(pz - fz);
+        unsigned int seed = params.seed + 1013u * o;
+
+        float v00 = lattice_value(ix, iz, seed), v10 = lattice_value(ix + 1, iz, seed);
+        float v01 = lattice_value(ix, iz + 1, seed), v11 = lattice_value(ix + 1, iz + 1, seed);
+        float a = v00 + (v10 - v00) * tx;
+        float b = v01 + (v11 - v01) * tx;
+        sum += (a + (b - a) * tz) * amplitude;
+
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    return sum * params.amplitude * ramp(params, x, z);
+}
+
+#if TERRAIN_SSE2
+// SSE2 has no 32-bit low multiply, build it from two 32x32->64 products
+static inline __m128i mullo_epi32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128 lattice_value4(__m128i x, __m128i z, __m128i seed)
+{
+    __m128i h = _mm_add_epi32(_mm_add_epi32(mullo_epi32(x, _mm_set1_epi32(374761393)), mullo_epi32(z, _mm_set1_epi32(668265263))), seed);
+    h = mullo_epi32(_mm_xor_si128(h, _mm_srli_epi32(h, 13)), _mm_set1_epi32(1274126177));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(h, _mm_set1_epi32(0xffffff))), _mm_set1_ps(1.0f / 16777216.0f));
+}
+
+static inline __m128 fade4(__m128 t)
+{
+    return _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_add_ps(t, t)));
+}
+
+static inline __m128 floor4(__m128 v)
+{
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, v), _mm_set1_ps(1.0f)));
+}
+#endif
+
+void terrain_heights(const TerrainParams& params, float x0, float z0, float spacing, int count_x, int count_z, float* out)
+{
+    for (int j = 0; j < count_z; ++j)
+    {
+        float z = z0 + j * spacing;
+        float* row = out + (size_t)j * count_x;
+        int i = 0;
+#if TERRAIN_SSE2
+        for (; i + 4 <= count_x; i += 4)
+        {
+            __m128 x = _mm_add_ps(_mm_set1_ps(x0), _mm_mul_ps(_mm_set_ps(i + 3.0f, i + 2.0f, i + 1.0f, (float)i), _mm_set1_ps(spacing)));
+            __m128 zv = _mm_set1_ps(z);
+            __m128 sum = _mm_setzero_ps();
+            float amplitude = 1.0f, frequency = params.frequency;
+            for (int o = 0; o < params.octaves; ++o)
+            {
+                __m128 px = _mm_mul_ps(x, _mm_set1_ps(frequency)), pz = _mm_mul_ps(zv, _mm_set1_ps(frequency));
+                __m128 fx = floor4(px), fz = floor4(pz);
+                __m128i ix = _mm_cvttps_epi32(fx), iz = _mm_cvttps_epi32(fz);
+                __m128i ix1 = _mm_add_epi32(ix, _mm_set1_epi32(1)), iz1 = _mm_add_epi32(iz, _mm_set1_epi32(1));
+                __m128 tx = fade4(_mm_sub_ps(px, fx)), tz = fade4(_mm_sub_ps(pz, fz));
+                __m128i seed = _mm_set1_epi32((int)(params.seed + 1013u * o));
+
+                __m128 v00 = lattice_value4(ix, iz, seed), v10 = lattice_value4(ix1, iz, seed);
+                __m128 v01 = lattice_value4(ix, iz1, seed), v11 = lattice_value4(ix1, iz1, seed);
+                __m128 a = _mm_add_ps(v00, _mm_mul_ps(_mm_sub_ps(v10, v00), tx));
+                __m128 b = _mm_add_ps(v01, _mm_mul_ps(_mm_sub_ps(v11, v01), tx));
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), tz)), _mm_set1_ps(amplitude)));
+
+                amplitude *= 0.5f;
+                frequency *= 2.0f;
+            }
+
+            float heights[4];
+            _mm_storeu_ps(heights, _mm_mul_ps(sum, _mm_set1_ps(params.amplitude)));
+            for (int k = 0; k < 4; ++k)
+            {
+                row[i + k] = heights[k] * ramp(params, x0 + (i + k) * spacing, z);
+            }
+        }
+#endif
+        for (; i < count_x; ++i)
+        {
+            row[i] = terrain_height(params, x0 + i * spacing, z);
+        }
+    }
+    return;
+}
+
+int terrain_chunk_vertex_num(const TerrainParams& params)
+{
+    int edge = params.chunk_quads + 1;
+    return edge * edge + 4 * edge;
+}
+
+void build_terrain_chunk(const TerrainParams& params, int chunk_x, int chunk_z, TerrainChunkData& chunk)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    int edge = params.chunk_quads + 1;
+    float spacing = params.chunk_size / params.chunk_quads;
+    float x0 = chunk_x * params.chunk_size, z0 = chunk_z * params.chunk_size;
+
+    vector<float> heights(edge * edge);
+    terrain_heights(params, x0, z0, spacing, edge, edge, heights.data());
+
+    chunk.chunk_x = chunk_x;
+    chunk.chunk_z = chunk_z;
+    chunk.vertices.resize(5 * terrain_chunk_vertex_num(params));
+    chunk.min_y = heights[0];
+    chunk.max_y = heights[0];
+
+    // texture coordinates repeat every 40 units, matching the original ground quad
+    float* v = chunk.vertices.data();
+    for (int j = 0; j < edge; ++j)
+    {
+        for (int i = 0; i < edge; ++i)
+        {
+            float x = x0 + i * spacing, z = z0 + j * spacing, y = heights[j * edge + i];
+            *v++ = x;
+            *v++ = y;
+            *v++ = z;
+            *v++ = (x + 20.0f) / 40.0f;
+            *v++ = (20.0f - z) / 40.0f;
+            chunk.min_y = min(chunk.min_y, y);
+            chunk.max_y = max(chunk.max_y, y);
+        }
+    }
+
+    // skirts: each edge vertex again, pushed down, in the order -z, +x, +z, -x
+    for (int e = 0; e < 4; ++e)
+    {
+        for (int k = 0; k < edge; ++k)
+        {
+            int i = e == 1 ? edge - 1 : (e == 3 ? 0 : k);
+            int j = e == 0 ? 0 : (e == 2 ? edge - 1 : k);
+            const float* top = &chunk.vertices[5 * (j * edge + i)];
+            *v++ = top[0];
+            *v++ = top[1] - params.skirt_depth;
+            *v++ = top[2];
+            *v++ = top[3];
+            *v++ = top[4];
+        }
+    }
+    chunk.min_y -= params.skirt_depth;
+
+    chunk.generate_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return;
+}
+
+void build_terrain_indices(const TerrainParams& params, TerrainIndices& indices)
+{
+    int edge = params.chunk_quads + 1;
+    int skirtBase = edge * edge;
+    indices.indices.clear();
+    indices.lod_offsets.clear();
+    indices.lod_counts.clear();
+
+    for (int lod = 0; lod < params.lod_levels; ++lod)
+    {
+        int step = 1 << lod;
+        indices.lod_offsets.push_back((int)indices.indices.size());
+
+        for (int j = 0; j + step <= params.chunk_quads; j += step)
+        {
+            for (int i = 0; i + step <= params.chunk_quads; i += step)
+            {
+                unsigned int a = j * edge + i, b = a + step, c = a + step * edge, d = c + step;
+                unsigned int quad[6] = { a, c, b, b, c, d };
+                indices.indices.insert(indices.indices.end(), quad, quad + 6);
+            }
+        }
+
+        for (int e = 0; e < 4; ++e)
+        {
+            for (int k = 0; k + step <= params.chunk_quads; k += step)
+            {
+                int i0 = e == 1 ? edge - 1 : (e == 3 ? 0 : k), j0 = e == 0 ? 0 : (e == 2 ? edge - 1 : k);
+                int i1 = e == 1 ? edge - 1 : (e == 3 ? 0 : k + step), j1 = e == 0 ? 0 : (e == 2 ? edge - 1 : k + step);
+                unsigned int top0 = j0 * edge + i0, top1 = j1 * edge + i1;
+                unsigned int bottom0 = skirtBase + e * edge + k, bottom1 = bottom0 + step;
+                unsigned int quad[6] = { top0, bottom0, top1, top1, bottom0, bottom1 };
+                indices.indices.insert(indices.indices.end(), quad, quad + 6);
+            }
+        }
+
+        indices.lod_counts.push_back((int)indices.indices.size() - indices.lod_offsets.back());
+    }
+    return;
+}
@@ -0,0 +1,50 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <vector>
+
+// heightfield shape and chunk layout
+struct TerrainParams
+{
+    float chunk_size; // world units along a chunk edge
+    int chunk_quads; // quads along a chunk edge at full detail, a power of two
+    int lod_levels; // level l steps over 2^l quads
+    float amplitude;
+    float frequency; // of the first octave, per world unit
+    int octaves;
+    float flat_radius; // the farm stays at height 0 inside this square
+    float ramp_width; // hills fade in over this distance outside it
+    float skirt_depth; // skirts hide the cracks between chunks of different detail
+    unsigned int seed;
+};
+
+// a generated chunk, ready for upload: grid vertices first, then four skirt edges
+struct TerrainChunkData
+{
+    int chunk_x;
+    int chunk_z;
+    std::vector<float> vertices; // x, y, z, u, v in world space
+    float min_y;
+    float max_y;
+    double generate_ms;
+};
+
+// one index list shared by every chunk, with a range per LOD level
+struct TerrainIndices
+{
+    std::vector<unsigned int> indices;
+    std::vector<int> lod_offsets; // first index of each level
+    std::vector<int> lod_counts;
+};
+
+void set_default_terrain_params(TerrainParams& params);
+
+// fBm value noise. The scalar and the batched (SSE2, four samples per step) paths return the same heights
+float terrain_height(const TerrainParams& params, float x, float z);
+void terrain_heights(const TerrainParams& params, float x0, float z0, float spacing, int count_x, int count_z, float* out);
+
+int terrain_chunk_vertex_num(const TerrainParams& params);
+void build_terrain_chunk(const TerrainParams& params, int chunk_x, int chunk_z, TerrainChunkData& chunk);
+void build_terrain_indices(const TerrainParams& params, TerrainIndices& indices);
+
+#endif
@@ -0,0 +1,318 @@
+#include "terrain_streamer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glad/glad.h>
+
+#include "frame_profiler.h"
+
+using namespace std;
+
+TerrainStreamer::TerrainStreamer()
+{
+    set_default_terrain_params(this->params);
+    this->view_radius = 0.0f;
+    this->lod_bias = 1.0f;
+    this->uploads_per_frame = 1;
+    this->chunk_bytes = 0;
+    this->initialized = false;
+    this->ebo = 0;
+    this->center[0] = 0.0f;
+    this->center[1] = 0.0f;
+    this->busy_workers = 0;
+    this->stopping = false;
+    this->stats = TerrainStats();
+    return;
+}
+
+bool TerrainStreamer::init(const TerrainParams& params, float view_radius, size_t memory_budget, int worker_num, int uploads_per_frame)
+{
+    this->params = params;
+    this->view_radius = view_radius;
+    this->uploads_per_frame = max(1, uploads_per_frame);
+    this->chunk_bytes = sizeof(float) * 5 * terrain_chunk_vertex_num(params);
+    this->stats.slot_num = (int)max((size_t)1, memory_budget / this->chunk_bytes);
+
+    build_terrain_indices(params, this->indices);
+    glGenBuffers(1, &this->ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * this->indices.indices.size(), this->indices.indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    this->stopping = false;
+    for (int i = 0; i < max(1, worker_num); ++i)
+    {
+        this->workers.push_back(thread(&TerrainStreamer::worker_loop, this));
+    }
+
+    this->initialized = true;
+    return true;
+}
+
+void TerrainStreamer::destroy()
+{
+    if (!this->initialized)
+        return;
+
+    {
+        lock_guard<mutex> lock(this->queue_mutex);
+        this->stopping = true;
+    }
+    this->queue_signal.notify_all();
+    for (size_t i = 0; i < this->workers.size(); ++i)
+    {
+        this->workers[i].join();
+    }
+    this->workers.clear();
+
+    for (size_t i = 0; i < this->slots.size(); ++i)
+    {
+        glDeleteVertexArrays(1, &this->slots[i].vao);
+        glDeleteBuffers(1, &this->slots[i].vbo);
+    }
+    glDeleteBuffers(1, &this->ebo);
+    this->slots.clear();
+    this->resident.clear();
+    this->pending.clear();
+    this->initialized = false;
+    return;
+}
+
+void TerrainStreamer::update(float camera_x, float camera_z, bool wait)
+{
+    if (!this->initialized)
+        return;
+
+    this->center[0] = camera_x;
+    this->center[1] = camera_z;
+    float margin = this->params.chunk_size; // hysteresis, so chunks on the border do not thrash
+
+    // free the slots of chunks that fell out of range, their GL buffers are reused
+    for (size_t i = 0; i < this->slots.size(); ++i)
+    {
+        ChunkSlot& slot = this->slots[i];
+        if (slot.used && !this->in_range(slot.chunk_x, slot.chunk_z, margin))
+        {
+            slot.used = false;
+            this->resident.erase(chunk_key(slot.chunk_x, slot.chunk_z));
+        }
+    }
+
+    // nearest missing chunks first, never more in flight than the budget can hold
+    vector<pair<float, long long> > wanted;
+    int reach = (int)ceil(this->view_radius / this->params.chunk_size) + 1;
+    int baseX = (int)floor(camera_x / this->params.chunk_size), baseZ = (int)floor(camera_z / this->params.chunk_size);
+    for (int z = baseZ - reach; z <= baseZ + reach; ++z)
+    {
+        for (int x = baseX - reach; x <= baseX + reach; ++x)
+        {
+            long long key = chunk_key(x, z);
+            if (!this->in_range(x, z, 0.0f) || this->resident.count(key) > 0 || this->pending.count(key) > 0)
+                continue;
+            float dx = (x + 0.5f) * this->params.chunk_size - camera_x, dz = (z + 0.5f) * this->params.chunk_size - camera_z;
+            wanted.push_back(make_pair(dx * dx + dz * dz, key));
+        }
+    }
+    sort(wanted.begin(), wanted.end());
+
+    {
+        lock_guard<mutex> lock(this->queue_mutex);
+        for (deque<long long>::iterator it = this->jobs.begin(); it != this->jobs.end();)
+        {
+            if (this->in_range((int)(*it >> 32), (int)(*it & 0xffffffff), margin))
+            {
+                ++it;
+                continue;
+            }
+            this->pending.erase(*it);
+            it = this->jobs.erase(it);
+        }
+
+        for (size_t i = 0; i < wanted.size() && (int)(this->resident.size() + this->pending.size()) < this->stats.slot_num; ++i)
+        {
+            this->jobs.push_back(wanted[i].second);
+            this->pending[wanted[i].second] = true;
+        }
+    }
+    this->queue_signal.notify_all();
+
+    // upload a few finished chunks per frame, or all of them once the queue drains when waiting
+    deque<TerrainChunkData> ready;
+    {
+        unique_lock<mutex> lock(this->queue_mutex);
+        if (wait)
+        {
+            this->done_signal.wait(lock, [this]() { return this->jobs.empty() && this->busy_workers == 0; });
+        }
+        int uploadNum = wait ? (int)this->finished.size() : min((int)this->finished.size(), this->uploads_per_frame);
+        for (int i = 0; i < uploadNum; ++i)
+        {
+            ready.push_back(move(this->finished.front()));
+            this->finished.pop_front();
+        }
+    }
+
+    for (size_t i = 0; i < ready.size(); ++i)
+    {
+        const TerrainChunkData& chunk = ready[i];
+        long long key = chunk_key(chunk.chunk_x, chunk.chunk_z);
+        this->pending.erase(key);
+        if (this->resident.count(key) > 0 || !this->in_range(chunk.chunk_x, chunk.chunk_z, margin))
+            continue;
+
+        int slot = this->acquire_slot();
+        if (slot < 0)
+            continue;
+        this->upload(chunk, slot);
+        this->resident[key] = slot;
+    }
+
+    return;
+}
+
+void TerrainStreamer::draw(const Frustum& frustum, const float camera[3])
+{
+    this->stats.drawn = 0;
+    this->stats.triangles = 0;
+
+    for (size_t i = 0; i < this->slots.size(); ++i)
+    {
+        const ChunkSlot& slot = this->slots[i];
+        if (!slot.used || !aabb_in_frustum(frustum, slot.min, slot.max))
+            continue;
+
+        // geomipmapping: one level coarser every 1.5 chunk lengths
+        float dx = 0.5f * (slot.min[0] + slot.max[0]) - camera[0];
+        float dy = 0.5f * (slot.min[1] + slot.max[1]) - camera[1];
+        float dz = 0.5f * (slot.min[2] + slot.max[2]) - camera[2];
+        int lod = min((int)(sqrt(dx * dx + dy * dy + dz * dz) * this->lod_bias / (1.5f * this->params.chunk_size)), this->params.lod_levels - 1);
+
+        int count = this->indices.lod_counts[lod];
+        glBindVertexArray(slot.vao);
+        glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * this->indices.lod_offsets[lod]));
+        count_draw(count / 3);
+        this->stats.drawn++;
+        this->stats.triangles += count / 3;
+    }
+
+    return;
+}
+
+void TerrainStreamer::set_lod_bias(float bias)
+{
+    this->lod_bias = bias;
+    return;
+}
+
+float TerrainStreamer::get_height(float x, float z) const
+{
+    return terrain_height(this->params, x, z);
+}
+
+void TerrainStreamer::get_stats(TerrainStats& stats)
+{
+    lock_guard<mutex> lock(this->queue_mutex);
+    this->stats.resident = (int)this->resident.size();
+    this->stats.pending = (int)this->pending.size();
+    this->stats.gpu_bytes = this->slots.size() * this->chunk_bytes + sizeof(unsigned int) * this->indices.indices.size();
+    stats = this->stats;
+    this->stats.generated = 0;
+    this->stats.generate_ms = 0.0;
+    return;
+}
+
+long long TerrainStreamer::chunk_key(int chunk_x, int chunk_z)
+{
+    return ((long long)chunk_x << 32) | (unsigned int)chunk_z;
+}
+
+bool TerrainStreamer::in_range(int chunk_x, int chunk_z, float margin) const
+{
+    // distance from the camera to the closest point of the chunk's square
+    float size = this->params.chunk_size;
+    float dx = max(max(chunk_x * size - this->center[0], this->center[0] - (chunk_x + 1) * size), 0.0f);
+    float dz = max(max(chunk_z * size - this->center[1], this->center[1] - (chunk_z + 1) * size), 0.0f);
+    float radius = this->view_radius + margin;
+    return dx * dx + dz * dz <= radius * radius;
+}
+
+void TerrainStreamer::worker_loop()
+{
+    while (true)
+    {
+        long long key;
+        {
+            unique_lock<mutex> lock(this->queue_mutex);
+            this->queue_signal.wait(lock, [this]() { return this->stopping || !this->jobs.empty(); });
+            if (this->stopping)
+                return;
+            key = this->jobs.front();
+            this->jobs.pop_front();
+            this->busy_workers++;
+        }
+
+        TerrainChunkData chunk;
+        {
+            PROFILE_SCOPE("terrain chunk");
+            build_terrain_chunk(this->params, (int)(key >> 32), (int)(key & 0xffffffff), chunk);
+        }
+
+        {
+            lock_guard<mutex> lock(this->queue_mutex);
+            this->stats.generated++;
+            this->stats.generate_ms += chunk.generate_ms;
+            this->finished.push_back(move(chunk));
+            this->busy_workers--;
+        }
+        this->done_signal.notify_all();
+    }
+}
+
+int TerrainStreamer::acquire_slot()
+{
+    for (size_t i = 0; i < this->slots.size(); ++i)
+    {
+        if (!this->slots[i].used)
+            return (int)i;
+    }
+    if ((int)this->slots.size() >= this->stats.slot_num)
+        return -1;
+
+    // slots are created on demand and keep their buffers for the rest of the run
+    ChunkSlot slot;
+    slot.used = false;
+    glGenVertexArrays(1, &slot.vao);
+    glGenBuffers(1, &slot.vbo);
+    glBindVertexArray(slot.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, slot.vbo);
+    glBufferData(GL_ARRAY_BUFFER, this->chunk_bytes, NULL, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo);
+    glBindVertexArray(0);
+
+    this->slots.push_back(slot);
+    return (int)this->slots.size() - 1;
+}
+
+void TerrainStreamer::upload(const TerrainChunkData& chunk, int slot)
+{
+    ChunkSlot& target = this->slots[slot];
+    glBindBuffer(GL_ARRAY_BUFFER, target.vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * chunk.vertices.size(), chunk.vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    target.chunk_x = chunk.chunk_x;
+    target.chunk_z = chunk.chunk_z;
+    target.used = true;
+    target.min[0] = chunk.chunk_x * this->params.chunk_size;
+    target.min[1] = chunk.min_y;
+    target.min[2] = chunk.chunk_z * this->params.chunk_size;
+    target.max[0] = target.min[0] + this->params.chunk_size;
+    target.max[1] = chunk.max_y;
+    target.max[2] = target.min[2] + this->params.chunk_size;
+    return;
+}
@@ -0,0 +1,90 @@
+#ifndef TERRAIN_STREAMER_H
+#define TERRAIN_STREAMER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "terrain.h"
+#include "frustum.h"
+
+struct TerrainStats
+{
+    int resident; // chunks on the GPU
+    int pending; // queued or being generated
+    int slot_num; // chunk budget
+    int generated; // finished since the last get_stats
+    double generate_ms; // worker time spent on those
+    int drawn;
+    long long triangles;
+    size_t gpu_bytes;
+};
+
+// streams heightfield chunks in and out around the camera. Workers generate chunks from a job
+// queue, the GL thread uploads a few finished ones per frame into a fixed pool of chunk slots
+// sized by the memory budget, and every chunk draws one LOD range of a shared index buffer.
+class TerrainStreamer
+{
+public:
+    TerrainStreamer();
+
+    bool init(const TerrainParams& params, float view_radius, size_t memory_budget, int worker_num, int uploads_per_frame);
+    void destroy();
+
+    // wait blocks until every chunk in range is resident, for deterministic headless frames
+    void update(float camera_x, float camera_z, bool wait);
+    void draw(const Frustum& frustum, const float camera[3]);
+    void set_lod_bias(float bias); // above 1, coarser levels start closer to the camera
+
+    float get_height(float x, float z) const;
+    void get_stats(TerrainStats& stats);
+
+private:
+    struct ChunkSlot
+    {
+        int chunk_x;
+        int chunk_z;
+        bool used;
+        unsigned int vao;
+        unsigned int vbo;
+        float min[3];
+        float max[3];
+    };
+
+    TerrainParams params;
+    TerrainIndices indices;
+    float view_radius;
+    float lod_bias;
+    int uploads_per_frame;
+    size_t chunk_bytes;
+    bool initialized;
+
+    unsigned int ebo; // every LOD level, shared by all chunks
+    std::vector<ChunkSlot> slots;
+    std::unordered_map<long long, int> resident; // chunk key -> slot
+    std::unordered_map<long long, bool> pending; // queued, generating or waiting for upload
+    float center[2];
+
+    std::vector<std::thread> workers;
+    std::mutex queue_mutex;
+    std::condition_variable queue_signal;
+    std::condition_variable done_signal;
+    std::deque<long long> jobs;
+    std::deque<TerrainChunkData> finished;
+    int busy_workers;
+    bool stopping;
+
+    TerrainStats stats;
+
+    static long long chunk_key(int chunk_x, int chunk_z);
+    bool in_range(int chunk_x, int chunk_z, float margin) const;
+    void worker_loop();
+    int acquire_slot();
+    void upload(const TerrainChunkData& chunk, int slot);
+};
+
+#endif
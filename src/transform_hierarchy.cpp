@@ -0,0 +1,117 @@
+#include "transform_hierarchy.h"
+
+#include "frustum.h"
+
+#include <cstring>
+
+using namespace std;
+
+static const float IDENTITY[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+TransformHierarchy::TransformHierarchy()
+{
+    return;
+}
+
+int TransformHierarchy::add_node(int parent)
+{
+    TransformNode node;
+    node.parent = parent;
+    node.first_child = -1;
+    node.next_sibling = -1;
+    memcpy(node.local, IDENTITY, sizeof(node.local));
+    memcpy(node.world, IDENTITY, sizeof(node.world));
+    node.dirty = true;
+
+    int index = (int)this->nodes.size();
+    if (parent >= 0)
+    {
+        node.next_sibling = this->nodes[parent].first_child;
+        this->nodes[parent].first_child = index;
+    }
+    this->nodes.push_back(node);
+    this->dirty_nodes.push_back(index);
+    return index;
+}
+
+void TransformHierarchy::set_local(int node, const float local[16])
+{
+    TransformNode& target = this->nodes[node];
+    memcpy(target.local, local, sizeof(target.local));
+    if (!target.dirty)
+    {
+        target.dirty = true;
+        this->dirty_nodes.push_back(node);
+    }
+    return;
+}
+
+void TransformHierarchy::clear()
+{
+    this->nodes.clear();
+    this->dirty_nodes.clear();
+    this->changed.clear();
+    return;
+}
+
+int TransformHierarchy::update()
+{
+    this->changed.clear();
+    for (size_t i = 0; i < this->dirty_nodes.size(); ++i)
+    {
+        int node = this->dirty_nodes[i];
+        if (!this->nodes[node].dirty)
+            continue; // already redone with a dirty ancestor
+
+        // start from the highest dirty ancestor so every matrix is computed once, after its parent
+        int root = node;
+        for (int p = this->nodes[node].parent; p >= 0; p = this->nodes[p].parent)
+        {
+            if (this->nodes[p].dirty)
+                root = p;
+        }
+        this->update_subtree(root);
+    }
+    this->dirty_nodes.clear();
+    return (int)this->changed.size();
+}
+
+void TransformHierarchy::update_subtree(int root)
+{
+    this->stack.clear();
+    this->stack.push_back(root);
+    while (!this->stack.empty())
+    {
+        int index = this->stack.back();
+        this->stack.pop_back();
+
+        TransformNode& node = this->nodes[index];
+        if (node.parent >= 0)
+            multiply_matrices(this->nodes[node.parent].world, node.local, node.world);
+        else
+            memcpy(node.world, node.local, sizeof(node.world));
+        node.dirty = false;
+        this->changed.push_back(index);
+
+        for (int child = node.first_child; child >= 0; child = this->nodes[child].next_sibling)
+        {
+            this->stack.push_back(child);
+        }
+    }
+    return;
+}
+
+const vector<int>& TransformHierarchy::get_changed() const
+{
+    return this->changed;
+}
+
+const float* TransformHierarchy::get_world(int node) const
+{
+    return this->nodes[node].world;
+}
+
+int TransformHierarchy::get_node_num() const
+{
+    return (int)this->nodes.size();
+}
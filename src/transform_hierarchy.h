@@ -0,0 +1,42 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <vector>
+
+struct TransformNode
+{
+    int parent; // -1 for a root
+    int first_child;
+    int next_sibling;
+    float local[16]; // column-major, relative to the parent
+    float world[16];
+    bool dirty; // local changed since the last update, the whole subtree is stale
+};
+
+// parent-child transforms with dirty flags. set_local() only queues the node; update() recomputes the
+// world matrices of the queued subtrees and nothing else, so a frame costs as much as what moved.
+class TransformHierarchy
+{
+public:
+    TransformHierarchy();
+
+    int add_node(int parent); // starts at identity, queued for the next update
+    void set_local(int node, const float local[16]);
+    void clear();
+
+    int update(); // returns the number of world matrices recomputed
+    const std::vector<int>& get_changed() const; // nodes recomputed by the last update
+
+    const float* get_world(int node) const;
+    int get_node_num() const;
+
+private:
+    std::vector<TransformNode> nodes;
+    std::vector<int> dirty_nodes;
+    std::vector<int> changed;
+    std::vector<int> stack;
+
+    void update_subtree(int root);
+};
+
+#endif